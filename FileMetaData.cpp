@@ -1,20 +1,143 @@
 // FileMetadata.cpp
 #include "FileMetaData.hpp"
-#include "storage.hpp"
-std::map<std::string, std::string> FileMetadata::schema;
+#include "tablefile.hpp"
+#include "wal.hpp"
+#include <algorithm>
 FileMetadata* FileMetadata::instance = nullptr;
+
+namespace {
+
+// Fixed fields at the start of the first header block, followed by reserved[] and the payload
+struct HeaderFields {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t pageCount;
+    uint64_t segmentPages;
+    uint64_t chainHead;      // First metadata continuation page, or NO_PAGE
+    uint32_t payloadSize;    // Serialized schema bytes across the whole chain
+};
+
+// A metadata continuation page: PageMetadata, next page in the chain, chunk length, chunk
+struct ChainFields {
+    uint64_t nextPage;
+    uint32_t chunkSize;
+};
+
+}
+
 FileMetadata::FileMetadata() {
     std::memset(reserved, 0, RESERVED_SIZE);
 }
 
+bool FileMetadata::isCurrentFormat(const std::string& tablePath) {
+    std::ifstream file(tablePath, std::ios::binary);
+    uint32_t magic = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    return file && magic == FORMAT_MAGIC;
+}
+
+bool FileMetadata::readLayout(const std::string& tablePath, uint64_t& segmentPages, uint32_t& pageSize) {
+    std::ifstream file(tablePath, std::ios::binary);
+    HeaderFields fields;
+    FileMetadata layout;
+    file.read(reinterpret_cast<char*>(&fields), sizeof(fields));
+    file.read(layout.reserved, RESERVED_SIZE);
+    if (!file || fields.magic != FORMAT_MAGIC) {
+        return false;
+    }
+    segmentPages = fields.segmentPages;
+    pageSize = layout.getPageSize();
+    return true;
+}
+
 void FileMetadata::setSchema(const std::map<std::string, std::string>& tableSchema) {
     schema = tableSchema;
+    schemaCharge.set(mapMemoryBytes(schema));
 }
 
-void FileMetadata::setPageCount(uint16_t count) {
+void FileMetadata::setPageCount(uint64_t count) {
     pageCount = count;
 }
 
+uint64_t FileMetadata::allocatePage() {
+    return pageCount++;
+}
+
+void FileMetadata::setSegmentPages(uint64_t pages) {
+    segmentPages = pages;
+}
+
+uint64_t FileMetadata::getSegmentPages() const {
+    return segmentPages;
+}
+
+void FileMetadata::setClustered(bool clustered) {
+    if (clustered) {
+        reserved[FLAGS_OFFSET] |= FLAG_CLUSTERED;
+    } else {
+        reserved[FLAGS_OFFSET] &= ~FLAG_CLUSTERED;
+    }
+}
+
+bool FileMetadata::isClustered() const {
+    return reserved[FLAGS_OFFSET] & FLAG_CLUSTERED;
+}
+
+void FileMetadata::setExtentPages(uint64_t pages) {
+    std::memcpy(reserved + EXTENT_OFFSET, &pages, sizeof(pages));
+}
+
+uint64_t FileMetadata::getExtentPages() const {
+    uint64_t pages;
+    std::memcpy(&pages, reserved + EXTENT_OFFSET, sizeof(pages));
+    return pages;
+}
+
+void FileMetadata::setAllocatedPages(uint64_t pages) {
+    std::memcpy(reserved + ALLOCATED_OFFSET, &pages, sizeof(pages));
+}
+
+uint64_t FileMetadata::getAllocatedPages() const {
+    uint64_t pages;
+    std::memcpy(&pages, reserved + ALLOCATED_OFFSET, sizeof(pages));
+    return pages;
+}
+
+void FileMetadata::setPageSize(uint32_t bytes) {
+    std::memcpy(reserved + PAGE_SIZE_OFFSET, &bytes, sizeof(bytes));
+}
+
+uint32_t FileMetadata::getPageSize() const {
+    uint32_t bytes;
+    std::memcpy(&bytes, reserved + PAGE_SIZE_OFFSET, sizeof(bytes));
+    return bytes == 0 ? PAGE_SIZE : bytes; // Tables written before the size was recorded
+}
+
+void FileMetadata::setInsertPage(uint64_t pageID) {
+    uint64_t stored = pageID + 1;
+    std::memcpy(reserved + INSERT_PAGE_OFFSET, &stored, sizeof(stored));
+}
+
+uint64_t FileMetadata::getInsertPage() const {
+    uint64_t stored;
+    std::memcpy(&stored, reserved + INSERT_PAGE_OFFSET, sizeof(stored));
+    if (stored != 0 && stored <= pageCount) {
+        return stored - 1;
+    }
+    return pageCount > 0 ? pageCount - 1 : NO_PAGE; // Tables written before the hint existed
+}
+
+void FileMetadata::setFreePageHead(uint64_t pageID) {
+    uint64_t stored = pageID == NO_PAGE ? 0 : pageID + 1;
+    std::memcpy(reserved + FREE_PAGE_OFFSET, &stored, sizeof(stored));
+}
+
+uint64_t FileMetadata::getFreePageHead() const {
+    uint64_t stored;
+    std::memcpy(&stored, reserved + FREE_PAGE_OFFSET, sizeof(stored));
+    return stored != 0 && stored <= pageCount ? stored - 1 : NO_PAGE;
+}
+
 uint32_t FileMetadata::getNextPageID() const {
     return nextPageID;
 }
@@ -27,96 +150,128 @@ void FileMetadata::incrementPageID() {
     nextPageID++;
 }
 
-void FileMetadata::addTupleToPageMap(int tupleId, int pageId) {
-    if (tupleToPageMap.find(tupleId) != tupleToPageMap.end()) {
+void FileMetadata::addTupleToPageMap(int64_t tupleId, int64_t pageId) {
+    if (idIndex->find(tupleId) != -1) {
         std::cerr << "Warning addTupleToPageMap: Overwriting existing mapping for Tuple ID " << tupleId << ".\n";
     }
-    tupleToPageMap[tupleId] = pageId;
+    if (!idIndex->insert(tupleId, pageId)) {
+        throw std::runtime_error("Error addTupleToPageMap: Id index is not open.");
+    }
 }
 
-void FileMetadata::removeTupleFromPageMap(int tupleId) {
-    tupleToPageMap[tupleId] = -2; // Mark as deleted
+void FileMetadata::removeTupleFromPageMap(int64_t tupleId) {
+    idIndex->erase(tupleId);
 }
 
-bool FileMetadata::hasTupleInPageMap(int tupleID) const {
-    auto it = tupleToPageMap.find(tupleID);
-    return it != tupleToPageMap.end() && it->second != -1 && it->second != -2;
+bool FileMetadata::hasTupleInPageMap(int64_t tupleID) const {
+    return idIndex->find(tupleID) >= 0;
 }
 
 const std::map<std::string, std::string>& FileMetadata::getSchema() const {
     return schema;
 }
 
-uint16_t FileMetadata::getPageCount() const {
+uint64_t FileMetadata::getPageCount() const {
     return pageCount;
 }
 
-const std::map<int, int>& FileMetadata::getTupleToPageMap() const {
-    return tupleToPageMap;
+uint64_t FileMetadata::getMetadataPageCount() const {
+    return metadataPages.size();
 }
 
-int FileMetadata::getPageIDForTuple(int tupleID) const {
-    auto it = tupleToPageMap.find(tupleID);
-    if (it == tupleToPageMap.end()) return -1; // Tuple does not exist
-    if (it->second == -1 || it->second == -2) return -2; // Tuple is deleted
-    return it->second;
+bool FileMetadata::openIndex(const std::string& tablePath) {
+    idIndex = std::make_shared<IdIndex>(); // Not the one a handle may share with this metadata
+    return idIndex->open(IdIndex::pathForTable(tablePath));
 }
 
-std::streampos FileMetadata::getPagePosition(int pageID) const {
-    if (pageID < 0 || pageID > pageCount) {
-        std::cerr << "Error getPagePosition: Invalid pageID: " << pageID << " (pageCount: " << pageCount << ")\n";
-        throw std::out_of_range("Invalid pageID: " + std::to_string(pageID));
-    }
-    return std::streampos(METADATA_SIZE + (pageID * 4096));
+IdIndex& FileMetadata::getIdIndex() {
+    return *idIndex;
+}
+
+int64_t FileMetadata::getPageIDForTuple(int64_t tupleID) const {
+    return idIndex->find(tupleID); // -1 when the tuple does not exist or was deleted
 }
 
-void FileMetadata::setTupleAsDeleted(int tupleID) {
-    tupleToPageMap[tupleID] = -2;
+void FileMetadata::setTupleAsDeleted(int64_t tupleID) {
+    idIndex->erase(tupleID);
     std::cout << "[DEBUG setTupleAsDeleted] Tuple " << tupleID << " marked as deleted." << std::endl;
 }
 
-bool FileMetadata::hasTupleWithID(int tupleID) const {
-    auto it = tupleToPageMap.find(tupleID);
-    if (it == tupleToPageMap.end()) {
-        std::cout << "[DEBUG hasTupleWithID] Tuple " << tupleID << " not found in the map." << std::endl;
-        return false;
-    }
-    if (it->second == -1 || it->second == -2) {
-        std::cout << "[DEBUG hasTupleWithID] Tuple " << tupleID << " is marked as deleted." << std::endl;
+bool FileMetadata::hasTupleWithID(int64_t tupleID) const {
+    if (idIndex->find(tupleID) < 0) {
+        std::cout << "[DEBUG hasTupleWithID] Tuple " << tupleID << " not found in the index." << std::endl;
         return false;
     }
     return true;
 }
 
-void FileMetadata::serialize(std::fstream& dbFile) {
-    if (!dbFile.is_open() || !dbFile) {
-        dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }
+void FileMetadata::serialize(TableFile& table) {
+    if (!table.isOpen()) {
+        throw std::runtime_error("Error File Metadata serialize: Table file is not open.");
     }
 
     try {
-        uint16_t schemaSize = schema.size();
-        char buffer[12];
-        dbFile.write(std::to_string(schemaSize).c_str(), sizeof(schemaSize));
+        std::string payload;
+        auto append = [&payload](const void* bytes, size_t size) {
+            payload.append(static_cast<const char*>(bytes), size);
+        };
+        uint32_t schemaSize = schema.size();
+        append(&schemaSize, sizeof(schemaSize));
         for (const auto& [key, value] : schema) {
             uint16_t keySize = key.size();
             uint16_t valueSize = value.size();
-            dbFile.write(reinterpret_cast<const char*>(&keySize), sizeof(keySize));
-            dbFile.write(key.c_str(), keySize);
-            dbFile.write(reinterpret_cast<const char*>(&valueSize), sizeof(valueSize));
-            dbFile.write(value.c_str(), valueSize);
+            append(&keySize, sizeof(keySize));
+            append(key.data(), keySize);
+            append(&valueSize, sizeof(valueSize));
+            append(value.data(), valueSize);
+        }
+
+        // Whatever does not fit in the first block continues in metadata pages
+        const size_t firstCapacity = METADATA_SIZE - sizeof(HeaderFields) - RESERVED_SIZE;
+        const size_t pageSize = getPageSize();
+        const size_t chainCapacity = pageSize - sizeof(PageMetadata) - sizeof(ChainFields);
+        size_t firstChunk = std::min(payload.size(), firstCapacity);
+        size_t chainPages = (payload.size() - firstChunk + chainCapacity - 1) / chainCapacity;
+        while (metadataPages.size() < chainPages) {
+            metadataPages.push_back(allocatePage());
         }
 
-        dbFile.write(reinterpret_cast<char*>(&pageCount), sizeof(pageCount));
-        dbFile.write(reserved, RESERVED_SIZE);
+        size_t offset = firstChunk;
+        for (size_t i = 0; i < chainPages; ++i) {
+            std::vector<char> buffer(pageSize, 0);
+            char* image = buffer.data();
+            PageMetadata pageHeader = {metadataPages[i], 0, 0, 0, PAGE_TYPE_METADATA, 0};
+            ChainFields chain = {i + 1 < chainPages ? metadataPages[i + 1] : NO_PAGE,
+                                 static_cast<uint32_t>(std::min(chainCapacity, payload.size() - offset))};
+            std::memcpy(image, &pageHeader, sizeof(pageHeader));
+            std::memcpy(image + sizeof(pageHeader), &chain, sizeof(chain));
+            std::memcpy(image + sizeof(pageHeader) + sizeof(chain), payload.data() + offset, chain.chunkSize);
+            table.writePageImages(*this, metadataPages[i], image, 1);
+            offset += chain.chunkSize;
+        }
 
-        uint16_t mapSize = tupleToPageMap.size();
-        dbFile.write(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
-        for (const auto& [tupleId, pageId] : tupleToPageMap) {
-            dbFile.write(reinterpret_cast<const char*>(&tupleId), sizeof(tupleId));
-            dbFile.write(reinterpret_cast<const char*>(&pageId), sizeof(pageId));
+        std::vector<char> block(METADATA_SIZE, 0);
+        HeaderFields fields = {FORMAT_MAGIC, FORMAT_VERSION, pageCount, segmentPages,
+                               chainPages > 0 ? metadataPages[0] : NO_PAGE, static_cast<uint32_t>(payload.size())};
+        std::memcpy(block.data(), &fields, sizeof(fields));
+        std::memcpy(block.data() + sizeof(fields), reserved, RESERVED_SIZE);
+        std::memcpy(block.data() + sizeof(fields) + RESERVED_SIZE, payload.data(), firstChunk);
+
+        std::fstream& dbFile = table.headerStream();
+        auto writeBlock = [&]() {
+            dbFile.seekp(0, std::ios::beg);
+            dbFile.write(block.data(), block.size());
+            if (!dbFile) {
+                throw std::runtime_error("write to " + table.getPath() + " failed");
+            }
+        };
+        if (WriteAheadLog* log = WriteAheadLog::find(table.getPath())) {
+            log->write(WriteAheadLog::HEADER_BLOCK, 0, block.data(), block.size(), [&]() {
+                writeBlock();
+                dbFile.flush();
+            });
+        } else {
+            writeBlock();
         }
 
         std::cout << "[DEBUG File Metadata serialize] FileMetadata serialized successfully.\n";
@@ -126,54 +281,89 @@ void FileMetadata::serialize(std::fstream& dbFile) {
     }
 }
 
-std::map<std::string, std::string>  FileMetadata::deserialize(std::fstream& file) {
-    static std::map<std::string, std::string> schema1; 
-    if (!file.is_open() || !file) {
-        file.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!file.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }   
-         }
+std::map<std::string, std::string>  FileMetadata::deserialize(TableFile& table) {
+    if (!table.isOpen()) {
+        throw std::runtime_error("Error File Metadata deserialize: Table file is not open.");
+    }
 
     try {
-        uint16_t schemaSize;
-        file.read(reinterpret_cast<char*>(&schemaSize), sizeof(schemaSize));
-        schema1.clear();
-        for (uint16_t i = 0; i < schemaSize; ++i) {
+        std::vector<char> block(METADATA_SIZE);
+        std::fstream& file = table.headerStream();
+        file.seekg(0, std::ios::beg);
+        file.read(block.data(), block.size());
+        if (!file) {
+            throw std::runtime_error("header of " + table.getPath() + " is truncated");
+        }
+
+        HeaderFields fields;
+        std::memcpy(&fields, block.data(), sizeof(fields));
+        if (fields.magic != FORMAT_MAGIC) {
+            throw std::runtime_error(table.getPath() + " uses the version 1 format; migrate it with Storage::migrateTable");
+        }
+        pageCount = fields.pageCount;
+        segmentPages = fields.segmentPages;
+        std::memcpy(reserved, block.data() + sizeof(fields), RESERVED_SIZE);
+        if (!isSupportedPageSize(getPageSize())) {
+            throw std::runtime_error(table.getPath() + " has an unsupported page size of " + std::to_string(getPageSize()));
+        }
+
+        const size_t firstCapacity = METADATA_SIZE - sizeof(HeaderFields) - RESERVED_SIZE;
+        std::string payload(block.data() + sizeof(fields) + RESERVED_SIZE, std::min<size_t>(fields.payloadSize, firstCapacity));
+        metadataPages.clear();
+        std::vector<char> buffer(getPageSize());
+        char* image = buffer.data();
+        for (uint64_t pageID = fields.chainHead; pageID != NO_PAGE;) {
+            table.readPageImage(*this, pageID, image);
+            ChainFields chain;
+            std::memcpy(&chain, image + sizeof(PageMetadata), sizeof(chain));
+            payload.append(image + sizeof(PageMetadata) + sizeof(chain), chain.chunkSize);
+            metadataPages.push_back(pageID);
+            pageID = chain.nextPage;
+        }
+        if (payload.size() != fields.payloadSize) {
+            throw std::runtime_error("metadata chain of " + table.getPath() + " is incomplete");
+        }
+
+        size_t pos = 0;
+        auto read = [&payload, &pos](void* bytes, size_t size) {
+            if (pos + size > payload.size()) {
+                throw std::runtime_error("schema extends past the metadata payload");
+            }
+            std::memcpy(bytes, payload.data() + pos, size);
+            pos += size;
+        };
+        uint32_t schemaSize;
+        read(&schemaSize, sizeof(schemaSize));
+        schema.clear();
+        for (uint32_t i = 0; i < schemaSize; ++i) {
             uint16_t keySize, valueSize;
-            file.read(reinterpret_cast<char*>(&keySize), sizeof(keySize));
+            read(&keySize, sizeof(keySize));
             std::string key(keySize, '\0');
-            file.read(&key[0], keySize);
+            read(&key[0], keySize);
 
-            file.read(reinterpret_cast<char*>(&valueSize), sizeof(valueSize));
+            read(&valueSize, sizeof(valueSize));
             std::string value(valueSize, '\0');
-            file.read(&value[0], valueSize);
+            read(&value[0], valueSize);
 
-            schema1[key] = value;
+            schema[key] = value;
         }
 
-        file.read(reinterpret_cast<char*>(&pageCount), sizeof(pageCount));
-        file.read(reserved, RESERVED_SIZE);
-
-        uint16_t mapSize;
-        file.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
-        tupleToPageMap.clear();
-        for (uint16_t i = 0; i < mapSize; ++i) {
-            int tupleId, pageId;
-            file.read(reinterpret_cast<char*>(&tupleId), sizeof(tupleId));
-            file.read(reinterpret_cast<char*>(&pageId), sizeof(pageId));
-            tupleToPageMap[tupleId] = pageId;
+        std::shared_ptr<IdIndex> index = table.getIdIndex(); // Opened once per handle
+        if (!index) {
+            throw std::runtime_error("unable to open id index for " + table.getPath());
         }
+        idIndex = index;
 
         std::cout << "[DEBUG File Metadata deserialize] FileMetadata deserialized successfully.\n";
 
     } catch (const std::exception& e) {
         throw std::runtime_error(std::string("File Metadata Deserialization failed: ") + e.what());
     }
-    for (const auto& [key, type] : schema1) {
+    schemaCharge.set(mapMemoryBytes(schema));
+    for (const auto& [key, type] : schema) {
         std::cout<<key<<" "<<" type";
         std::cout<<std::endl;}
-    return schema1; 
+    return schema;
 }
 
 void FileMetadata::printMetadata() const {
@@ -188,16 +378,22 @@ void FileMetadata::printMetadata() const {
         }
     }
 
+    std::cout << "Format Version: " << FORMAT_VERSION << "\n";
     std::cout << "Page Count: " << pageCount << "\n";
+    std::cout << "Page Size: " << getPageSize() << " bytes\n";
+    std::cout << "Segment Pages: " << (segmentPages == 0 ? std::string("(single file)") : std::to_string(segmentPages)) << "\n";
+    std::cout << "Metadata Pages: " << metadataPages.size() << "\n";
+    std::cout << "Clustered: " << (isClustered() ? "yes" : "no") << "\n";
+    std::cout << "Extent Pages: " << (getExtentPages() == 0 ? std::string("(page by page)") : std::to_string(getExtentPages()))
+              << ", Allocated Pages: " << getAllocatedPages() << "\n";
     std::cout << "Reserved Space: " << RESERVED_SIZE << " bytes\n";
 
     std::cout << "Tuple-to-Page Map:\n";
-    if (tupleToPageMap.empty()) {
+    if (idIndex->size() == 0) {
         std::cout << "  (Map is empty)\n";
     } else {
-        for (const auto& [tupleId, pageId] : tupleToPageMap) {
-            std::cout << "  Tuple ID: " << tupleId
-                      << ", Page ID: " << (pageId == -1 ? "(Deleted)" : std::to_string(pageId)) << "\n";
+        for (auto it = idIndex->begin(); it.valid(); it.next()) {
+            std::cout << "  Tuple ID: " << it.key() << ", Page ID: " << it.value() << "\n";
         }
     }
 
@@ -11,43 +11,91 @@
 #include <fstream>
 #include <filesystem>
 #include <stdexcept>
+#include <memory>
+#include <cstdint>
+#include "idindex.hpp"
+#include "memory.hpp"
 
 namespace fs = std::filesystem;
 
+class TableFile;
+
+// Table header, format version 2.
+// The first METADATA_SIZE bytes of the main file hold the fixed fields and the start of the
+// schema; a schema too large for that block continues in a chain of metadata pages.
 class FileMetadata {
 private:
     static const int SCHEMA_SIZE = 512;        // Fixed size for schema
     static const int RESERVED_SIZE = 508;     // Reserved for future use
+    static const int FLAGS_OFFSET = 0;        // Table option bits, kept in reserved[0]
+    static const char FLAG_CLUSTERED = 0x01;  // Rows are placed in id order
+    static const int EXTENT_OFFSET = 8;       // uint64 pages per extent, kept in reserved[8..15]
+    static const int ALLOCATED_OFFSET = 16;   // uint64 pages the files have space for, reserved[16..23]
+    static const int INSERT_PAGE_OFFSET = 24; // uint64 data page inserts go to plus one, reserved[24..31]; 0 = the last page
+    static const int PAGE_SIZE_OFFSET = 32;   // uint32 bytes per page, reserved[32..35]; 0 = PAGE_SIZE
+    static const int FREE_PAGE_OFFSET = 40;   // uint64 first free page plus one, reserved[40..47]; 0 = none
+public:
     static const int METADATA_SIZE = 8192;    // Total metadata size (8 KB)
+    static const uint32_t FORMAT_MAGIC = 0x32444148; // "HAD2"
+    static const uint32_t FORMAT_VERSION = 2;
+    static const uint64_t NO_PAGE = UINT64_MAX;
+private:
     static FileMetadata* instance;
     // Maps attribute name to its type (e.g., "id" -> "int")
-    uint16_t pageCount = 0;
+    std::map<std::string, std::string> schema;
+    uint64_t pageCount = 0;
+    uint64_t segmentPages = 0;                // Pages per segment file, 0 = single file
     char reserved[RESERVED_SIZE] = {0};       // Reserved for future features
-    std::map<int, int> tupleToPageMap;
+    std::vector<uint64_t> metadataPages;      // Header continuation chain, in order
     uint32_t nextPageID = 1;                  // Tracks the next page ID
+    std::shared_ptr<IdIndex> idIndex = std::make_shared<IdIndex>(); // Tuple ID -> page ID in <table>.IDX; the handle's once deserialized
+    MemoryCharge schemaCharge{MemoryComponent::Metadata};
 
 public:
     FileMetadata();
     static FileMetadata* getInstance();
-    static std::map<std::string, std::string> schema; 
+    static bool isCurrentFormat(const std::string& tablePath);
+    // Reads only the page layout from the fixed header fields, for when the rest may still need recovery
+    static bool readLayout(const std::string& tablePath, uint64_t& segmentPages, uint32_t& pageSize);
     void setSchema(const std::map<std::string, std::string>& tableSchema);
-    void setPageCount(uint16_t count);
+    void setPageCount(uint64_t count);
+    uint64_t allocatePage();
+    void setSegmentPages(uint64_t pages);
+    uint64_t getSegmentPages() const;
+    // Bytes per page, chosen when the table is created (see isSupportedPageSize)
+    void setPageSize(uint32_t bytes);
+    uint32_t getPageSize() const;
+    void setClustered(bool clustered);
+    bool isClustered() const;
+    // Files grow by preallocated extents of this many pages; 0 grows them page by page
+    void setExtentPages(uint64_t pages);
+    uint64_t getExtentPages() const;
+    // High-water mark of preallocated space; pages below it but at or above the page count are free
+    void setAllocatedPages(uint64_t pages);
+    uint64_t getAllocatedPages() const;
+    // Data page unclustered inserts fill; later pages may hold overflow chains instead of rows
+    void setInsertPage(uint64_t pageID);
+    uint64_t getInsertPage() const;       // NO_PAGE while the table has no pages
+    // Head of the list of released overflow pages (see OverflowStore); NO_PAGE when it is empty
+    void setFreePageHead(uint64_t pageID);
+    uint64_t getFreePageHead() const;
     uint32_t getNextPageID() const;
     void incrementPageID();
-    void addTupleToPageMap(int tupleId, int pageId);
-    void removeTupleFromPageMap(int tupleId);
-    bool hasTupleInPageMap(int tupleID) const;
+    void addTupleToPageMap(int64_t tupleId, int64_t pageId);
+    void removeTupleFromPageMap(int64_t tupleId);
+    bool hasTupleInPageMap(int64_t tupleID) const;
     const std::map<std::string, std::string>& getSchema() const;
-    uint16_t getPageCount() const;
-    const std::map<int, int>& getTupleToPageMap() const;
-    int getPageIDForTuple(int tupleID) const;
-    std::streampos getPagePosition(int pageID) const;
-    void setTupleAsDeleted(int tupleID);
-    bool hasTupleWithID(int tupleID) const;
-    void serialize(std::fstream& dbFile);
-    std::map<std::string, std::string>  deserialize(std::fstream& file);
+    uint64_t getPageCount() const;
+    uint64_t getMetadataPageCount() const;
+    bool openIndex(const std::string& tablePath);
+    IdIndex& getIdIndex();
+    int64_t getPageIDForTuple(int64_t tupleID) const;
+    void setTupleAsDeleted(int64_t tupleID);
+    bool hasTupleWithID(int64_t tupleID) const;
+    void serialize(TableFile& table);
+    std::map<std::string, std::string>  deserialize(TableFile& table);
     void printMetadata() const;
-    
+
 };
 
 #endif // FILEMETADATA_HPP
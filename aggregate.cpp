@@ -0,0 +1,323 @@
+#include "aggregate.hpp"
+#include "overflow.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Reductions over a contiguous batch. Eight independent lanes let the compiler keep the
+// partial results in vector registers without reordering a single floating-point chain.
+const size_t LANES = 8;
+
+double sumKernel(const double* values, size_t count) {
+    double lanes[LANES] = {0};
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        for (size_t l = 0; l < LANES; ++l) {
+            lanes[l] += values[i + l];
+        }
+    }
+    double total = 0;
+    for (size_t l = 0; l < LANES; ++l) {
+        total += lanes[l];
+    }
+    for (; i < count; ++i) {
+        total += values[i];
+    }
+    return total;
+}
+
+double minKernel(const double* values, size_t count, double start) {
+    double lanes[LANES];
+    std::fill(lanes, lanes + LANES, start);
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        for (size_t l = 0; l < LANES; ++l) {
+            lanes[l] = values[i + l] < lanes[l] ? values[i + l] : lanes[l];
+        }
+    }
+    double result = start;
+    for (size_t l = 0; l < LANES; ++l) {
+        result = lanes[l] < result ? lanes[l] : result;
+    }
+    for (; i < count; ++i) {
+        result = values[i] < result ? values[i] : result;
+    }
+    return result;
+}
+
+double maxKernel(const double* values, size_t count, double start) {
+    double lanes[LANES];
+    std::fill(lanes, lanes + LANES, start);
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        for (size_t l = 0; l < LANES; ++l) {
+            lanes[l] = values[i + l] > lanes[l] ? values[i + l] : lanes[l];
+        }
+    }
+    double result = start;
+    for (size_t l = 0; l < LANES; ++l) {
+        result = lanes[l] > result ? lanes[l] : result;
+    }
+    for (; i < count; ++i) {
+        result = values[i] > result ? values[i] : result;
+    }
+    return result;
+}
+
+const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+const double INF = std::numeric_limits<double>::infinity();
+
+} // namespace
+
+Aggregator::Aggregator(const CompiledSchema& schema, const std::vector<AggregateSpec>& aggregateSpecs, const std::string& groupColumn)
+    : specs(aggregateSpecs), groupBy(groupColumn) {
+    for (const AggregateSpec& spec : specs) {
+        if (spec.function == AggregateFunction::Count) {
+            specInput.push_back(-1);
+            continue;
+        }
+        int ordinal = schema.ordinalOf(spec.column);
+        if (ordinal == CompiledSchema::NO_COLUMN) {
+            throw std::invalid_argument("Unknown column in aggregate: " + spec.column);
+        }
+        ColumnType type = schema.getColumn(ordinal).type;
+        if (type != ColumnType::Int && type != ColumnType::Double) {
+            throw std::invalid_argument("Aggregate needs a numeric column: " + spec.column);
+        }
+        auto existing = std::find(inputColumns.begin(), inputColumns.end(), spec.column);
+        specInput.push_back(existing - inputColumns.begin());
+        if (existing == inputColumns.end()) {
+            inputColumns.push_back(spec.column);
+        }
+    }
+    if (!groupBy.empty() && schema.ordinalOf(groupBy) == CompiledSchema::NO_COLUMN) {
+        throw std::invalid_argument("Unknown GROUP BY column: " + groupBy);
+    }
+
+    batchValues.assign(inputColumns.size(), std::vector<double>(BATCH_SIZE));
+    batchGroups.assign(BATCH_SIZE, 0);
+    sums.resize(specs.size());
+    mins.resize(specs.size());
+    maxs.resize(specs.size());
+    if (groupBy.empty()) {
+        groupKeys.push_back("");
+        addGroup();
+    } else {
+        slots.assign(64, {0, EMPTY_SLOT});
+    }
+}
+
+uint64_t Aggregator::rowsScanned() const {
+    return scanned;
+}
+
+void Aggregator::addGroup() {
+    counts.push_back(0);
+    for (size_t s = 0; s < specs.size(); ++s) {
+        sums[s].push_back(0);
+        mins[s].push_back(INF);
+        maxs[s].push_back(-INF);
+    }
+}
+
+uint32_t Aggregator::groupFor(std::string_view key) {
+    if (groupBy.empty()) {
+        return 0;
+    }
+    uint64_t hash = std::hash<std::string_view>()(key);
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (slot.group == EMPTY_SLOT) {
+            return insertGroup(key, hash);
+        }
+        if (slot.hash == hash && groupKeys[slot.group] == key) {
+            return slot.group;
+        }
+    }
+}
+
+uint32_t Aggregator::insertGroup(std::string_view key, uint64_t hash) {
+    // Keep the table at most half full so probe runs stay short
+    if ((groupKeys.size() + 1) * 2 > slots.size()) {
+        growTable();
+    }
+    uint32_t group = groupKeys.size();
+    groupKeys.emplace_back(key);
+    addGroup();
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    while (slots[i].group != EMPTY_SLOT) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = {hash, group};
+    return group;
+}
+
+void Aggregator::growTable() {
+    std::vector<Slot> old = std::move(slots);
+    slots.assign(old.size() * 2, {0, EMPTY_SLOT});
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.group == EMPTY_SLOT) continue;
+        size_t i = slot.hash & mask;
+        while (slots[i].group != EMPTY_SLOT) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
+
+bool Aggregator::decodeRow(const std::string& tupleData, std::string_view& groupKey, bool& groupSpilled) {
+    size_t found = 0;
+    bool hasGroup = groupBy.empty();
+    size_t pos = 0;
+    while (pos < tupleData.size()) {
+        size_t open = tupleData.find('(', pos);
+        size_t bar = open == std::string::npos ? open : tupleData.find('|', open);
+        size_t close = bar == std::string::npos ? bar : tupleData.find(')', bar);
+        if (close == std::string::npos) return false;
+
+        std::string_view key(tupleData.data() + pos, open - pos);
+        const char* value = tupleData.data() + bar + 1;
+        const char* valueEnd = tupleData.data() + close;
+        if (!hasGroup && key == groupBy) {
+            groupKey = std::string_view(value, valueEnd - value);
+            groupSpilled = OverflowStore::isPointerType(std::string_view(tupleData).substr(open + 1, bar - open - 1));
+            hasGroup = true;
+        }
+        for (size_t c = 0; c < inputColumns.size(); ++c) {
+            if (key == inputColumns[c]) {
+                double parsed;
+                if (std::from_chars(value, valueEnd, parsed).ptr != valueEnd) return false;
+                batchValues[c][batchSize] = parsed;
+                ++found;
+                break;
+            }
+        }
+        pos = close + 1;
+    }
+    return hasGroup && found == inputColumns.size();
+}
+
+void Aggregator::consume(const Page& page, const Projection::Fetch& fetch) {
+    std::string spilledKey;
+    for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+        if (page.getSlot(i).length == 0) continue; // Deleted slot
+        std::string tupleData = page.getTupleData(i);
+        std::string_view groupKey;
+        bool groupSpilled = false;
+        if (!decodeRow(tupleData, groupKey, groupSpilled)) {
+            std::cerr << "Error aggregate: Skipping a row without the aggregated columns on page " << page.getPageID() << ".\n";
+            continue;
+        }
+        if (groupSpilled) {
+            spilledKey.clear();
+            if (!fetch || !fetch(groupKey, spilledKey)) {
+                std::cerr << "Error aggregate: Skipping a row whose group key cannot be read on page " << page.getPageID() << ".\n";
+                continue;
+            }
+            groupKey = spilledKey;
+        }
+        batchGroups[batchSize] = groupFor(groupKey); // Resolved now, while the key's row is alive
+        ++scanned;
+        if (++batchSize == BATCH_SIZE) {
+            flushBatch();
+        }
+    }
+    flushBatch();
+}
+
+void Aggregator::flushBatch() {
+    if (batchSize == 0) {
+        return;
+    }
+    if (groupBy.empty()) {
+        counts[0] += batchSize;
+        for (size_t s = 0; s < specs.size(); ++s) {
+            if (specInput[s] < 0) continue;
+            const double* values = batchValues[specInput[s]].data();
+            switch (specs[s].function) {
+                case AggregateFunction::Sum:
+                case AggregateFunction::Avg:
+                    sums[s][0] += sumKernel(values, batchSize);
+                    break;
+                case AggregateFunction::Min:
+                    mins[s][0] = minKernel(values, batchSize, mins[s][0]);
+                    break;
+                case AggregateFunction::Max:
+                    maxs[s][0] = maxKernel(values, batchSize, maxs[s][0]);
+                    break;
+                default:
+                    break;
+            }
+        }
+    } else {
+        const uint32_t* groups = batchGroups.data();
+        for (size_t i = 0; i < batchSize; ++i) {
+            counts[groups[i]] += 1;
+        }
+        for (size_t s = 0; s < specs.size(); ++s) {
+            if (specInput[s] < 0) continue;
+            const double* values = batchValues[specInput[s]].data();
+            double* sum = sums[s].data();
+            double* low = mins[s].data();
+            double* high = maxs[s].data();
+            switch (specs[s].function) {
+                case AggregateFunction::Sum:
+                case AggregateFunction::Avg:
+                    for (size_t i = 0; i < batchSize; ++i) sum[groups[i]] += values[i];
+                    break;
+                case AggregateFunction::Min:
+                    for (size_t i = 0; i < batchSize; ++i) low[groups[i]] = std::min(low[groups[i]], values[i]);
+                    break;
+                case AggregateFunction::Max:
+                    for (size_t i = 0; i < batchSize; ++i) high[groups[i]] = std::max(high[groups[i]], values[i]);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    batchSize = 0;
+}
+
+void Aggregator::merge(const Aggregator& other) {
+    for (uint32_t otherGroup = 0; otherGroup < other.groupKeys.size(); ++otherGroup) {
+        uint32_t group = groupFor(other.groupKeys[otherGroup]);
+        counts[group] += other.counts[otherGroup];
+        for (size_t s = 0; s < specs.size(); ++s) {
+            sums[s][group] += other.sums[s][otherGroup];
+            mins[s][group] = std::min(mins[s][group], other.mins[s][otherGroup]);
+            maxs[s][group] = std::max(maxs[s][group], other.maxs[s][otherGroup]);
+        }
+    }
+    scanned += other.scanned;
+}
+
+std::vector<AggregateRow> Aggregator::results() const {
+    std::vector<AggregateRow> rows;
+    rows.reserve(groupKeys.size());
+    for (uint32_t group = 0; group < groupKeys.size(); ++group) {
+        AggregateRow row;
+        row.group = groupKeys[group];
+        bool empty = counts[group] == 0;
+        for (size_t s = 0; s < specs.size(); ++s) {
+            switch (specs[s].function) {
+                case AggregateFunction::Count: row.values.push_back(counts[group]); break;
+                case AggregateFunction::Sum: row.values.push_back(sums[s][group]); break;
+                case AggregateFunction::Min: row.values.push_back(empty ? NOT_A_NUMBER : mins[s][group]); break;
+                case AggregateFunction::Max: row.values.push_back(empty ? NOT_A_NUMBER : maxs[s][group]); break;
+                case AggregateFunction::Avg: row.values.push_back(empty ? NOT_A_NUMBER : sums[s][group] / counts[group]); break;
+            }
+        }
+        rows.push_back(std::move(row));
+    }
+    std::sort(rows.begin(), rows.end(), [](const AggregateRow& a, const AggregateRow& b) { return a.group < b.group; });
+    return rows;
+}
@@ -0,0 +1,87 @@
+#ifndef AGGREGATE_HPP
+#define AGGREGATE_HPP
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "schema.hpp"
+#include "page.hpp"
+#include "projection.hpp"
+
+enum class AggregateFunction {
+    Count,
+    Sum,
+    Min,
+    Max,
+    Avg,
+};
+
+struct AggregateSpec {
+    AggregateFunction function;
+    std::string column;     // Ignored for Count, which counts rows
+};
+
+// One output row: the group key (empty without GROUP BY) and one value per spec.
+// Count is exact up to 2^53; Min/Max/Avg of an empty group are NaN.
+struct AggregateRow {
+    std::string group;
+    std::vector<double> values;
+};
+
+// Computes aggregates over pages of one table.
+// Live rows are decoded a page at a time into column batches of doubles, then reduced with
+// straight loops over those arrays that the compiler vectorizes. GROUP BY keys go through an
+// open-addressing hash table with linear probing whose slots are a flat array of
+// (hash, group) pairs; accumulators are kept per group in parallel arrays.
+// Aggregators over disjoint pages can be merged, which is how parallel scans combine.
+class Aggregator {
+public:
+    Aggregator(const CompiledSchema& schema, const std::vector<AggregateSpec>& specs, const std::string& groupBy = "");
+
+    // A group key kept in overflow pages is read through fetch
+    void consume(const Page& page, const Projection::Fetch& fetch = Projection::Fetch());
+    void merge(const Aggregator& other);
+    std::vector<AggregateRow> results() const;
+    uint64_t rowsScanned() const;
+
+private:
+    static const size_t BATCH_SIZE = 1024;
+    static const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t group;
+    };
+
+    std::vector<AggregateSpec> specs;
+    std::vector<std::string> inputColumns;   // Distinct numeric columns the specs read
+    std::vector<int> specInput;              // Spec -> index into inputColumns, -1 for Count
+    std::string groupBy;
+    uint64_t scanned = 0;
+
+    // Current batch, column-major
+    std::vector<std::vector<double>> batchValues;
+    std::vector<uint32_t> batchGroups;
+    size_t batchSize = 0;
+
+    // Accumulators, indexed [spec][group]
+    std::vector<std::vector<double>> sums;
+    std::vector<std::vector<double>> mins;
+    std::vector<std::vector<double>> maxs;
+    std::vector<double> counts;
+
+    // GROUP BY hash table
+    std::vector<Slot> slots;
+    std::vector<std::string> groupKeys;
+
+    uint32_t groupFor(std::string_view key);
+    uint32_t insertGroup(std::string_view key, uint64_t hash);
+    void growTable();
+    void addGroup();
+    bool decodeRow(const std::string& tupleData, std::string_view& groupKey, bool& groupSpilled);
+    void flushBatch();
+};
+
+#endif // AGGREGATE_HPP
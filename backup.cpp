@@ -0,0 +1,520 @@
+#include "backup.hpp"
+#include "tablefile.hpp"
+#include "FileMetaData.hpp"
+#include "idindex.hpp"
+#include "idfilter.hpp"
+#include "wal.hpp"
+#include "page.hpp"
+#include "projection.hpp"
+#include <algorithm>
+#include <random>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+std::mutex ChangeTracker::registryMutex;
+std::map<std::string, std::shared_ptr<ChangeTracker>> ChangeTracker::registry;
+
+namespace {
+
+bool testBit(const std::vector<uint64_t>& bits, uint64_t page) {
+    uint64_t word = page / 64;
+    return word < bits.size() && ((bits[word] >> (page % 64)) & 1);
+}
+
+void setBit(std::vector<uint64_t>& bits, uint64_t page) {
+    uint64_t word = page / 64;
+    if (word >= bits.size()) {
+        bits.resize(word + 1, 0);
+    }
+    bits[word] |= uint64_t(1) << (page % 64);
+}
+
+void clearBit(std::vector<uint64_t>& bits, uint64_t page) {
+    uint64_t word = page / 64;
+    if (word < bits.size()) {
+        bits[word] &= ~(uint64_t(1) << (page % 64));
+    }
+}
+
+uint64_t newChainId() {
+    std::random_device random;
+    uint64_t id = (uint64_t(random()) << 32) ^ random();
+    id ^= static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    return id == 0 ? 1 : id;
+}
+
+bool copyBytes(std::istream& in, std::ostream& out, uint64_t bytes) {
+    std::vector<char> buffer(1024 * 1024);
+    while (bytes > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(bytes, buffer.size()));
+        if (!in.read(buffer.data(), chunk) || !out.write(buffer.data(), chunk)) {
+            return false;
+        }
+        bytes -= chunk;
+    }
+    return true;
+}
+
+// Main file, segment files and id index of a table
+std::vector<std::pair<std::string, std::string>> tableFiles(const std::string& from, const std::string& to) {
+    std::vector<std::pair<std::string, std::string>> files = {{from, to}, {IdIndex::pathForTable(from), IdIndex::pathForTable(to)}};
+    for (uint64_t segment = 1; fs::exists(TableFile::segmentPath(from, segment)); ++segment) {
+        files.push_back({TableFile::segmentPath(from, segment), TableFile::segmentPath(to, segment)});
+    }
+    return files;
+}
+
+void removeTableFiles(const std::string& tablePath) {
+    for (const auto& file : tableFiles(tablePath, tablePath)) {
+        fs::remove(file.first);
+    }
+}
+
+} // namespace
+
+std::string ChangeTracker::pathForTable(const std::string& tablePath) {
+    return tablePath + ".chg";
+}
+
+std::shared_ptr<ChangeTracker> ChangeTracker::find(const std::string& tablePath) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(tablePath);
+    if (it != registry.end()) {
+        return it->second;
+    }
+    std::shared_ptr<ChangeTracker> tracker;
+    std::string changePath = pathForTable(tablePath);
+    if (fs::exists(changePath)) {
+        tracker.reset(new ChangeTracker(changePath));
+        if (!tracker->load()) {
+            std::cerr << "Error ChangeTracker: Unreadable change file " << changePath << "; the next backup must be a full one.\n";
+            tracker->broken = true;
+        }
+    }
+    registry[tablePath] = tracker;
+    return tracker;
+}
+
+std::shared_ptr<ChangeTracker> ChangeTracker::create(const std::string& tablePath) {
+    std::shared_ptr<ChangeTracker> tracker = find(tablePath);
+    if (tracker) {
+        return tracker;
+    }
+    tracker.reset(new ChangeTracker(pathForTable(tablePath)));
+    tracker->header = {CHANGE_MAGIC, CHANGE_VERSION, 0, 0};
+    if (!tracker->save()) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry[tablePath] = tracker;
+    return tracker;
+}
+
+void ChangeTracker::discard(const std::string& tablePath) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(tablePath);
+    if (it != registry.end()) {
+        if (it->second) {
+            std::lock_guard<std::mutex> trackerLock(it->second->mutex);
+            it->second->discarded = true;
+            it->second->file.close();
+        }
+        registry.erase(it);
+    }
+    fs::remove(pathForTable(tablePath));
+}
+
+bool ChangeTracker::load() {
+    file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != CHANGE_MAGIC || header.version != CHANGE_VERSION) {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    uint64_t words = (static_cast<uint64_t>(file.tellg()) - sizeof(header)) / sizeof(uint64_t);
+    changed.assign(words, 0);
+    file.seekg(sizeof(header), std::ios::beg);
+    file.read(reinterpret_cast<char*>(changed.data()), words * sizeof(uint64_t));
+    return static_cast<bool>(file);
+}
+
+bool ChangeTracker::save() {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(changed.data()), changed.size() * sizeof(uint64_t));
+        if (!out.flush()) {
+            std::cerr << "Error ChangeTracker save: Failed to write " << temporary << std::endl;
+            return false;
+        }
+    }
+    if (file.is_open()) {
+        file.close();
+    }
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "Error ChangeTracker save: " << error.message() << std::endl;
+        return false;
+    }
+    file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    return file.is_open();
+}
+
+void ChangeTracker::beforeWrite(TableFile& table, const FileMetadata& metadata, uint64_t firstPageID, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (discarded) {
+        return;
+    }
+    uint64_t firstWord = UINT64_MAX, lastWord = 0;
+    std::vector<char> image;
+    for (uint64_t pageID = firstPageID; pageID < firstPageID + count; ++pageID) {
+        if (!testBit(changed, pageID)) {
+            setBit(changed, pageID);
+            firstWord = std::min(firstWord, pageID / 64);
+            lastWord = std::max(lastWord, pageID / 64);
+        }
+        if (!backup) continue;
+        setBit(changedSinceCut, pageID);
+        if (!testBit(pending, pageID)) continue;
+        // The backup still needs this page as of its cut: save it before it is overwritten
+        clearBit(pending, pageID);
+        image.resize(metadata.getPageSize());
+        try {
+            table.readPageImage(metadata, pageID, image.data());
+            backup->writeImage(pageID, image.data());
+            backup->preImages++;
+        } catch (const std::exception& e) {
+            backup->fail(e.what());
+        }
+    }
+    if (firstWord == UINT64_MAX || broken) {
+        return;
+    }
+    // Only the first write to a page since the last backup gets here
+    file.clear();
+    file.seekp(sizeof(header) + firstWord * sizeof(uint64_t), std::ios::beg);
+    file.write(reinterpret_cast<const char*>(&changed[firstWord]), (lastWord - firstWord + 1) * sizeof(uint64_t));
+    if (!file.flush()) {
+        std::cerr << "Error ChangeTracker: Failed to record changed pages in " << path << "; the next backup must be a full one.\n";
+        broken = true;
+    }
+}
+
+TableBackup::TableBackup(const std::string& tablePath, const std::string& backupPath, const BackupOptions& options)
+    : tablePath(tablePath), backupPath(backupPath), options(options) {}
+
+TableBackup::~TableBackup() {
+    detach();
+}
+
+const BackupStats& TableBackup::getStats() const {
+    return stats;
+}
+
+void TableBackup::fail(const std::string& message) {
+    if (!failed.exchange(true)) {
+        std::cerr << "Error TableBackup: Backup of " << tablePath << " to " << backupPath << " failed: " << message << std::endl;
+    }
+}
+
+void TableBackup::writeImage(uint64_t pageID, const char* image) {
+    std::lock_guard<std::mutex> lock(outMutex);
+    if (failed) return;
+    out.write(reinterpret_cast<const char*>(&pageID), sizeof(pageID));
+    out.write(image, header.pageSize);
+    if (!out) {
+        fail("unable to write " + backupPath);
+        return;
+    }
+    pagesCopied++;
+}
+
+void TableBackup::detach() {
+    if (!tracker) return;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    if (tracker->backup == this) {
+        tracker->backup = nullptr;
+        tracker->pending.clear();
+        tracker->changedSinceCut.clear();
+    }
+}
+
+bool TableBackup::begin(TableFile& file, const FileMetadata& metadata) {
+    started = std::chrono::steady_clock::now();
+    tracker = ChangeTracker::find(tablePath);
+    if (options.incremental && (!tracker || tracker->header.sequence == 0)) {
+        std::cerr << "Error TableBackup: No full backup of " << tablePath << " to build an incremental one on.\n";
+        return false;
+    }
+    if (!tracker) {
+        tracker = ChangeTracker::create(tablePath);
+        if (!tracker) return false;
+    }
+
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    if (tracker->backup) {
+        std::cerr << "Error TableBackup: A backup of " << tablePath << " is already running.\n";
+        return false;
+    }
+    if (options.incremental && tracker->broken) {
+        std::cerr << "Error TableBackup: Changed pages of " << tablePath << " were not all recorded; take a full backup.\n";
+        return false;
+    }
+    header = {BACKUP_MAGIC, BACKUP_VERSION, 0, 1, 0, metadata.getPageCount(), metadata.getPageSize(), 0, 0};
+    if (options.incremental) {
+        header.chainId = tracker->header.chainId;
+        header.baseSequence = tracker->header.sequence;
+        header.sequence = header.baseSequence + 1;
+    } else {
+        header.chainId = newChainId();
+    }
+    segmentPages = metadata.getSegmentPages();
+
+    // The cut: the header block as it is now, with nothing buffered in between
+    file.flush();
+    std::ifstream main(tablePath, std::ios::binary);
+    out.open(backupPath, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!copyBytes(main, out, FileMetadata::METADATA_SIZE)) {
+        std::cerr << "Error TableBackup: Unable to write the cut of " << tablePath << " to " << backupPath << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t>& pending = tracker->pending;
+    if (options.incremental) {
+        pending = tracker->changed;
+    } else {
+        pending.assign((header.pageCount + 63) / 64, ~uint64_t(0));
+    }
+    pending.resize((header.pageCount + 63) / 64, 0);
+    if (header.pageCount % 64 != 0) {
+        pending.back() &= (uint64_t(1) << (header.pageCount % 64)) - 1; // Pages past the cut are not in it
+    }
+    tracker->changedSinceCut.clear();
+    tracker->backup = this;
+
+    stats.sequence = header.sequence;
+    stats.pagesInCut = header.pageCount;
+    return true;
+}
+
+bool TableBackup::copyPages() {
+    TableFile reader;
+    if (!reader.open(tablePath, false)) {
+        fail("unable to open the table");
+    }
+    FileMetadata layout;
+    layout.setPageSize(header.pageSize);
+    layout.setSegmentPages(segmentPages);
+    layout.setPageCount(header.pageCount);
+
+    std::vector<char> images(COPY_RUN_PAGES * header.pageSize);
+    std::vector<uint64_t> pageIDs;
+    uint64_t next = 0;
+    while (!failed && next < header.pageCount) {
+        pageIDs.clear();
+        {
+            // Reading and clearing the pending bit together keeps writers from overtaking the copy
+            std::lock_guard<std::mutex> lock(tracker->mutex);
+            if (tracker->discarded) {
+                fail("the table was replaced");
+                break;
+            }
+            std::vector<uint64_t>& pending = tracker->pending;
+            try {
+                while (next < header.pageCount && pageIDs.size() < COPY_RUN_PAGES) {
+                    if (next % 64 == 0 && pending[next / 64] == 0) {
+                        next += 64; // Nothing left to copy in this word
+                        continue;
+                    }
+                    if (testBit(pending, next)) {
+                        reader.readPageImage(layout, next, images.data() + pageIDs.size() * header.pageSize);
+                        clearBit(pending, next);
+                        pageIDs.push_back(next);
+                    }
+                    ++next;
+                }
+            } catch (const std::exception& e) {
+                fail(e.what());
+                break;
+            }
+        }
+        for (size_t i = 0; i < pageIDs.size(); ++i) {
+            writeImage(pageIDs[i], images.data() + i * header.pageSize);
+        }
+    }
+
+    if (!failed) {
+        std::lock_guard<std::mutex> lock(outMutex);
+        header.complete = 1;
+        header.pagesStored = pagesCopied;
+        out.seekp(0, std::ios::beg);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!out.flush()) {
+            failed = true;
+        }
+        out.close();
+    }
+
+    // Pages written since the cut are what the next incremental backup copies
+    {
+        std::lock_guard<std::mutex> lock(tracker->mutex);
+        if (!failed && !tracker->discarded) {
+            ChangeTracker::ChangeHeader previous = tracker->header;
+            tracker->header.chainId = header.chainId;
+            tracker->header.sequence = header.sequence;
+            tracker->changed.swap(tracker->changedSinceCut);
+            if (tracker->save()) {
+                tracker->broken = false;
+            } else {
+                tracker->header = previous;
+                tracker->changed.swap(tracker->changedSinceCut);
+                fail("unable to save the change file");
+            }
+        }
+        tracker->backup = nullptr;
+        tracker->pending.clear();
+        tracker->changedSinceCut.clear();
+    }
+    if (failed) {
+        out.close();
+        fs::remove(backupPath);
+    }
+
+    stats.completed = !failed;
+    stats.pagesCopied = pagesCopied;
+    stats.preImages = preImages;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return stats.completed;
+}
+
+bool TableBackup::restore(const std::string& tablePath, const std::vector<std::string>& backupPaths) {
+    if (backupPaths.empty()) {
+        std::cerr << "Error TableBackup restore: No backups given.\n";
+        return false;
+    }
+    std::vector<std::ifstream> inputs;
+    std::vector<BackupHeader> headers;
+    for (const std::string& path : backupPaths) {
+        inputs.emplace_back(path, std::ios::binary);
+        BackupHeader header{};
+        if (!inputs.back().read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            header.magic != BACKUP_MAGIC || header.version != BACKUP_VERSION) {
+            std::cerr << "Error TableBackup restore: " << path << " is not a table backup.\n";
+            return false;
+        }
+        if (!header.complete) {
+            std::cerr << "Error TableBackup restore: " << path << " is incomplete.\n";
+            return false;
+        }
+        if (headers.empty() ? header.baseSequence != 0
+                            : header.chainId != headers.back().chainId || header.baseSequence != headers.back().sequence ||
+                              header.pageSize != headers.back().pageSize) {
+            std::cerr << "Error TableBackup restore: " << path << " does not follow "
+                      << (headers.empty() ? std::string("a full backup") : backupPaths[headers.size() - 1]) << std::endl;
+            return false;
+        }
+        headers.push_back(header);
+    }
+
+    // Build the table next to the old one, then swap the files in
+    const BackupHeader& last = headers.back();
+    std::string staging = tablePath + ".restore";
+    removeTableFiles(staging);
+    {
+        std::ifstream& in = inputs.back();
+        std::ofstream main(staging, std::ios::binary | std::ios::trunc);
+        in.seekg(sizeof(BackupHeader), std::ios::beg);
+        if (!copyBytes(in, main, FileMetadata::METADATA_SIZE)) {
+            std::cerr << "Error TableBackup restore: Unable to restore the header from " << backupPaths.back() << std::endl;
+            removeTableFiles(staging);
+            return false;
+        }
+    }
+    uint64_t segmentPages;
+    uint32_t pageSize;
+    if (!FileMetadata::readLayout(staging, segmentPages, pageSize) || pageSize != last.pageSize) {
+        std::cerr << "Error TableBackup restore: Header block in " << backupPaths.back() << " is damaged.\n";
+        removeTableFiles(staging);
+        return false;
+    }
+    FileMetadata layout;
+    layout.setPageSize(pageSize);
+    layout.setSegmentPages(segmentPages);
+    layout.setPageCount(last.pageCount);
+
+    // Later backups hold later images of the same pages
+    TableFile table(staging);
+    std::vector<uint64_t> restored;
+    std::vector<char> image(pageSize);
+    try {
+        for (size_t b = 0; b < headers.size(); ++b) {
+            std::ifstream& in = inputs[b];
+            in.seekg(sizeof(BackupHeader) + FileMetadata::METADATA_SIZE, std::ios::beg);
+            for (uint64_t r = 0; r < headers[b].pagesStored; ++r) {
+                uint64_t pageID;
+                if (!in.read(reinterpret_cast<char*>(&pageID), sizeof(pageID)) || !in.read(image.data(), pageSize)) {
+                    throw std::runtime_error(backupPaths[b] + " ends early");
+                }
+                if (pageID >= last.pageCount) continue;
+                table.writePageImages(layout, pageID, image.data(), 1);
+                setBit(restored, pageID);
+            }
+        }
+        table.flush();
+
+        // Every live row is in the index, so rebuild it from the rows of the restored pages
+        std::vector<std::pair<int64_t, int64_t>> entries; // (tuple id, page id)
+        Page page(0, pageSize);
+        for (uint64_t pageID = 0; pageID < last.pageCount; ++pageID) {
+            if (!testBit(restored, pageID)) {
+                throw std::runtime_error("no backup holds page " + std::to_string(pageID));
+            }
+            table.readPage(layout, pageID, page);
+            for (uint32_t slot = 0; slot < page.getSlots().size(); ++slot) {
+                if (page.getSlot(slot).length == 0) continue;
+                int64_t id;
+                if (!Projection::readId(page.getTupleData(slot), id)) {
+                    throw std::runtime_error("unreadable row on page " + std::to_string(pageID));
+                }
+                entries.push_back({id, static_cast<int64_t>(pageID)});
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        IdIndex::BulkBuilder index(IdIndex::pathForTable(staging), 1.0);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i > 0 && entries[i].first == entries[i - 1].first) {
+                throw std::runtime_error("duplicate ID " + std::to_string(entries[i].first));
+            }
+            if (!index.add(entries[i].first, entries[i].second)) {
+                throw std::runtime_error("unable to rebuild the id index");
+            }
+        }
+        if (!index.finish()) {
+            throw std::runtime_error("unable to rebuild the id index");
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error TableBackup restore: " << e.what() << std::endl;
+        table.close();
+        removeTableFiles(staging);
+        return false;
+    }
+    table.close();
+
+    removeTableFiles(tablePath);
+    IdFilter::discard(IdIndex::pathForTable(tablePath));
+    WriteAheadLog::removeFiles(tablePath);
+    ChangeTracker::discard(tablePath); // A restored table starts a new chain with its next full backup
+    std::error_code error;
+    for (const auto& [from, to] : tableFiles(staging, tablePath)) {
+        fs::rename(from, to, error);
+        if (error) {
+            std::cerr << "Error TableBackup restore: Unable to move " << from << " into place: " << error.message() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
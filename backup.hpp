@@ -0,0 +1,145 @@
+#ifndef BACKUP_HPP
+#define BACKUP_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class TableFile;
+class FileMetadata;
+class TableBackup;
+
+struct BackupOptions {
+    bool incremental = false;   // Copy only pages written since the table's last backup; needs a full one first
+};
+
+struct BackupStats {
+    bool completed = false;
+    uint64_t sequence = 0;      // Position in the table's backup chain; 1 = the full backup it starts from
+    uint64_t pagesInCut = 0;    // Pages the table had when the backup started
+    uint64_t pagesCopied = 0;   // Page images written to the backup
+    uint64_t preImages = 0;     // Of those, saved by a writer just before it overwrote the page
+    double seconds = 0;
+};
+
+// Pages written since a table's last completed backup, kept in <table>.HAD.chg.
+// Once a table has been backed up, TableFile calls beforeWrite ahead of every page write in
+// the process. The first write to a page after a backup sets its bit, and the bit is written
+// to the file before the page itself, so a crash can only leave extra pages marked. While a
+// backup runs, beforeWrite also saves the old image of any page the backup still has to copy.
+class ChangeTracker {
+public:
+    static const uint32_t CHANGE_MAGIC = 0x47484348; // "HCHG"
+    static const uint32_t CHANGE_VERSION = 1;
+
+    struct ChangeHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t chainId;       // Identifies the full backup the chain starts from
+        uint64_t sequence;      // Of the last completed backup
+    };
+
+    static std::string pathForTable(const std::string& tablePath);
+    // Tracker of a table that has been backed up, or null; the answer is cached per path
+    static std::shared_ptr<ChangeTracker> find(const std::string& tablePath);
+    // The table's files were replaced or removed: its next backup has to be a full one
+    static void discard(const std::string& tablePath);
+
+    ChangeTracker(const ChangeTracker&) = delete;
+    ChangeTracker& operator=(const ChangeTracker&) = delete;
+
+    void beforeWrite(TableFile& file, const FileMetadata& metadata, uint64_t firstPageID, size_t count);
+
+private:
+    friend class TableBackup;
+
+    std::mutex mutex;
+    std::string path;
+    std::fstream file;
+    ChangeHeader header{};
+    std::vector<uint64_t> changed;          // Bit per page written since the last completed backup
+    bool broken = false;                    // A mark could not be saved; incrementals are refused
+    bool discarded = false;
+    TableBackup* backup = nullptr;          // Backup in progress
+    std::vector<uint64_t> changedSinceCut;  // Becomes changed when that backup completes
+    std::vector<uint64_t> pending;          // Pages of its cut it has not copied yet
+
+    static std::mutex registryMutex;
+    static std::map<std::string, std::shared_ptr<ChangeTracker>> registry; // Null = not tracked
+
+    explicit ChangeTracker(const std::string& changePath) : path(changePath) {}
+    static std::shared_ptr<ChangeTracker> create(const std::string& tablePath);
+    bool load();
+    bool save(); // Rewrites the whole file, replacing it atomically
+};
+
+// Online backup of one table to a single file.
+// begin() takes the cut while the caller holds writers off: it records the header block as
+// it is and which pages to copy (all of them, or for an incremental backup those the change
+// tracker has marked). copyPages() then copies those pages from its own handle and may run
+// on another thread while writes continue; a writer that reaches a page first saves the
+// page's old image into the backup, so every page is as of the cut.
+//
+// The file is BackupHeader, the header block, then (page ID, image) records. The id index
+// is not backed up: restore() rebuilds it from the rows, as migration does, after applying
+// a full backup and the incrementals after it, in order.
+class TableBackup {
+public:
+    static const uint32_t BACKUP_MAGIC = 0x4B414248; // "HBAK"
+    static const uint32_t BACKUP_VERSION = 1;
+    static const uint64_t COPY_RUN_PAGES = 64;      // Pages copied per turn on the tracker lock
+
+    struct BackupHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t chainId;
+        uint64_t sequence;
+        uint64_t baseSequence;  // Backup this one builds on, 0 for a full backup
+        uint64_t pageCount;     // Of the table at the cut
+        uint32_t pageSize;
+        uint32_t complete;      // Set once every page is in
+        uint64_t pagesStored;
+    };
+
+    TableBackup(const std::string& tablePath, const std::string& backupPath, const BackupOptions& options);
+    ~TableBackup();
+    TableBackup(const TableBackup&) = delete;
+    TableBackup& operator=(const TableBackup&) = delete;
+
+    // metadata is the table's as last written, and file has no writes buffered
+    bool begin(TableFile& file, const FileMetadata& metadata);
+    bool copyPages();
+    const BackupStats& getStats() const;
+
+    // Writes the table at tablePath from the backups; any existing table files are replaced
+    static bool restore(const std::string& tablePath, const std::vector<std::string>& backupPaths);
+
+private:
+    std::string tablePath;
+    std::string backupPath;
+    BackupOptions options;
+    BackupHeader header{};
+    BackupStats stats;
+    std::shared_ptr<ChangeTracker> tracker;
+    uint64_t segmentPages = 0;
+    std::fstream out;
+    std::mutex outMutex;
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t> pagesCopied{0};
+    std::atomic<uint64_t> preImages{0};
+    std::chrono::steady_clock::time_point started;
+
+    friend class ChangeTracker;
+    void writeImage(uint64_t pageID, const char* image);
+    void fail(const std::string& message);
+    void detach();
+};
+
+#endif // BACKUP_HPP
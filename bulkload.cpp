@@ -0,0 +1,498 @@
+#include "bulkload.hpp"
+#include "storage.hpp"
+#include "idindex.hpp"
+#include "schema.hpp"
+#include <algorithm>
+#include <queue>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
+namespace {
+
+// Same type codes Storage::insert accepts
+int typeCodeFor(const std::string& type) {
+    ColumnType columnType = CompiledSchema::typeFromName(type);
+    return columnType == ColumnType::Invalid ? -1 : static_cast<int>(columnType);
+}
+
+bool parseInt(const std::string& text, int& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || parsed < INT_MIN || parsed > INT_MAX) return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+bool parseInt64(const std::string& text, int64_t& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0') return false;
+    value = static_cast<int64_t>(parsed);
+    return true;
+}
+
+bool parseDouble(const std::string& text) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    std::strtod(text.c_str(), &end);
+    return errno == 0 && *end == '\0';
+}
+
+// Splits one CSV record, honouring double-quoted fields with "" escapes.
+std::vector<std::string> splitCSV(const std::string& line, char delimiter) {
+    std::vector<std::string> fields;
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                field += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == delimiter) {
+            fields.push_back(field);
+            field.clear();
+        } else if (c != '\r') {
+            field += c;
+        }
+    }
+    fields.push_back(field);
+    return fields;
+}
+
+struct RunReader {
+    std::ifstream in;
+    int64_t id = 0;
+    std::string row;
+
+    bool advance() {
+        uint32_t length;
+        if (!in.read(reinterpret_cast<char*>(&id), sizeof(id))) return false;
+        if (!in.read(reinterpret_cast<char*>(&length), sizeof(length))) return false;
+        row.resize(length);
+        return static_cast<bool>(in.read(&row[0], length));
+    }
+};
+
+} // namespace
+
+BulkLoader::BulkLoader(const std::string& dbName, const std::string& tableName, const BulkLoadOptions& opts)
+    : tablePath(dbName + "/" + tableName + ".HAD"), options(opts) {
+    std::string tempDir = options.tempDir.empty() ? dbName : options.tempDir;
+    tempPrefix = tempDir + "/" + tableName + ".run";
+}
+
+const BulkLoadStats& BulkLoader::getStats() const {
+    return stats;
+}
+
+bool BulkLoader::begin() {
+    if (!fs::exists(tablePath)) {
+        std::cerr << "Error bulkLoad: Table does not exist: " << tablePath << std::endl;
+        return false;
+    }
+    if (options.fillFactor <= 0.0 || options.fillFactor > 1.0) {
+        std::cerr << "Error bulkLoad: Fill factor must be in (0, 1], got " << options.fillFactor << std::endl;
+        return false;
+    }
+
+    TableFile file(tablePath, false);
+    if (!file.isOpen()) {
+        std::cerr << "Error bulkLoad: Failed to open table file: " << tablePath << std::endl;
+        return false;
+    }
+    FileMetadata metadata;
+    std::map<std::string, std::string> schema;
+    try {
+        schema = metadata.deserialize(file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error bulkLoad: " << e.what() << std::endl;
+        return false;
+    }
+    if (metadata.getPageCount() != metadata.getMetadataPageCount() || metadata.getIdIndex().size() != 0) {
+        std::cerr << "Error bulkLoad: Bulk loading requires an empty table: " << tablePath << std::endl;
+        return false;
+    }
+
+    columnTypes.clear();
+    for (const auto& [column, type] : schema) {
+        int code = typeCodeFor(type);
+        if (code < 0) {
+            std::cerr << "Error bulkLoad: Unsupported type '" << type << "' for column " << column << std::endl;
+            return false;
+        }
+        columnTypes[column] = code;
+    }
+    if (columnTypes.find("id") == columnTypes.end() || columnTypes["id"] != 1) {
+        std::cerr << "Error bulkLoad: Table schema needs an int 'id' column.\n";
+        return false;
+    }
+
+    buffer.clear();
+    bufferedBytes = 0;
+    runPaths.clear();
+    stats = BulkLoadStats();
+    return true;
+}
+
+bool BulkLoader::addRow(int64_t id, std::string serialized) {
+    bufferedBytes += serialized.size() + sizeof(std::pair<int64_t, std::string>);
+    buffer.emplace_back(id, std::move(serialized));
+    if (bufferedBytes >= options.memoryBudget) {
+        return spillRun();
+    }
+    return true;
+}
+
+bool BulkLoader::spillRun() {
+    std::sort(buffer.begin(), buffer.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::string runPath = tempPrefix + std::to_string(runPaths.size()) + ".tmp";
+    std::ofstream run(runPath, std::ios::binary | std::ios::trunc);
+    if (!run) {
+        std::cerr << "Error bulkLoad: Unable to create sort run: " << runPath << std::endl;
+        return false;
+    }
+    for (const auto& [id, row] : buffer) {
+        uint32_t length = row.size();
+        run.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        run.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        run.write(row.data(), length);
+    }
+    if (!run) {
+        std::cerr << "Error bulkLoad: Failed writing sort run: " << runPath << std::endl;
+        return false;
+    }
+    runPaths.push_back(runPath);
+    stats.runsSpilled++;
+
+    buffer.clear();
+    buffer.shrink_to_fit();
+    bufferedBytes = 0;
+    return true;
+}
+
+bool BulkLoader::mergeRuns(const std::function<bool(int64_t, const std::string&)>& emit) {
+    std::vector<RunReader> readers(runPaths.size());
+    using Head = std::pair<int64_t, size_t>; // (id, run)
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+
+    for (size_t i = 0; i < runPaths.size(); ++i) {
+        readers[i].in.open(runPaths[i], std::ios::binary);
+        if (!readers[i].in) {
+            std::cerr << "Error bulkLoad: Unable to reopen sort run: " << runPaths[i] << std::endl;
+            return false;
+        }
+        if (readers[i].advance()) {
+            heads.push({readers[i].id, i});
+        }
+    }
+
+    while (!heads.empty()) {
+        size_t run = heads.top().second;
+        heads.pop();
+        if (!emit(readers[run].id, readers[run].row)) {
+            return false;
+        }
+        if (readers[run].advance()) {
+            heads.push({readers[run].id, run});
+        }
+    }
+    return true;
+}
+
+bool BulkLoader::finish() {
+    bool ok;
+    if (runPaths.empty()) {
+        std::sort(buffer.begin(), buffer.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        ok = writeTable([this](const std::function<bool(int64_t, const std::string&)>& emit) {
+            for (const auto& [id, row] : buffer) {
+                if (!emit(id, row)) return false;
+            }
+            return true;
+        });
+    } else {
+        ok = (buffer.empty() || spillRun()) &&
+             writeTable([this](const std::function<bool(int64_t, const std::string&)>& emit) {
+                 return mergeRuns(emit);
+             });
+    }
+    buffer.clear();
+    removeRuns();
+    return ok;
+}
+
+bool BulkLoader::writeTable(const std::function<bool(const std::function<bool(int64_t, const std::string&)>&)>& source) {
+    TableFile file(tablePath);
+    if (!file.isOpen()) {
+        std::cerr << "Error bulkLoad: Failed to open table file: " << tablePath << std::endl;
+        return false;
+    }
+    FileMetadata metadata;
+    metadata.deserialize(file);
+    metadata.getIdIndex().close();
+
+    // The index is built beside the live one and only swapped in once the load succeeded
+    std::string indexPath = IdIndex::pathForTable(tablePath);
+    std::string indexTempPath = indexPath + ".tmp";
+    IdIndex::BulkBuilder index(indexTempPath, options.fillFactor);
+
+    const size_t pageSize = metadata.getPageSize();
+    const size_t writeBytes = std::max<size_t>(64 * PAGE_SIZE, pageSize);
+    const size_t fillLimit = static_cast<size_t>((pageSize - PAGE_HEADER_SIZE) * options.fillFactor);
+    std::vector<char> writeBuffer;
+    writeBuffer.reserve(writeBytes);
+
+    // Data pages follow the header's continuation pages, if any
+    uint64_t pageID = metadata.allocatePage();
+    uint64_t bufferFirstPage = pageID;
+    Page page(pageID, pageSize);
+    bool pageHasRows = false;
+    bool hasPreviousId = false;
+    int64_t previousId = 0;
+
+    auto flushBuffer = [&]() {
+        try {
+            file.reserveExtent(metadata);
+            file.writePageImages(metadata, bufferFirstPage, writeBuffer.data(), writeBuffer.size() / pageSize);
+        } catch (const std::exception& e) {
+            std::cerr << "Error bulkLoad: " << e.what() << std::endl;
+            return false;
+        }
+        bufferFirstPage += writeBuffer.size() / pageSize;
+        writeBuffer.clear();
+        return true;
+    };
+    auto flushPage = [&]() {
+        // Overflow chains written since the buffer started break its run of adjacent pages
+        if (!writeBuffer.empty() && bufferFirstPage + writeBuffer.size() / pageSize != pageID && !flushBuffer()) return false;
+        if (writeBuffer.empty()) bufferFirstPage = pageID;
+        size_t offset = writeBuffer.size();
+        writeBuffer.resize(offset + pageSize);
+        page.toImage(writeBuffer.data() + offset);
+        stats.pagesWritten++;
+        return writeBuffer.size() < writeBytes || flushBuffer();
+    };
+
+    bool ok = source([&](int64_t id, const std::string& row) {
+        if (hasPreviousId && id == previousId) {
+            std::cerr << "Error bulkLoad: Duplicate ID: " << id << std::endl;
+            return false;
+        }
+        hasPreviousId = true;
+        previousId = id;
+
+        // Long values go to overflow pages as they do for single inserts
+        std::string spilled;
+        if (row.size() > OverflowStore::inlineLimit(pageSize)) {
+            spilled = row;
+            try {
+                if (!OverflowStore::spill(file, metadata, spilled)) {
+                    std::cerr << "Error bulkLoad: Row with ID " << id << " does not fit in a page (" << row.size() << " bytes).\n";
+                    return false;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error bulkLoad: " << e.what() << std::endl;
+                return false;
+            }
+        }
+        const std::string& stored = spilled.empty() ? row : spilled;
+
+        size_t used = pageSize - PAGE_HEADER_SIZE - page.getFreeSpace();
+        if (pageHasRows && (used + stored.size() + sizeof(Slot) > fillLimit || !page.appendTuple(stored))) {
+            if (!flushPage()) return false;
+            pageID = metadata.allocatePage();
+            page = Page(pageID, pageSize);
+            pageHasRows = false;
+        }
+        if (!pageHasRows) {
+            if (!page.appendTuple(stored)) {
+                std::cerr << "Error bulkLoad: Row with ID " << id << " does not fit in a page (" << stored.size() << " bytes).\n";
+                return false;
+            }
+            pageHasRows = true;
+        }
+        stats.rowsLoaded++;
+        return index.add(id, pageID);
+    });
+
+    if (ok && pageHasRows) {
+        ok = flushPage();
+    }
+    ok = ok && flushBuffer() && index.finish();
+    if (!ok) {
+        std::cerr << "Error bulkLoad: Load aborted, table left empty: " << tablePath << std::endl;
+        fs::remove(indexTempPath);
+        return false;
+    }
+
+    fs::rename(indexTempPath, indexPath);
+    IdFilter::discard(indexPath);
+    if (!pageHasRows) {
+        metadata.setPageCount(pageID); // The page allocated for a first row that never came
+    }
+    metadata.serialize(file);
+    file.flush();
+    return static_cast<bool>(file.headerStream());
+}
+
+void BulkLoader::removeRuns() {
+    for (const auto& runPath : runPaths) {
+        fs::remove(runPath);
+    }
+    runPaths.clear();
+}
+
+bool BulkLoader::loadCSV(const std::string& csvPath) {
+    std::ifstream csv(csvPath);
+    if (!csv) {
+        std::cerr << "Error bulkLoad: Unable to open CSV file: " << csvPath << std::endl;
+        return false;
+    }
+    if (!begin()) return false;
+
+    std::string line;
+    if (!std::getline(csv, line)) {
+        std::cerr << "Error bulkLoad: CSV file is empty: " << csvPath << std::endl;
+        return false;
+    }
+    std::vector<std::string> columns = splitCSV(line, options.delimiter);
+    std::vector<int> codes;
+    int idColumn = -1;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        auto it = columnTypes.find(columns[i]);
+        if (it == columnTypes.end()) {
+            std::cerr << "Error bulkLoad: CSV column '" << columns[i] << "' is not in the table schema.\n";
+            return false;
+        }
+        codes.push_back(it->second);
+        if (columns[i] == "id") idColumn = i;
+    }
+    if (idColumn < 0 || columns.size() != columnTypes.size()) {
+        std::cerr << "Error bulkLoad: CSV header must name every schema column, including 'id'.\n";
+        return false;
+    }
+
+    uint64_t lineNumber = 1;
+    std::string serialized;
+    while (std::getline(csv, line)) {
+        ++lineNumber;
+        if (line.empty() || line == "\r") continue;
+        std::vector<std::string> fields = splitCSV(line, options.delimiter);
+        if (fields.size() != columns.size()) {
+            std::cerr << "Error bulkLoad: Line " << lineNumber << " has " << fields.size()
+                      << " fields, expected " << columns.size() << std::endl;
+            removeRuns();
+            return false;
+        }
+
+        int64_t id = 0;
+        serialized.clear();
+        for (size_t i = 0; i < fields.size(); ++i) {
+            std::string& value = fields[i];
+            bool valid = !value.empty() && value.find(')') == std::string::npos;
+            if (valid && codes[i] == 1) {
+                int64_t parsed;
+                valid = parseInt64(value, parsed);
+                if (valid) {
+                    value = std::to_string(parsed); // Ids are matched as text, keep them canonical
+                    if (static_cast<int>(i) == idColumn) id = parsed;
+                }
+            } else if (valid && codes[i] == 3) {
+                valid = parseDouble(value);
+            }
+            if (!valid) {
+                std::cerr << "Error bulkLoad: Line " << lineNumber << ": invalid value for column "
+                          << columns[i] << ": '" << value << "'\n";
+                removeRuns();
+                return false;
+            }
+            serialized += columns[i];
+            serialized += '(';
+            serialized += std::to_string(codes[i]);
+            serialized += '|';
+            serialized += value;
+            serialized += ')';
+        }
+        if (!addRow(id, serialized)) {
+            removeRuns();
+            return false;
+        }
+    }
+    return finish();
+}
+
+bool BulkLoader::loadRowStream(std::istream& rows) {
+    if (!begin()) return false;
+
+    uint64_t rowNumber = 0;
+    uint32_t length;
+    while (rows.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        ++rowNumber;
+        std::string row(length, '\0');
+        if (!rows.read(&row[0], length)) {
+            std::cerr << "Error bulkLoad: Row " << rowNumber << " is truncated.\n";
+            removeRuns();
+            return false;
+        }
+
+        // Walk the key(type|value) tokens without building a Tuple
+        bool valid = true;
+        bool hasId = false;
+        int64_t id = 0;
+        size_t seen = 0;
+        size_t pos = 0;
+        while (valid && pos < row.size()) {
+            size_t open = row.find('(', pos);
+            size_t bar = row.find('|', open);
+            size_t close = row.find(')', bar);
+            if (open == std::string::npos || bar == std::string::npos || close == std::string::npos) {
+                valid = false;
+                break;
+            }
+            std::string key = row.substr(pos, open - pos);
+            std::string value = row.substr(bar + 1, close - bar - 1);
+            int code;
+            auto it = columnTypes.find(key);
+            valid = it != columnTypes.end() && parseInt(row.substr(open + 1, bar - open - 1), code) &&
+                    code == it->second && !value.empty();
+            if (valid && code == 1) {
+                int64_t parsed;
+                valid = parseInt64(value, parsed) && std::to_string(parsed) == value;
+                if (valid && key == "id") {
+                    id = parsed;
+                    hasId = true;
+                }
+            } else if (valid && code == 3) {
+                valid = parseDouble(value);
+            }
+            ++seen;
+            pos = close + 1;
+        }
+        if (!valid || !hasId || seen != columnTypes.size()) {
+            std::cerr << "Error bulkLoad: Row " << rowNumber << " does not match the table schema.\n";
+            removeRuns();
+            return false;
+        }
+        if (!addRow(id, std::move(row))) {
+            removeRuns();
+            return false;
+        }
+    }
+    return finish();
+}
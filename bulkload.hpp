@@ -0,0 +1,60 @@
+#ifndef BULKLOAD_HPP
+#define BULKLOAD_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include "page.hpp"
+#include "FileMetaData.hpp"
+
+struct BulkLoadOptions {
+    double fillFactor = 0.9;                      // Fraction of each page's tuple space to fill
+    size_t memoryBudget = 256 * 1024 * 1024;      // Bytes of rows buffered before a sorted run is spilled
+    std::string tempDir;                          // Where sorted runs go, defaults to the database folder
+    char delimiter = ',';
+};
+
+struct BulkLoadStats {
+    uint64_t rowsLoaded = 0;
+    uint64_t pagesWritten = 0;
+    uint32_t runsSpilled = 0;
+};
+
+// Loads an empty table in one sequential pass instead of row-by-row inserts.
+// Rows are validated against the table schema, sorted by id (spilling sorted runs to disk
+// when they exceed the memory budget), packed into pages up to the fill factor and written
+// in order. The id index is built bottom-up from the same sorted stream.
+class BulkLoader {
+public:
+    BulkLoader(const std::string& dbName, const std::string& tableName, const BulkLoadOptions& options = BulkLoadOptions());
+
+    // CSV with a header row naming the table's columns.
+    bool loadCSV(const std::string& csvPath);
+    // Binary stream of [uint32 length][row serialized as by Tuple::serialize()] records.
+    bool loadRowStream(std::istream& rows);
+
+    const BulkLoadStats& getStats() const;
+
+private:
+    std::string tablePath;
+    std::string tempPrefix;
+    BulkLoadOptions options;
+    BulkLoadStats stats;
+    std::map<std::string, int> columnTypes;       // Column name -> type code used in serialized tuples
+    std::vector<std::pair<int64_t, std::string>> buffer;
+    size_t bufferedBytes = 0;
+    std::vector<std::string> runPaths;
+
+    bool begin();
+    bool addRow(int64_t id, std::string serialized);
+    bool spillRun();
+    bool finish();
+    bool mergeRuns(const std::function<bool(int64_t, const std::string&)>& emit);
+    bool writeTable(const std::function<bool(const std::function<bool(int64_t, const std::string&)>&)>& source);
+    void removeRuns();
+};
+
+#endif // BULKLOAD_HPP
@@ -0,0 +1,93 @@
+#include "storage.hpp"
+#include <chrono>
+
+// Command-line front end for BulkLoader.
+// Usage: bulkload <database> <table> <input> [--binary] [--schema id:int,name:string]
+//                 [--fill 0.9] [--memory-mb 256] [--temp-dir DIR] [--delimiter C]
+static void printUsage() {
+    std::cerr << "Usage: bulkload <database> <table> <input> [--binary] [--schema col:type,...]\n"
+              << "                [--fill 0.9] [--memory-mb 256] [--temp-dir DIR] [--delimiter C]\n";
+}
+
+static bool parseSchema(const std::string& spec, std::map<std::string, std::string>& schema) {
+    std::istringstream iss(spec);
+    std::string column;
+    while (std::getline(iss, column, ',')) {
+        auto colon = column.find(':');
+        if (colon == std::string::npos) return false;
+        schema[column.substr(0, colon)] = column.substr(colon + 1);
+    }
+    return !schema.empty();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
+    std::string dbName = argv[1];
+    std::string tableName = argv[2];
+    std::string inputPath = argv[3];
+
+    BulkLoadOptions options;
+    bool binary = false;
+    std::map<std::string, std::string> schema;
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--binary") {
+            binary = true;
+        } else if (arg == "--schema" && hasValue) {
+            if (!parseSchema(argv[++i], schema)) {
+                std::cerr << "Invalid schema, expected col:type,...\n";
+                return 1;
+            }
+        } else if (arg == "--fill" && hasValue) {
+            options.fillFactor = std::stod(argv[++i]);
+        } else if (arg == "--memory-mb" && hasValue) {
+            options.memoryBudget = std::stoull(argv[++i]) * 1024 * 1024;
+        } else if (arg == "--temp-dir" && hasValue) {
+            options.tempDir = argv[++i];
+        } else if (arg == "--delimiter" && hasValue) {
+            options.delimiter = argv[++i][0];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    Storage storage;
+    if (!storage.createDatabase(dbName)) {
+        return 1;
+    }
+    if (!storage.tableExists(dbName, tableName)) {
+        if (schema.empty() || !storage.createTable(dbName, tableName, schema)) {
+            std::cerr << "Table " << tableName << " does not exist; pass --schema to create it.\n";
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    BulkLoader loader(dbName, tableName, options);
+    bool ok;
+    if (binary) {
+        std::ifstream rows(inputPath, std::ios::binary);
+        if (!rows) {
+            std::cerr << "Unable to open input: " << inputPath << std::endl;
+            return 1;
+        }
+        ok = loader.loadRowStream(rows);
+    } else {
+        ok = loader.loadCSV(inputPath);
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const BulkLoadStats& stats = loader.getStats();
+    std::cout << "Loaded " << stats.rowsLoaded << " rows into " << stats.pagesWritten << " pages in "
+              << seconds << " s (" << (seconds > 0 ? stats.rowsLoaded / seconds : 0) << " rows/s, "
+              << stats.runsSpilled << " sorted runs spilled)" << std::endl;
+    return 0;
+}
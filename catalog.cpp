@@ -0,0 +1,230 @@
+#include "catalog.hpp"
+#include "FileMetaData.hpp"
+#include <algorithm>
+#include <cctype>
+
+Catalog::Catalog(size_t budget) : fileBudget(std::max<size_t>(budget, 1)) {}
+
+std::string Catalog::pathFor(const std::string& dbName, const std::string& tableName) {
+    return dbName + "/" + tableName + ".HAD";
+}
+
+// Stats for a table found outside a directory scan
+CatalogTable Catalog::describe(const std::string& tablePath) {
+    CatalogTable table;
+    table.path = tablePath;
+    std::error_code error;
+    table.fileBytes = fs::file_size(tablePath, error);
+    table.modified = fs::last_write_time(tablePath, error);
+    for (uint64_t segment = 1; fs::exists(TableFile::segmentPath(tablePath, segment), error); ++segment) {
+        table.fileBytes += fs::file_size(TableFile::segmentPath(tablePath, segment), error);
+    }
+    return table;
+}
+
+size_t Catalog::loadDatabase(const std::string& dbName) {
+    auto loaded = databases.find(dbName);
+    if (loaded != databases.end()) {
+        return loaded->second.size();
+    }
+
+    std::error_code error;
+    fs::directory_iterator dir(dbName, error);
+    if (error == std::errc::no_such_file_or_directory) {
+        return 0; // Not created yet
+    }
+    if (error) {
+        std::cerr << "Error loadDatabase: Unable to scan database " << dbName << ": " << error.message() << std::endl;
+        return 0;
+    }
+
+    // One pass over the directory: <table>.HAD files are tables, <table>.HAD.<n> their segments
+    std::map<std::string, CatalogTable>& tables = databases[dbName];
+    std::map<std::string, uint64_t> segmentBytes;
+    for (const fs::directory_entry& file : dir) {
+        if (!file.is_regular_file(error)) {
+            continue;
+        }
+        std::string name = file.path().filename().string();
+        size_t marker = name.rfind(".HAD");
+        if (marker == std::string::npos || marker == 0) {
+            continue;
+        }
+        std::string tableName = name.substr(0, marker);
+        std::string suffix = name.substr(marker + 4);
+        if (suffix.empty()) {
+            CatalogTable& table = tables[tableName];
+            table.path = pathFor(dbName, tableName);
+            table.fileBytes += file.file_size(error);
+            table.modified = file.last_write_time(error);
+        } else if (suffix.size() > 1 && suffix[0] == '.' &&
+                   std::all_of(suffix.begin() + 1, suffix.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            segmentBytes[tableName] += file.file_size(error);
+        }
+    }
+    for (const auto& [tableName, bytes] : segmentBytes) {
+        auto table = tables.find(tableName);
+        if (table != tables.end()) {
+            table->second.fileBytes += bytes;
+        }
+    }
+    return tables.size();
+}
+
+// Entry for the table, scanning its database on first use; a miss is checked on disk once
+CatalogTable* Catalog::entry(const std::string& dbName, const std::string& tableName) {
+    loadDatabase(dbName);
+    auto db = databases.find(dbName);
+    if (db == databases.end()) {
+        return nullptr;
+    }
+    auto table = db->second.find(tableName);
+    if (table != db->second.end()) {
+        return &table->second;
+    }
+    std::string tablePath = pathFor(dbName, tableName);
+    if (!fs::exists(tablePath)) {
+        return nullptr;
+    }
+    return &db->second.emplace(tableName, describe(tablePath)).first->second;
+}
+
+bool Catalog::hasTable(const std::string& dbName, const std::string& tableName) {
+    return entry(dbName, tableName) != nullptr;
+}
+
+const CatalogTable* Catalog::findTable(const std::string& dbName, const std::string& tableName) {
+    return entry(dbName, tableName);
+}
+
+std::vector<std::string> Catalog::listTables(const std::string& dbName) {
+    std::vector<std::string> names;
+    loadDatabase(dbName);
+    auto db = databases.find(dbName);
+    if (db != databases.end()) {
+        for (const auto& [tableName, table] : db->second) {
+            names.push_back(tableName);
+        }
+    }
+    return names;
+}
+
+const std::map<std::string, std::string>* Catalog::getSchema(const std::string& dbName, const std::string& tableName) {
+    CatalogTable* table = entry(dbName, tableName);
+    if (!table) {
+        return nullptr;
+    }
+    if (!table->schemaLoaded) {
+        TableFile* file = open(dbName, tableName);
+        if (!file) {
+            return nullptr;
+        }
+        FileMetadata metadata;
+        try {
+            metadata.deserialize(*file);
+        } catch (const std::exception& e) {
+            std::cerr << "Error getSchema: " << e.what() << std::endl;
+            return nullptr;
+        }
+        table->schema = metadata.getSchema();
+        table->schemaCharge.set(mapMemoryBytes(table->schema));
+        table->schemaLoaded = true;
+    }
+    return &table->schema;
+}
+
+void Catalog::addTable(const std::string& dbName, const std::string& tableName) {
+    loadDatabase(dbName);
+    auto db = databases.find(dbName);
+    if (db != databases.end()) {
+        db->second[tableName] = describe(pathFor(dbName, tableName));
+    }
+}
+
+void Catalog::forget(const std::string& tablePath) {
+    close(tablePath);
+    fs::path path(tablePath);
+    auto db = databases.find(path.parent_path().string());
+    if (db != databases.end()) {
+        db->second.erase(path.stem().string());
+    }
+}
+
+TableFile* Catalog::open(const std::string& dbName, const std::string& tableName) {
+    std::string tablePath = pathFor(dbName, tableName);
+    auto handle = handles.find(tablePath);
+    if (handle != handles.end()) {
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, handle->second.recent);
+        hits++;
+        return handle->second.file.get();
+    }
+    if (!entry(dbName, tableName)) {
+        return nullptr;
+    }
+
+    evict(1);
+    auto file = std::make_unique<TableFile>(tablePath);
+    if (!file->isOpen()) {
+        forget(tablePath); // Deleted behind the catalog's back
+        return nullptr;
+    }
+    opens++;
+    recentlyUsed.push_front(tablePath);
+    Handle& opened = handles[tablePath];
+    opened.file = std::move(file);
+    opened.recent = recentlyUsed.begin();
+    return opened.file.get();
+}
+
+void Catalog::close(const std::string& tablePath) {
+    auto handle = handles.find(tablePath);
+    if (handle == handles.end()) {
+        return;
+    }
+    recentlyUsed.erase(handle->second.recent);
+    handles.erase(handle); // TableFile flushes and closes its streams
+}
+
+void Catalog::closeAll() {
+    handles.clear();
+    recentlyUsed.clear();
+}
+
+void Catalog::setFileBudget(size_t files) {
+    fileBudget = std::max<size_t>(files, 1);
+    evict(0);
+}
+
+size_t Catalog::openFiles() const {
+    size_t files = 0;
+    for (const auto& [tablePath, handle] : handles) {
+        files += handle.file->openFiles();
+    }
+    return files;
+}
+
+// Closes least recently used handles until incoming more files fit in the budget
+void Catalog::evict(size_t incoming) {
+    size_t files = openFiles();
+    while (!recentlyUsed.empty() && files + incoming > fileBudget) {
+        auto handle = handles.find(recentlyUsed.back());
+        files -= handle->second.file->openFiles();
+        recentlyUsed.pop_back();
+        handles.erase(handle);
+        evictions++;
+    }
+}
+
+CatalogStats Catalog::getStats() const {
+    CatalogStats stats;
+    stats.databases = databases.size();
+    for (const auto& [dbName, tables] : databases) {
+        stats.tables += tables.size();
+    }
+    stats.opens = opens;
+    stats.hits = hits;
+    stats.evictions = evictions;
+    stats.openHandles = handles.size();
+    stats.openFiles = openFiles();
+    return stats;
+}
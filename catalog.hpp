@@ -0,0 +1,96 @@
+#ifndef CATALOG_HPP
+#define CATALOG_HPP
+
+#include <iostream>
+#include <map>
+#include <list>
+#include <vector>
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <cstdint>
+#include "tablefile.hpp"
+#include "memory.hpp"
+
+namespace fs = std::filesystem;
+
+// What the catalog knows about one table without opening it
+struct CatalogTable {
+    std::string path;                           // <db>/<table>.HAD
+    uint64_t fileBytes = 0;                     // Main file plus segments, as of the last scan
+    fs::file_time_type modified;                // Main file, as of the last scan
+    bool schemaLoaded = false;                  // Schema is read from the header on first use
+    std::map<std::string, std::string> schema;
+    MemoryCharge schemaCharge{MemoryComponent::Metadata};
+};
+
+struct CatalogStats {
+    uint64_t databases = 0;     // Database directories scanned
+    uint64_t tables = 0;
+    uint64_t opens = 0;         // Handles opened
+    uint64_t hits = 0;          // Requests served by an already open handle
+    uint64_t evictions = 0;     // Handles closed to stay within the file budget
+    size_t openHandles = 0;
+    size_t openFiles = 0;
+};
+
+// In-process catalog of databases and their tables.
+// Each database directory is scanned once, the first time it is used, and every table file
+// found is recorded with its size and modification time; schemas are read from the header
+// the first time they are asked for. Table files are opened lazily and stay open, most
+// recently used first, until the files held open (main files plus segment files) would
+// exceed the file budget, at which point the least recently used handles are closed.
+//
+// Tables created or deleted through another Storage are picked up on the next miss, which
+// costs one existence check. A cached handle keeps pointing at the file it opened, so a
+// table replaced on disk must be closed here first (see Storage::migrateTable).
+class Catalog {
+public:
+    static const size_t DEFAULT_FILE_BUDGET = 128;
+
+    explicit Catalog(size_t fileBudget = DEFAULT_FILE_BUDGET);
+    Catalog(const Catalog&) = delete;
+    Catalog& operator=(const Catalog&) = delete;
+
+    // Scans the database directory if it has not been yet; returns how many tables it holds
+    size_t loadDatabase(const std::string& dbName);
+
+    bool hasTable(const std::string& dbName, const std::string& tableName);
+    const CatalogTable* findTable(const std::string& dbName, const std::string& tableName);
+    std::vector<std::string> listTables(const std::string& dbName);
+    // Null when the table does not exist or its header cannot be read
+    const std::map<std::string, std::string>* getSchema(const std::string& dbName, const std::string& tableName);
+
+    void addTable(const std::string& dbName, const std::string& tableName);
+    void forget(const std::string& tablePath); // Table was deleted: drop its entry and handle
+
+    // Open handle on the table, valid until the next open() or close; null if it does not exist
+    TableFile* open(const std::string& dbName, const std::string& tableName);
+    void close(const std::string& tablePath);
+    void closeAll();
+    void setFileBudget(size_t files);
+
+    CatalogStats getStats() const;
+
+private:
+    struct Handle {
+        std::unique_ptr<TableFile> file;
+        std::list<std::string>::iterator recent;
+    };
+
+    size_t fileBudget;
+    std::map<std::string, std::map<std::string, CatalogTable>> databases; // Db -> table name -> entry
+    std::map<std::string, Handle> handles;                                // Table path -> open handle
+    std::list<std::string> recentlyUsed;                                  // Table paths, most recent first
+    uint64_t opens = 0;
+    uint64_t hits = 0;
+    uint64_t evictions = 0;
+
+    static std::string pathFor(const std::string& dbName, const std::string& tableName);
+    static CatalogTable describe(const std::string& tablePath);
+    CatalogTable* entry(const std::string& dbName, const std::string& tableName);
+    size_t openFiles() const;
+    void evict(size_t incoming);
+};
+
+#endif // CATALOG_HPP
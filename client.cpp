@@ -0,0 +1,255 @@
+#include "client.hpp"
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+StorageClient::~StorageClient() {
+    close();
+}
+
+bool StorageClient::connect(const std::string& socketPath) {
+    close();
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        error = "socket path too long: " + socketPath;
+        return false;
+    }
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        error = "unable to connect to " + socketPath + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool StorageClient::isConnected() const {
+    return fd >= 0;
+}
+
+void StorageClient::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    out.clear();
+    in.clear();
+    unclaimed.clear();
+}
+
+const std::string& StorageClient::lastError() const {
+    return error;
+}
+
+std::string StorageClient::tableBody(const std::string& dbName, const std::string& tableName) {
+    std::string body;
+    WireWriter writer(body);
+    writer.str(dbName);
+    writer.str(tableName);
+    return body;
+}
+
+uint32_t StorageClient::queue(RequestOp op, const std::string& body) {
+    uint32_t id = nextRequestId++;
+    WireWriter writer(out);
+    size_t frame = writer.begin(id, static_cast<uint8_t>(op));
+    out.append(body);
+    writer.end(frame);
+    return id;
+}
+
+uint32_t StorageClient::queueInsert(const std::string& dbName, const std::string& tableName, const Tuple& tuple) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter(body).tuple(tuple);
+    return queue(RequestOp::Insert, body);
+}
+
+uint32_t StorageClient::queueGet(const std::string& dbName, const std::string& tableName, int64_t id) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter(body).i64(id);
+    return queue(RequestOp::Get, body);
+}
+
+bool StorageClient::flush() {
+    size_t sent = 0;
+    while (sent < out.size()) {
+        ssize_t wrote = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (wrote < 0) {
+            if (errno == EINTR) continue;
+            error = std::string("send failed: ") + std::strerror(errno);
+            out.clear();
+            return false;
+        }
+        sent += wrote;
+    }
+    out.clear();
+    return true;
+}
+
+bool StorageClient::readResponse(ClientResponse& response) {
+    for (;;) {
+        if (in.size() >= FRAME_HEADER_SIZE) {
+            uint32_t length;
+            std::memcpy(&length, in.data(), sizeof(length));
+            if (length < FRAME_HEADER_SIZE - sizeof(uint32_t) || length > MAX_FRAME_BYTES) {
+                error = "malformed reply";
+                return false;
+            }
+            if (in.size() >= sizeof(uint32_t) + length) {
+                std::memcpy(&response.requestId, in.data() + 4, sizeof(response.requestId));
+                response.status = static_cast<ResponseStatus>(in[8]);
+                response.body.assign(in, FRAME_HEADER_SIZE, length - (FRAME_HEADER_SIZE - sizeof(uint32_t)));
+                in.erase(0, sizeof(uint32_t) + length);
+                if (response.status == ResponseStatus::Error) {
+                    WireReader reader(response.body);
+                    error = std::string(reader.str());
+                }
+                return true;
+            }
+        }
+        char chunk[64 * 1024];
+        ssize_t got = ::read(fd, chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            error = got == 0 ? "server closed the connection" : std::string("read failed: ") + std::strerror(errno);
+            return false;
+        }
+        in.append(chunk, got);
+    }
+}
+
+bool StorageClient::receive(ClientResponse& response) {
+    if (!unclaimed.empty()) {
+        response = std::move(unclaimed.front());
+        unclaimed.pop_front();
+        return true;
+    }
+    return readResponse(response);
+}
+
+bool StorageClient::call(RequestOp op, const std::string& body, ClientResponse& response) {
+    if (fd < 0) {
+        error = "not connected";
+        return false;
+    }
+    uint32_t id = queue(op, body);
+    if (!flush()) {
+        return false;
+    }
+    while (readResponse(response)) {
+        if (response.requestId == id) {
+            return true;
+        }
+        unclaimed.push_back(std::move(response));
+    }
+    return false;
+}
+
+bool StorageClient::decodeRow(const std::string& body, std::map<std::string, std::string>& row) {
+    WireReader reader(body);
+    row.clear();
+    for (uint32_t n = reader.u32(), i = 0; reader.ok() && i < n; ++i) {
+        std::string column(reader.str());
+        row[column] = reader.str();
+    }
+    return reader.ok();
+}
+
+bool StorageClient::ping() {
+    ClientResponse response;
+    return call(RequestOp::Ping, "", response) && response.status == ResponseStatus::Ok;
+}
+
+bool StorageClient::createDatabase(const std::string& dbName) {
+    std::string body;
+    WireWriter(body).str(dbName);
+    ClientResponse response;
+    return call(RequestOp::CreateDatabase, body, response) && response.status == ResponseStatus::Ok;
+}
+
+bool StorageClient::createTable(const std::string& dbName, const std::string& tableName, const std::map<std::string, std::string>& schema) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter writer(body);
+    writer.u32(static_cast<uint32_t>(schema.size()));
+    for (const auto& [column, type] : schema) {
+        writer.str(column);
+        writer.str(type);
+    }
+    ClientResponse response;
+    return call(RequestOp::CreateTable, body, response) && response.status == ResponseStatus::Ok;
+}
+
+bool StorageClient::tableExists(const std::string& dbName, const std::string& tableName) {
+    ClientResponse response;
+    return call(RequestOp::TableExists, tableBody(dbName, tableName), response) && response.status == ResponseStatus::Ok;
+}
+
+bool StorageClient::insert(const std::string& dbName, const std::string& tableName, const Tuple& tuple) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter(body).tuple(tuple);
+    ClientResponse response;
+    return call(RequestOp::Insert, body, response) && response.status == ResponseStatus::Ok;
+}
+
+bool StorageClient::get(const std::string& dbName, const std::string& tableName, int64_t id, std::map<std::string, std::string>& row) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter(body).i64(id);
+    ClientResponse response;
+    return call(RequestOp::Get, body, response) && response.status == ResponseStatus::Ok && decodeRow(response.body, row);
+}
+
+bool StorageClient::remove(const std::string& dbName, const std::string& tableName, int64_t id) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter(body).i64(id);
+    ClientResponse response;
+    return call(RequestOp::Delete, body, response) && response.status == ResponseStatus::Ok;
+}
+
+bool StorageClient::update(const std::string& dbName, const std::string& tableName, int64_t id, const Tuple& tuple) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter writer(body);
+    writer.i64(id);
+    writer.tuple(tuple);
+    ClientResponse response;
+    return call(RequestOp::Update, body, response) && response.status == ResponseStatus::Ok;
+}
+
+uint64_t StorageClient::scan(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi,
+                             const std::vector<std::string>& columns,
+                             const std::function<bool(int64_t id, const std::vector<std::string>& values)>& visit, uint32_t limit) {
+    std::string body = tableBody(dbName, tableName);
+    WireWriter writer(body);
+    writer.i64(lo);
+    writer.i64(hi);
+    writer.u32(limit);
+    writer.u32(static_cast<uint32_t>(columns.size()));
+    for (const std::string& column : columns) {
+        writer.str(column);
+    }
+    ClientResponse response;
+    if (!call(RequestOp::Scan, body, response) || response.status != ResponseStatus::Ok) {
+        return 0;
+    }
+
+    WireReader reader(response.body);
+    std::vector<std::string> values(columns.size());
+    uint64_t visited = 0;
+    for (uint32_t rows = reader.u32(), r = 0; reader.ok() && r < rows; ++r) {
+        int64_t id = reader.i64();
+        for (std::string& value : values) {
+            value = reader.str();
+        }
+        if (!reader.ok()) {
+            error = "malformed scan reply";
+            break;
+        }
+        ++visited;
+        if (!visit(id, values)) {
+            break;
+        }
+    }
+    return visited;
+}
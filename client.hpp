@@ -0,0 +1,72 @@
+#ifndef CLIENT_HPP
+#define CLIENT_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <functional>
+#include <cstdint>
+#include "protocol.hpp"
+
+struct ClientResponse {
+    uint32_t requestId = 0;
+    ResponseStatus status = ResponseStatus::Ok;
+    std::string body;
+};
+
+// Connection to a StorageServer.
+// The blocking calls send one request and wait for its reply. To pipeline, queue any number
+// of requests, flush() them in one write and receive() the replies, which may come back in
+// any order; match them by request id. A blocking call made while pipelined replies are
+// outstanding keeps the ones it reads past for later receive() calls.
+class StorageClient {
+public:
+    StorageClient() = default;
+    ~StorageClient();
+    StorageClient(const StorageClient&) = delete;
+    StorageClient& operator=(const StorageClient&) = delete;
+
+    bool connect(const std::string& socketPath);
+    bool isConnected() const;
+    void close();
+    const std::string& lastError() const; // Message of the last Error reply or I/O failure
+
+    // Pipelining; each returns the request id its reply will carry
+    uint32_t queue(RequestOp op, const std::string& body);
+    uint32_t queueInsert(const std::string& dbName, const std::string& tableName, const Tuple& tuple);
+    uint32_t queueGet(const std::string& dbName, const std::string& tableName, int64_t id);
+    bool flush();
+    bool receive(ClientResponse& response);
+
+    bool ping();
+    bool createDatabase(const std::string& dbName);
+    bool createTable(const std::string& dbName, const std::string& tableName, const std::map<std::string, std::string>& schema);
+    bool tableExists(const std::string& dbName, const std::string& tableName);
+    bool insert(const std::string& dbName, const std::string& tableName, const Tuple& tuple);
+    // False if the row does not exist
+    bool get(const std::string& dbName, const std::string& tableName, int64_t id, std::map<std::string, std::string>& row);
+    bool remove(const std::string& dbName, const std::string& tableName, int64_t id);
+    bool update(const std::string& dbName, const std::string& tableName, int64_t id, const Tuple& tuple);
+    // Rows with lo <= id <= hi, the given columns of each; SCAN_NO_LIMIT means all
+    uint64_t scan(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi,
+                  const std::vector<std::string>& columns,
+                  const std::function<bool(int64_t id, const std::vector<std::string>& values)>& visit, uint32_t limit = SCAN_NO_LIMIT);
+
+    static bool decodeRow(const std::string& body, std::map<std::string, std::string>& row);
+
+private:
+    int fd = -1;
+    uint32_t nextRequestId = 1;
+    std::string out;                      // Queued requests not yet written
+    std::string in;                       // Bytes read past the last whole reply
+    std::deque<ClientResponse> unclaimed; // Replies a blocking call read past
+    std::string error;
+
+    bool readResponse(ClientResponse& response);
+    bool call(RequestOp op, const std::string& body, ClientResponse& response);
+    static std::string tableBody(const std::string& dbName, const std::string& tableName);
+};
+
+#endif // CLIENT_HPP
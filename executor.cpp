@@ -0,0 +1,160 @@
+#include "executor.hpp"
+#include "storage.hpp"
+
+StorageExecutor::StorageExecutor(Storage& owner, unsigned threads) : storage(owner), pool(threads) {
+    // Split the open file budget between the workers' handles
+    size_t budget = std::max<size_t>(Catalog::DEFAULT_FILE_BUDGET / pool.size(), 2);
+    for (unsigned i = 0; i < pool.size(); ++i) {
+        readers.push_back(std::make_unique<Reader>(budget));
+    }
+}
+
+StorageExecutor::~StorageExecutor() = default;
+
+std::shared_mutex& StorageExecutor::tableLock(const std::string& tablePath) {
+    std::lock_guard<std::mutex> lock(tableLocksMutex);
+    std::unique_ptr<std::shared_mutex>& tableMutex = tableLocks[tablePath];
+    if (!tableMutex) {
+        tableMutex = std::make_unique<std::shared_mutex>();
+    }
+    return *tableMutex;
+}
+
+std::future<std::map<std::string, std::string>> StorageExecutor::get(const std::string& dbName, const std::string& tableName,
+                                                                      const std::string& id) {
+    return pool.submit([this, dbName, tableName, id]() {
+        TraceSpan span(storage.trace, TraceOp::Get, dbName, tableName);
+        span.setId(id);
+        std::string path = dbName + "/" + tableName + ".HAD";
+        int64_t rowId = 0;
+        bool cacheable = storage.rowCache.enabled() && Storage::parseRowId(id, rowId);
+        Reader& reader = *readers[pool.currentWorker()];
+        std::lock_guard<std::mutex> readerLock(reader.mutex);
+        // Held until the row is cached, so a write to it cannot slip in between
+        std::shared_lock<std::shared_mutex> tableReadLock(tableLock(path));
+        reads++;
+        RowCache::Row row;
+        if (cacheable && storage.rowCache.lookup(path, rowId, row)) {
+            return row;
+        }
+        TableFile* file = reader.catalog.open(dbName, tableName);
+        if (!file) {
+            throw std::runtime_error("Failed to open the table file.");
+        }
+        try {
+            reader.metadata.deserialize(*file);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Error deserializing file metadata: " + std::string(e.what()));
+        }
+        row = Storage::readRow(*file, reader.metadata, id);
+        if (cacheable) {
+            storage.rowCache.store(path, rowId, row);
+        }
+        return row;
+    });
+}
+
+std::future<bool> StorageExecutor::insert(const std::string& dbName, const std::string& tableName, const Tuple& tuple) {
+    return queueWrite(dbName, tableName, PendingWrite{WriteKind::Insert, "", tuple, {}});
+}
+
+std::future<bool> StorageExecutor::remove(const std::string& dbName, const std::string& tableName, const std::string& id) {
+    return queueWrite(dbName, tableName, PendingWrite{WriteKind::Delete, id, Tuple(), {}});
+}
+
+std::future<bool> StorageExecutor::update(const std::string& dbName, const std::string& tableName, const std::string& id,
+                                          const Tuple& tuple) {
+    return queueWrite(dbName, tableName, PendingWrite{WriteKind::Update, id, tuple, {}});
+}
+
+std::future<bool> StorageExecutor::queueWrite(const std::string& dbName, const std::string& tableName, PendingWrite write) {
+    std::future<bool> result = write.done.get_future();
+    TableKey table(dbName, tableName);
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        WriteQueue& queue = writeQueues[table];
+        queue.writes.push_back(std::move(write));
+        schedule = !queue.scheduled;
+        queue.scheduled = true;
+    }
+    if (schedule) {
+        pool.post([this, table]() { applyWrites(table); });
+    }
+    return result;
+}
+
+// Applies everything queued for the table in order, then again if more arrived meanwhile
+void StorageExecutor::applyWrites(const TableKey& table) {
+    const std::string& dbName = table.first;
+    const std::string& tableName = table.second;
+    std::vector<PendingWrite> batch;
+    std::vector<Tuple> tuples;
+    std::vector<uint8_t> inserted;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            auto queue = writeQueues.find(table);
+            if (queue->second.writes.empty()) {
+                writeQueues.erase(queue);
+                return;
+            }
+            batch.clear();
+            batch.swap(queue->second.writes);
+        }
+
+        std::lock_guard<std::mutex> engine(engineMutex);
+        std::unique_lock<std::shared_mutex> tableWriteLock(tableLock(dbName + "/" + tableName + ".HAD"));
+        writeBatches++;
+        writes += batch.size();
+        for (size_t i = 0; i < batch.size();) {
+            try {
+                if (batch[i].kind == WriteKind::Insert) {
+                    size_t end = i;
+                    tuples.clear();
+                    while (end < batch.size() && batch[end].kind == WriteKind::Insert) {
+                        tuples.push_back(std::move(batch[end++].tuple));
+                    }
+                    inserted.assign(tuples.size(), 0);
+                    storage.insertBatch(dbName, tableName, tuples, &inserted);
+                    batchedInserts += tuples.size();
+                    for (size_t j = 0; i < end; ++i, ++j) {
+                        batch[i].done.set_value(inserted[j] != 0);
+                    }
+                    continue;
+                }
+                bool ok = batch[i].kind == WriteKind::Delete
+                              ? storage.deleteTupleFromTable(dbName, tableName, batch[i].id)
+                              : storage.updateTupleInTable(dbName, tableName, batch[i].id, batch[i].tuple);
+                batch[i].done.set_value(ok);
+                ++i;
+            } catch (...) {
+                // insertBatch fails as a whole; hand the error to every write it carried
+                size_t end = i + 1;
+                while (batch[i].kind == WriteKind::Insert && end < batch.size() && batch[end].kind == WriteKind::Insert) {
+                    ++end;
+                }
+                for (; i < end; ++i) {
+                    batch[i].done.set_exception(std::current_exception());
+                }
+            }
+        }
+    }
+}
+
+void StorageExecutor::forgetTable(const std::string& tablePath) {
+    for (auto& reader : readers) {
+        std::lock_guard<std::mutex> lock(reader->mutex);
+        reader->catalog.forget(tablePath);
+    }
+}
+
+ExecutorStats StorageExecutor::getStats() const {
+    ExecutorStats stats;
+    stats.reads = reads.load();
+    stats.writes = writes.load();
+    stats.writeBatches = writeBatches.load();
+    stats.batchedInserts = batchedInserts.load();
+    stats.pool = pool.getStats();
+    return stats;
+}
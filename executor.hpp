@@ -0,0 +1,105 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include "catalog.hpp"
+#include "FileMetaData.hpp"
+#include "tuple.hpp"
+#include "threadpool.hpp"
+
+class Storage;
+
+struct ExecutorStats {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t writeBatches = 0;     // Times a table's queued writes were applied together
+    uint64_t batchedInserts = 0;   // Inserts applied through insertBatch
+    ThreadPoolStats pool;
+};
+
+// Runs Storage operations on a work-stealing ThreadPool (see Storage::submitGet and friends).
+//
+// Reads run in parallel: each worker has its own table handles and metadata and reads
+// under a shared lock on the table, so lookups of independent keys scale with the workers.
+// Writes go through the Storage itself, which is not thread-safe, so they take turns on it
+// and hold the table's lock exclusively. Writes to a table are queued in submission order;
+// one task applies everything queued for the table when it runs, turning each run of
+// consecutive inserts into one insertBatch, so writes submitted close together share page
+// and header writes.
+//
+// Writes submitted before a read are not guaranteed to be applied when the read runs; wait
+// for their futures first. Do not call the synchronous Storage methods from other threads
+// while submitted work is in flight.
+class StorageExecutor {
+public:
+    StorageExecutor(Storage& storage, unsigned threads);
+    ~StorageExecutor(); // Finishes everything submitted
+    StorageExecutor(const StorageExecutor&) = delete;
+    StorageExecutor& operator=(const StorageExecutor&) = delete;
+
+    std::future<std::map<std::string, std::string>> get(const std::string& dbName, const std::string& tableName, const std::string& id);
+    std::future<bool> insert(const std::string& dbName, const std::string& tableName, const Tuple& tuple);
+    std::future<bool> remove(const std::string& dbName, const std::string& tableName, const std::string& id);
+    std::future<bool> update(const std::string& dbName, const std::string& tableName, const std::string& id, const Tuple& tuple);
+
+    // Closes the workers' handles on a table that is being deleted or replaced
+    void forgetTable(const std::string& tablePath);
+
+    ExecutorStats getStats() const;
+
+private:
+    enum class WriteKind { Insert, Delete, Update };
+
+    struct PendingWrite {
+        WriteKind kind;
+        std::string id;
+        Tuple tuple;
+        std::promise<bool> done;
+    };
+
+    struct WriteQueue {
+        std::vector<PendingWrite> writes;
+        bool scheduled = false;    // A task to apply them is queued or running
+    };
+
+    struct Reader {
+        std::mutex mutex;          // Uncontended except against forgetTable
+        Catalog catalog;
+        FileMetadata metadata;
+        explicit Reader(size_t fileBudget) : catalog(fileBudget) {}
+    };
+
+    using TableKey = std::pair<std::string, std::string>; // (db, table)
+
+    Storage& storage;
+    std::mutex engineMutex;        // One writer at a time in storage
+    std::vector<std::unique_ptr<Reader>> readers; // One per pool worker
+
+    std::mutex tableLocksMutex;
+    std::map<std::string, std::unique_ptr<std::shared_mutex>> tableLocks; // Table path -> lock
+
+    std::mutex writeMutex;
+    std::map<TableKey, WriteQueue> writeQueues;
+
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> writeBatches{0};
+    std::atomic<uint64_t> batchedInserts{0};
+
+    ThreadPool pool;               // Last, so the workers stop before the rest goes
+
+    std::shared_mutex& tableLock(const std::string& tablePath);
+    std::future<bool> queueWrite(const std::string& dbName, const std::string& tableName, PendingWrite write);
+    void applyWrites(const TableKey& table);
+};
+
+#endif // EXECUTOR_HPP
@@ -0,0 +1,217 @@
+#include "idfilter.hpp"
+#include "idindex.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+std::mutex IdFilter::registryMutex;
+std::map<std::string, std::shared_ptr<IdFilter>> IdFilter::registry;
+std::atomic<uint64_t> IdFilter::queries{0};
+std::atomic<uint64_t> IdFilter::negatives{0};
+std::atomic<uint64_t> IdFilter::falsePositives{0};
+std::atomic<uint64_t> IdFilter::rebuilds{0};
+
+namespace {
+
+const std::streamoff BLOCKS_OFFSET = IdFilter::BLOCK_BYTES; // Header padded to one block
+const int WORDS_PER_BLOCK = IdFilter::BLOCK_BYTES / sizeof(uint64_t);
+
+// splitmix64 finalizer; ids are often dense, so they need mixing before use
+uint64_t mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+} // namespace
+
+std::string IdFilter::pathForIndex(const std::string& indexPath) {
+    return fs::path(indexPath).replace_extension(".BLM").string();
+}
+
+std::shared_ptr<IdFilter> IdFilter::open(const std::string& indexPath, const IdIndex& index) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(indexPath);
+    if (it != registry.end()) {
+        return it->second;
+    }
+    std::shared_ptr<IdFilter> filter(new IdFilter(pathForIndex(indexPath)));
+    if (!filter->load(index.size())) {
+        filter->rebuild(index, std::max(MIN_CAPACITY, 2 * index.size()));
+    }
+    registry[indexPath] = filter;
+    return filter;
+}
+
+std::shared_ptr<IdFilter> IdFilter::find(const std::string& indexPath) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(indexPath);
+    return it == registry.end() ? nullptr : it->second;
+}
+
+void IdFilter::discard(const std::string& indexPath) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(indexPath);
+    if (it != registry.end()) {
+        it->second->retired = true;
+        if (it->second->file.is_open()) {
+            it->second->file.close();
+        }
+        registry.erase(it);
+    }
+    fs::remove(pathForIndex(indexPath));
+}
+
+IdFilterStats IdFilter::getStats() {
+    IdFilterStats stats;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        stats.tables = registry.size();
+        for (const auto& entry : registry) {
+            stats.bytes += entry.second->bits.size() * sizeof(uint64_t);
+        }
+    }
+    stats.queries = queries.load();
+    stats.negatives = negatives.load();
+    stats.falsePositives = falsePositives.load();
+    uint64_t absent = stats.negatives + stats.falsePositives;
+    stats.falsePositiveRate = absent > 0 ? static_cast<double>(stats.falsePositives) / absent : 0.0;
+    stats.rebuilds = rebuilds.load();
+    return stats;
+}
+
+uint64_t IdFilter::blockFor(uint64_t hash) const {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(hash) * header.blockCount) >> 64);
+}
+
+bool IdFilter::isRetired() const {
+    return retired.load();
+}
+
+// Probe positions come from a second mix of the hash by double hashing within the block
+bool IdFilter::mayContain(int64_t key) const {
+    if (retired) return true;
+    queries++;
+    uint64_t hash = mix(static_cast<uint64_t>(key));
+    const uint64_t* block = &bits[blockFor(hash) * WORDS_PER_BLOCK];
+    uint64_t probe = mix(hash);
+    uint32_t position = static_cast<uint32_t>(probe >> 32);
+    uint32_t step = static_cast<uint32_t>(probe) | 1;
+    for (int i = 0; i < PROBES; ++i, position += step) {
+        uint32_t bit = position & (BLOCK_BYTES * 8 - 1);
+        if (!(block[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+            negatives++;
+            return false;
+        }
+    }
+    return true;
+}
+
+void IdFilter::noteFalsePositive() const {
+    falsePositives++;
+}
+
+void IdFilter::setBits(int64_t key) {
+    uint64_t hash = mix(static_cast<uint64_t>(key));
+    uint64_t* block = &bits[blockFor(hash) * WORDS_PER_BLOCK];
+    uint64_t probe = mix(hash);
+    uint32_t position = static_cast<uint32_t>(probe >> 32);
+    uint32_t step = static_cast<uint32_t>(probe) | 1;
+    for (int i = 0; i < PROBES; ++i, position += step) {
+        uint32_t bit = position & (BLOCK_BYTES * 8 - 1);
+        block[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+}
+
+void IdFilter::add(int64_t key, uint64_t indexEntries, const IdIndex& index) {
+    if (retired) return;
+    if (header.keys >= header.capacity) {
+        rebuild(index, 2 * std::max(header.capacity, index.size()));
+    }
+    setBits(key);
+    header.keys++;
+    header.indexEntries = indexEntries;
+    uint64_t hash = mix(static_cast<uint64_t>(key));
+    writeBlock(blockFor(hash));
+    writeHeader();
+    file.flush();
+}
+
+void IdFilter::setIndexEntries(uint64_t indexEntries) {
+    if (retired) return;
+    header.indexEntries = indexEntries;
+    writeHeader();
+    file.flush();
+}
+
+bool IdFilter::load(uint64_t indexEntries) {
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        return false; // None yet, or removed with a replaced index
+    }
+    file.read(reinterpret_cast<char*>(&header), sizeof(FilterHeader));
+    if (!file || header.magic != FILTER_MAGIC || header.version != FILTER_VERSION || header.blockCount == 0 ||
+        header.indexEntries != indexEntries) {
+        file.close();
+        return false; // Does not match its index, so it is rebuilt
+    }
+    bits.assign(header.blockCount * WORDS_PER_BLOCK, 0);
+    file.seekg(BLOCKS_OFFSET, std::ios::beg);
+    file.read(reinterpret_cast<char*>(bits.data()), bits.size() * sizeof(uint64_t));
+    if (!file) {
+        std::cerr << "Error IdFilter load: Truncated filter file: " << path << std::endl;
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+// Sizes the filter for capacity ids and refills it from the index leaves
+void IdFilter::rebuild(const IdIndex& index, uint64_t capacity) {
+    header = {FILTER_MAGIC, FILTER_VERSION, 0, capacity, 0, index.size()};
+    header.blockCount = std::max<uint64_t>(1, (capacity * BITS_PER_KEY + BLOCK_BYTES * 8 - 1) / (BLOCK_BYTES * 8));
+    bits.assign(header.blockCount * WORDS_PER_BLOCK, 0);
+    for (IdIndex::Iterator it = index.begin(); it.valid(); it.next()) {
+        setBits(it.key());
+        header.keys++;
+    }
+    rebuilds++;
+    save();
+}
+
+bool IdFilter::save() {
+    if (file.is_open()) {
+        file.close();
+    }
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        char padded[BLOCK_BYTES] = {0};
+        std::memcpy(padded, &header, sizeof(FilterHeader));
+        out.write(padded, BLOCK_BYTES);
+        out.write(reinterpret_cast<const char*>(bits.data()), bits.size() * sizeof(uint64_t));
+        if (!out) {
+            std::cerr << "Error IdFilter save: Unable to write filter file: " << path << std::endl;
+            return false;
+        }
+    }
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    return file.is_open();
+}
+
+void IdFilter::writeHeader() {
+    file.clear();
+    file.seekp(0, std::ios::beg);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(FilterHeader));
+}
+
+void IdFilter::writeBlock(uint64_t block) {
+    file.clear();
+    file.seekp(BLOCKS_OFFSET + static_cast<std::streamoff>(block) * BLOCK_BYTES, std::ios::beg);
+    file.write(reinterpret_cast<const char*>(&bits[block * WORDS_PER_BLOCK]), BLOCK_BYTES);
+    if (!file) {
+        std::cerr << "Error IdFilter writeBlock: Failed to write block " << block << " of " << path << std::endl;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef IDFILTER_HPP
+#define IDFILTER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "memory.hpp"
+
+class IdIndex;
+
+struct IdFilterStats {
+    uint64_t tables = 0;            // Filters loaded in this process
+    uint64_t bytes = 0;             // Memory they use
+    uint64_t queries = 0;
+    uint64_t negatives = 0;         // Queries answered "absent" without touching the index
+    uint64_t falsePositives = 0;    // Queries the filter passed but the index did not have
+    double falsePositiveRate = 0;   // falsePositives / all queries for absent ids
+    uint64_t rebuilds = 0;          // Filters built from their index: missing, stale or outgrown
+};
+
+// Blocked Bloom filter over the ids in a table's id index, stored in <table>.BLM.
+// All probes for an id land in one 64-byte block, so a lookup touches a single cache line.
+// IdIndex keeps it in step: an id's bits are set and written before the index nodes that
+// hold the id, so the filter on disk never misses an id the index has. Deleted ids keep
+// their bits until the filter is rebuilt, which happens when it outgrows its capacity or
+// its recorded entry count disagrees with the index (a crash between the two writes).
+// Filters are shared process-wide per index path, so a negative answer needs no I/O.
+class IdFilter {
+public:
+    static const uint32_t FILTER_MAGIC = 0x464C4248; // "HBLF"
+    static const uint32_t FILTER_VERSION = 1;
+    static const int BLOCK_BYTES = 64;
+    static const int PROBES = 8;                     // Bits set per id within its block
+    static const int BITS_PER_KEY = 12;              // About 0.5% false positives at capacity
+    static const uint64_t MIN_CAPACITY = 1024;
+
+    struct FilterHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t blockCount;
+        uint64_t capacity;      // Ids it was sized for; rebuilt larger past this
+        uint64_t keys;          // Ids added since it was built, deleted ones included
+        uint64_t indexEntries;  // Index entry count when last written
+    };
+
+    static std::string pathForIndex(const std::string& indexPath);
+
+    // The filter for an open index: the shared one, else loaded from disk, else built from the index
+    static std::shared_ptr<IdFilter> open(const std::string& indexPath, const IdIndex& index);
+    // The shared filter if it is loaded, without any I/O
+    static std::shared_ptr<IdFilter> find(const std::string& indexPath);
+    // Drops the filter of an index that was replaced or removed, in memory and on disk
+    static void discard(const std::string& indexPath);
+    static IdFilterStats getStats();
+
+    IdFilter(const IdFilter&) = delete;
+    IdFilter& operator=(const IdFilter&) = delete;
+
+    bool mayContain(int64_t key) const;
+    bool isRetired() const;
+    void noteFalsePositive() const;
+    // Adds an id the index is about to store; indexEntries is the index size once it has
+    void add(int64_t key, uint64_t indexEntries, const IdIndex& index);
+    // Records the index size after an erase, so a reload does not take it for a crash
+    void setIndexEntries(uint64_t indexEntries);
+
+private:
+    std::string path;
+    FilterHeader header{};
+    std::vector<uint64_t, AccountingAllocator<uint64_t, MemoryComponent::IdFilters>> bits; // blockCount * 8 words
+    std::fstream file;
+    std::atomic<bool> retired{false}; // Discarded while an index still held it: answers "maybe"
+
+    static std::mutex registryMutex;
+    static std::map<std::string, std::shared_ptr<IdFilter>> registry;
+    static std::atomic<uint64_t> queries;
+    static std::atomic<uint64_t> negatives;
+    static std::atomic<uint64_t> falsePositives;
+    static std::atomic<uint64_t> rebuilds;
+
+    explicit IdFilter(const std::string& filterPath) : path(filterPath) {}
+    bool load(uint64_t indexEntries);
+    void rebuild(const IdIndex& index, uint64_t capacity);
+    void setBits(int64_t key);
+    uint64_t blockFor(uint64_t hash) const;
+    bool save();
+    void writeHeader();
+    void writeBlock(uint64_t block);
+};
+
+#endif // IDFILTER_HPP
@@ -0,0 +1,498 @@
+#include "idindex.hpp"
+#include "wal.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+IdIndex::~IdIndex() {
+    close();
+}
+
+std::string IdIndex::pathForTable(const std::string& tablePath) {
+    return fs::path(tablePath).replace_extension(".IDX").string();
+}
+
+bool IdIndex::open(const std::string& indexPath) {
+    close();
+    path = indexPath;
+
+    if (!fs::exists(path)) {
+        // Fresh index: header node plus a single empty root leaf
+        std::ofstream create(path, std::ios::binary | std::ios::trunc);
+        if (!create) {
+            std::cerr << "Error IdIndex open: Unable to create index file: " << path << std::endl;
+            return false;
+        }
+        create.close();
+
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error IdIndex open: Unable to open index file: " << path << std::endl;
+            return false;
+        }
+        header = {INDEX_MAGIC, INDEX_VERSION, 1, 2, 0, 1, 1};
+        IndexNode root{};
+        root.type = 1;
+        writeNode(1, root);
+        writeHeader();
+        IdFilter::discard(path); // Whatever filter is left belongs to a removed index
+        filter = IdFilter::open(path, *this);
+        return true;
+    }
+
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error IdIndex open: Unable to open index file: " << path << std::endl;
+        return false;
+    }
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(&header), sizeof(IndexHeader));
+    if (!file || header.magic != INDEX_MAGIC || header.version != INDEX_VERSION) {
+        std::cerr << "Error IdIndex open: Corrupted or outdated index header in " << path << std::endl;
+        file.close();
+        return false;
+    }
+    filter = IdFilter::open(path, *this);
+    return true;
+}
+
+bool IdIndex::refresh() {
+    IndexHeader current;
+    file.clear();
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(&current), sizeof(IndexHeader));
+    if (!file || current.magic != INDEX_MAGIC || current.version != INDEX_VERSION) {
+        return false;
+    }
+    header = current;
+    if (filter && filter->isRetired()) {
+        filter = IdFilter::open(path, *this); // Discarded since: take up the current one
+    }
+    return true;
+}
+
+void IdIndex::close() {
+    filter.reset();
+    if (file.is_open()) {
+        file.flush();
+        file.close();
+    }
+}
+
+bool IdIndex::isOpen() const {
+    return file.is_open();
+}
+
+uint64_t IdIndex::size() const {
+    return header.entryCount;
+}
+
+void IdIndex::readNode(uint64_t nodeID, IndexNode& node) const {
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(nodeID) * NODE_SIZE, std::ios::beg);
+    file.read(reinterpret_cast<char*>(&node), sizeof(IndexNode));
+    if (!file) {
+        throw std::runtime_error("Error IdIndex readNode: Failed to read node " + std::to_string(nodeID));
+    }
+}
+
+void IdIndex::writeNode(uint64_t nodeID, const IndexNode& node) {
+    char buffer[NODE_SIZE] = {0};
+    std::memcpy(buffer, &node, sizeof(IndexNode));
+    writeBlock(static_cast<std::streamoff>(nodeID) * NODE_SIZE, buffer);
+    if (!file) {
+        throw std::runtime_error("Error IdIndex writeNode: Failed to write node " + std::to_string(nodeID));
+    }
+}
+
+void IdIndex::writeHeader() {
+    char buffer[NODE_SIZE] = {0};
+    std::memcpy(buffer, &header, sizeof(IndexHeader));
+    writeBlock(0, buffer);
+    file.flush();
+}
+
+// Node writes of a logged table go through its redo log first
+void IdIndex::writeBlock(std::streamoff offset, const char* buffer) {
+    auto writeNow = [&]() {
+        file.clear();
+        file.seekp(offset, std::ios::beg);
+        file.write(buffer, NODE_SIZE);
+    };
+    if (WriteAheadLog* log = WriteAheadLog::find(path)) {
+        log->write(WriteAheadLog::INDEX_NODE, offset, buffer, NODE_SIZE, [&]() {
+            writeNow();
+            file.flush();
+        });
+    } else {
+        writeNow();
+    }
+}
+
+uint64_t IdIndex::findLeaf(int64_t key, std::vector<std::pair<uint64_t, int>>* path) const {
+    uint64_t nodeID = header.rootNode;
+    IndexNode node;
+    for (uint32_t level = 1; level < header.height; ++level) {
+        readNode(nodeID, node);
+        int child = std::upper_bound(node.keys, node.keys + node.count, key) - node.keys;
+        if (path) {
+            path->push_back({nodeID, child});
+        }
+        nodeID = node.values[child];
+    }
+    return nodeID;
+}
+
+int64_t IdIndex::find(int64_t key) const {
+    if (!isOpen()) return -1;
+    if (filter && !filter->mayContain(key)) {
+        return -1;
+    }
+    IndexNode leaf;
+    readNode(findLeaf(key, nullptr), leaf);
+    const int64_t* it = std::lower_bound(leaf.keys, leaf.keys + leaf.count, key);
+    if (it == leaf.keys + leaf.count || *it != key) {
+        if (filter) filter->noteFalsePositive();
+        return -1;
+    }
+    return leaf.values[it - leaf.keys];
+}
+
+int64_t IdIndex::findFloor(int64_t key, int64_t* floorKey) const {
+    if (!isOpen()) return -1;
+
+    std::vector<std::pair<uint64_t, int>> path;
+    IndexNode node;
+    readNode(findLeaf(key, &path), node);
+    int pos = std::upper_bound(node.keys, node.keys + node.count, key) - node.keys;
+
+    // Nothing <= key in this leaf: step to the rightmost leaf of the nearest left subtree
+    while (pos == 0) {
+        while (!path.empty() && path.back().second == 0) {
+            path.pop_back();
+        }
+        if (path.empty()) {
+            return -1;
+        }
+        path.back().second--;
+        readNode(path.back().first, node);
+        uint64_t child = node.values[path.back().second];
+        while (path.size() + 1 < header.height) {
+            readNode(child, node);
+            path.push_back({child, node.count});
+            child = node.values[node.count];
+        }
+        readNode(child, node);
+        pos = node.count;
+    }
+
+    if (floorKey) {
+        *floorKey = node.keys[pos - 1];
+    }
+    return node.values[pos - 1];
+}
+
+bool IdIndex::insert(int64_t key, int64_t value) {
+    if (!isOpen()) return false;
+
+    std::vector<std::pair<uint64_t, int>> path;
+    uint64_t leafID = findLeaf(key, &path);
+    IndexNode leaf;
+    readNode(leafID, leaf);
+
+    int pos = std::lower_bound(leaf.keys, leaf.keys + leaf.count, key) - leaf.keys;
+    if (pos < leaf.count && leaf.keys[pos] == key) {
+        leaf.values[pos] = value;
+        writeNode(leafID, leaf);
+        file.flush();
+        return true;
+    }
+
+    // The filter learns the key before any node holding it is written
+    if (filter) filter->add(key, header.entryCount + 1, *this);
+    header.entryCount++;
+    if (leaf.count < NODE_CAPACITY) {
+        std::memmove(leaf.keys + pos + 1, leaf.keys + pos, (leaf.count - pos) * sizeof(int64_t));
+        std::memmove(leaf.values + pos + 1, leaf.values + pos, (leaf.count - pos) * sizeof(int64_t));
+        leaf.keys[pos] = key;
+        leaf.values[pos] = value;
+        leaf.count++;
+        writeNode(leafID, leaf);
+        writeHeader();
+        return true;
+    }
+
+    // Leaf is full: split it in half and push the right half's first key up
+    std::vector<int64_t> keys(leaf.keys, leaf.keys + leaf.count);
+    std::vector<int64_t> values(leaf.values, leaf.values + leaf.count);
+    keys.insert(keys.begin() + pos, key);
+    values.insert(values.begin() + pos, value);
+
+    int leftCount = keys.size() / 2;
+    IndexNode right{};
+    right.type = 1;
+    right.count = keys.size() - leftCount;
+    right.next = leaf.next;
+    std::copy(keys.begin() + leftCount, keys.end(), right.keys);
+    std::copy(values.begin() + leftCount, values.end(), right.values);
+
+    uint64_t rightID = header.nodeCount++;
+    leaf.count = leftCount;
+    leaf.next = rightID;
+    std::copy(keys.begin(), keys.begin() + leftCount, leaf.keys);
+    std::copy(values.begin(), values.begin() + leftCount, leaf.values);
+
+    writeNode(leafID, leaf);
+    writeNode(rightID, right);
+    insertIntoParent(path, right.keys[0], rightID);
+    writeHeader();
+    return true;
+}
+
+void IdIndex::insertIntoParent(std::vector<std::pair<uint64_t, int>>& path, int64_t separator, uint64_t rightNode) {
+    if (path.empty()) {
+        IndexNode root{};
+        root.type = 2;
+        root.count = 1;
+        root.keys[0] = separator;
+        root.values[0] = header.rootNode;
+        root.values[1] = rightNode;
+        uint64_t rootID = header.nodeCount++;
+        writeNode(rootID, root);
+        header.rootNode = rootID;
+        header.height++;
+        return;
+    }
+
+    auto [parentID, childIndex] = path.back();
+    path.pop_back();
+
+    IndexNode parent;
+    readNode(parentID, parent);
+
+    std::vector<int64_t> keys(parent.keys, parent.keys + parent.count);
+    std::vector<int64_t> children(parent.values, parent.values + parent.count + 1);
+    keys.insert(keys.begin() + childIndex, separator);
+    children.insert(children.begin() + childIndex + 1, rightNode);
+
+    if (keys.size() <= static_cast<size_t>(NODE_CAPACITY)) {
+        parent.count = keys.size();
+        std::copy(keys.begin(), keys.end(), parent.keys);
+        std::copy(children.begin(), children.end(), parent.values);
+        writeNode(parentID, parent);
+        return;
+    }
+
+    // Internal split: the middle key moves up, it does not stay in either half
+    int mid = keys.size() / 2;
+    IndexNode right{};
+    right.type = 2;
+    right.count = keys.size() - mid - 1;
+    std::copy(keys.begin() + mid + 1, keys.end(), right.keys);
+    std::copy(children.begin() + mid + 1, children.end(), right.values);
+
+    parent.count = mid;
+    std::copy(keys.begin(), keys.begin() + mid, parent.keys);
+    std::copy(children.begin(), children.begin() + mid + 1, parent.values);
+
+    uint64_t rightID = header.nodeCount++;
+    writeNode(parentID, parent);
+    writeNode(rightID, right);
+    insertIntoParent(path, keys[mid], rightID);
+}
+
+bool IdIndex::erase(int64_t key) {
+    if (!isOpen()) return false;
+
+    // Leaves are not merged on underflow; a bulk rebuild compacts the tree
+    uint64_t leafID = findLeaf(key, nullptr);
+    IndexNode leaf;
+    readNode(leafID, leaf);
+    int pos = std::lower_bound(leaf.keys, leaf.keys + leaf.count, key) - leaf.keys;
+    if (pos == leaf.count || leaf.keys[pos] != key) {
+        return false;
+    }
+    std::memmove(leaf.keys + pos, leaf.keys + pos + 1, (leaf.count - pos - 1) * sizeof(int64_t));
+    std::memmove(leaf.values + pos, leaf.values + pos + 1, (leaf.count - pos - 1) * sizeof(int64_t));
+    leaf.count--;
+    header.entryCount--;
+    if (filter) filter->setIndexEntries(header.entryCount);
+    writeNode(leafID, leaf);
+    writeHeader();
+    return true;
+}
+
+size_t IdIndex::eraseBatch(const std::vector<int64_t>& keys) {
+    if (!isOpen()) return 0;
+
+    size_t erased = 0;
+    IndexNode leaf;
+    for (size_t i = 0; i < keys.size();) {
+        uint64_t leafID = findLeaf(keys[i], nullptr);
+        readNode(leafID, leaf);
+        // The keys up to the leaf's last one all live here; keys[i] past it is not in the index
+        size_t end = i;
+        while (end < keys.size() && leaf.count > 0 && keys[end] <= leaf.keys[leaf.count - 1]) ++end;
+        if (end == i) {
+            ++i;
+            continue;
+        }
+        uint16_t kept = 0;
+        size_t k = i;
+        for (uint16_t pos = 0; pos < leaf.count; ++pos) {
+            while (k < end && keys[k] < leaf.keys[pos]) ++k;
+            if (k < end && keys[k] == leaf.keys[pos]) continue;
+            leaf.keys[kept] = leaf.keys[pos];
+            leaf.values[kept] = leaf.values[pos];
+            ++kept;
+        }
+        if (kept != leaf.count) {
+            erased += leaf.count - kept;
+            leaf.count = kept;
+            writeNode(leafID, leaf);
+        }
+        i = end;
+    }
+    if (erased > 0) {
+        header.entryCount -= erased;
+        if (filter) filter->setIndexEntries(header.entryCount);
+        writeHeader();
+    }
+    return erased;
+}
+
+IdIndex::Iterator IdIndex::lowerBound(int64_t key) const {
+    Iterator it;
+    if (!isOpen()) return it;
+    it.index = this;
+    readNode(findLeaf(key, nullptr), it.leaf);
+    it.position = std::lower_bound(it.leaf.keys, it.leaf.keys + it.leaf.count, key) - it.leaf.keys;
+    it.atEnd = false;
+    it.skipExhaustedLeaves();
+    return it;
+}
+
+IdIndex::Iterator IdIndex::begin() const {
+    Iterator it;
+    if (!isOpen()) return it;
+    it.index = this;
+    readNode(header.firstLeaf, it.leaf);
+    it.position = 0;
+    it.atEnd = false;
+    it.skipExhaustedLeaves();
+    return it;
+}
+
+bool IdIndex::Iterator::valid() const {
+    return !atEnd;
+}
+
+int64_t IdIndex::Iterator::key() const {
+    return leaf.keys[position];
+}
+
+int64_t IdIndex::Iterator::value() const {
+    return leaf.values[position];
+}
+
+void IdIndex::Iterator::next() {
+    if (atEnd) return;
+    position++;
+    skipExhaustedLeaves();
+}
+
+void IdIndex::Iterator::skipExhaustedLeaves() {
+    while (position >= leaf.count) {
+        if (leaf.next == 0) {
+            atEnd = true;
+            return;
+        }
+        index->readNode(leaf.next, leaf);
+        position = 0;
+    }
+}
+
+IdIndex::BulkBuilder::BulkBuilder(const std::string& indexPath, double fill)
+    : out(indexPath, std::ios::binary | std::ios::trunc), fillFactor(fill) {
+    if (!out) {
+        throw std::runtime_error("Error IdIndex BulkBuilder: Unable to create index file: " + indexPath);
+    }
+    int capacity = static_cast<int>(NODE_CAPACITY * fillFactor);
+    leafCapacity = std::max(1, std::min(capacity, static_cast<int>(NODE_CAPACITY)));
+    current.type = 1;
+
+    // Reserve node 0 for the header, written once the root is known
+    char buffer[NODE_SIZE] = {0};
+    out.write(buffer, NODE_SIZE);
+}
+
+void IdIndex::BulkBuilder::writeNode(uint64_t nodeID, const IndexNode& node) {
+    char buffer[NODE_SIZE] = {0};
+    std::memcpy(buffer, &node, sizeof(IndexNode));
+    out.seekp(static_cast<std::streamoff>(nodeID) * NODE_SIZE, std::ios::beg);
+    out.write(buffer, NODE_SIZE);
+}
+
+void IdIndex::BulkBuilder::flushLeaf(bool hasNext) {
+    current.next = hasNext ? nextNode + 1 : 0;
+    levelNodes.push_back({current.keys[0], nextNode});
+    writeNode(nextNode++, current);
+    current = IndexNode{};
+    current.type = 1;
+}
+
+bool IdIndex::BulkBuilder::add(int64_t key, int64_t value) {
+    if (hasLastKey && key <= lastKey) {
+        std::cerr << "Error IdIndex BulkBuilder: Keys must be strictly increasing (" << lastKey
+                  << " then " << key << ").\n";
+        return false;
+    }
+    if (current.count == leafCapacity) {
+        flushLeaf(true);
+    }
+    current.keys[current.count] = key;
+    current.values[current.count] = value;
+    current.count++;
+    entryCount++;
+    lastKey = key;
+    hasLastKey = true;
+    return true;
+}
+
+bool IdIndex::BulkBuilder::finish() {
+    flushLeaf(false);
+
+    uint32_t height = 1;
+    uint32_t fanout = leafCapacity + 1;
+    while (levelNodes.size() > 1) {
+        std::vector<std::pair<int64_t, uint64_t>> parents;
+        for (size_t start = 0; start < levelNodes.size(); start += fanout) {
+            size_t end = std::min(start + fanout, levelNodes.size());
+            IndexNode node{};
+            node.type = 2;
+            node.count = end - start - 1;
+            for (size_t i = start; i < end; ++i) {
+                if (i > start) {
+                    node.keys[i - start - 1] = levelNodes[i].first;
+                }
+                node.values[i - start] = levelNodes[i].second;
+            }
+            parents.push_back({levelNodes[start].first, nextNode});
+            writeNode(nextNode++, node);
+        }
+        levelNodes.swap(parents);
+        height++;
+    }
+
+    IndexHeader header = {INDEX_MAGIC, INDEX_VERSION, levelNodes.front().second, nextNode, entryCount, 1, height};
+    char buffer[NODE_SIZE] = {0};
+    std::memcpy(buffer, &header, sizeof(IndexHeader));
+    out.seekp(0, std::ios::beg);
+    out.write(buffer, NODE_SIZE);
+    out.flush();
+    bool ok = static_cast<bool>(out);
+    out.close();
+    return ok;
+}
@@ -0,0 +1,120 @@
+#ifndef IDINDEX_HPP
+#define IDINDEX_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "idfilter.hpp"
+
+// Persistent B+tree mapping 64-bit tuple IDs to page IDs.
+// Lives next to the table file as <table>.IDX and is made of fixed 4 KB nodes.
+// Node 0 is the index header, leaves are chained left to right for ordered scans.
+// An IdFilter in <table>.BLM answers lookups of absent keys without reading nodes.
+class IdIndex {
+public:
+    static const int NODE_SIZE = 4096;
+    static const int NODE_CAPACITY = 254;       // Keys per node (leaf or internal)
+    static const uint32_t INDEX_MAGIC = 0x58444948; // "HIDX"
+    static const uint32_t INDEX_VERSION = 2;    // 64-bit keys, values and node numbers
+
+    struct IndexHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t rootNode;
+        uint64_t nodeCount;
+        uint64_t entryCount;
+        uint64_t firstLeaf;
+        uint32_t height;        // 1 = root is a leaf
+    };
+
+    struct IndexNode {
+        uint16_t type;          // 1 = leaf, 2 = internal
+        uint16_t count;         // Number of keys
+        uint32_t unused;
+        uint64_t next;          // Next leaf (0 = none), unused for internal nodes
+        int64_t keys[NODE_CAPACITY];
+        int64_t values[NODE_CAPACITY + 1]; // Page IDs for leaves, child nodes for internal nodes
+    };
+
+    // Forward iterator over the leaf chain, used for ordered range walks.
+    class Iterator {
+    public:
+        Iterator() = default;
+        bool valid() const;
+        int64_t key() const;
+        int64_t value() const;
+        void next();
+
+    private:
+        friend class IdIndex;
+        const IdIndex* index = nullptr;
+        IndexNode leaf{};
+        uint16_t position = 0;
+        bool atEnd = true;
+        void skipExhaustedLeaves();
+    };
+
+    // Writes a complete index bottom-up from a stream of strictly increasing keys.
+    // Leaves are written sequentially as they fill, internal levels are built once at finish().
+    class BulkBuilder {
+    public:
+        BulkBuilder(const std::string& indexPath, double fillFactor);
+        bool add(int64_t key, int64_t value);
+        bool finish();
+
+    private:
+        std::ofstream out;
+        IndexNode current{};
+        uint64_t nextNode = 1;
+        uint64_t entryCount = 0;
+        uint32_t leafCapacity;
+        bool hasLastKey = false;
+        int64_t lastKey = 0;
+        std::vector<std::pair<int64_t, uint64_t>> levelNodes; // (first key, node) of the level being built
+        double fillFactor;
+        void flushLeaf(bool hasNext);
+        void writeNode(uint64_t nodeID, const IndexNode& node);
+    };
+
+    IdIndex() = default;
+    ~IdIndex();
+    IdIndex(const IdIndex&) = delete;
+    IdIndex& operator=(const IdIndex&) = delete;
+
+    static std::string pathForTable(const std::string& tablePath);
+
+    bool open(const std::string& indexPath);
+    // Re-reads the header of an open index, for when another handle may have written to it
+    bool refresh();
+    void close();
+    bool isOpen() const;
+
+    int64_t find(int64_t key) const;            // Page ID, or -1 if the key is absent
+    int64_t findFloor(int64_t key, int64_t* floorKey = nullptr) const; // Page ID of the largest key <= argument, or -1
+    bool insert(int64_t key, int64_t value);    // Inserts or overwrites
+    bool erase(int64_t key);
+    // Erases sorted keys, writing each leaf they touch and the header once; returns how many were present
+    size_t eraseBatch(const std::vector<int64_t>& keys);
+    Iterator lowerBound(int64_t key) const;     // First entry with key >= argument
+    Iterator begin() const;
+    uint64_t size() const;
+
+private:
+    mutable std::fstream file;
+    std::string path;
+    IndexHeader header{};
+    std::shared_ptr<IdFilter> filter;
+
+    void readNode(uint64_t nodeID, IndexNode& node) const;
+    void writeNode(uint64_t nodeID, const IndexNode& node);
+    void writeHeader();
+    void writeBlock(std::streamoff offset, const char* buffer);
+    uint64_t findLeaf(int64_t key, std::vector<std::pair<uint64_t, int>>* path) const;
+    void insertIntoParent(std::vector<std::pair<uint64_t, int>>& path, int64_t separator, uint64_t rightNode);
+};
+
+#endif // IDINDEX_HPP
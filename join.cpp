@@ -0,0 +1,286 @@
+#include "join.hpp"
+#include "tablefile.hpp"
+#include "schema.hpp"
+#include "projection.hpp"
+#include "FileMetaData.hpp"
+#include "page.hpp"
+#include "overflow.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+uint64_t hashKey(std::string_view key) {
+    return std::hash<std::string_view>()(key);
+}
+
+void writeRecord(std::ofstream& out, std::string_view key, const std::string& row) {
+    uint32_t keyLength = key.size();
+    uint32_t rowLength = row.size();
+    out.write(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+    out.write(key.data(), keyLength);
+    out.write(reinterpret_cast<const char*>(&rowLength), sizeof(rowLength));
+    out.write(row.data(), rowLength);
+}
+
+bool readRecord(std::ifstream& in, std::string& key, std::string& row) {
+    uint32_t keyLength, rowLength;
+    if (!in.read(reinterpret_cast<char*>(&keyLength), sizeof(keyLength))) return false;
+    key.resize(keyLength);
+    in.read(&key[0], keyLength);
+    in.read(reinterpret_cast<char*>(&rowLength), sizeof(rowLength));
+    row.resize(rowLength);
+    return static_cast<bool>(in.read(&row[0], rowLength));
+}
+
+} // namespace
+
+void HashJoin::HashTable::add(uint64_t hash, std::string key, std::string row) {
+    entries.push_back({hash, std::move(key), std::move(row), UINT32_MAX});
+}
+
+void HashJoin::HashTable::build() {
+    size_t bucketCount = 16;
+    while (bucketCount < entries.size()) {
+        bucketCount *= 2;
+    }
+    buckets.assign(bucketCount, UINT32_MAX);
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        uint32_t& head = buckets[entries[i].hash & (bucketCount - 1)];
+        entries[i].next = head;
+        head = i;
+    }
+}
+
+void HashJoin::HashTable::clear() {
+    entries.clear();
+    buckets.clear();
+}
+
+size_t HashJoin::HashTable::size() const {
+    return entries.size();
+}
+
+template <typename Match>
+bool HashJoin::HashTable::probe(uint64_t hash, std::string_view key, Match match) const {
+    if (buckets.empty()) {
+        return true;
+    }
+    for (uint32_t i = buckets[hash & (buckets.size() - 1)]; i != UINT32_MAX; i = entries[i].next) {
+        const Entry& entry = entries[i];
+        if (entry.hash == hash && entry.key == key && !match(entry.row)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Visit>
+void HashJoin::HashTable::forEach(Visit visit) const {
+    for (const Entry& entry : entries) {
+        visit(entry.hash, entry.key, entry.row);
+    }
+}
+
+HashJoin::HashJoin(const std::string& dbName, const std::string& leftTable, const std::string& leftCol,
+                   const std::string& rightTable, const std::string& rightCol, const JoinOptions& opts)
+    : leftPath(dbName + "/" + leftTable + ".HAD"), rightPath(dbName + "/" + rightTable + ".HAD"),
+      leftColumn(leftCol), rightColumn(rightCol), options(opts) {
+    std::string tempDir = options.tempDir.empty() ? dbName : options.tempDir;
+    tempPrefix = tempDir + "/" + leftTable + "_" + rightTable + ".join";
+}
+
+const JoinStats& HashJoin::getStats() const {
+    return stats;
+}
+
+bool HashJoin::checkColumns() {
+    uint64_t pages[2];
+    ColumnType types[2];
+    const std::string* paths[2] = {&leftPath, &rightPath};
+    const std::string* columns[2] = {&leftColumn, &rightColumn};
+    for (int side = 0; side < 2; ++side) {
+        TableFile file(*paths[side], false);
+        if (!file.isOpen()) {
+            std::cerr << "Error join: Table does not exist: " << *paths[side] << std::endl;
+            return false;
+        }
+        FileMetadata metadata;
+        try {
+            metadata.deserialize(file);
+        } catch (const std::exception& e) {
+            std::cerr << "Error join: " << e.what() << std::endl;
+            return false;
+        }
+        CompiledSchema schema(metadata.getSchema());
+        int ordinal = schema.ordinalOf(*columns[side]);
+        if (ordinal == CompiledSchema::NO_COLUMN) {
+            std::cerr << "Error join: Column " << *columns[side] << " is not in " << *paths[side] << std::endl;
+            return false;
+        }
+        types[side] = schema.getColumn(ordinal).type;
+        pages[side] = metadata.getPageCount() - metadata.getMetadataPageCount();
+    }
+    if (types[0] != types[1]) {
+        std::cerr << "Error join: " << leftColumn << " is " << CompiledSchema::typeName(types[0]) << " but "
+                  << rightColumn << " is " << CompiledSchema::typeName(types[1]) << std::endl;
+        return false;
+    }
+    stats = JoinStats();
+    stats.buildIsLeft = pages[0] <= pages[1];
+    return true;
+}
+
+bool HashJoin::scanTable(const std::string& tablePath, const std::function<bool(const std::string&)>& visit) {
+    TableFile file(tablePath, false);
+    FileMetadata metadata;
+    metadata.deserialize(file);
+    Page page(0);
+    std::string row;
+    for (uint64_t pageID = 0; pageID < metadata.getPageCount(); ++pageID) {
+        file.readPage(metadata, pageID, page); // Overflow and header pages come back without rows
+        for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+            if (page.getSlot(i).length == 0) continue; // Deleted slot
+            row = page.getTupleData(i);
+            // Rows are emitted whole, so long values are read back from their overflow pages
+            if (OverflowStore::hasPointers(row) && !OverflowStore::resolveRow(file, metadata, row)) {
+                throw std::runtime_error("unable to read the overflow pages of a row in " + tablePath);
+            }
+            if (!visit(row)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool HashJoin::emitPair(const Emit& emit, const std::string& buildRow, const std::string& probeRow, bool& stopped) {
+    stats.outputRows++;
+    bool more = stats.buildIsLeft ? emit(buildRow, probeRow) : emit(probeRow, buildRow);
+    stopped = !more;
+    return more;
+}
+
+std::string HashJoin::spillPath(bool build, size_t partition) const {
+    return tempPrefix + (build ? ".b" : ".p") + std::to_string(partition) + ".tmp";
+}
+
+void HashJoin::removeSpills() {
+    for (const std::string& path : spillPaths) {
+        std::filesystem::remove(path);
+    }
+    spillPaths.clear();
+}
+
+bool HashJoin::run(const Emit& emit) {
+    if (!checkColumns()) {
+        return false;
+    }
+    const std::string& buildPath = stats.buildIsLeft ? leftPath : rightPath;
+    const std::string& probePath = stats.buildIsLeft ? rightPath : leftPath;
+    const std::string& buildColumn = stats.buildIsLeft ? leftColumn : rightColumn;
+    const std::string& probeColumn = stats.buildIsLeft ? rightColumn : leftColumn;
+    const unsigned bits = std::min(options.partitionBits, 16u);
+    const size_t partitionCount = size_t(1) << bits;
+    auto partitionOf = [bits](uint64_t hash) { return bits == 0 ? 0 : hash >> (64 - bits); };
+
+    HashTable table;
+    size_t buildBytes = 0;
+    std::vector<std::unique_ptr<std::ofstream>> partitions;
+    auto closePartitions = [&]() {
+        for (auto& partition : partitions) {
+            partition->close();
+            if (!*partition) {
+                throw std::runtime_error("unable to write join partition");
+            }
+        }
+        partitions.clear();
+    };
+    auto openPartitions = [&](bool build) {
+        closePartitions();
+        for (size_t p = 0; p < partitionCount; ++p) {
+            spillPaths.push_back(spillPath(build, p));
+            partitions.push_back(std::make_unique<std::ofstream>(spillPaths.back(), std::ios::binary | std::ios::trunc));
+            if (!*partitions.back()) {
+                throw std::runtime_error("unable to create join partition " + spillPaths.back());
+            }
+        }
+    };
+
+    bool stopped = false;
+    try {
+        // Build side: in memory until the budget is exceeded, then radix partitions on disk
+        bool spilled = false;
+        scanTable(buildPath, [&](const std::string& row) {
+            std::string_view key;
+            if (!Projection::readValue(row, buildColumn, key)) return true;
+            uint64_t hash = hashKey(key);
+            stats.buildRows++;
+            if (spilled) {
+                writeRecord(*partitions[partitionOf(hash)], key, row);
+                return true;
+            }
+            buildBytes += key.size() + row.size() + sizeof(uint64_t) * 8;
+            table.add(hash, std::string(key), row);
+            if (buildBytes > options.memoryBudget) {
+                openPartitions(true);
+                table.forEach([&](uint64_t entryHash, const std::string& entryKey, const std::string& entryRow) {
+                    writeRecord(*partitions[partitionOf(entryHash)], entryKey, entryRow);
+                });
+                table.clear();
+                spilled = true;
+            }
+            return true;
+        });
+
+        if (!spilled) {
+            table.build();
+            scanTable(probePath, [&](const std::string& row) {
+                std::string_view key;
+                if (!Projection::readValue(row, probeColumn, key)) return true;
+                stats.probeRows++;
+                return table.probe(hashKey(key), key, [&](const std::string& buildRow) {
+                    return emitPair(emit, buildRow, row, stopped);
+                });
+            });
+            return true;
+        }
+
+        // Partition the probe side with the same hash bits, then join one partition pair at a time
+        openPartitions(false);
+        scanTable(probePath, [&](const std::string& row) {
+            std::string_view key;
+            if (!Projection::readValue(row, probeColumn, key)) return true;
+            stats.probeRows++;
+            writeRecord(*partitions[partitionOf(hashKey(key))], key, row);
+            return true;
+        });
+        closePartitions();
+        stats.partitionsSpilled = partitionCount;
+
+        std::string key, row;
+        for (size_t p = 0; p < partitionCount && !stopped; ++p) {
+            std::ifstream buildIn(spillPath(true, p), std::ios::binary);
+            while (readRecord(buildIn, key, row)) {
+                table.add(hashKey(key), key, row);
+            }
+            if (table.size() == 0) continue;
+            table.build();
+            std::ifstream probeIn(spillPath(false, p), std::ios::binary);
+            while (!stopped && readRecord(probeIn, key, row)) {
+                table.probe(hashKey(key), key, [&](const std::string& buildRow) {
+                    return emitPair(emit, buildRow, row, stopped);
+                });
+            }
+            table.clear();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error join: " << e.what() << std::endl;
+        removeSpills();
+        return false;
+    }
+    removeSpills();
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef JOIN_HPP
+#define JOIN_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+struct JoinOptions {
+    size_t memoryBudget = 64 * 1024 * 1024;  // Bytes of build rows held in memory before partitions spill
+    unsigned partitionBits = 5;              // 2^bits radix partitions when spilling
+    std::string tempDir;                     // Where spilled partitions go, defaults to the database folder
+};
+
+struct JoinStats {
+    uint64_t buildRows = 0;
+    uint64_t probeRows = 0;
+    uint64_t outputRows = 0;
+    uint32_t partitionsSpilled = 0;
+    bool buildIsLeft = false;
+};
+
+// Equi-join of two tables in the same database: left.leftColumn = right.rightColumn.
+// The table with fewer pages is the build side and goes into an in-memory hash table; the
+// other is streamed past it. If the build rows outgrow the memory budget, both inputs are
+// radix-partitioned on the key hash into temporary files and joined one partition pair at a
+// time (grace hash join). Keys compare as their stored text, so both columns must have the
+// same type. Rows are passed to emit in their serialized key(type|value) form, left first.
+class HashJoin {
+public:
+    using Emit = std::function<bool(const std::string& leftRow, const std::string& rightRow)>;
+
+    HashJoin(const std::string& dbName, const std::string& leftTable, const std::string& leftColumn,
+             const std::string& rightTable, const std::string& rightColumn, const JoinOptions& options = JoinOptions());
+
+    // Calls emit for every matching pair; emit may return false to stop early
+    bool run(const Emit& emit);
+    const JoinStats& getStats() const;
+
+private:
+    // Build rows of one partition, chained by key hash
+    class HashTable {
+    public:
+        void add(uint64_t hash, std::string key, std::string row);
+        void build();
+        void clear();
+        size_t size() const;
+        // Calls match(row) for every build row with this key
+        template <typename Match>
+        bool probe(uint64_t hash, std::string_view key, Match match) const;
+        // Calls visit(hash, key, row) for every build row, in insertion order
+        template <typename Visit>
+        void forEach(Visit visit) const;
+
+    private:
+        struct Entry {
+            uint64_t hash;
+            std::string key;
+            std::string row;
+            uint32_t next;
+        };
+        std::vector<Entry> entries;
+        std::vector<uint32_t> buckets;
+    };
+
+    std::string leftPath, rightPath;
+    std::string leftColumn, rightColumn;
+    std::string tempPrefix;
+    JoinOptions options;
+    JoinStats stats;
+    std::vector<std::string> spillPaths;
+
+    bool checkColumns();
+    bool scanTable(const std::string& tablePath, const std::function<bool(const std::string&)>& visit);
+    bool emitPair(const Emit& emit, const std::string& buildRow, const std::string& probeRow, bool& stopped);
+    std::string spillPath(bool build, size_t partition) const;
+    void removeSpills();
+};
+
+#endif // JOIN_HPP
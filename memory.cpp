@@ -0,0 +1,187 @@
+#include "memory.hpp"
+#include <algorithm>
+
+// Changes this thread has not published yet; published when the thread exits too
+struct ThreadMemoryDeltas {
+    int64_t delta[MemoryGovernor::COMPONENTS] = {0};
+
+    ~ThreadMemoryDeltas() {
+        for (size_t c = 0; c < MemoryGovernor::COMPONENTS; ++c) {
+            if (delta[c] != 0) {
+                MemoryGovernor::getInstance().publish(static_cast<MemoryComponent>(c), delta[c]);
+            }
+        }
+    }
+};
+
+namespace {
+thread_local ThreadMemoryDeltas threadDeltas;
+}
+
+MemoryGovernor::MemoryGovernor() {
+    for (auto& count : bytes) {
+        count = 0;
+    }
+}
+
+MemoryGovernor& MemoryGovernor::getInstance() {
+    // Never destroyed, so threads exiting after main can still publish
+    static MemoryGovernor* instance = new MemoryGovernor();
+    return *instance;
+}
+
+const char* MemoryGovernor::componentName(MemoryComponent component) {
+    switch (component) {
+        case MemoryComponent::Pages: return "pages";
+        case MemoryComponent::Tuples: return "tuples";
+        case MemoryComponent::Metadata: return "metadata";
+        case MemoryComponent::IdFilters: return "idfilters";
+        case MemoryComponent::RowCache: return "rowcache";
+        default: return "unknown";
+    }
+}
+
+void MemoryGovernor::charge(MemoryComponent component, size_t size) {
+    int64_t& delta = threadDeltas.delta[static_cast<size_t>(component)];
+    delta += static_cast<int64_t>(size);
+    if (delta >= FLUSH_BYTES) {
+        int64_t published = delta;
+        delta = 0;
+        getInstance().publish(component, published);
+    }
+}
+
+void MemoryGovernor::release(MemoryComponent component, size_t size) {
+    int64_t& delta = threadDeltas.delta[static_cast<size_t>(component)];
+    delta -= static_cast<int64_t>(size);
+    if (delta <= -FLUSH_BYTES) {
+        int64_t published = delta;
+        delta = 0;
+        getInstance().publish(component, published);
+    }
+}
+
+void MemoryGovernor::publish(MemoryComponent component, int64_t delta) {
+    bytes[static_cast<size_t>(component)] += delta;
+    int64_t now = total += delta;
+    int64_t highest = peak.load();
+    while (now > highest && !peak.compare_exchange_weak(highest, now)) {
+    }
+    size_t limit = budget.load();
+    if (delta > 0 && limit > 0 && now > static_cast<int64_t>(limit)) {
+        reclaim();
+    }
+}
+
+void MemoryGovernor::reclaim() {
+    std::unique_lock<std::mutex> turn(reclaimMutex, std::try_to_lock);
+    if (!turn.owns_lock()) {
+        return; // Another thread is already shrinking the caches
+    }
+    size_t limit = budget.load();
+    if (limit == 0 || total.load() <= static_cast<int64_t>(limit)) {
+        return;
+    }
+    reclaims++;
+    // Held while the reclaimers run so none of them can be unregistered mid-call
+    std::lock_guard<std::mutex> lock(reclaimerMutex);
+    for (auto& [handle, reclaimer] : reclaimers) {
+        // The reclaimer's releases land in this thread's deltas; publish them to see the new total
+        size_t freed = reclaimer(static_cast<size_t>(total.load() - static_cast<int64_t>(limit)));
+        reclaimedBytes += freed;
+        publishThread(true);
+        if (total.load() <= static_cast<int64_t>(limit)) {
+            return;
+        }
+    }
+    overBudget++;
+}
+
+// Publishes this thread's pending changes without reclaiming
+void MemoryGovernor::publishThread(bool releasesOnly) {
+    for (size_t c = 0; c < COMPONENTS; ++c) {
+        int64_t delta = threadDeltas.delta[c];
+        if (delta < 0 || (delta > 0 && !releasesOnly)) {
+            bytes[c] += delta;
+            int64_t now = total += delta;
+            int64_t highest = peak.load();
+            while (now > highest && !peak.compare_exchange_weak(highest, now)) {
+            }
+            threadDeltas.delta[c] = 0;
+        }
+    }
+}
+
+void MemoryGovernor::setBudget(size_t size) {
+    budget = size;
+    if (size > 0 && total.load() > static_cast<int64_t>(size)) {
+        reclaim();
+    }
+}
+
+size_t MemoryGovernor::getBudget() const {
+    return budget.load();
+}
+
+uint64_t MemoryGovernor::registerReclaimer(Reclaimer reclaimer) {
+    std::lock_guard<std::mutex> lock(reclaimerMutex);
+    uint64_t handle = nextHandle++;
+    reclaimers.emplace_back(handle, std::move(reclaimer));
+    return handle;
+}
+
+void MemoryGovernor::unregisterReclaimer(uint64_t handle) {
+    std::lock_guard<std::mutex> lock(reclaimerMutex);
+    for (auto it = reclaimers.begin(); it != reclaimers.end(); ++it) {
+        if (it->first == handle) {
+            reclaimers.erase(it);
+            return;
+        }
+    }
+}
+
+MemoryStats MemoryGovernor::getStats() {
+    publishThread(false);
+    MemoryStats stats;
+    stats.budgetBytes = budget.load();
+    stats.totalBytes = static_cast<uint64_t>(std::max<int64_t>(0, total.load()));
+    stats.peakBytes = static_cast<uint64_t>(std::max<int64_t>(0, peak.load()));
+    stats.reclaims = reclaims.load();
+    stats.reclaimedBytes = reclaimedBytes.load();
+    stats.overBudget = overBudget.load();
+    for (size_t c = 0; c < COMPONENTS; ++c) {
+        // Unpublished releases on other threads can briefly leave a count below zero
+        stats.components[componentName(static_cast<MemoryComponent>(c))] =
+            static_cast<uint64_t>(std::max<int64_t>(0, bytes[c].load()));
+    }
+    return stats;
+}
+
+MemoryCharge& MemoryCharge::operator=(const MemoryCharge& other) {
+    if (this != &other) {
+        set(0);
+        component = other.component;
+        set(other.bytes);
+    }
+    return *this;
+}
+
+void MemoryCharge::set(size_t newBytes) {
+    if (newBytes > bytes) {
+        MemoryGovernor::charge(component, newBytes - bytes);
+    } else if (newBytes < bytes) {
+        MemoryGovernor::release(component, bytes - newBytes);
+    }
+    bytes = newBytes;
+}
+
+size_t mapMemoryBytes(const std::map<std::string, std::string>& map) {
+    size_t size = 0;
+    for (const auto& [key, value] : map) {
+        // Red-black node header plus the two strings; short strings live inside the node
+        size += 32 + sizeof(std::string) * 2;
+        if (key.size() > 15) size += key.capacity() + 1;
+        if (value.size() > 15) size += value.capacity() + 1;
+    }
+    return size;
+}
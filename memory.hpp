@@ -0,0 +1,143 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// What engine memory is held for; the governor keeps one byte count per component
+enum class MemoryComponent : uint8_t {
+    Pages = 0,      // Page images and slot directories
+    Tuples,         // Tuple attribute lists
+    Metadata,       // Table schemas held by headers and the catalog
+    IdFilters,      // Bloom filter bits
+    RowCache,       // Decoded rows cached for get
+    Count
+};
+
+struct MemoryStats {
+    uint64_t budgetBytes = 0;       // 0 = no budget
+    uint64_t totalBytes = 0;
+    uint64_t peakBytes = 0;
+    uint64_t reclaims = 0;          // Times the caches were asked to shrink
+    uint64_t reclaimedBytes = 0;
+    uint64_t overBudget = 0;        // Reclaims that could not get back under the budget
+    std::map<std::string, uint64_t> components; // Component name -> bytes
+};
+
+// Process-wide accounting of engine memory by component, with an optional total budget.
+// Allocations report through AccountingAllocator or MemoryCharge. Each thread batches its
+// changes and publishes them once they pass FLUSH_BYTES, so the counts may lag by that much
+// per thread and component. When a publish takes the total over the budget, the registered
+// reclaimers (caches) are asked, in registration order, to give back the excess.
+// Memory that is not a cache cannot be refused; it only shows up in the stats.
+class MemoryGovernor {
+public:
+    static const int64_t FLUSH_BYTES = 64 * 1024;
+    // Frees up to the given bytes and returns how many it freed. Runs on whichever thread
+    // crossed the budget, possibly inside an allocation. A reclaimer may block on its own
+    // locks only if its owner never charges or releases memory while holding them, since
+    // that thread would then reclaim into a lock it already holds (RowCache asserts this).
+    using Reclaimer = std::function<size_t(size_t bytes)>;
+
+    static MemoryGovernor& getInstance();
+    static const char* componentName(MemoryComponent component);
+
+    MemoryGovernor(const MemoryGovernor&) = delete;
+    MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+    void setBudget(size_t bytes); // Reclaims right away if already over
+    size_t getBudget() const;
+
+    // Batched per thread; the hot path is a thread-local add
+    static void charge(MemoryComponent component, size_t bytes);
+    static void release(MemoryComponent component, size_t bytes);
+
+    uint64_t registerReclaimer(Reclaimer reclaimer);
+    void unregisterReclaimer(uint64_t handle);
+
+    // Publishes the calling thread's pending changes first, so its own work shows exactly
+    MemoryStats getStats();
+
+private:
+    static const size_t COMPONENTS = static_cast<size_t>(MemoryComponent::Count);
+
+    std::atomic<int64_t> bytes[COMPONENTS];
+    std::atomic<int64_t> total{0};
+    std::atomic<int64_t> peak{0};
+    std::atomic<size_t> budget{0};
+    std::atomic<uint64_t> reclaims{0};
+    std::atomic<uint64_t> reclaimedBytes{0};
+    std::atomic<uint64_t> overBudget{0};
+
+    mutable std::mutex reclaimerMutex;
+    std::vector<std::pair<uint64_t, Reclaimer>> reclaimers;
+    uint64_t nextHandle = 1;
+    std::mutex reclaimMutex;        // One thread reclaims at a time; others carry on
+
+    MemoryGovernor();
+    friend struct ThreadMemoryDeltas;
+    void publish(MemoryComponent component, int64_t delta);
+    void reclaim();
+    void publishThread(bool releasesOnly);
+};
+
+// Allocator for standard containers that reports what it holds to the governor
+template <typename T, MemoryComponent C>
+class AccountingAllocator {
+public:
+    using value_type = T;
+    template <typename U>
+    struct rebind {
+        using other = AccountingAllocator<U, C>;
+    };
+
+    AccountingAllocator() noexcept = default;
+    template <typename U>
+    AccountingAllocator(const AccountingAllocator<U, C>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        MemoryGovernor::charge(C, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        std::allocator<T>().deallocate(p, n);
+        MemoryGovernor::release(C, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const AccountingAllocator<U, C>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AccountingAllocator<U, C>&) const noexcept { return false; }
+};
+
+// Charge held by an object whose memory is estimated rather than allocated through an
+// AccountingAllocator (e.g. a std::map that is part of a public signature)
+class MemoryCharge {
+public:
+    explicit MemoryCharge(MemoryComponent component) : component(component) {}
+    MemoryCharge(const MemoryCharge& other) : component(other.component) { set(other.bytes); }
+    MemoryCharge& operator=(const MemoryCharge& other);
+    ~MemoryCharge() { set(0); }
+
+    void set(size_t newBytes);
+    size_t get() const { return bytes; }
+
+private:
+    MemoryComponent component;
+    size_t bytes = 0;
+};
+
+// Estimated heap bytes of a string map: the node and both strings' buffers
+size_t mapMemoryBytes(const std::map<std::string, std::string>& map);
+
+#endif // MEMORY_HPP
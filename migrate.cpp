@@ -0,0 +1,354 @@
+#include "migrate.hpp"
+#include "tablefile.hpp"
+#include "tuple.hpp"
+#include "idindex.hpp"
+#include "projection.hpp"
+#include "overflow.hpp"
+#include <algorithm>
+
+namespace {
+
+const int V1_RESERVED_SIZE = 508;
+const char V1_FLAG_CLUSTERED = 0x01; // reserved[0], same bit the current format uses
+
+} // namespace
+
+TableMigration::TableMigration(const std::string& path) : tablePath(path) {}
+
+const MigrationStats& TableMigration::getStats() const {
+    return stats;
+}
+
+bool TableMigration::readHeader(std::ifstream& in, std::map<std::string, std::string>& schema, uint16_t& pageCount, char* reserved) {
+    in.seekg(0, std::ios::beg);
+    uint16_t schemaSize;
+    in.read(reinterpret_cast<char*>(&schemaSize), sizeof(schemaSize));
+    for (uint16_t i = 0; in && i < schemaSize; ++i) {
+        uint16_t keySize, valueSize;
+        in.read(reinterpret_cast<char*>(&keySize), sizeof(keySize));
+        std::string key(keySize, '\0');
+        in.read(&key[0], keySize);
+        in.read(reinterpret_cast<char*>(&valueSize), sizeof(valueSize));
+        std::string value(valueSize, '\0');
+        in.read(&value[0], valueSize);
+        schema[key] = value;
+    }
+    in.read(reinterpret_cast<char*>(&pageCount), sizeof(pageCount));
+    in.read(reserved, V1_RESERVED_SIZE);
+    // The legacy tuple map that follows is not needed, the index is rebuilt from the rows
+    if (!in || in.tellg() > FileMetadata::METADATA_SIZE) {
+        std::cerr << "Error migrateTable: Version 1 header of " << tablePath << " is truncated or corrupt.\n";
+        return false;
+    }
+    return true;
+}
+
+bool TableMigration::readPageRows(std::ifstream& in, uint16_t pageID, std::vector<std::string>& rows) {
+    char image[PAGE_SIZE];
+    in.clear();
+    in.seekg(FileMetadata::METADATA_SIZE + static_cast<std::streamoff>(pageID) * PAGE_SIZE, std::ios::beg);
+    if (!in.read(image, PAGE_SIZE)) {
+        std::cerr << "Error migrateTable: Failed to read version 1 page " << pageID << ".\n";
+        return false;
+    }
+    stats.pagesRead++;
+
+    const size_t headerSize = sizeof(V1PageMetadata) + sizeof(uint16_t);
+    uint16_t directorySize;
+    std::memcpy(&directorySize, image + sizeof(V1PageMetadata), sizeof(directorySize));
+    if (headerSize + directorySize * sizeof(V1Slot) > PAGE_SIZE) {
+        std::cerr << "Error migrateTable: Version 1 page " << pageID << " has a corrupt slot directory.\n";
+        return false;
+    }
+    for (uint16_t i = 0; i < directorySize; ++i) {
+        V1Slot slot;
+        std::memcpy(&slot, image + headerSize + i * sizeof(V1Slot), sizeof(slot));
+        if (slot.length == 0) continue; // Deleted slot
+        if (slot.offset + slot.length > PAGE_SIZE) {
+            std::cerr << "Error migrateTable: Skipping invalid slot " << i << " on version 1 page " << pageID << ".\n";
+            continue;
+        }
+        rows.emplace_back(image + slot.offset, slot.length);
+    }
+    return true;
+}
+
+bool TableMigration::run() {
+    if (FileMetadata::isCurrentFormat(tablePath)) {
+        std::cout << "Table is already in the current format: " << tablePath << std::endl;
+        return true;
+    }
+    std::ifstream in(tablePath, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error migrateTable: Unable to open table file: " << tablePath << std::endl;
+        return false;
+    }
+
+    std::map<std::string, std::string> schema;
+    uint16_t pageCount = 0;
+    char reserved[V1_RESERVED_SIZE] = {0};
+    if (!readHeader(in, schema, pageCount, reserved)) {
+        return false;
+    }
+    stats = MigrationStats();
+
+    std::string tempPath = tablePath + ".migrate";
+    std::string indexPath = IdIndex::pathForTable(tablePath);
+    std::string indexTempPath = indexPath + ".migrate";
+    { std::ofstream create(tempPath, std::ios::binary | std::ios::trunc); }
+    TableFile out(tempPath);
+    if (!out.isOpen()) {
+        std::cerr << "Error migrateTable: Unable to create " << tempPath << std::endl;
+        return false;
+    }
+
+    FileMetadata metadata;
+    metadata.setSchema(schema);
+    metadata.setClustered(reserved[0] & V1_FLAG_CLUSTERED);
+    std::vector<std::pair<int64_t, int64_t>> entries; // (tuple id, page id)
+    bool ok = true;
+    try {
+        metadata.serialize(out); // Places any header continuation pages ahead of the data
+
+        Page page(metadata.allocatePage());
+        bool pageHasRows = false;
+        for (uint16_t pageID = 0; ok && pageID < pageCount; ++pageID) {
+            std::vector<std::string> rows;
+            ok = readPageRows(in, pageID, rows);
+            for (size_t i = 0; ok && i < rows.size(); ++i) {
+                Tuple tuple;
+                if (!tuple.deserialize(rows[i])) {
+                    std::cerr << "Error migrateTable: Unreadable row on version 1 page " << pageID << ".\n";
+                    ok = false;
+                    break;
+                }
+                if (pageHasRows && !page.appendTuple(rows[i])) {
+                    out.writePage(metadata, page);
+                    stats.pagesWritten++;
+                    page = Page(metadata.allocatePage());
+                    pageHasRows = false;
+                }
+                if (!pageHasRows && !page.appendTuple(rows[i])) {
+                    std::cerr << "Error migrateTable: Row on version 1 page " << pageID << " does not fit in a page.\n";
+                    ok = false;
+                    break;
+                }
+                pageHasRows = true;
+                entries.push_back({std::stoll(tuple.getAttributeValue("id")), static_cast<int64_t>(page.getPageID())});
+                stats.rowsMigrated++;
+            }
+        }
+        if (ok && pageHasRows) {
+            out.writePage(metadata, page);
+            stats.pagesWritten++;
+        } else {
+            metadata.setPageCount(page.getPageID()); // Give back the unused page
+        }
+        if (ok) {
+            metadata.serialize(out);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error migrateTable: " << e.what() << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::sort(entries.begin(), entries.end());
+        IdIndex::BulkBuilder index(indexTempPath, 1.0);
+        for (size_t i = 0; ok && i < entries.size(); ++i) {
+            if (i > 0 && entries[i].first == entries[i - 1].first) {
+                std::cerr << "Error migrateTable: Duplicate ID " << entries[i].first << " in " << tablePath << std::endl;
+                ok = false;
+            } else {
+                ok = index.add(entries[i].first, entries[i].second);
+            }
+        }
+        ok = ok && index.finish();
+    }
+
+    out.close();
+    in.close();
+    if (!ok) {
+        std::cerr << "Error migrateTable: Migration aborted, " << tablePath << " left unchanged.\n";
+        fs::remove(tempPath);
+        fs::remove(indexTempPath);
+        return false;
+    }
+
+    fs::rename(indexTempPath, indexPath);
+    IdFilter::discard(indexPath);
+    fs::rename(tempPath, tablePath);
+    return true;
+}
+
+TableCompaction::TableCompaction(const std::string& path) : tablePath(path) {}
+
+const CompactionStats& TableCompaction::getStats() const {
+    return stats;
+}
+
+bool TableCompaction::run() {
+    if (!FileMetadata::isCurrentFormat(tablePath)) {
+        std::cerr << "Error compactTable: " << tablePath << " is not in the current format; migrate it first.\n";
+        return false;
+    }
+    TableFile in(tablePath, false);
+    if (!in.isOpen()) {
+        std::cerr << "Error compactTable: Unable to open table file: " << tablePath << std::endl;
+        return false;
+    }
+    stats = CompactionStats();
+
+    std::string tempPath = tablePath + ".compact";
+    std::string indexPath = IdIndex::pathForTable(tablePath);
+    std::string indexTempPath = indexPath + ".compact";
+    { std::ofstream create(tempPath, std::ios::binary | std::ios::trunc); }
+    TableFile out(tempPath);
+    if (!out.isOpen()) {
+        std::cerr << "Error compactTable: Unable to create " << tempPath << std::endl;
+        return false;
+    }
+
+    FileMetadata source;
+    FileMetadata metadata;
+    std::vector<std::pair<int64_t, int64_t>> entries; // (tuple id, page id)
+    bool ok = true;
+    try {
+        source.deserialize(in);
+        const size_t pageSize = source.getPageSize();
+        stats.pagesBefore = source.getPageCount();
+        metadata.setSchema(source.getSchema());
+        metadata.setClustered(source.isClustered());
+        metadata.setPageSize(source.getPageSize());
+        metadata.setSegmentPages(source.getSegmentPages());
+        metadata.setExtentPages(source.getExtentPages());
+        metadata.serialize(out); // Places any header continuation pages ahead of the data
+
+        Page page(metadata.allocatePage(), pageSize);
+        bool pageHasRows = false;
+        uint64_t lastDataPage = FileMetadata::NO_PAGE;
+        auto copyRow = [&](int64_t id, std::string row) {
+            // Chains stay with the old file, so long values are read back and spilled again
+            if (OverflowStore::hasPointers(row) &&
+                (!OverflowStore::resolveRow(in, source, row) || !OverflowStore::spill(out, metadata, row))) {
+                std::cerr << "Error compactTable: Unable to copy the long values of row " << id << ".\n";
+                return false;
+            }
+            if (pageHasRows && !page.appendTuple(row)) {
+                out.reserveExtent(metadata);
+                out.writePage(metadata, page);
+                lastDataPage = page.getPageID();
+                page = Page(metadata.allocatePage(), pageSize);
+                pageHasRows = false;
+            }
+            if (!pageHasRows && !page.appendTuple(row)) {
+                std::cerr << "Error compactTable: Row " << id << " does not fit in a page.\n";
+                return false;
+            }
+            pageHasRows = true;
+            entries.push_back({id, static_cast<int64_t>(page.getPageID())});
+            stats.rowsCopied++;
+            return true;
+        };
+
+        Page current(0, pageSize);
+        if (source.isClustered()) {
+            // In id order; neighbouring ids share pages, so each page is read about once
+            std::map<int64_t, std::string> pageRows;
+            int64_t loadedPage = -1;
+            for (IdIndex::Iterator it = source.getIdIndex().begin(); ok && it.valid(); it.next()) {
+                if (it.value() != loadedPage) {
+                    loadedPage = it.value();
+                    in.readPage(source, loadedPage, current);
+                    pageRows.clear();
+                    for (uint32_t i = 0; i < current.getSlots().size(); ++i) {
+                        if (current.getSlot(i).length == 0) continue; // Deleted slot
+                        std::string row = current.getTupleData(i);
+                        int64_t rowId;
+                        if (Projection::readId(row, rowId)) {
+                            pageRows[rowId] = std::move(row);
+                        }
+                    }
+                }
+                auto row = pageRows.find(it.key());
+                if (row == pageRows.end()) {
+                    std::cerr << "Error compactTable: Row " << it.key() << " is missing from page " << loadedPage << ".\n";
+                    ok = false;
+                } else {
+                    ok = copyRow(it.key(), std::move(row->second));
+                }
+            }
+        } else {
+            for (uint64_t pageID = 0; ok && pageID < source.getPageCount(); ++pageID) {
+                in.readPage(source, pageID, current);
+                if (current.getPageType() != PAGE_TYPE_DATA) continue; // Header, overflow or free page
+                for (uint32_t i = 0; ok && i < current.getSlots().size(); ++i) {
+                    if (current.getSlot(i).length == 0) continue;
+                    std::string row = current.getTupleData(i);
+                    int64_t rowId;
+                    if (!Projection::readId(row, rowId)) {
+                        std::cerr << "Error compactTable: Unreadable row on page " << pageID << ".\n";
+                        ok = false;
+                    } else {
+                        ok = copyRow(rowId, std::move(row));
+                    }
+                }
+            }
+        }
+
+        if (ok && pageHasRows) {
+            out.reserveExtent(metadata);
+            out.writePage(metadata, page);
+            lastDataPage = page.getPageID();
+        } else if (!pageHasRows) {
+            metadata.setPageCount(page.getPageID()); // Give back the unused page
+        }
+        if (ok) {
+            if (!metadata.isClustered() && lastDataPage != FileMetadata::NO_PAGE) {
+                metadata.setInsertPage(lastDataPage); // Overflow chains may follow it
+            }
+            metadata.serialize(out);
+            out.flush();
+            ok = static_cast<bool>(out.headerStream());
+            stats.pagesAfter = metadata.getPageCount();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error compactTable: " << e.what() << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::sort(entries.begin(), entries.end());
+        IdIndex::BulkBuilder index(indexTempPath, 1.0);
+        for (size_t i = 0; ok && i < entries.size(); ++i) {
+            ok = index.add(entries[i].first, entries[i].second);
+        }
+        ok = ok && index.finish();
+    }
+
+    out.close();
+    in.close();
+    if (!ok) {
+        std::cerr << "Error compactTable: Compaction aborted, " << tablePath << " left unchanged.\n";
+        fs::remove(tempPath);
+        for (uint64_t segment = 1; fs::exists(TableFile::segmentPath(tempPath, segment)); ++segment) {
+            fs::remove(TableFile::segmentPath(tempPath, segment));
+        }
+        fs::remove(indexTempPath);
+        return false;
+    }
+
+    // Old segments past the new end are removed, the others replaced, and the main file goes last
+    fs::rename(indexTempPath, indexPath);
+    IdFilter::discard(indexPath);
+    for (uint64_t segment = 1; fs::exists(TableFile::segmentPath(tablePath, segment)) ||
+                               fs::exists(TableFile::segmentPath(tempPath, segment)); ++segment) {
+        if (fs::exists(TableFile::segmentPath(tempPath, segment))) {
+            fs::rename(TableFile::segmentPath(tempPath, segment), TableFile::segmentPath(tablePath, segment));
+        } else {
+            fs::remove(TableFile::segmentPath(tablePath, segment));
+        }
+    }
+    fs::rename(tempPath, tablePath);
+    return true;
+}
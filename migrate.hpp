@@ -0,0 +1,74 @@
+#ifndef MIGRATE_HPP
+#define MIGRATE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include "page.hpp"
+#include "FileMetaData.hpp"
+
+struct MigrationStats {
+    uint64_t rowsMigrated = 0;
+    uint64_t pagesRead = 0;
+    uint64_t pagesWritten = 0;
+};
+
+// Rewrites a version 1 table in the current format.
+// Version 1 files have a fixed 8 KB header with 16-bit page count and schema sizes, and pages
+// with 16-bit page ids and slots. Live rows are copied page by page in their existing order
+// (a page that no longer fits the wider slot directory spills into the next one), the id index
+// is rebuilt from the rows, and the new files replace the old ones only once both are complete.
+class TableMigration {
+public:
+    explicit TableMigration(const std::string& tablePath);
+
+    bool run();
+    const MigrationStats& getStats() const;
+
+private:
+    // On-disk layouts of the version 1 format
+    struct V1PageMetadata {
+        uint16_t pageID;
+        uint16_t slotCount;
+        uint16_t freeSpace;
+        uint16_t freeSpaceEnd;
+    };
+    struct V1Slot {
+        uint16_t offset;
+        uint16_t length;
+    };
+
+    std::string tablePath;
+    MigrationStats stats;
+
+    bool readHeader(std::ifstream& in, std::map<std::string, std::string>& schema, uint16_t& pageCount, char* reserved);
+    bool readPageRows(std::ifstream& in, uint16_t pageID, std::vector<std::string>& rows);
+};
+
+struct CompactionStats {
+    uint64_t rowsCopied = 0;
+    uint64_t pagesBefore = 0;
+    uint64_t pagesAfter = 0;
+};
+
+// Rewrites a current-format table without the space of its deleted rows.
+// Deletes only tombstone slots and release overflow chains to the free list, so a table that
+// lost most of its rows keeps its size. Live rows are copied into full pages, in id order for
+// a clustered table and page order otherwise, their long values are written to new chains,
+// and the id index is rebuilt. As with a migration, the new files replace the old ones only
+// once they are complete; the table keeps its page size, segment and extent options.
+class TableCompaction {
+public:
+    explicit TableCompaction(const std::string& tablePath);
+
+    bool run();
+    const CompactionStats& getStats() const;
+
+private:
+    std::string tablePath;
+    CompactionStats stats;
+};
+
+#endif // MIGRATE_HPP
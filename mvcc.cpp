@@ -0,0 +1,285 @@
+#include "mvcc.hpp"
+#include "tupleiterator.hpp"
+#include <cstdlib>
+
+Snapshot::Snapshot(VersionedTable* owner, uint64_t timestamp) : table(owner), readTimestamp(timestamp) {}
+
+Snapshot::Snapshot(Snapshot&& other) noexcept : table(other.table), readTimestamp(other.readTimestamp) {
+    other.table = nullptr;
+}
+
+Snapshot::~Snapshot() {
+    if (table) {
+        table->release(readTimestamp);
+    }
+}
+
+uint64_t Snapshot::timestamp() const {
+    return readTimestamp;
+}
+
+VersionedTable::VersionedTable(const std::string& db, const std::string& table)
+    : dbName(db), tableName(table), tablePath(db + "/" + table + ".HAD") {}
+
+VersionedTable::~VersionedTable() {
+    stopGarbageCollector();
+}
+
+Snapshot VersionedTable::snapshot() {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    uint64_t timestamp = committed.load();
+    liveSnapshots.insert(timestamp);
+    return Snapshot(this, timestamp);
+}
+
+void VersionedTable::release(uint64_t timestamp) {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    auto it = liveSnapshots.find(timestamp);
+    if (it != liveSnapshots.end()) {
+        liveSnapshots.erase(it);
+    }
+}
+
+bool VersionedTable::readCurrent(int64_t id, std::string& row) {
+    try {
+        TupleIterator it(tablePath, id, id);
+        if (!it.valid()) {
+            return false;
+        }
+        row = it.tuple().serialize();
+        return true;
+    } catch (const std::exception&) {
+        return false; // A torn read shows up as a sequence change and is retried
+    }
+}
+
+bool VersionedTable::readChunk(int64_t lo, int64_t hi, std::vector<std::pair<int64_t, std::string>>& rows) {
+    try {
+        for (TupleIterator it(tablePath, lo, hi); it.valid() && rows.size() < SCAN_CHUNK; it.next()) {
+            rows.push_back({it.id(), it.tuple().serialize()});
+        }
+        return true;
+    } catch (const std::exception&) {
+        rows.clear();
+        return false;
+    }
+}
+
+// Null when the table file already holds the version the snapshot sees
+const VersionedTable::Version* VersionedTable::visibleVersion(const VersionChain& chain, uint64_t timestamp) const {
+    if (chain.currentBegin <= timestamp) {
+        return nullptr;
+    }
+    for (auto it = chain.versions.rbegin(); it != chain.versions.rend(); ++it) {
+        if (it->begin <= timestamp && timestamp < it->end) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t VersionedTable::waitForQuietFile() {
+    uint64_t sequence = writeSequence.load();
+    while (sequence & 1) {
+        std::this_thread::yield();
+        sequence = writeSequence.load();
+    }
+    return sequence;
+}
+
+bool VersionedTable::write(int64_t id, const std::function<bool()>& change) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    std::string before;
+    bool existed = readCurrent(id, before);
+    uint64_t commit = committed.load() + 1;
+    {
+        std::unique_lock<std::shared_mutex> chainLock(chainMutex);
+        VersionChain& chain = chains[id];
+        chain.versions.push_back({chain.currentBegin, commit, existed, std::move(before)});
+        chain.currentBegin = commit;
+    }
+
+    // The old state is in place before the file changes, so snapshots older than this commit
+    // never need the file for this row again. The commit is kept even if the change fails:
+    // the stored version then matches the file and reads stay correct either way.
+    writeSequence.fetch_add(1);
+    bool ok = change();
+    writeSequence.fetch_add(1);
+    committed.store(commit);
+    return ok;
+}
+
+bool VersionedTable::insert(const Tuple& tuple) {
+    char* end = nullptr;
+    std::string idValue = tuple.getAttributeValue("id");
+    int64_t id = std::strtoll(idValue.c_str(), &end, 10);
+    if (idValue.empty() || *end != '\0') {
+        std::cerr << "Error VersionedTable::insert: Tuple has no integer id." << std::endl;
+        return false;
+    }
+    return write(id, [&]() { return storage.insert(dbName, tableName, tuple); });
+}
+
+bool VersionedTable::update(int64_t id, const Tuple& tuple) {
+    return write(id, [&]() { return storage.updateTupleInTable(dbName, tableName, std::to_string(id), tuple); });
+}
+
+bool VersionedTable::remove(int64_t id) {
+    return write(id, [&]() { return storage.deleteTupleFromTable(dbName, tableName, std::to_string(id)); });
+}
+
+bool VersionedTable::get(const Snapshot& snapshot, int64_t id, std::string& row) {
+    uint64_t timestamp = snapshot.timestamp();
+    for (;;) {
+        uint64_t sequence = waitForQuietFile();
+        {
+            std::shared_lock<std::shared_mutex> chainLock(chainMutex);
+            auto chain = chains.find(id);
+            if (chain != chains.end()) {
+                if (const Version* version = visibleVersion(chain->second, timestamp)) {
+                    if (version->exists) {
+                        row = version->row;
+                    }
+                    return version->exists;
+                }
+            }
+        }
+        bool found = readCurrent(id, row);
+        if (writeSequence.load() == sequence) {
+            return found;
+        }
+        readRetries++;
+    }
+}
+
+uint64_t VersionedTable::scan(const Snapshot& snapshot, int64_t lo, int64_t hi,
+                              const std::function<bool(int64_t id, const std::string& row)>& visit) {
+    uint64_t timestamp = snapshot.timestamp();
+    std::vector<std::pair<int64_t, std::string>> rows;
+    std::vector<std::pair<int64_t, std::string>> merged;
+    uint64_t visited = 0;
+    int64_t next = lo;
+
+    while (next <= hi) {
+        uint64_t sequence = waitForQuietFile();
+        rows.clear();
+        bool ok = readChunk(next, hi, rows);
+        int64_t chunkEnd = rows.size() == SCAN_CHUNK ? rows.back().first : hi;
+
+        // Overlay the versions of rows changed after the snapshot, including ones since deleted.
+        // Rows are copied out so that visit runs without holding the chain lock.
+        merged.clear();
+        {
+            std::shared_lock<std::shared_mutex> chainLock(chainMutex);
+            auto chain = chains.lower_bound(next);
+            auto chainEnd = chains.upper_bound(chunkEnd);
+            size_t r = 0;
+            while (r < rows.size() || chain != chainEnd) {
+                bool fromFile = chain == chainEnd || (r < rows.size() && rows[r].first < chain->first);
+                bool fromChain = r == rows.size() || (chain != chainEnd && chain->first < rows[r].first);
+                if (fromFile) {
+                    merged.push_back(std::move(rows[r++]));
+                    continue;
+                }
+                const Version* version = visibleVersion(chain->second, timestamp);
+                if (version) {
+                    if (version->exists) merged.push_back({chain->first, version->row});
+                } else if (!fromChain) {
+                    merged.push_back(std::move(rows[r]));
+                }
+                if (!fromChain) ++r;
+                ++chain;
+            }
+        }
+
+        if (writeSequence.load() != sequence) {
+            readRetries++;
+            continue;
+        }
+        if (!ok) {
+            std::cerr << "Error VersionedTable::scan: Failed to read " << tablePath << std::endl;
+            return visited;
+        }
+        for (const auto& [id, row] : merged) {
+            ++visited;
+            if (!visit(id, row)) {
+                return visited;
+            }
+        }
+        if (chunkEnd >= hi) {
+            break;
+        }
+        next = chunkEnd + 1;
+    }
+    return visited;
+}
+
+size_t VersionedTable::collectGarbage() {
+    uint64_t oldest;
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        oldest = liveSnapshots.empty() ? committed.load() : *liveSnapshots.begin();
+    }
+
+    // A version is dead once it ended at or before the oldest timestamp anyone can still read
+    size_t collected = 0;
+    std::unique_lock<std::shared_mutex> chainLock(chainMutex);
+    for (auto chain = chains.begin(); chain != chains.end();) {
+        std::vector<Version>& versions = chain->second.versions;
+        size_t dead = 0;
+        while (dead < versions.size() && versions[dead].end <= oldest) {
+            ++dead;
+        }
+        versions.erase(versions.begin(), versions.begin() + dead);
+        collected += dead;
+        if (versions.empty() && chain->second.currentBegin <= oldest) {
+            chain = chains.erase(chain);
+        } else {
+            ++chain;
+        }
+    }
+    versionsCollected += collected;
+    return collected;
+}
+
+void VersionedTable::startGarbageCollector(std::chrono::milliseconds interval) {
+    if (collector.joinable()) {
+        return;
+    }
+    collectorStop = false;
+    collector = std::thread([this, interval]() {
+        std::unique_lock<std::mutex> lock(collectorMutex);
+        while (!collectorWake.wait_for(lock, interval, [this]() { return collectorStop; })) {
+            lock.unlock();
+            collectGarbage();
+            lock.lock();
+        }
+    });
+}
+
+void VersionedTable::stopGarbageCollector() {
+    if (!collector.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(collectorMutex);
+        collectorStop = true;
+    }
+    collectorWake.notify_all();
+    collector.join();
+}
+
+VersionStats VersionedTable::getStats() const {
+    VersionStats stats;
+    stats.committed = committed.load();
+    {
+        std::shared_lock<std::shared_mutex> chainLock(chainMutex);
+        stats.chains = chains.size();
+        for (const auto& [id, chain] : chains) {
+            stats.versions += chain.versions.size();
+        }
+    }
+    stats.versionsCollected = versionsCollected.load();
+    stats.readRetries = readRetries.load();
+    return stats;
+}
@@ -0,0 +1,130 @@
+#ifndef MVCC_HPP
+#define MVCC_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include "storage.hpp"
+
+class VersionedTable;
+
+// A consistent read view of a VersionedTable as of one commit timestamp.
+// Registered with the table while alive so garbage collection keeps the versions it can see.
+class Snapshot {
+public:
+    Snapshot(Snapshot&& other) noexcept;
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+    ~Snapshot();
+
+    uint64_t timestamp() const;
+
+private:
+    friend class VersionedTable;
+    Snapshot(VersionedTable* table, uint64_t timestamp);
+    VersionedTable* table;
+    uint64_t readTimestamp;
+};
+
+struct VersionStats {
+    uint64_t committed = 0;        // Timestamp of the last committed write
+    uint64_t chains = 0;           // Rows with versions older than the table file holds
+    uint64_t versions = 0;
+    uint64_t versionsCollected = 0;
+    uint64_t readRetries = 0;      // Reads repeated because a writer changed the file under them
+};
+
+// Multi-version access to one table: writers serialize among themselves and update the table
+// file in place as before; readers take a snapshot and never wait for a write latch.
+//
+// The table file always holds the newest committed version of each row. Before a writer
+// changes a row it stores the row's previous state in an in-memory undo chain, stamped with
+// the timestamps [begin, end) during which that state was current. A snapshot read of a row
+// whose newest version began after the snapshot takes the matching version from the chain;
+// every other read goes to the file. Writers bump a sequence number around each file change,
+// so a reader that overlapped one simply reads again instead of holding writers off.
+// A background collector drops versions that no live snapshot can see anymore.
+//
+// Versions live in memory and timestamps restart with the process; use one VersionedTable
+// per table, and do all writes to that table through it.
+class VersionedTable {
+public:
+    VersionedTable(const std::string& dbName, const std::string& tableName);
+    ~VersionedTable();
+
+    Snapshot snapshot();
+
+    bool insert(const Tuple& tuple);
+    bool update(int64_t id, const Tuple& tuple);
+    bool remove(int64_t id);
+
+    // Serialized row as of the snapshot; false if it did not exist then
+    bool get(const Snapshot& snapshot, int64_t id, std::string& row);
+    // Rows with lo <= id <= hi as of the snapshot, in id order; visit may return false to stop
+    uint64_t scan(const Snapshot& snapshot, int64_t lo, int64_t hi,
+                  const std::function<bool(int64_t id, const std::string& row)>& visit);
+
+    // Drops versions older than every live snapshot; returns how many went
+    size_t collectGarbage();
+    void startGarbageCollector(std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+    void stopGarbageCollector();
+
+    VersionStats getStats() const;
+
+private:
+    friend class Snapshot;
+
+    struct Version {
+        uint64_t begin;     // Commit that made this state current
+        uint64_t end;       // Commit that replaced it
+        bool exists;        // False when the row was absent (before an insert)
+        std::string row;
+    };
+
+    struct VersionChain {
+        uint64_t currentBegin = 0;      // Commit that wrote the state now in the table file
+        std::vector<Version> versions;  // Oldest first
+    };
+
+    static const size_t SCAN_CHUNK = 1024;
+
+    std::string dbName, tableName, tablePath;
+    Storage storage;                    // Used by writers only, under writerMutex
+
+    std::mutex writerMutex;
+    std::atomic<uint64_t> committed{0};
+    std::atomic<uint64_t> writeSequence{0}; // Odd while a writer is changing the table file
+
+    mutable std::shared_mutex chainMutex;
+    std::map<int64_t, VersionChain> chains;
+
+    mutable std::mutex snapshotMutex;
+    std::multiset<uint64_t> liveSnapshots;
+
+    std::thread collector;
+    std::mutex collectorMutex;
+    std::condition_variable collectorWake;
+    bool collectorStop = false;
+
+    std::atomic<uint64_t> versionsCollected{0};
+    std::atomic<uint64_t> readRetries{0};
+
+    void release(uint64_t timestamp);
+    bool readCurrent(int64_t id, std::string& row);
+    bool readChunk(int64_t lo, int64_t hi, std::vector<std::pair<int64_t, std::string>>& rows);
+    const Version* visibleVersion(const VersionChain& chain, uint64_t timestamp) const;
+    bool write(int64_t id, const std::function<bool()>& change);
+    uint64_t waitForQuietFile();
+};
+
+#endif // MVCC_HPP
@@ -0,0 +1,330 @@
+#include "overflow.hpp"
+#include "schema.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> valuesSpilled{0};
+std::atomic<uint64_t> pagesWritten{0};
+std::atomic<uint64_t> valuesFetched{0};
+std::atomic<uint64_t> pagesRead{0};
+std::atomic<uint64_t> pagesReleased{0};
+std::atomic<uint64_t> pagesReused{0};
+
+const char STRING_CODE = '0' + static_cast<int>(ColumnType::String);
+const char POINTER_CODE = '0' + static_cast<int>(ColumnType::Overflow);
+const size_t MAX_POINTER = 41; // "firstPage:length" with two 20-digit numbers
+
+// One key(type|value) attribute of a stored row, as offsets into it
+struct Attribute {
+    size_t start;
+    size_t open;
+    size_t bar;
+    size_t close;
+};
+
+bool parseRow(const std::string& row, std::vector<Attribute>& attributes) {
+    attributes.clear();
+    size_t pos = 0;
+    while (pos < row.size()) {
+        size_t open = row.find('(', pos);
+        size_t bar = open == std::string::npos ? open : row.find('|', open);
+        size_t close = bar == std::string::npos ? bar : row.find(')', bar);
+        if (close == std::string::npos) return false;
+        attributes.push_back({pos, open, bar, close});
+        pos = close + 1;
+    }
+    return true;
+}
+
+bool parsePointer(std::string_view pointer, uint64_t& firstPage, uint64_t& length) {
+    const char* end = pointer.data() + pointer.size();
+    auto first = std::from_chars(pointer.data(), end, firstPage);
+    if (first.ec != std::errc() || first.ptr == end || *first.ptr != ':') return false;
+    auto second = std::from_chars(first.ptr + 1, end, length);
+    return second.ec == std::errc() && second.ptr == end;
+}
+
+} // namespace
+
+bool OverflowStore::isPointerType(std::string_view typeCode) {
+    return typeCode.size() == 1 && typeCode[0] == POINTER_CODE;
+}
+
+bool OverflowStore::hasPointers(const std::string& row) {
+    if (row.find(std::string{'(', POINTER_CODE, '|'}) == std::string::npos) {
+        return false; // Common case: nothing that could be a pointer
+    }
+    std::vector<Attribute> attributes;
+    parseRow(row, attributes);
+    for (const Attribute& a : attributes) {
+        if (isPointerType(std::string_view(row).substr(a.open + 1, a.bar - a.open - 1))) return true;
+    }
+    return false;
+}
+
+std::vector<uint64_t> OverflowStore::takePages(TableFile& file, FileMetadata& metadata, size_t count) {
+    std::vector<uint64_t> pages;
+    std::vector<char> buffer(metadata.getPageSize());
+    while (pages.size() < count && metadata.getFreePageHead() != FileMetadata::NO_PAGE) {
+        uint64_t head = metadata.getFreePageHead();
+        PageMetadata pageHeader{};
+        ChainFields chain{};
+        try {
+            file.readPageImage(metadata, head, buffer.data());
+            std::memcpy(&pageHeader, buffer.data(), sizeof(pageHeader));
+            std::memcpy(&chain, buffer.data() + sizeof(pageHeader), sizeof(chain));
+        } catch (const std::exception& e) {
+            std::cerr << "Error OverflowStore: " << e.what() << std::endl;
+        }
+        if (pageHeader.pageType != PAGE_TYPE_FREE || pageHeader.pageID != head ||
+            std::find(pages.begin(), pages.end(), head) != pages.end()) {
+            std::cerr << "Error OverflowStore: Free page list of " << file.getPath() << " is broken at page " << head
+                      << ", dropping the rest of it.\n";
+            metadata.setFreePageHead(FileMetadata::NO_PAGE);
+            break;
+        }
+        pages.push_back(head);
+        metadata.setFreePageHead(chain.nextPage);
+        pagesReused++;
+    }
+    if (pages.size() < count) {
+        while (pages.size() < count) {
+            pages.push_back(metadata.allocatePage()); // Consecutive, so written in one call
+        }
+        file.reserveExtent(metadata);
+    }
+    return pages;
+}
+
+void OverflowStore::writeImages(TableFile& file, const FileMetadata& metadata, const std::vector<uint64_t>& pages, const char* images) {
+    const size_t pageSize = metadata.getPageSize();
+    for (size_t start = 0; start < pages.size();) {
+        size_t end = start + 1;
+        while (end < pages.size() && pages[end] == pages[end - 1] + 1) {
+            ++end;
+        }
+        file.writePageImages(metadata, pages[start], images + start * pageSize, end - start);
+        start = end;
+    }
+}
+
+std::string OverflowStore::writeChain(TableFile& file, FileMetadata& metadata, std::string_view value) {
+    const size_t pageSize = metadata.getPageSize();
+    const size_t capacity = chunkCapacity(pageSize);
+    size_t pageCount = std::max<size_t>(1, (value.size() + capacity - 1) / capacity);
+    std::vector<uint64_t> pages = takePages(file, metadata, pageCount);
+
+    std::vector<char> images(pageCount * pageSize, 0);
+    size_t offset = 0;
+    for (size_t i = 0; i < pageCount; ++i) {
+        char* image = images.data() + i * pageSize;
+        PageMetadata pageHeader = {pages[i], 0, 0, 0, PAGE_TYPE_OVERFLOW, 0};
+        ChainFields chain = {i + 1 < pageCount ? pages[i + 1] : FileMetadata::NO_PAGE,
+                             static_cast<uint32_t>(std::min(capacity, value.size() - offset))};
+        std::memcpy(image, &pageHeader, sizeof(pageHeader));
+        std::memcpy(image + sizeof(pageHeader), &chain, sizeof(chain));
+        std::memcpy(image + sizeof(pageHeader) + sizeof(chain), value.data() + offset, chain.chunkSize);
+        offset += chain.chunkSize;
+    }
+    writeImages(file, metadata, pages, images.data());
+    valuesSpilled++;
+    pagesWritten += pageCount;
+    return std::to_string(pages.front()) + ":" + std::to_string(value.size());
+}
+
+bool OverflowStore::spill(TableFile& file, FileMetadata& metadata, std::string& row) {
+    std::vector<Attribute> attributes;
+    if (!parseRow(row, attributes)) {
+        std::cerr << "Error OverflowStore spill: Malformed row.\n";
+        return false;
+    }
+
+    // Long strings always move; then the longest others until the row fits on a page
+    const size_t limit = inlineLimit(metadata.getPageSize());
+    const size_t maxRow = maxInlineRow(metadata.getPageSize());
+    std::vector<uint8_t> spilled(attributes.size(), 0);
+    std::vector<size_t> candidates;
+    size_t size = row.size();
+    for (size_t i = 0; i < attributes.size(); ++i) {
+        const Attribute& a = attributes[i];
+        size_t length = a.close - a.bar - 1;
+        if (a.bar != a.open + 2 || row[a.open + 1] != STRING_CODE || length <= SPILL_MINIMUM) continue;
+        if (length > limit) {
+            spilled[i] = 1;
+            size -= length - MAX_POINTER;
+        } else {
+            candidates.push_back(i);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [&](size_t x, size_t y) {
+        return attributes[x].close - attributes[x].bar > attributes[y].close - attributes[y].bar;
+    });
+    for (size_t i = 0; i < candidates.size() && size > maxRow; ++i) {
+        spilled[candidates[i]] = 1;
+        size -= attributes[candidates[i]].close - attributes[candidates[i]].bar - 1 - MAX_POINTER;
+    }
+    if (size > maxRow) {
+        std::cerr << "Error OverflowStore spill: Row of " << row.size() << " bytes does not fit on a page even with its strings moved out.\n";
+        return false;
+    }
+    if (std::find(spilled.begin(), spilled.end(), 1) == spilled.end()) {
+        return true;
+    }
+
+    std::string rewritten;
+    rewritten.reserve(size);
+    for (size_t i = 0; i < attributes.size(); ++i) {
+        const Attribute& a = attributes[i];
+        if (!spilled[i]) {
+            rewritten.append(row, a.start, a.close + 1 - a.start);
+            continue;
+        }
+        rewritten.append(row, a.start, a.open - a.start);
+        rewritten += '(';
+        rewritten += POINTER_CODE;
+        rewritten += '|';
+        rewritten += writeChain(file, metadata, std::string_view(row).substr(a.bar + 1, a.close - a.bar - 1));
+        rewritten += ')';
+    }
+    row.swap(rewritten);
+    return true;
+}
+
+void OverflowStore::release(TableFile& file, FileMetadata& metadata, const std::string& row) {
+    std::vector<Attribute> attributes;
+    if (!parseRow(row, attributes)) {
+        return;
+    }
+    const size_t pageSize = metadata.getPageSize();
+    for (const Attribute& a : attributes) {
+        if (a.bar != a.open + 2 || row[a.open + 1] != POINTER_CODE) continue;
+        std::string_view pointer = std::string_view(row).substr(a.bar + 1, a.close - a.bar - 1);
+        uint64_t pageID, remaining;
+        if (!parsePointer(pointer, pageID, remaining)) continue;
+
+        // The whole chain is checked before any of it changes, so a damaged one stays as it is
+        std::vector<uint64_t> pages;
+        std::vector<char> images;
+        bool intact = true;
+        while (intact && remaining > 0) {
+            if (pageID >= metadata.getPageCount() || pages.size() >= metadata.getPageCount()) {
+                intact = false;
+                break;
+            }
+            images.resize((pages.size() + 1) * pageSize);
+            char* image = images.data() + pages.size() * pageSize;
+            PageMetadata pageHeader{};
+            ChainFields chain{};
+            try {
+                file.readPageImage(metadata, pageID, image);
+                std::memcpy(&pageHeader, image, sizeof(pageHeader));
+                std::memcpy(&chain, image + sizeof(pageHeader), sizeof(chain));
+            } catch (const std::exception& e) {
+                std::cerr << "Error OverflowStore release: " << e.what() << std::endl;
+            }
+            intact = pageHeader.pageType == PAGE_TYPE_OVERFLOW && pageHeader.pageID == pageID &&
+                     chain.chunkSize > 0 && chain.chunkSize <= remaining;
+            pages.push_back(pageID);
+            remaining -= std::min<uint64_t>(chain.chunkSize, remaining);
+            pageID = chain.nextPage;
+        }
+        if (!intact) {
+            std::cerr << "Error OverflowStore release: Chain of " << pointer << " is damaged, its pages stay in use.\n";
+            continue;
+        }
+        if (pages.empty()) continue;
+
+        // The chain's own links become the list's; its last page points at the old head
+        for (size_t i = 0; i < pages.size(); ++i) {
+            char* image = images.data() + i * pageSize;
+            PageMetadata pageHeader = {pages[i], 0, 0, 0, PAGE_TYPE_FREE, 0};
+            ChainFields chain = {i + 1 < pages.size() ? pages[i + 1] : metadata.getFreePageHead(), 0};
+            std::memset(image, 0, pageSize);
+            std::memcpy(image, &pageHeader, sizeof(pageHeader));
+            std::memcpy(image + sizeof(pageHeader), &chain, sizeof(chain));
+        }
+        writeImages(file, metadata, pages, images.data());
+        metadata.setFreePageHead(pages.front());
+        pagesReleased += pages.size();
+    }
+}
+
+bool OverflowStore::fetch(TableFile& file, const FileMetadata& metadata, std::string_view pointer, std::string& value) {
+    uint64_t pageID, remaining;
+    if (!parsePointer(pointer, pageID, remaining)) {
+        std::cerr << "Error OverflowStore fetch: Malformed pointer " << pointer << std::endl;
+        return false;
+    }
+    value.reserve(value.size() + remaining);
+    const size_t capacity = chunkCapacity(metadata.getPageSize());
+    std::vector<char> buffer(metadata.getPageSize());
+    char* image = buffer.data();
+    // A chain never has more pages than the table, so a damaged one cannot loop forever
+    for (uint64_t steps = 0; remaining > 0; ++steps) {
+        if (pageID >= metadata.getPageCount() || steps >= metadata.getPageCount()) {
+            std::cerr << "Error OverflowStore fetch: Chain of " << pointer << " ends early.\n";
+            return false;
+        }
+        try {
+            file.readPageImage(metadata, pageID, image);
+        } catch (const std::exception& e) {
+            std::cerr << "Error OverflowStore fetch: " << e.what() << std::endl;
+            return false;
+        }
+        pagesRead++;
+        PageMetadata pageHeader;
+        ChainFields chain;
+        std::memcpy(&pageHeader, image, sizeof(pageHeader));
+        std::memcpy(&chain, image + sizeof(pageHeader), sizeof(chain));
+        if (pageHeader.pageType != PAGE_TYPE_OVERFLOW || pageHeader.pageID != pageID ||
+            chain.chunkSize > capacity || chain.chunkSize > remaining) {
+            std::cerr << "Error OverflowStore fetch: Page " << pageID << " is not part of the chain of " << pointer << std::endl;
+            return false;
+        }
+        value.append(image + sizeof(pageHeader) + sizeof(chain), chain.chunkSize);
+        remaining -= chain.chunkSize;
+        pageID = chain.nextPage;
+    }
+    valuesFetched++;
+    return true;
+}
+
+bool OverflowStore::resolveRow(TableFile& file, const FileMetadata& metadata, std::string& row) {
+    std::vector<Attribute> attributes;
+    if (!parseRow(row, attributes)) {
+        return false;
+    }
+    std::string resolved;
+    for (const Attribute& a : attributes) {
+        if (a.bar != a.open + 2 || row[a.open + 1] != POINTER_CODE) {
+            resolved.append(row, a.start, a.close + 1 - a.start);
+            continue;
+        }
+        resolved.append(row, a.start, a.open - a.start);
+        resolved += '(';
+        resolved += STRING_CODE;
+        resolved += '|';
+        if (!fetch(file, metadata, std::string_view(row).substr(a.bar + 1, a.close - a.bar - 1), resolved)) {
+            return false;
+        }
+        resolved += ')';
+    }
+    row.swap(resolved);
+    return true;
+}
+
+OverflowStats OverflowStore::getStats() {
+    OverflowStats stats;
+    stats.valuesSpilled = valuesSpilled;
+    stats.pagesWritten = pagesWritten;
+    stats.valuesFetched = valuesFetched;
+    stats.pagesRead = pagesRead;
+    stats.pagesReleased = pagesReleased;
+    stats.pagesReused = pagesReused;
+    return stats;
+}
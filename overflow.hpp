@@ -0,0 +1,72 @@
+#ifndef OVERFLOW_HPP
+#define OVERFLOW_HPP
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "page.hpp"
+#include "FileMetaData.hpp"
+#include "tablefile.hpp"
+
+struct OverflowStats {
+    uint64_t valuesSpilled = 0;     // Values moved out of their rows
+    uint64_t pagesWritten = 0;
+    uint64_t valuesFetched = 0;     // Pointers resolved back to values
+    uint64_t pagesRead = 0;
+    uint64_t pagesReleased = 0;     // Pages of deleted rows' chains put on a free list
+    uint64_t pagesReused = 0;       // Chain pages taken from a free list instead of the end of the table
+};
+
+// Long string values stored out of line.
+// A string value longer than a quarter page, or any string needed to make a row fit on an empty
+// page, is written to a chain of overflow pages and the row keeps key(4|firstPage:length)
+// instead. Each overflow page holds the page header, the next page of the chain and one chunk
+// of the value. Readers resolve pointers only for the columns they return, so a scan that does
+// not project a spilled column never reads its chain.
+// Deleting a row (an update deletes the old version) releases its chains to a free list
+// linked through the same next-page field, headed in the table header; new chains take pages
+// from it before growing the table. A list page that is no longer marked free, as after a
+// crash between reusing it and writing the header, drops the rest of the list.
+class OverflowStore {
+public:
+    // Longest string value kept in its row; rows no longer than this are never rewritten
+    static size_t inlineLimit(size_t pageSize) { return pageSize / 4; }
+    // Largest serialized row a data page takes
+    static size_t maxInlineRow(size_t pageSize) { return pageSize - PAGE_HEADER_SIZE - sizeof(Slot); }
+
+    // Moves long values of a serialized row to new overflow pages and rewrites the row with
+    // pointers. The pages are written but the header is not; false if the row cannot be made
+    // to fit on a page.
+    static bool spill(TableFile& file, FileMetadata& metadata, std::string& row);
+    // Puts the chains a stored row points to on the free list. Call once the row is gone from
+    // its page; the header is not written.
+    static void release(TableFile& file, FileMetadata& metadata, const std::string& row);
+
+    // Whether a stored attribute's type code (the text between '(' and '|') marks a pointer
+    static bool isPointerType(std::string_view typeCode);
+    // Appends the value a pointer refers to; false if the chain is damaged
+    static bool fetch(TableFile& file, const FileMetadata& metadata, std::string_view pointer, std::string& value);
+    // Replaces every pointer in a stored row with its value, for readers that return whole rows
+    static bool resolveRow(TableFile& file, const FileMetadata& metadata, std::string& row);
+    static bool hasPointers(const std::string& row);
+
+    static OverflowStats getStats();
+
+private:
+    struct ChainFields {
+        uint64_t nextPage;
+        uint32_t chunkSize;
+    };
+    static size_t chunkCapacity(size_t pageSize) { return pageSize - sizeof(PageMetadata) - sizeof(ChainFields); }
+    static const size_t SPILL_MINIMUM = 64; // Shorter values are not worth a pointer
+
+    static std::string writeChain(TableFile& file, FileMetadata& metadata, std::string_view value);
+    // Pages for a new chain: released ones first, then new ones at the end of the table
+    static std::vector<uint64_t> takePages(TableFile& file, FileMetadata& metadata, size_t count);
+    // Writes images of the pages in order, one call per run of adjacent pages
+    static void writeImages(TableFile& file, const FileMetadata& metadata, const std::vector<uint64_t>& pages, const char* images);
+};
+
+#endif // OVERFLOW_HPP
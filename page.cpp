@@ -2,27 +2,36 @@
 #include <iostream>
 #include <stdexcept>
 #include "storage.hpp"
-Page::Page(uint16_t id) {
+Page::Page(uint64_t id, size_t pageSize) : data(pageSize, 0) {
     metadata.pageID = id;
+    metadata.pageType = PAGE_TYPE_DATA;
+    metadata.reserved = 0;
     metadata.slotCount = 0;
-    metadata.freeSpace = PAGE_SIZE - sizeof(PageMetadata);
-    metadata.freeSpaceEnd = PAGE_SIZE;
-    std::memset(data, 0, PAGE_SIZE);
+    metadata.freeSpace = pageSize - PAGE_HEADER_SIZE;
+    metadata.freeSpaceEnd = pageSize;
 }
 
-uint32_t Page::getPageID() const {
+uint64_t Page::getPageID() const {
     return metadata.pageID;
 }
 
+size_t Page::getPageSize() const {
+    return data.size();
+}
+
+uint16_t Page::getPageType() const {
+    return metadata.pageType;
+}
+
 size_t Page::getFreeSpace() const {
     return metadata.freeSpace;
 }
 
-uint16_t Page::getTupleCount() const {
+uint32_t Page::getTupleCount() const {
     return metadata.slotCount;
 }
 
-const std::vector<Slot>& Page::getSlots() const {
+const SlotList& Page::getSlots() const {
     return slots;
 }
 
@@ -33,44 +42,15 @@ Slot Page::getSlot(size_t index) const {
     throw std::out_of_range("Slot index out of range");
 }
 
-bool Page::addTuple(const std::string& tuple, FileMetadata* fileMetadata, int tupleId) {
+bool Page::addTuple(const std::string& tuple, FileMetadata* fileMetadata, int64_t tupleId) {
     std::cout << "Debug addTuple: Attempting to add tuple. Free space: " << metadata.freeSpace
                 << ", Tuple size: " << tuple.size() + sizeof(Slot) << std::endl;
 
-        // Check if there's enough space for the tuple and slot metadata
-        if (metadata.freeSpace < tuple.size() + sizeof(Slot)) {
+        if (!appendTuple(tuple)) {
             std::cout << "Debug addTuple: Not enough space to add tuple.\n";
             return false; // Not enough space
         }
-
-        // Calculate the offset where the tuple will be placed
-        uint16_t tupleOffset = metadata.freeSpaceEnd - tuple.size();
-        // Debug: Log tuple offset calculation
-        std::cout << "Debug addTuple: Calculating tuple offset. Free space end: " << metadata.freeSpaceEnd
-              << ", Tuple size: " << tuple.size() << std::endl;
-
-
-        // Safety check to prevent writing out of bounds
-        if (tupleOffset < sizeof(PageMetadata) + slots.size() * sizeof(Slot)) {
-            std::cerr << "Error addTuple: Not enough space for tuple and slot metadata.\n";
-            return false;
-        }
-
-        // Insert the tuple into the page's data array
-        std::memcpy(data + tupleOffset, tuple.c_str(), tuple.size());
-        std::cout << "Debug addTuple: Tuple added at offset: " << tupleOffset << " with size: " << tuple.size() << std::endl;
-
-
-        // Create a new slot for the tuplef
-        Slot slot = {tupleOffset, static_cast<uint16_t>(tuple.size())};
-        slots.push_back(slot);
-
-        // Update page metadata
-        metadata.freeSpaceEnd = tupleOffset;
-        metadata.freeSpace -= (tuple.size() + sizeof(Slot));
-        metadata.slotCount++;
-        std::cout << "Debug addTuple: Slot count after adding tuple: " << metadata.slotCount << std::endl;
-
+        std::cout << "Debug addTuple: Tuple added at offset: " << slots.back().offset << " with size: " << tuple.size() << std::endl;
 
         // Update FileMetadata with the new tuple location
         fileMetadata->addTupleToPageMap(tupleId, metadata.pageID);
@@ -83,197 +63,145 @@ bool Page::addTuple(const std::string& tuple, FileMetadata* fileMetadata, int tu
         return true;
 }
 
-void Page::serialize(std::fstream& dbFile) {
-    if (!dbFile) {
-             dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }        
-           
-        }
+bool Page::appendTuple(const std::string& tuple) {
+    // Check if there's enough space for the tuple and slot metadata
+    if (metadata.freeSpace < tuple.size() + sizeof(Slot)) {
+        return false;
+    }
 
-        // Write the page metadata
-        dbFile.write(reinterpret_cast<char*>(&metadata), sizeof(PageMetadata));
-        if (!dbFile) {
-            dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }               
-        }
-        std::cout << "Debug  page serialize: Serialized page metadata (PageID: " << metadata.pageID << ", SlotCount: " << metadata.slotCount << ")\n";
+    // Tuples grow down from the end of the page, the slot directory grows up after the header
+    uint32_t tupleOffset = metadata.freeSpaceEnd - tuple.size();
+    if (tupleOffset < PAGE_HEADER_SIZE + (slots.size() + 1) * sizeof(Slot)) {
+        std::cerr << "Error appendTuple: Not enough space for tuple and slot metadata.\n";
+        return false;
+    }
 
-        // Count and write the number of active slots
-        uint16_t activeSlotCount = 0;
-        for (const auto& slot : slots) {
-            if (slot.length > 0) {
-                ++activeSlotCount;
-            }
-        }
-        dbFile.write(reinterpret_cast<char*>(&activeSlotCount), sizeof(activeSlotCount));
-        if (!dbFile) {
-            dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }    
-            
-        }
+    std::memcpy(data.data() + tupleOffset, tuple.c_str(), tuple.size());
+    slots.push_back({tupleOffset, static_cast<uint32_t>(tuple.size())});
 
-        std::cout << "Debug  page serialize: Active slots count: " << activeSlotCount << std::endl;
-
-        // Serialize each active slot
-        for (const auto& slot : slots) {
-            if (slot.length > 0) {
-                   dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }    
-        if (!dbFile) {
-                    std::cerr << "Error  page serialize: Failed to write slot metadata.\n";
-                    
-                }
-                dbFile.write(reinterpret_cast<const char*>(&slot), sizeof(Slot));
-                
-                std::cout << "Debug  page serialize: Serialized Slot. Offset: " << slot.offset 
-                        << ", Length: " << slot.length << std::endl;
-            }
-        }
-         dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }  
-        if (!dbFile) {
-            std::cerr << "Error  page serialize: Failed to write page data.\n";
-            return;
-        }
-        // Write the page data
-        dbFile.write(data, PAGE_SIZE);
-        
-        std::cout << "Debug  page serialize: Finished serializing page.\n";
+    metadata.freeSpaceEnd = tupleOffset;
+    metadata.freeSpace -= (tuple.size() + sizeof(Slot));
+    metadata.slotCount++;
+    return true;
 }
 
-void Page::deserialize(std::fstream& dbFile) {
-    std::cout << "Debug: Deserializing page.\n";
+void Page::toImage(char* image) const {
+    std::memcpy(image, data.data(), data.size());
+    std::memcpy(image, &metadata, sizeof(PageMetadata));
+    uint32_t directorySize = slots.size();
+    std::memcpy(image + sizeof(PageMetadata), &directorySize, sizeof(directorySize));
+    std::memcpy(image + PAGE_HEADER_SIZE, slots.data(), slots.size() * sizeof(Slot));
+}
 
-    if (!dbFile) {
-        dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }               
+void Page::imagePieces(struct iovec* pieces, uint32_t& directorySize) const {
+    // Same bytes as toImage: header, directory length, directory, then the rest of data
+    directorySize = slots.size();
+    size_t directoryEnd = PAGE_HEADER_SIZE + slots.size() * sizeof(Slot);
+    pieces[0] = {const_cast<PageMetadata*>(&metadata), sizeof(PageMetadata)};
+    pieces[1] = {&directorySize, sizeof(directorySize)};
+    pieces[2] = {const_cast<Slot*>(slots.data()), slots.size() * sizeof(Slot)};
+    pieces[3] = {const_cast<char*>(data.data()) + directoryEnd, data.size() - directoryEnd};
+}
+
+void Page::fromImage(const char* image) {
+    std::memcpy(data.data(), image, data.size());
+    parseImage();
+}
+
+// Reads the header and slot directory back out of the image in data
+void Page::parseImage() {
+    const char* image = data.data();
+    std::memcpy(&metadata, image, sizeof(PageMetadata));
+    if (metadata.pageType != PAGE_TYPE_DATA) {
+        slots.clear(); // Other page types have their own layout after the header and hold no tuples
+        return;
+    }
+    uint32_t directorySize;
+    std::memcpy(&directorySize, image + sizeof(PageMetadata), sizeof(directorySize));
+    if (PAGE_HEADER_SIZE + directorySize * sizeof(Slot) > data.size()) {
+        throw std::runtime_error("Corrupted page " + std::to_string(metadata.pageID) + ": slot directory overflows the page.");
     }
 
-    // Read the page metadata
-    dbFile.read(reinterpret_cast<char*>(&metadata), sizeof(PageMetadata));
-    if (!dbFile) {
-dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }            
+    // Deleted slots stay in the directory with length 0 so slot indexes remain stable
+    slots.resize(directorySize);
+    std::memcpy(slots.data(), image + PAGE_HEADER_SIZE, directorySize * sizeof(Slot));
+    for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].length > 0 && slots[i].offset + slots[i].length > data.size()) {
+            std::cerr << "Error page deserialize: Invalid slot at index " << i << ". Offset: " << slots[i].offset
+                      << ", Length: " << slots[i].length << std::endl;
+            slots[i] = {0, 0};
+        }
     }
-    std::cout << "Debug page deserialize: Deserialized page metadata successfully. PageID: " << metadata.pageID
-              << ", SlotCount: " << metadata.slotCount << "\n";
+}
 
-    // Read the number of slots
-    uint16_t slotCount;
-    dbFile.read(reinterpret_cast<char*>(&slotCount), sizeof(slotCount));
+void Page::serialize(std::fstream& dbFile) const {
+    if (!dbFile.is_open()) {
+        throw std::runtime_error("Error page serialize: File stream is not open.");
+    }
+
+    std::vector<char> image(data.size());
+    toImage(image.data());
+    dbFile.write(image.data(), image.size());
     if (!dbFile) {
-       dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }    
-       
+        throw std::runtime_error("Error page serialize: Failed to write page " + std::to_string(metadata.pageID) + ".");
     }
-    std::cout << "Debug page deserialize: Slot count from file: " << slotCount << std::endl;
-
-    // Clear existing slots and prepare to load new ones
-    slots.clear();
-    for (int i = 0; i < slotCount; ++i) {
-        Slot slot;
-        dbFile.read(reinterpret_cast<char*>(&slot), sizeof(Slot));
-
-         // Debugging output for each slot
-        if (dbFile) {
-            std::cout << "Deserialized Slot: Offset = " << slot.offset << ", Length = " << slot.length << std::endl;
-        } else {
-            std::cerr << "Error page deserialize: Failed to read slot " << i << std::endl;
-            return;
-        }
+    std::cout << "Debug  page serialize: Serialized page (PageID: " << metadata.pageID << ", SlotCount: " << metadata.slotCount << ")\n";
+}
 
-        // Ensure that the slot has a valid length and does not exceed the page size
-        if (slot.length > 0 && slot.offset + slot.length <= PAGE_SIZE) {
-            slots.push_back(slot);
-            std::cout << "Debug page deserialize: Slot added. Offset: " << slot.offset 
-                      << ", Length: " << slot.length << std::endl;
-        } else {
-            // Log error if the slot is invalid
-            std::cerr << "Error page deserialize: Invalid slot at index " << i << ". Offset: " << slot.offset
-                      << ", Length: " << slot.length << std::endl;
-        }
+void Page::deserialize(std::fstream& dbFile) {
+    if (!dbFile.is_open()) {
+        throw std::runtime_error("Error page deserialize: File stream is not open.");
     }
 
-    // Read the page data
-    dbFile.read(data, PAGE_SIZE);
+    // Read straight into the page's own buffer
+    dbFile.read(data.data(), data.size());
     if (!dbFile) {
-       dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }    
-        
+        throw std::runtime_error("Error page deserialize: Failed to read page " + std::to_string(metadata.pageID) + ".");
     }
+    parseImage();
 
-    std::cout << "Debug page deserialize: Finished deserializing page. PageID: " << metadata.pageID << "\n";
-
+    std::cout << "Debug page deserialize: Finished deserializing page. PageID: " << metadata.pageID
+              << ", SlotCount: " << metadata.slotCount << "\n";
 }
 
-std::string Page::getTupleIndex(const std::string& tablePath, uint16_t tupleID) {
-    std::fstream dbFile;
-    dbFile.open(tablePath, std::ios::in | std::ios::binary);
-    if (!dbFile.is_open()) {
-        dbFile.open(tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }        
+std::string Page::getTupleIndex(const std::string& tablePath, int64_t tupleID) {
+    TableFile dbFile(tablePath, false);
+    if (!dbFile.isOpen()) {
+        std::cerr << "Error getTupleIndex: Unable to open table file: " << tablePath << std::endl;
         return "";
     }
 
     // Deserialize file metadata (assumed at the beginning of the file)
     FileMetadata fileMetadata;
-    fileMetadata.deserialize(dbFile);
-
-     // Check for deserialization success
-    if (dbFile.fail()) {
-        std::cerr << "Error getTupleIndex: Failed to deserialize file metadata.\n";
-        dbFile.close();
+    try {
+        fileMetadata.deserialize(dbFile);
+    } catch (const std::exception& e) {
+        std::cerr << "Error getTupleIndex: Failed to deserialize file metadata: " << e.what() << "\n";
         return "";
     }
 
-    // Use the tuple-to-page map to find the page ID associated with the tupleID
-    auto it = fileMetadata.getTupleToPageMap().find(tupleID);
-    if (it == fileMetadata.getTupleToPageMap().end() || it->second == -2) {
+    // Use the id index to find the page ID associated with the tupleID
+    int64_t pageID = fileMetadata.getPageIDForTuple(tupleID);
+    if (pageID < 0) {
         std::cerr << "Error getTupleIndex: Tuple ID not found or marked as deleted." << std::endl;
-        dbFile.close();
         return "";
     }
 
-    uint16_t pageID = it->second;
     std::cout << "Debug getTupleIndex: Found tuple with ID " << tupleID << " on page " << pageID << std::endl;
 
-    // Use your getPagePosition function to get the page position
-    uint64_t pagePosition = fileMetadata.getPagePosition(pageID); // Assuming getPagePosition handles the offset correctly
-    std::cout << "Debug getTupleIndex: Seeking to page position " << pagePosition << std::endl;
-
     // Deserialize the page
     Page page(pageID);
-    page.deserialize(dbFile);
-    // Check for deserialization success
-    if (dbFile.fail()) {
-        std::cerr << "Error getTupleIndex: Failed to deserialize page " << pageID << ".\n";
-        dbFile.close();
+    try {
+        dbFile.readPage(fileMetadata, pageID, page);
+    } catch (const std::exception& e) {
+        std::cerr << "Error getTupleIndex: Failed to deserialize page " << pageID << ": " << e.what() << "\n";
         return "";
     }
 
     // Map the tupleID to the correct slot index
-    uint16_t slotIndex = -1;
-    for (uint16_t i = 0; i < page.getTupleCount(); ++i) {
+    int slotIndex = -1;
+    for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+        if (page.getSlot(i).length == 0) continue; // Deleted slot
         // Assuming the tuple ID is stored in the tuple itself, you could compare here
         std::string tupleData = page.getTupleData(i);  // Retrieve the tuple data
         Tuple tuple;
@@ -291,7 +219,6 @@ std::string Page::getTupleIndex(const std::string& tablePath, uint16_t tupleID)
 
     if (slotIndex == -1) {
         std::cerr << "Error getTupleIndex: Tuple ID not found on the page." << std::endl;
-        dbFile.close();
         return "";
     }
 
@@ -299,11 +226,10 @@ std::string Page::getTupleIndex(const std::string& tablePath, uint16_t tupleID)
     std::string tupleData = page.getTupleData(slotIndex);
     std::cout << "Debug getTupleIndex: Retrieved tuple data: " << tupleData << std::endl;
 
-    dbFile.close();
     return tupleData;
 }
 
-std::string Page::getTupleData(uint16_t index) const
+std::string Page::getTupleData(uint32_t index) const
 {
     // Debug: Check if the index is valid
         std::cout << "Debug getTupleData: Retrieving tuple at index " << index << std::endl;
@@ -312,64 +238,24 @@ std::string Page::getTupleData(uint16_t index) const
             std::cerr << "Error getTupleData: Tuple ID not found at index " << index << std::endl;
             throw std::out_of_range("Tuple ID not found");
         }
-        if (slots[index].offset + slots[index].length > PAGE_SIZE) {
+        if (slots[index].offset + slots[index].length > data.size()) {
         std::cerr << "Error getTupleData: Corrupted page data. Tuple offset and length are out of bounds." << std::endl;
         throw std::runtime_error("Corrupted page data.");
     }
         const Slot& slot = slots[index];
         std::cout << "Debug getTupleData: Tuple found. Offset: " << slot.offset << ", Length: " << slot.length << std::endl;
 
-        return std::string(data + slot.offset, slot.length);
+        return std::string(data.data() + slot.offset, slot.length);
 }
-bool Page::deleteTuple(uint16_t slotIndex, int tupleID, const std::string& tablePath)
-{
-    std::cout << "Debug deleteTuple: Attempting to delete tuple with ID " << tupleID << " at slot index " << slotIndex << std::endl;
-
+bool Page::markDeleted(uint32_t slotIndex) {
     if (slotIndex >= slots.size() || slots[slotIndex].length == 0) {
-        std::cerr << "Error deleteTuple: Tuple not found or already deleted at slot index " << slotIndex << std::endl;
-        return false;  // Tuple not found or already deleted
+        return false;
     }
-    
-    Slot& slot = slots[slotIndex];
-    
-    // Open the file to update the tuple-to-page map
-    std::fstream dbFile(tablePath, std::ios::in | std::ios::out | std::ios::binary);
-    if (!dbFile.is_open()) {
-         dbFile.open(tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }
-    }
-    
-    // Deserialize the file metadata
-    FileMetadata fileMetadata;
-    fileMetadata.deserialize(dbFile);
-    
-    // Remove the tuple from the page map (mark as deleted)
-    fileMetadata.removeTupleFromPageMap(tupleID);
-    std::cout << "Debug deleteTuple: Tuple with ID " << tupleID << " is marked as deleted in the page map." << std::endl;
-    
-    // Clear the data associated with the slot
-    std::memset(data + slot.offset, 0, slot.length);
-    std::cout << "Debug deleteTuple: Cleared data at offset " << slot.offset << ", Length: " << slot.length << std::endl;
-
-    // Reset the slot metadata to mark the tuple as deleted
-    slot.length = 0;
-    slot.offset = 0;
+    slots[slotIndex] = {0, 0};
     metadata.slotCount--;
-    std::cout << "Debug deleteTuple: Slot marked as deleted. Remaining slot count: " << metadata.slotCount << std::endl;
-
-    
-    // Move the file pointer back to the beginning of the file before writing the updated metadata
-    dbFile.seekp(0, std::ios::beg);
-    
-    // Serialize the updated file metadata
-    fileMetadata.serialize(dbFile);  // This will update the metadata in the file
-    std::cout << "Debug deleteTuple: Updated file metadata written to the file." << std::endl;
-
-    dbFile.close();
     return true;
 }
+
 int Page::getTupleIndexByID(const std::string& id) const
 {
     std::cout << "Debug getTupleIndexByID: Searching for tuple with ID " << id << std::endl;
@@ -381,7 +267,7 @@ int Page::getTupleIndexByID(const std::string& id) const
         }
 
         // Extract tuple data from the page
-        std::string tupleData(data + slots[i].offset, slots[i].length);
+        std::string tupleData(data.data() + slots[i].offset, slots[i].length);
 
         // Deserialize the tuple
         Tuple tuple;
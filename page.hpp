@@ -7,44 +7,81 @@
 #include <fstream>
 #include <cstring>
 #include <map>
+#include <sys/uio.h>
 #include "tuple.hpp"
+#include "memory.hpp"
 
 #include"FileMetaData.hpp"
-constexpr size_t PAGE_SIZE = 4096; // 4 KB
+constexpr size_t PAGE_SIZE = 4096; // Default page size, 4 KB
+constexpr size_t MAX_PAGE_SIZE = 65536;
+
+// Page sizes a table can be created with; the size is fixed for the table's lifetime
+inline bool isSupportedPageSize(size_t size) {
+    return size == 4096 || size == 8192 || size == 16384 || size == 32768 || size == MAX_PAGE_SIZE;
+}
+
+// Values of PageMetadata::pageType
+constexpr uint16_t PAGE_TYPE_DATA = 0;
+constexpr uint16_t PAGE_TYPE_METADATA = 1; // Continuation of the file header
+constexpr uint16_t PAGE_TYPE_OVERFLOW = 2; // Part of a long value kept out of its row (see OverflowStore)
+constexpr uint16_t PAGE_TYPE_FREE = 3;     // Released overflow page, waiting to be reused
 
 struct Slot {
-    uint16_t offset;
-    uint16_t length;
+    uint32_t offset;
+    uint32_t length;
 };
 
 struct PageMetadata {
-    uint16_t pageID;
-    uint16_t slotCount;
-    uint16_t freeSpace;
-    uint16_t freeSpaceEnd;
+    uint64_t pageID;
+    uint32_t slotCount;
+    uint32_t freeSpace;
+    uint32_t freeSpaceEnd;
+    uint16_t pageType;
+    uint16_t reserved;
 };
 
+using SlotList = std::vector<Slot, AccountingAllocator<Slot, MemoryComponent::Pages>>;
+
+// On disk a page is exactly its table's page size: PageMetadata, the slot directory length,
+// the slot directory, free space, then tuple data growing down from the end.
+constexpr size_t PAGE_HEADER_SIZE = sizeof(PageMetadata) + sizeof(uint32_t);
+
 class Page {
 private:
     PageMetadata metadata;
-    std::vector<Slot> slots;
-    char data[PAGE_SIZE];
+    SlotList slots;
+    std::vector<char, AccountingAllocator<char, MemoryComponent::Pages>> data; // The page image; its size is the page size
+
+    friend class TableFile; // Reads into data and writes the image straight from the page
+
+    void parseImage();
+    // The image as IMAGE_PIECES buffers for a vectored write, without assembling it
+    void imagePieces(struct iovec* pieces, uint32_t& directorySize) const;
 
 public:
-    Page(uint16_t id);
+    static const int IMAGE_PIECES = 4;
+
+    Page(uint64_t id, size_t pageSize = PAGE_SIZE);
 
-    uint32_t getPageID() const;
+    uint64_t getPageID() const;
+    size_t getPageSize() const;
+    uint16_t getPageType() const;
     size_t getFreeSpace() const;
-    uint16_t getTupleCount() const;
-    const std::vector<Slot>& getSlots() const;
+    uint32_t getTupleCount() const;
+    const SlotList& getSlots() const;
     Slot getSlot(size_t index) const;
 
-    bool addTuple(const std::string& tuple, FileMetadata* fileMetadata, int tupleId);
-    void serialize(std::fstream& dbFile);
+    bool addTuple(const std::string& tuple, FileMetadata* fileMetadata, int64_t tupleId);
+    bool appendTuple(const std::string& tuple);
+    // Images are getPageSize() bytes
+    void toImage(char* image) const;
+    void fromImage(const char* image);
+    void serialize(std::fstream& dbFile) const;
     void deserialize(std::fstream& dbFile);
-    std::string getTupleIndex(const std::string& tablePath, uint16_t tupleID);
-    std::string getTupleData(uint16_t index)const;
-    bool deleteTuple(uint16_t slotIndex, int tupleID, const std::string& tablePath) ;
+    std::string getTupleIndex(const std::string& tablePath, int64_t tupleID);
+    std::string getTupleData(uint32_t index)const;
+    // Tombstones a slot in memory only; the row's bytes stay in the image until space is reclaimed
+    bool markDeleted(uint32_t slotIndex);
     int getTupleIndexByID(const std::string& id) const;
 
 
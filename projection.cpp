@@ -0,0 +1,107 @@
+#include "projection.hpp"
+#include "overflow.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+Projection::Projection(const CompiledSchema& schema, const std::vector<std::string>& requested) {
+    columns.reserve(requested.size());
+    for (const std::string& column : requested) {
+        if (schema.ordinalOf(column) == CompiledSchema::NO_COLUMN) {
+            throw std::invalid_argument("Unknown column in projection: " + column);
+        }
+        columns.push_back(column);
+    }
+}
+
+void Projection::setFetch(Fetch fetchValue) {
+    fetch = std::move(fetchValue);
+}
+
+size_t Projection::size() const {
+    return columns.size();
+}
+
+const std::string& Projection::getColumn(size_t index) const {
+    return columns.at(index);
+}
+
+int Projection::indexOf(const std::string& column) const {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i] == column) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool Projection::readId(const std::string& tupleData, int64_t& id) {
+    size_t pos = 0;
+    while (pos < tupleData.size()) {
+        size_t open = tupleData.find('(', pos);
+        size_t bar = open == std::string::npos ? open : tupleData.find('|', open);
+        size_t close = bar == std::string::npos ? bar : tupleData.find(')', bar);
+        if (close == std::string::npos) return false;
+        if (open - pos == 2 && tupleData.compare(pos, 2, "id") == 0) {
+            char* end = nullptr;
+            id = std::strtoll(tupleData.c_str() + bar + 1, &end, 10);
+            return end == tupleData.c_str() + close;
+        }
+        pos = close + 1;
+    }
+    return false;
+}
+
+bool Projection::readValue(const std::string& tupleData, const std::string& column, std::string_view& value) {
+    size_t pos = 0;
+    while (pos < tupleData.size()) {
+        size_t open = tupleData.find('(', pos);
+        size_t bar = open == std::string::npos ? open : tupleData.find('|', open);
+        size_t close = bar == std::string::npos ? bar : tupleData.find(')', bar);
+        if (close == std::string::npos) return false;
+        if (open - pos == column.size() && tupleData.compare(pos, column.size(), column) == 0) {
+            value = std::string_view(tupleData.data() + bar + 1, close - bar - 1);
+            return true;
+        }
+        pos = close + 1;
+    }
+    return false;
+}
+
+bool Projection::decode(const std::string& tupleData, ProjectedRow& row) const {
+    row.data.clear();
+    row.spans.assign(columns.size(), {0, 0});
+    size_t found = 0;
+    bool hasId = false;
+
+    size_t pos = 0;
+    while (pos < tupleData.size() && (found < columns.size() || !hasId)) {
+        size_t open = tupleData.find('(', pos);
+        size_t bar = open == std::string::npos ? open : tupleData.find('|', open);
+        size_t close = bar == std::string::npos ? bar : tupleData.find(')', bar);
+        if (close == std::string::npos) return false;
+
+        const char* key = tupleData.data() + pos;
+        size_t keyLength = open - pos;
+        if (keyLength == 2 && std::memcmp(key, "id", 2) == 0) {
+            char* end = nullptr;
+            row.id = std::strtoll(tupleData.c_str() + bar + 1, &end, 10);
+            hasId = true;
+        }
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i].size() == keyLength && std::memcmp(columns[i].data(), key, keyLength) == 0) {
+                if (row.spans[i].second == 0) ++found;
+                size_t offset = row.data.size();
+                if (OverflowStore::isPointerType(std::string_view(tupleData).substr(open + 1, bar - open - 1))) {
+                    if (!fetch || !fetch(std::string_view(tupleData).substr(bar + 1, close - bar - 1), row.data)) {
+                        return false;
+                    }
+                } else {
+                    row.data.append(tupleData, bar + 1, close - bar - 1);
+                }
+                row.spans[i] = {static_cast<uint32_t>(offset), static_cast<uint32_t>(row.data.size() - offset)};
+                break;
+            }
+        }
+        pos = close + 1;
+    }
+    return hasId && found == columns.size();
+}
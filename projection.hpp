@@ -0,0 +1,54 @@
+#ifndef PROJECTION_HPP
+#define PROJECTION_HPP
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "schema.hpp"
+
+// Requested columns of one row.
+// All values share one buffer, so a row costs two allocations however many columns it has,
+// and reusing a row across a scan costs none once the buffers have grown.
+struct ProjectedRow {
+    int64_t id = 0;
+    std::string data;                                // Values back to back
+    std::vector<std::pair<uint32_t, uint32_t>> spans; // (offset, length) per projected column
+
+    size_t size() const { return spans.size(); }
+    std::string_view value(size_t column) const {
+        return std::string_view(data).substr(spans[column].first, spans[column].second);
+    }
+    std::string_view operator[](size_t column) const { return value(column); }
+};
+
+// A list of columns resolved against a compiled schema.
+// decode() walks a stored key(type|value) row once and copies out only the requested values.
+// Values kept in overflow pages are fetched through the fetch function, and only when projected.
+class Projection {
+public:
+    // Appends the value an overflow pointer refers to; false if it cannot be read
+    using Fetch = std::function<bool(std::string_view pointer, std::string& value)>;
+
+    Projection(const CompiledSchema& schema, const std::vector<std::string>& columns);
+    void setFetch(Fetch fetch);
+
+    size_t size() const;
+    const std::string& getColumn(size_t index) const;
+    int indexOf(const std::string& column) const; // Position in the projection, or -1
+
+    // Reads only the id attribute of a stored row
+    static bool readId(const std::string& tupleData, int64_t& id);
+    // Finds one attribute's value in a stored row without decoding the others
+    static bool readValue(const std::string& tupleData, const std::string& column, std::string_view& value);
+    // Fills row with the projected values; false if the row lacks one of them
+    bool decode(const std::string& tupleData, ProjectedRow& row) const;
+
+private:
+    std::vector<std::string> columns;
+    Fetch fetch;
+};
+
+#endif // PROJECTION_HPP
@@ -0,0 +1,152 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstring>
+#include "tuple.hpp"
+
+// Wire format shared by StorageServer and StorageClient.
+// Every frame starts with a uint32 length counting the bytes after it, then a uint32 request
+// id and one code byte: the operation in a request, the status in its response. Integers are
+// in host byte order, since both ends run on the same machine. Strings are a uint32 length and
+// the bytes. A client may send any number of requests before reading responses; responses
+// carry the id of their request and can arrive in any order.
+//
+// Request bodies (responses in brackets):
+//   Ping           -                                       [-]
+//   CreateDatabase db                                      [-]
+//   CreateTable    db table u32 n {column type}*n          [-]
+//   TableExists    db table                                [Ok or NotFound]
+//   Insert         db table tuple                          [-]
+//   Get            db table i64 id                         [u32 n {column value}*n]
+//   Delete         db table i64 id                         [-]
+//   Update         db table i64 id tuple                   [-]
+//   Scan           db table i64 lo i64 hi u32 limit u32 n {column}*n
+//                                                          [u32 rows {i64 id {value}*n}*rows]
+// where tuple is u32 n {name u8 type value}*n. An Error response body holds a message.
+// A Scan limit caps the rows of the reply; SCAN_NO_LIMIT (0) returns every row in [lo, hi].
+// A Scan reply also ends early once it passes half the frame limit; scan on from the last id.
+enum class RequestOp : uint8_t {
+    Ping = 1,
+    CreateDatabase = 2,
+    CreateTable = 3,
+    TableExists = 4,
+    Insert = 5,
+    Get = 6,
+    Delete = 7,
+    Update = 8,
+    Scan = 9
+};
+
+enum class ResponseStatus : uint8_t {
+    Ok = 0,
+    NotFound = 1,
+    Error = 2
+};
+
+const size_t FRAME_HEADER_SIZE = 9;               // Length, request id, code
+const uint32_t MAX_FRAME_BYTES = 64 * 1024 * 1024;
+const uint32_t SCAN_NO_LIMIT = 0;                 // Scan limit that caps nothing
+
+// Appends fields to a buffer; frames are opened with begin() and closed with end()
+class WireWriter {
+public:
+    explicit WireWriter(std::string& buffer) : out(buffer) {}
+
+    size_t begin(uint32_t requestId, uint8_t code) {
+        size_t start = out.size();
+        u32(0);
+        u32(requestId);
+        u8(code);
+        return start;
+    }
+    void end(size_t start) {
+        uint32_t length = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+        std::memcpy(&out[start], &length, sizeof(length));
+    }
+
+    void u8(uint8_t value) { out.push_back(static_cast<char>(value)); }
+    void u32(uint32_t value) { out.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void i64(int64_t value) { out.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void str(std::string_view value) {
+        u32(static_cast<uint32_t>(value.size()));
+        out.append(value.data(), value.size());
+    }
+    void tuple(const Tuple& tuple) {
+        const auto& attributes = tuple.getAttributeList();
+        u32(static_cast<uint32_t>(attributes.size()));
+        for (const auto& [name, typed] : attributes) {
+            str(name);
+            u8(static_cast<uint8_t>(typed.first));
+            str(typed.second);
+        }
+    }
+
+private:
+    std::string& out;
+};
+
+// Reads fields from a frame body; a read past the end clears ok() and returns empty values
+class WireReader {
+public:
+    explicit WireReader(std::string_view body) : data(body) {}
+
+    bool ok() const { return good; }
+    bool atEnd() const { return pos == data.size(); }
+
+    uint8_t u8() {
+        uint8_t value = 0;
+        take(&value, sizeof(value));
+        return value;
+    }
+    uint32_t u32() {
+        uint32_t value = 0;
+        take(&value, sizeof(value));
+        return value;
+    }
+    int64_t i64() {
+        int64_t value = 0;
+        take(&value, sizeof(value));
+        return value;
+    }
+    std::string_view str() {
+        uint32_t length = u32();
+        if (!good || length > data.size() - pos) {
+            good = false;
+            return {};
+        }
+        std::string_view value = data.substr(pos, length);
+        pos += length;
+        return value;
+    }
+    bool tuple(Tuple& tuple) {
+        uint32_t count = u32();
+        for (uint32_t i = 0; good && i < count; ++i) {
+            std::string name(str());
+            int type = u8();
+            std::string value(str());
+            if (good) tuple.addAttribute(name, type, value);
+        }
+        return good;
+    }
+
+private:
+    std::string_view data;
+    size_t pos = 0;
+    bool good = true;
+
+    void take(void* value, size_t size) {
+        if (!good || size > data.size() - pos) {
+            good = false;
+            return;
+        }
+        std::memcpy(value, data.data() + pos, size);
+        pos += size;
+    }
+};
+
+#endif // PROTOCOL_HPP
@@ -0,0 +1,591 @@
+#include "query.hpp"
+#include "storage.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <charconv>
+#include <limits>
+
+namespace {
+
+struct Token {
+    enum Kind { Word, Number, String, Symbol, Param, End } kind;
+    std::string text;
+};
+
+// Splits a statement into words, numbers, 'strings', ? and the symbols , ( ) * = != <> < <= > >=
+bool tokenize(const std::string& text, std::vector<Token>& tokens, std::string& error) {
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t start = i;
+            while (i < text.size() && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_')) ++i;
+            tokens.push_back({Token::Word, text.substr(start, i - start)});
+        } else if (std::isdigit(static_cast<unsigned char>(c)) ||
+                   ((c == '-' || c == '.') && i + 1 < text.size() && std::isdigit(static_cast<unsigned char>(text[i + 1])))) {
+            size_t start = i++;
+            while (i < text.size() && (std::isdigit(static_cast<unsigned char>(text[i])) || text[i] == '.')) ++i;
+            tokens.push_back({Token::Number, text.substr(start, i - start)});
+        } else if (c == '\'') {
+            std::string value;
+            for (++i;; ++i) {
+                if (i == text.size()) {
+                    error = "unterminated string";
+                    return false;
+                }
+                if (text[i] == '\'') {
+                    if (i + 1 < text.size() && text[i + 1] == '\'') {
+                        value += '\'';
+                        ++i;
+                        continue;
+                    }
+                    ++i;
+                    break;
+                }
+                value += text[i];
+            }
+            tokens.push_back({Token::String, value});
+        } else if (c == '?') {
+            tokens.push_back({Token::Param, "?"});
+            ++i;
+        } else if ((c == '!' || c == '<' || c == '>') && i + 1 < text.size() &&
+                   (text[i + 1] == '=' || (c == '<' && text[i + 1] == '>'))) {
+            tokens.push_back({Token::Symbol, text.substr(i, 2)});
+            i += 2;
+        } else if (std::string(",()*=<>;").find(c) != std::string::npos) {
+            tokens.push_back({Token::Symbol, std::string(1, c)});
+            ++i;
+        } else {
+            error = std::string("unexpected character '") + c + "'";
+            return false;
+        }
+    }
+    if (!tokens.empty() && tokens.back().kind == Token::Symbol && tokens.back().text == ";") {
+        tokens.pop_back();
+    }
+    tokens.push_back({Token::End, ""});
+    return true;
+}
+
+class Parser {
+public:
+    Parser(const std::vector<Token>& tokens, std::string& error) : tokens(tokens), error(error) {}
+
+    const Token& peek() const { return tokens[pos]; }
+
+    bool isKeyword(const char* word) const {
+        const Token& token = peek();
+        if (token.kind != Token::Word || token.text.size() != std::strlen(word)) return false;
+        for (size_t i = 0; i < token.text.size(); ++i) {
+            if (std::toupper(static_cast<unsigned char>(token.text[i])) != word[i]) return false;
+        }
+        return true;
+    }
+
+    bool acceptKeyword(const char* word) {
+        if (!isKeyword(word)) return false;
+        ++pos;
+        return true;
+    }
+
+    bool expectKeyword(const char* word) {
+        return acceptKeyword(word) || fail(std::string("expected ") + word);
+    }
+
+    bool acceptSymbol(const char* symbol) {
+        if (peek().kind != Token::Symbol || peek().text != symbol) return false;
+        ++pos;
+        return true;
+    }
+
+    bool expectSymbol(const char* symbol) {
+        return acceptSymbol(symbol) || fail(std::string("expected '") + symbol + "'");
+    }
+
+    bool name(std::string& out) {
+        if (peek().kind != Token::Word) return fail("expected a name");
+        out = tokens[pos++].text;
+        return true;
+    }
+
+    bool value(QueryPlan::Value& out, size_t& parameters) {
+        const Token& token = peek();
+        if (token.kind == Token::Param) {
+            out.param = static_cast<int>(parameters++);
+        } else if (token.kind == Token::Number || token.kind == Token::String) {
+            out.text = token.text;
+        } else {
+            return fail("expected a value");
+        }
+        ++pos;
+        return true;
+    }
+
+    bool op(QueryPlan::Op& out) {
+        static const std::pair<const char*, QueryPlan::Op> ops[] = {
+            {"=", QueryPlan::Op::Eq}, {"!=", QueryPlan::Op::Ne}, {"<>", QueryPlan::Op::Ne}, {"<", QueryPlan::Op::Lt},
+            {"<=", QueryPlan::Op::Le}, {">", QueryPlan::Op::Gt}, {">=", QueryPlan::Op::Ge}};
+        for (const auto& [symbol, value] : ops) {
+            if (acceptSymbol(symbol)) {
+                out = value;
+                return true;
+            }
+        }
+        return fail("expected a comparison");
+    }
+
+    bool atEnd() const { return peek().kind == Token::End; }
+
+    bool fail(const std::string& message) {
+        error = message + (atEnd() ? " at end of statement" : " near '" + peek().text + "'");
+        return false;
+    }
+
+private:
+    const std::vector<Token>& tokens;
+    size_t pos = 0;
+    std::string& error;
+};
+
+bool parseWhere(Parser& parser, std::vector<QueryPlan::Condition>& conditions, size_t& parameters) {
+    if (!parser.acceptKeyword("WHERE")) return true;
+    do {
+        QueryPlan::Condition condition;
+        if (!parser.name(condition.column) || !parser.op(condition.op) || !parser.value(condition.value, parameters)) {
+            return false;
+        }
+        conditions.push_back(std::move(condition));
+    } while (parser.acceptKeyword("AND"));
+    return true;
+}
+
+bool parseInt(std::string_view text, int64_t& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool parseDouble(std::string_view text, double& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool fitsType(const std::string& text, ColumnType type) {
+    int64_t i;
+    double d;
+    return type == ColumnType::Int ? parseInt(text, i) : type == ColumnType::Double ? parseDouble(text, d) : true;
+}
+
+template <typename T>
+bool compare(const T& a, const T& b, QueryPlan::Op op) {
+    switch (op) {
+        case QueryPlan::Op::Eq: return a == b;
+        case QueryPlan::Op::Ne: return !(a == b);
+        case QueryPlan::Op::Lt: return a < b;
+        case QueryPlan::Op::Le: return !(b < a);
+        case QueryPlan::Op::Gt: return b < a;
+        case QueryPlan::Op::Ge: return !(a < b);
+    }
+    return false;
+}
+
+} // namespace
+
+std::shared_ptr<QueryPlan> QueryPlan::parse(const std::string& dbName, const std::string& text, std::string& error) {
+    std::vector<Token> tokens;
+    if (!tokenize(text, tokens, error)) {
+        return nullptr;
+    }
+    auto plan = std::make_shared<QueryPlan>();
+    plan->dbName = dbName;
+    Parser parser(tokens, error);
+    size_t& parameters = plan->parameters;
+    bool ok;
+
+    if (parser.acceptKeyword("SELECT")) {
+        plan->kind = Kind::Select;
+        if (parser.acceptSymbol("*")) {
+            plan->columns.clear(); // Every column, filled in by bind
+        } else {
+            do {
+                plan->columns.emplace_back();
+                if (!parser.name(plan->columns.back())) return nullptr;
+            } while (parser.acceptSymbol(","));
+        }
+        ok = parser.expectKeyword("FROM") && parser.name(plan->table) && parseWhere(parser, plan->conditions, parameters);
+    } else if (parser.acceptKeyword("INSERT")) {
+        plan->kind = Kind::Insert;
+        ok = parser.expectKeyword("INTO") && parser.name(plan->table) && parser.expectSymbol("(");
+        while (ok) {
+            plan->columns.emplace_back();
+            ok = parser.name(plan->columns.back());
+            if (!ok || !parser.acceptSymbol(",")) break;
+        }
+        ok = ok && parser.expectSymbol(")") && parser.expectKeyword("VALUES");
+        while (ok) {
+            plan->insertRows.emplace_back();
+            ok = parser.expectSymbol("(");
+            while (ok) {
+                plan->insertRows.back().emplace_back();
+                ok = parser.value(plan->insertRows.back().back(), parameters);
+                if (!ok || !parser.acceptSymbol(",")) break;
+            }
+            ok = ok && parser.expectSymbol(")");
+            if (!ok || !parser.acceptSymbol(",")) break;
+        }
+    } else if (parser.acceptKeyword("UPDATE")) {
+        plan->kind = Kind::Update;
+        ok = parser.name(plan->table) && parser.expectKeyword("SET");
+        while (ok) {
+            Assignment assignment;
+            ok = parser.name(assignment.column) && parser.expectSymbol("=") && parser.value(assignment.value, parameters);
+            plan->assignments.push_back(std::move(assignment));
+            if (!ok || !parser.acceptSymbol(",")) break;
+        }
+        ok = ok && parseWhere(parser, plan->conditions, parameters);
+    } else if (parser.acceptKeyword("DELETE")) {
+        plan->kind = Kind::Delete;
+        ok = parser.expectKeyword("FROM") && parser.name(plan->table) && parseWhere(parser, plan->conditions, parameters);
+    } else {
+        ok = parser.fail("expected SELECT, INSERT, UPDATE or DELETE");
+    }
+    if (ok && !parser.atEnd()) {
+        ok = parser.fail("unexpected text");
+    }
+    if (!ok) {
+        return nullptr;
+    }
+    plan->tablePath = dbName + "/" + plan->table + ".HAD";
+    return plan;
+}
+
+bool QueryPlan::bind(const std::map<std::string, std::string>& schema, std::string& error) {
+    if (schema.empty()) {
+        error = "no table " + table;
+        return false;
+    }
+    CompiledSchema compiled(schema);
+    auto typeOf = [&](const std::string& column, ColumnType& type) {
+        int ordinal = compiled.ordinalOf(column);
+        if (ordinal == CompiledSchema::NO_COLUMN) {
+            error = "no column " + column + " in " + table;
+            return false;
+        }
+        type = compiled.getColumn(ordinal).type;
+        return true;
+    };
+    auto checkLiteral = [&](const std::string& column, const Value& value, ColumnType type) {
+        if (value.param < 0 && !fitsType(value.text, type)) {
+            error = "'" + value.text + "' is not a valid " + CompiledSchema::typeName(type) + " for " + column;
+            return false;
+        }
+        return true;
+    };
+
+    if ((kind == Kind::Select && columns.empty()) || kind == Kind::Update) {
+        columns.clear(); // An update rewrites the whole row, so it reads every column
+        for (const ColumnDescriptor& column : compiled.getColumns()) {
+            columns.push_back(column.name);
+        }
+    }
+    columnTypes.resize(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (!typeOf(columns[i], columnTypes[i])) return false;
+    }
+
+    if (kind == Kind::Insert) {
+        if (std::find(columns.begin(), columns.end(), "id") == columns.end()) {
+            error = "an insert needs the id column";
+            return false;
+        }
+        for (const std::vector<Value>& row : insertRows) {
+            if (row.size() != columns.size()) {
+                error = "an insert row has " + std::to_string(row.size()) + " values for " + std::to_string(columns.size()) + " columns";
+                return false;
+            }
+            for (size_t i = 0; i < row.size(); ++i) {
+                if (!checkLiteral(columns[i], row[i], columnTypes[i])) return false;
+            }
+        }
+    }
+    for (Assignment& assignment : assignments) {
+        if (assignment.column == "id") {
+            error = "the id of a row cannot be updated";
+            return false;
+        }
+        if (!typeOf(assignment.column, assignment.type) || !checkLiteral(assignment.column, assignment.value, assignment.type)) {
+            return false;
+        }
+    }
+
+    readColumns = kind == Kind::Delete ? std::vector<std::string>() : columns;
+    for (Condition& condition : conditions) {
+        if (!typeOf(condition.column, condition.type) || !checkLiteral(condition.column, condition.value, condition.type)) {
+            return false;
+        }
+        if (condition.column == "id") {
+            condition.slot = -1;
+            continue;
+        }
+        auto it = std::find(readColumns.begin(), readColumns.end(), condition.column);
+        condition.slot = static_cast<int>(it - readColumns.begin());
+        if (it == readColumns.end()) {
+            readColumns.push_back(condition.column);
+        }
+    }
+    pointLookup = conditions.size() == 1 && conditions[0].column == "id" && conditions[0].op == Op::Eq;
+    bound = true;
+    return true;
+}
+
+QueryPlan::Kind QueryPlan::getKind() const {
+    return kind;
+}
+
+const std::string& QueryPlan::getTable() const {
+    return table;
+}
+
+const std::string& QueryPlan::getTablePath() const {
+    return tablePath;
+}
+
+size_t QueryPlan::parameterCount() const {
+    return parameters;
+}
+
+// A condition with its value converted to the column's type
+struct QueryPlan::Filter {
+    int slot = -1;
+    Op op = Op::Eq;
+    ColumnType type = ColumnType::Invalid;
+    int64_t intValue = 0;
+    double doubleValue = 0;
+    std::string text;
+
+    bool matches(const ProjectedRow& row) const {
+        if (slot < 0) {
+            return compare(row.id, intValue, op);
+        }
+        std::string_view value = row.value(slot);
+        if (type == ColumnType::Int) {
+            int64_t number;
+            return parseInt(value, number) && compare(number, intValue, op);
+        }
+        if (type == ColumnType::Double) {
+            double number;
+            return parseDouble(value, number) && compare(number, doubleValue, op);
+        }
+        return compare(value, std::string_view(text), op);
+    }
+};
+
+// What one execution works with once the parameters are in
+struct QueryPlan::Execution {
+    int64_t lo = std::numeric_limits<int64_t>::min();
+    int64_t hi = std::numeric_limits<int64_t>::max();
+    std::vector<Filter> filters;
+    std::vector<std::vector<std::string>> rows;    // INSERT values
+    std::vector<std::string> assigned;             // UPDATE values, as assignments
+
+    bool matches(const ProjectedRow& row) const {
+        for (const Filter& filter : filters) {
+            if (!filter.matches(row)) return false;
+        }
+        return true;
+    }
+};
+
+bool QueryPlan::valueText(const Value& value, const std::vector<std::string>& params, ColumnType type, std::string& text,
+                          std::string& error) const {
+    if (value.param < 0) {
+        text = value.text; // Checked by bind
+        return true;
+    }
+    text = params[value.param];
+    if (!fitsType(text, type)) {
+        error = "parameter " + std::to_string(value.param + 1) + " '" + text + "' is not a valid " + CompiledSchema::typeName(type);
+        return false;
+    }
+    return true;
+}
+
+bool QueryPlan::resolve(const std::vector<std::string>& params, Execution& execution, std::string& error) const {
+    if (!bound) {
+        error = "the statement is not bound";
+        return false;
+    }
+    if (params.size() != parameters) {
+        error = "expected " + std::to_string(parameters) + " parameters, got " + std::to_string(params.size());
+        return false;
+    }
+    std::string text;
+    for (const Condition& condition : conditions) {
+        if (!valueText(condition.value, params, condition.type, text, error)) return false;
+        Filter filter;
+        filter.slot = condition.slot;
+        filter.op = condition.op;
+        filter.type = condition.type;
+        if (condition.type == ColumnType::Int) {
+            parseInt(text, filter.intValue);
+        } else if (condition.type == ColumnType::Double) {
+            parseDouble(text, filter.doubleValue);
+        } else {
+            filter.text = std::move(text);
+        }
+        if (condition.slot >= 0 || condition.op == Op::Ne) {
+            execution.filters.push_back(std::move(filter));
+            continue;
+        }
+        // Conditions on id bound the index range instead
+        int64_t key = filter.intValue;
+        const int64_t min = std::numeric_limits<int64_t>::min(), max = std::numeric_limits<int64_t>::max();
+        switch (condition.op) {
+            case Op::Eq: execution.lo = std::max(execution.lo, key); execution.hi = std::min(execution.hi, key); break;
+            case Op::Lt: if (key == min) execution.hi = min, execution.lo = max; else execution.hi = std::min(execution.hi, key - 1); break;
+            case Op::Le: execution.hi = std::min(execution.hi, key); break;
+            case Op::Gt: if (key == max) execution.lo = max, execution.hi = min; else execution.lo = std::max(execution.lo, key + 1); break;
+            case Op::Ge: execution.lo = std::max(execution.lo, key); break;
+            case Op::Ne: break;
+        }
+    }
+    for (const std::vector<Value>& row : insertRows) {
+        execution.rows.emplace_back(row.size());
+        for (size_t i = 0; i < row.size(); ++i) {
+            if (!valueText(row[i], params, columnTypes[i], execution.rows.back()[i], error)) return false;
+        }
+    }
+    execution.assigned.resize(assignments.size());
+    for (size_t i = 0; i < assignments.size(); ++i) {
+        if (!valueText(assignments[i].value, params, assignments[i].type, execution.assigned[i], error)) return false;
+    }
+    return true;
+}
+
+QueryResult QueryPlan::execute(Storage& storage, const std::vector<std::string>& params) const {
+    QueryResult result;
+    Execution execution;
+    if (!resolve(params, execution, result.error)) {
+        std::cerr << "Error execute: " << result.error << std::endl;
+        return result;
+    }
+
+    try {
+        // Rows of the range that pass the filters, with the read columns
+        auto collect = [&](const std::function<void(const ProjectedRow&)>& emit) {
+            if (execution.lo > execution.hi) return;
+            if (pointLookup) {
+                ProjectedRow row;
+                try {
+                    row = storage.get(dbName, table, std::to_string(execution.lo), readColumns);
+                } catch (const std::out_of_range&) {
+                    return; // No such row
+                }
+                emit(row);
+                return;
+            }
+            storage.scan(dbName, table, execution.lo, execution.hi, readColumns, [&](const ProjectedRow& row) {
+                if (execution.matches(row)) emit(row);
+                return true;
+            });
+        };
+
+        switch (kind) {
+            case Kind::Select:
+                result.columns = columns;
+                collect([&](const ProjectedRow& row) {
+                    std::vector<std::string>& out = result.rows.emplace_back(columns.size());
+                    for (size_t i = 0; i < columns.size(); ++i) {
+                        out[i] = row.value(i);
+                    }
+                });
+                break;
+            case Kind::Insert: {
+                std::vector<Tuple> tuples(execution.rows.size());
+                for (size_t r = 0; r < tuples.size(); ++r) {
+                    for (size_t i = 0; i < columns.size(); ++i) {
+                        tuples[r].addAttribute(columns[i], static_cast<int>(columnTypes[i]), execution.rows[r][i]);
+                    }
+                }
+                if (tuples.size() == 1) {
+                    result.affected = storage.insert(dbName, table, tuples[0]) ? 1 : 0;
+                } else {
+                    result.affected = storage.insertBatch(dbName, table, tuples);
+                }
+                break;
+            }
+            case Kind::Update: {
+                // Read every matching row before the first is rewritten, as an update moves it
+                std::vector<std::pair<int64_t, Tuple>> updates;
+                collect([&](const ProjectedRow& row) {
+                    Tuple tuple;
+                    for (size_t i = 0; i < columns.size(); ++i) {
+                        std::string value(row.value(i));
+                        for (size_t a = 0; a < assignments.size(); ++a) {
+                            if (assignments[a].column == columns[i]) value = execution.assigned[a];
+                        }
+                        tuple.addAttribute(columns[i], static_cast<int>(columnTypes[i]), value);
+                    }
+                    updates.emplace_back(row.id, std::move(tuple));
+                });
+                for (const auto& [id, tuple] : updates) {
+                    if (storage.updateTupleInTable(dbName, table, std::to_string(id), tuple)) {
+                        ++result.affected;
+                    }
+                }
+                break;
+            }
+            case Kind::Delete:
+                if (execution.lo > execution.hi) break;
+                if (pointLookup) {
+                    result.affected = storage.deleteBatch(dbName, table, {execution.lo});
+                } else {
+                    result.affected = storage.deleteWhere(dbName, table, execution.lo, execution.hi, readColumns,
+                                                          [&](const ProjectedRow& row) { return execution.matches(row); });
+                }
+                break;
+        }
+    } catch (const std::exception& e) {
+        result.error = e.what();
+        std::cerr << "Error execute: " << result.error << std::endl;
+        return result;
+    }
+    result.ok = true;
+    return result;
+}
+
+std::shared_ptr<const QueryPlan> PlanCache::find(const std::string& dbName, const std::string& text) {
+    auto it = plans.find(dbName + '\n' + text);
+    if (it == plans.end()) {
+        stats.misses++;
+        return nullptr;
+    }
+    stats.hits++;
+    return it->second;
+}
+
+void PlanCache::store(const std::string& dbName, const std::string& text, std::shared_ptr<const QueryPlan> plan) {
+    if (plans.size() >= MAX_PLANS) {
+        plans.erase(plans.begin());
+    }
+    plans[dbName + '\n' + text] = std::move(plan);
+}
+
+void PlanCache::invalidateTable(const std::string& tablePath) {
+    for (auto it = plans.begin(); it != plans.end();) {
+        if (it->second->getTablePath() == tablePath) {
+            it = plans.erase(it);
+            stats.invalidations++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+PlanCacheStats PlanCache::getStats() const {
+    PlanCacheStats result = stats;
+    result.plans = plans.size();
+    return result;
+}
@@ -0,0 +1,122 @@
+#ifndef QUERY_HPP
+#define QUERY_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+#include "schema.hpp"
+
+class Storage;
+
+// Rows a statement produced, or how many it changed
+struct QueryResult {
+    bool ok = false;
+    std::string error;
+    std::vector<std::string> columns;            // SELECT only
+    std::vector<std::vector<std::string>> rows;  // SELECT only, in id order
+    size_t affected = 0;                         // Rows inserted, updated or deleted
+};
+
+struct PlanCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;      // Statements parsed and bound
+    uint64_t invalidations = 0; // Plans dropped because their table was created, deleted or restored
+    uint64_t plans = 0;
+};
+
+// A statement of the query language, parsed and bound against its table's schema once.
+//
+//   SELECT * | col, ... FROM table [WHERE cond AND ...]
+//   INSERT INTO table (col, ...) VALUES (value, ...)[, (value, ...) ...]
+//   UPDATE table SET col = value, ... [WHERE cond AND ...]
+//   DELETE FROM table [WHERE cond AND ...]
+//
+// A cond is "col op value" with op one of = != <> < <= > >=; a value is an integer or
+// decimal literal, a 'quoted' string ('' for a quote) or ?, the next parameter. Keywords
+// are case-insensitive. Conditions on id narrow the range of the index that is read; the
+// others are checked against each row in it, comparing as the column's type.
+//
+// Binding resolves every column against the schema and checks literals against their
+// column types, so execute() only converts the parameters before calling into Storage.
+class QueryPlan {
+public:
+    enum class Kind { Select, Insert, Update, Delete };
+    enum class Op { Eq, Ne, Lt, Le, Gt, Ge };
+
+    // A literal or the parameter at index param
+    struct Value {
+        int param = -1;
+        std::string text;
+    };
+
+    struct Condition {
+        std::string column;
+        Op op = Op::Eq;
+        Value value;
+        ColumnType type = ColumnType::Invalid; // Set by bind
+        int slot = -1;                          // Position in the scanned columns; -1 for id
+    };
+
+    struct Assignment {
+        std::string column;
+        Value value;
+        ColumnType type = ColumnType::Invalid;
+    };
+
+    // Null with error set if text is not a statement
+    static std::shared_ptr<QueryPlan> parse(const std::string& dbName, const std::string& text, std::string& error);
+    // Resolves the statement against its table's schema (column name -> type)
+    bool bind(const std::map<std::string, std::string>& schema, std::string& error);
+
+    Kind getKind() const;
+    const std::string& getTable() const;
+    const std::string& getTablePath() const;
+    size_t parameterCount() const;
+
+    QueryResult execute(Storage& storage, const std::vector<std::string>& params) const;
+
+private:
+    Kind kind = Kind::Select;
+    std::string dbName;
+    std::string table;
+    std::string tablePath;
+    size_t parameters = 0;
+    std::vector<std::string> columns;                 // SELECT output or INSERT target columns
+    std::vector<std::vector<Value>> insertRows;
+    std::vector<Assignment> assignments;              // UPDATE
+    std::vector<Condition> conditions;                // WHERE, ANDed
+    std::vector<ColumnType> columnTypes;              // Of columns
+    std::vector<std::string> readColumns;             // Projected while scanning: columns, then condition columns
+    bool pointLookup = false;                         // WHERE is a single id = value
+    bool bound = false;
+
+    struct Filter;
+    struct Execution;
+    bool resolve(const std::vector<std::string>& params, Execution& execution, std::string& error) const;
+    bool valueText(const Value& value, const std::vector<std::string>& params, ColumnType type, std::string& text,
+                   std::string& error) const;
+};
+
+// Plans of one Storage keyed by database and statement text, so a statement is parsed and
+// bound once however often it is prepared. A table's plans are dropped when the table is
+// created, deleted or restored, as its schema may have changed; a caller holding a plan
+// across such a change should prepare it again.
+class PlanCache {
+public:
+    static const size_t MAX_PLANS = 1024; // Past this an arbitrary plan makes room
+
+    std::shared_ptr<const QueryPlan> find(const std::string& dbName, const std::string& text);
+    void store(const std::string& dbName, const std::string& text, std::shared_ptr<const QueryPlan> plan);
+    void invalidateTable(const std::string& tablePath);
+    PlanCacheStats getStats() const;
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<const QueryPlan>> plans;
+    PlanCacheStats stats;
+};
+
+#endif // QUERY_HPP
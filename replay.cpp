@@ -0,0 +1,254 @@
+#include "replay.hpp"
+#include "storage.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+double percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)] / 1000.0;
+}
+
+} // namespace
+
+TraceReplayer::TraceReplayer(Storage& owner, const ReplayOptions& replayOptions)
+    : storage(owner), options(replayOptions) {}
+
+const ReplayReport& TraceReplayer::getReport() const {
+    return report;
+}
+
+bool TraceReplayer::run(const std::string& tracePath) {
+    TraceReader reader;
+    if (!reader.open(tracePath)) {
+        return false;
+    }
+    report = ReplayReport();
+    latencies.clear();
+    recordedLatencies.clear();
+    operationErrors.clear();
+    schemas.clear();
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t firstRecorded = 0;
+    uint64_t lastRecorded = 0;
+    bool first = true;
+    TraceEvent event;
+    while (reader.next(event)) {
+        if (first) {
+            firstRecorded = event.startNanos;
+            first = false;
+        }
+        lastRecorded = std::max(lastRecorded, event.startNanos + event.durationNanos);
+        if (!options.flatOut) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(event.startNanos - firstRecorded));
+        }
+
+        size_t slash = event.table.find('/');
+        std::string dbName = event.table.substr(0, slash);
+        std::string tableName = slash == std::string::npos ? "" : event.table.substr(slash + 1);
+        std::string name = traceOpName(event.op);
+        if (event.op == TraceOp::Aggregate || event.op == TraceOp::Join || event.op == TraceOp::OrderBy ||
+            event.op == TraceOp::BulkLoad) {
+            report.skipped++;
+            continue;
+        }
+
+        auto callStart = std::chrono::steady_clock::now();
+        bool ok;
+        try {
+            ok = replay(event, dbName, tableName);
+        } catch (const std::exception&) {
+            ok = false;
+        }
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - callStart).count();
+
+        report.operations++;
+        if (event.flags & TraceRecorder::FLAG_THREW) report.recordedThrows++;
+        if (!ok) {
+            report.errors++;
+            operationErrors[name]++;
+        }
+        latencies[name].push_back(nanos);
+        recordedLatencies[name].push_back(event.durationNanos);
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report.recordedSeconds = first ? 0 : (lastRecorded - firstRecorded) / 1e9;
+
+    std::vector<uint64_t> all;
+    std::vector<uint64_t> recordedAll;
+    for (auto& [name, nanos] : latencies) {
+        all.insert(all.end(), nanos.begin(), nanos.end());
+        recordedAll.insert(recordedAll.end(), recordedLatencies[name].begin(), recordedLatencies[name].end());
+        report.operationLatency[name] = summarize(nanos, recordedLatencies[name]);
+        report.operationLatency[name].errors = operationErrors[name];
+    }
+    report.operationLatency["all"] = summarize(all, recordedAll);
+    report.operationLatency["all"].errors = report.errors;
+    return true;
+}
+
+// Reissues one call; false when it failed
+bool TraceReplayer::replay(const TraceEvent& event, const std::string& dbName, const std::string& tableName) {
+    std::string id = std::to_string(event.key);
+    switch (event.op) {
+        case TraceOp::CreateTable: {
+            std::map<std::string, std::string> schema;
+            for (const std::string& column : splitList(event.extra)) {
+                size_t colon = column.find(':');
+                if (colon != std::string::npos) schema[column.substr(0, colon)] = column.substr(colon + 1);
+            }
+            schemas.erase(event.table);
+            storage.createDatabase(dbName);
+            return storage.createTable(dbName, tableName, schema);
+        }
+        case TraceOp::DeleteTable:
+            schemas.erase(event.table);
+            return storage.deleteTable(event.table + ".HAD");
+        case TraceOp::Get:
+            storage.get(dbName, tableName, id);
+            return true;
+        case TraceOp::GetColumns:
+            storage.get(dbName, tableName, id, splitList(event.extra));
+            return true;
+        case TraceOp::Scan: {
+            std::vector<std::string> columns = splitList(event.extra);
+            if (event.extra == "*") {
+                columns.clear();
+                for (const auto& column : storage.getTableSchema(dbName, tableName)) columns.push_back(column.first);
+            }
+            storage.scan(dbName, tableName, event.key, event.key2, columns, [](const ProjectedRow&) { return true; });
+            return true;
+        }
+        case TraceOp::Exists:
+            storage.checkTupleExists(dbName, tableName, id); // "No" is an answer, not a failure
+            return true;
+        case TraceOp::Insert:
+            return ensureTable(dbName, tableName) &&
+                   storage.insert(dbName, tableName, makeTuple(dbName, tableName, event.key, event.payloadBytes));
+        case TraceOp::InsertBatch: {
+            if (!ensureTable(dbName, tableName)) return false;
+            size_t rows = event.extra.size() / sizeof(int64_t);
+            uint32_t rowBytes = rows > 0 ? static_cast<uint32_t>(event.payloadBytes / rows) : 0;
+            std::vector<Tuple> tuples;
+            tuples.reserve(rows);
+            for (size_t i = 0; i < rows; ++i) {
+                int64_t rowId;
+                std::memcpy(&rowId, event.extra.data() + i * sizeof(int64_t), sizeof(rowId));
+                tuples.push_back(makeTuple(dbName, tableName, rowId, rowBytes));
+            }
+            return storage.insertBatch(dbName, tableName, tuples) == rows;
+        }
+        case TraceOp::Delete:
+            return storage.deleteTupleFromTable(dbName, tableName, id);
+        case TraceOp::DeleteBatch: {
+            std::vector<int64_t> ids(event.extra.size() / sizeof(int64_t));
+            std::memcpy(ids.data(), event.extra.data(), ids.size() * sizeof(int64_t));
+            return storage.deleteBatch(dbName, tableName, ids) == ids.size();
+        }
+        case TraceOp::Update:
+            return storage.updateTupleInTable(dbName, tableName, id, makeTuple(dbName, tableName, event.key, event.payloadBytes));
+        default:
+            return true;
+    }
+}
+
+// A fresh database has no table a trace wrote to without creating it; make a generic one
+bool TraceReplayer::ensureTable(const std::string& dbName, const std::string& tableName) {
+    if (storage.tableExists(dbName, tableName)) {
+        return true;
+    }
+    if (!options.createMissingTables) {
+        return false;
+    }
+    storage.createDatabase(dbName);
+    return storage.createTable(dbName, tableName, {{"id", "int"}, {"data", "string"}});
+}
+
+Tuple TraceReplayer::makeTuple(const std::string& dbName, const std::string& tableName, int64_t id, uint32_t payloadBytes) {
+    std::string table = dbName + "/" + tableName;
+    auto known = schemas.find(table);
+    if (known == schemas.end()) {
+        known = schemas.emplace(table, storage.getTableSchema(dbName, tableName)).first;
+    }
+    const std::map<std::string, std::string>& schema = known->second;
+
+    // Numbers come from the id; whatever is left of the payload is shared by the strings
+    Tuple tuple;
+    size_t used = 0;
+    size_t strings = 0;
+    std::vector<std::pair<std::string, std::string>> values;
+    for (const auto& [column, type] : schema) {
+        std::string value;
+        if (column == "id" || type == "int") {
+            value = std::to_string(id);
+        } else if (type == "double") {
+            value = std::to_string(id) + ".5";
+        } else {
+            strings++;
+        }
+        used += column.size() + value.size();
+        values.push_back({column, value});
+    }
+    size_t fill = strings > 0 && payloadBytes > used ? (payloadBytes - used) / strings : 0;
+    for (const auto& [column, value] : values) {
+        const std::string& type = schema.at(column);
+        if (column == "id" || type == "int") {
+            tuple.addAttribute(column, static_cast<int>(ColumnType::Int), value);
+        } else if (type == "double") {
+            tuple.addAttribute(column, static_cast<int>(ColumnType::Double), value);
+        } else {
+            tuple.addAttribute(column, static_cast<int>(ColumnType::String), std::string(std::max<size_t>(fill, 1), 'x'));
+        }
+    }
+    return tuple;
+}
+
+LatencySummary TraceReplayer::summarize(std::vector<uint64_t>& nanos, std::vector<uint64_t>& recorded) {
+    LatencySummary summary;
+    std::sort(nanos.begin(), nanos.end());
+    std::sort(recorded.begin(), recorded.end());
+    summary.count = nanos.size();
+    summary.p50 = percentile(nanos, 0.50);
+    summary.p90 = percentile(nanos, 0.90);
+    summary.p99 = percentile(nanos, 0.99);
+    summary.p999 = percentile(nanos, 0.999);
+    summary.max = nanos.empty() ? 0 : nanos.back() / 1000.0;
+    summary.recordedP50 = percentile(recorded, 0.50);
+    summary.recordedP99 = percentile(recorded, 0.99);
+    return summary;
+}
+
+void TraceReplayer::printReport(const ReplayReport& report, std::ostream& out) {
+    out << "Replayed " << report.operations << " calls in " << report.seconds << " s ("
+        << (report.seconds > 0 ? report.operations / report.seconds : 0) << " calls/s), recorded over "
+        << report.recordedSeconds << " s; " << report.errors << " failed (" << report.recordedThrows
+        << " had thrown when recorded), " << report.skipped << " skipped\n";
+    out << std::left << std::setw(12) << "operation" << std::right << std::setw(9) << "calls" << std::setw(8) << "failed"
+        << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us" << std::setw(10)
+        << "p99.9 us" << std::setw(10) << "max us" << std::setw(12) << "rec p50 us" << std::setw(12) << "rec p99 us" << "\n";
+    out << std::fixed << std::setprecision(1);
+    for (const auto& [name, summary] : report.operationLatency) {
+        out << std::left << std::setw(12) << name << std::right << std::setw(9) << summary.count << std::setw(8)
+            << summary.errors << std::setw(10) << summary.p50 << std::setw(10) << summary.p90 << std::setw(10)
+            << summary.p99 << std::setw(10) << summary.p999 << std::setw(10) << summary.max << std::setw(12)
+            << summary.recordedP50 << std::setw(12) << summary.recordedP99 << "\n";
+    }
+    out << std::defaultfloat;
+}
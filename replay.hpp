@@ -0,0 +1,68 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "trace.hpp"
+
+class Storage;
+
+struct ReplayOptions {
+    bool flatOut = false;               // Issue calls back to back instead of at their recorded times
+    bool createMissingTables = true;    // Writes to a table no trace created make it as id:int,data:string
+};
+
+struct LatencySummary {
+    uint64_t count = 0;
+    uint64_t errors = 0;
+    double p50 = 0;                     // Microseconds
+    double p90 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    double max = 0;
+    double recordedP50 = 0;             // Same call as recorded, for comparison
+    double recordedP99 = 0;
+};
+
+struct ReplayReport {
+    uint64_t operations = 0;            // Calls replayed
+    uint64_t skipped = 0;               // Calls that cannot be reissued from a trace
+    uint64_t errors = 0;                // Replayed calls that failed or threw
+    uint64_t recordedThrows = 0;        // Replayed calls that had thrown when recorded
+    double seconds = 0;
+    double recordedSeconds = 0;         // From the first to the last recorded call
+    std::map<std::string, LatencySummary> operationLatency; // By operation name, plus "all"
+};
+
+// Replays a trace written by TraceRecorder against a Storage, one call at a time.
+// Written rows are synthesized: the recorded id, numbers derived from it and string
+// columns padded so the row has the recorded payload size. Aggregates, joins, sorts and
+// bulk loads are counted as skipped, since a trace keeps too little to reissue them.
+// Calls that ran concurrently when recorded are replayed in start order, one at a time.
+class TraceReplayer {
+public:
+    TraceReplayer(Storage& storage, const ReplayOptions& options = ReplayOptions());
+
+    bool run(const std::string& tracePath);
+    const ReplayReport& getReport() const;
+    static void printReport(const ReplayReport& report, std::ostream& out);
+
+private:
+    Storage& storage;
+    ReplayOptions options;
+    ReplayReport report;
+    std::map<std::string, std::vector<uint64_t>> latencies;          // Nanoseconds, by operation
+    std::map<std::string, std::vector<uint64_t>> recordedLatencies;
+    std::map<std::string, uint64_t> operationErrors;
+    std::map<std::string, std::map<std::string, std::string>> schemas; // Table -> schema, as synthesized against
+
+    bool replay(const TraceEvent& event, const std::string& dbName, const std::string& tableName);
+    bool ensureTable(const std::string& dbName, const std::string& tableName);
+    Tuple makeTuple(const std::string& dbName, const std::string& tableName, int64_t id, uint32_t payloadBytes);
+    static LatencySummary summarize(std::vector<uint64_t>& nanos, std::vector<uint64_t>& recorded);
+};
+
+#endif // REPLAY_HPP
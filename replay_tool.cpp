@@ -0,0 +1,74 @@
+#include "replay.hpp"
+#include "storage.hpp"
+
+// Replays a trace recorded with Storage::startTrace against the databases in a directory.
+// Usage: replay <trace> [--dir DIR] [--copy DBDIR] [--flat-out] [--no-create] [--verbose]
+//   --dir      directory holding the databases, created if missing (default: current)
+//   --copy     copies a database directory into --dir first, so the original stays untouched
+//   --flat-out issues the calls back to back instead of at their recorded times
+static void printUsage() {
+    std::cerr << "Usage: replay <trace> [--dir DIR] [--copy DBDIR] [--flat-out] [--no-create] [--verbose]\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    fs::path tracePath = fs::absolute(argv[1]);
+    fs::path workDir = fs::current_path();
+    std::vector<fs::path> copies;
+    ReplayOptions options;
+    bool verbose = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--dir" && hasValue) {
+            workDir = fs::absolute(argv[++i]);
+        } else if (arg == "--copy" && hasValue) {
+            copies.push_back(fs::absolute(argv[++i]));
+        } else if (arg == "--flat-out") {
+            options.flatOut = true;
+        } else if (arg == "--no-create") {
+            options.createMissingTables = false;
+        } else if (arg == "--verbose") {
+            verbose = true;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    try {
+        fs::create_directories(workDir);
+        for (const fs::path& source : copies) {
+            fs::path target = workDir / source.filename();
+            if (fs::exists(target)) {
+                std::cerr << "Refusing to copy over existing " << target << std::endl;
+                return 1;
+            }
+            fs::copy(source, target, fs::copy_options::recursive);
+        }
+        fs::current_path(workDir); // Traces name tables relative to the engine's directory
+    } catch (const std::exception& e) {
+        std::cerr << "Unable to prepare " << workDir << ": " << e.what() << std::endl;
+        return 1;
+    }
+    if (!verbose) {
+        // The engine's debug output, and its messages for calls that fail; those are counted
+        std::cout.setstate(std::ios::failbit);
+        std::cerr.setstate(std::ios::failbit);
+    }
+
+    Storage storage;
+    TraceReplayer replayer(storage, options);
+    bool ok = replayer.run(tracePath.string());
+    std::cout.clear();
+    std::cerr.clear();
+    if (!ok) {
+        std::cerr << "Unable to replay " << tracePath << std::endl;
+        return 1;
+    }
+    TraceReplayer::printReport(replayer.getReport(), std::cout);
+    return 0;
+}
@@ -0,0 +1,220 @@
+#include "rowcache.hpp"
+#include <cassert>
+
+namespace {
+thread_local int shardLocksHeld = 0; // Across every RowCache
+}
+
+RowCache::ShardLock::ShardLock(const Shard& shard) : lock(shard.mutex) {
+    shardLocksHeld++;
+}
+
+RowCache::ShardLock::~ShardLock() {
+    shardLocksHeld--;
+}
+
+RowCache::RowCache(size_t capacityBytes) : capacity(capacityBytes) {
+    reclaimerHandle = MemoryGovernor::getInstance().registerReclaimer([this](size_t bytes) { return shrink(bytes); });
+}
+
+RowCache::~RowCache() {
+    MemoryGovernor::getInstance().unregisterReclaimer(reclaimerHandle);
+    clear();
+}
+
+bool RowCache::enabled() const {
+    return capacity.load() > 0;
+}
+
+void RowCache::setCapacity(size_t bytes) {
+    capacity = bytes;
+    for (Shard& shard : shards) {
+        ShardLock lock(shard);
+        makeRoom(shard, 0);
+    }
+}
+
+RowCache::Shard& RowCache::shardFor(const Key& key) {
+    // The low bits pick the bucket inside the shard's map, so use high ones for the shard
+    return shards[(KeyHash()(key) >> 32) % SHARDS];
+}
+
+size_t RowCache::shardCapacity() const {
+    return capacity.load() / SHARDS;
+}
+
+// Rough heap footprint: the strings, a map node per column and the entry itself
+size_t RowCache::rowBytes(const Key& key, const Row& row) {
+    size_t bytes = sizeof(Entry) + sizeof(Row) + key.first.size() + 64;
+    for (const auto& [column, value] : row) {
+        bytes += column.size() + value.size() + 96;
+    }
+    return bytes;
+}
+
+bool RowCache::lookup(const std::string& table, int64_t id, Row& row) {
+    if (!enabled()) return false;
+    Key key(table, id);
+    Shard& shard = shardFor(key);
+    std::shared_ptr<const Row> cached;
+    {
+        ShardLock lock(shard);
+        auto it = shard.slotOf.find(key);
+        if (it == shard.slotOf.end()) {
+            misses++;
+            return false;
+        }
+        Entry& entry = shard.slots[it->second];
+        entry.referenced = true;
+        cached = entry.row;
+    }
+    hits++;
+    row = *cached;
+    return true;
+}
+
+void RowCache::store(const std::string& table, int64_t id, const Row& row) {
+    if (!enabled()) return;
+    Key key(table, id);
+    size_t bytes = rowBytes(key, row);
+    if (bytes > shardCapacity()) {
+        return; // Would evict a whole shard for one row
+    }
+    auto cached = std::make_shared<const Row>(row);
+    Shard& shard = shardFor(key);
+    {
+        ShardLock lock(shard);
+        auto it = shard.slotOf.find(key);
+        if (it != shard.slotOf.end()) {
+            evictSlot(shard, it->second); // Replaced, not counted as an eviction
+        }
+        makeRoom(shard, bytes);
+
+        size_t slot;
+        if (!shard.freeSlots.empty()) {
+            slot = shard.freeSlots.back();
+            shard.freeSlots.pop_back();
+        } else {
+            slot = shard.slots.size();
+            shard.slots.emplace_back();
+        }
+        Entry& entry = shard.slots[slot];
+        entry.key = std::move(key);
+        entry.row = std::move(cached);
+        entry.bytes = bytes;
+        entry.used = true;
+        entry.referenced = false; // A row read once goes first
+        shard.slotOf[entry.key] = slot;
+        shard.bytes += bytes;
+    }
+    stores++;
+    // Outside the shard lock: going over the budget calls back into shrink
+    assert(shardLocksHeld == 0);
+    MemoryGovernor::charge(MemoryComponent::RowCache, bytes);
+}
+
+void RowCache::evictSlot(Shard& shard, size_t slot) {
+    Entry& entry = shard.slots[slot];
+    shard.slotOf.erase(entry.key);
+    shard.bytes -= entry.bytes;
+    MemoryGovernor::release(MemoryComponent::RowCache, entry.bytes);
+    entry = Entry();
+    shard.freeSlots.push_back(slot);
+}
+
+// Sweeps the CLOCK hand until the shard has room for bytes more
+void RowCache::makeRoom(Shard& shard, size_t bytes) {
+    size_t limit = shardCapacity();
+    evictTo(shard, limit > bytes ? limit - bytes : 0);
+}
+
+// Sweeps the CLOCK hand until the shard holds at most bytes
+void RowCache::evictTo(Shard& shard, size_t bytes) {
+    while (shard.bytes > bytes) {
+        if (shard.hand >= shard.slots.size()) {
+            shard.hand = 0;
+        }
+        Entry& entry = shard.slots[shard.hand];
+        if (entry.used) {
+            if (entry.referenced) {
+                entry.referenced = false;
+            } else {
+                evictSlot(shard, shard.hand);
+                evictions++;
+            }
+        }
+        shard.hand++;
+    }
+}
+
+void RowCache::invalidate(const std::string& table, int64_t id) {
+    if (!enabled()) return;
+    Key key(table, id);
+    Shard& shard = shardFor(key);
+    ShardLock lock(shard);
+    auto it = shard.slotOf.find(key);
+    if (it != shard.slotOf.end()) {
+        evictSlot(shard, it->second);
+        invalidations++;
+    }
+}
+
+void RowCache::invalidateTable(const std::string& table) {
+    for (Shard& shard : shards) {
+        ShardLock lock(shard);
+        for (size_t slot = 0; slot < shard.slots.size(); ++slot) {
+            if (shard.slots[slot].used && shard.slots[slot].key.first == table) {
+                evictSlot(shard, slot);
+                invalidations++;
+            }
+        }
+    }
+}
+
+void RowCache::clear() {
+    for (Shard& shard : shards) {
+        ShardLock lock(shard);
+        MemoryGovernor::release(MemoryComponent::RowCache, shard.bytes);
+        shard.slotOf.clear();
+        shard.slots.clear();
+        shard.freeSlots.clear();
+        shard.hand = 0;
+        shard.bytes = 0;
+    }
+}
+
+size_t RowCache::shrink(size_t bytes) {
+    // Reclaims start from charges, and those are only made outside shard locks (see store),
+    // so waiting for a shard here cannot wait on this thread
+    assert(shardLocksHeld == 0 && "memory charged while holding a row cache shard lock");
+    size_t freed = 0;
+    for (int i = 0; i < SHARDS && freed < bytes; ++i) {
+        Shard& shard = shards[i];
+        ShardLock lock(shard);
+        // Spread the request over the shards; ones that come up short leave more for the rest
+        size_t goal = i == SHARDS - 1 ? bytes : bytes / SHARDS * (i + 1);
+        if (freed >= goal) continue;
+        size_t before = shard.bytes;
+        evictTo(shard, before > goal - freed ? before - (goal - freed) : 0);
+        freed += before - shard.bytes;
+    }
+    reclaimed += freed;
+    return freed;
+}
+
+RowCacheStats RowCache::getStats() const {
+    RowCacheStats stats;
+    stats.hits = hits.load();
+    stats.misses = misses.load();
+    stats.stores = stores.load();
+    stats.evictions = evictions.load();
+    stats.invalidations = invalidations.load();
+    stats.capacityBytes = capacity.load();
+    stats.reclaimedBytes = reclaimed.load();
+    for (const Shard& shard : shards) {
+        ShardLock lock(shard);
+        stats.entries += shard.slotOf.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,119 @@
+#ifndef ROWCACHE_HPP
+#define ROWCACHE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "memory.hpp"
+
+struct RowCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stores = 0;
+    uint64_t evictions = 0;
+    uint64_t invalidations = 0;   // Entries dropped because their row was written
+    uint64_t entries = 0;
+    uint64_t bytes = 0;           // Estimated memory held by the cached rows
+    uint64_t capacityBytes = 0;
+    uint64_t reclaimedBytes = 0;  // Evicted at the memory governor's request
+};
+
+// Decoded rows of Storage::get, keyed by (table path, id), so hot keys skip both the page
+// read and Tuple::deserialize. The keys are spread over independently locked shards, each
+// with its own share of the memory cap and a CLOCK hand for eviction: a hit sets the
+// entry's reference bit, and the hand clears bits as it passes until it finds an entry
+// that was not touched since its last pass. A capacity of 0 turns the cache off.
+// Storage drops an entry whenever its row is inserted, deleted or updated, and a whole
+// table when the table is deleted or its files are replaced.
+// The cached bytes are charged to the memory governor, which may ask the cache to shrink
+// below its capacity when the process is over its memory budget.
+class RowCache {
+public:
+    using Row = std::map<std::string, std::string>;
+    static const int SHARDS = 16;
+
+    explicit RowCache(size_t capacityBytes = 0);
+    RowCache(const RowCache&) = delete;
+    RowCache& operator=(const RowCache&) = delete;
+    ~RowCache();
+
+    void setCapacity(size_t bytes); // Evicts down to the new cap
+    bool enabled() const;
+
+    bool lookup(const std::string& table, int64_t id, Row& row);
+    void store(const std::string& table, int64_t id, const Row& row);
+    void invalidate(const std::string& table, int64_t id);
+    void invalidateTable(const std::string& table);
+    void clear();
+    // Evicts about bytes worth of entries; returns bytes freed. Must not be called by a thread
+    // holding a shard lock, which the memory governor cannot do (see ShardLock).
+    size_t shrink(size_t bytes);
+
+    RowCacheStats getStats() const;
+
+private:
+    using Key = std::pair<std::string, int64_t>;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<std::string>()(key.first) ^ (std::hash<int64_t>()(key.second) * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Row> row; // Shared so a hit copies it outside the shard lock
+        size_t bytes = 0;
+        bool used = false;              // Slot holds an entry
+        bool referenced = false;        // Hit since the hand last passed
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, size_t, KeyHash> slotOf;
+        std::vector<Entry> slots;
+        std::vector<size_t> freeSlots;
+        size_t hand = 0;
+        size_t bytes = 0;
+    };
+
+    // Holds a shard's mutex and counts the shard locks the thread holds. Nothing charged to the
+    // memory governor is allocated under one, so the governor never calls shrink from inside
+    // a shard; shrink asserts as much and can then wait for a busy shard instead of skipping it.
+    class ShardLock {
+    public:
+        explicit ShardLock(const Shard& shard);
+        ~ShardLock();
+        ShardLock(const ShardLock&) = delete;
+        ShardLock& operator=(const ShardLock&) = delete;
+
+    private:
+        std::lock_guard<std::mutex> lock;
+    };
+
+    Shard shards[SHARDS];
+    std::atomic<size_t> capacity;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> stores{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> invalidations{0};
+    std::atomic<uint64_t> reclaimed{0};
+    uint64_t reclaimerHandle;
+
+    Shard& shardFor(const Key& key);
+    size_t shardCapacity() const;
+    void evictSlot(Shard& shard, size_t slot);
+    void makeRoom(Shard& shard, size_t bytes);
+    void evictTo(Shard& shard, size_t bytes);
+    static size_t rowBytes(const Key& key, const Row& row);
+};
+
+#endif // ROWCACHE_HPP
@@ -0,0 +1,186 @@
+#include "schema.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+
+CompiledSchema::CompiledSchema(const std::map<std::string, std::string>& schema) {
+    // std::map iterates by name, so ordinals follow name order and lookups can bisect
+    columns.reserve(schema.size());
+    valid = true;
+    bool hasId = false;
+    for (const auto& [name, type] : schema) {
+        ColumnType columnType = typeFromName(type);
+        if (columnType == ColumnType::Invalid) {
+            std::cerr << "Error CompiledSchema: Unsupported type '" << type << "' for column " << name << std::endl;
+            valid = false;
+        }
+        if (name == "id") {
+            idOrdinal = columns.size();
+            hasId = columnType == ColumnType::Int;
+        }
+        columns.push_back({name, columnType, static_cast<uint32_t>(columns.size())});
+    }
+    valid = valid && hasId;
+}
+
+ColumnType CompiledSchema::typeFromName(const std::string& typeName) {
+    if (typeName == "int") return ColumnType::Int;
+    if (typeName == "string") return ColumnType::String;
+    if (typeName == "double") return ColumnType::Double;
+    return ColumnType::Invalid;
+}
+
+const char* CompiledSchema::typeName(ColumnType type) {
+    switch (type) {
+        case ColumnType::Int: return "int";
+        case ColumnType::String: return "string";
+        case ColumnType::Double: return "double";
+        default: return "invalid";
+    }
+}
+
+bool CompiledSchema::isValid() const {
+    return valid;
+}
+
+size_t CompiledSchema::size() const {
+    return columns.size();
+}
+
+const std::vector<ColumnDescriptor>& CompiledSchema::getColumns() const {
+    return columns;
+}
+
+const ColumnDescriptor& CompiledSchema::getColumn(uint32_t ordinal) const {
+    return columns.at(ordinal);
+}
+
+uint32_t CompiledSchema::getIdOrdinal() const {
+    return idOrdinal;
+}
+
+int CompiledSchema::ordinalOf(const std::string& name) const {
+    return ordinalOf(name.data(), name.size());
+}
+
+int CompiledSchema::ordinalOf(const char* name, size_t length) const {
+    size_t lo = 0, hi = columns.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = columns[mid].name.compare(0, std::string::npos, name, length);
+        if (cmp == 0) return static_cast<int>(mid);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NO_COLUMN;
+}
+
+int CompiledSchema::findOrdinal(const std::string& name, uint32_t hint) const {
+    // Tuples usually list attributes in the same order every time, so try the next ordinal first
+    if (hint < columns.size() && columns[hint].name == name) {
+        return hint;
+    }
+    return ordinalOf(name);
+}
+
+bool CompiledSchema::isIntText(const std::string& text) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    std::strtoll(text.c_str(), &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+bool CompiledSchema::isDoubleText(const std::string& text) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    std::strtod(text.c_str(), &end);
+    return errno == 0 && *end == '\0';
+}
+
+bool CompiledSchema::encode(const Tuple& tuple, std::string& out, int64_t& id, std::string& error) const {
+    // One bit per column; tables wider than the stack bitmap fall back to the heap
+    const size_t words = (columns.size() + 63) / 64;
+    uint64_t stackSeen[64] = {0};
+    std::vector<uint64_t> heapSeen;
+    uint64_t* seen = stackSeen;
+    if (words > 64) {
+        heapSeen.assign(words, 0);
+        seen = heapSeen.data();
+    }
+
+    out.clear();
+    size_t seenCount = 0;
+    uint32_t hint = 0;
+    for (const auto& [key, typed] : tuple.getAttributeList()) {
+        int code = typed.first;
+        const std::string& value = typed.second;
+        if (value.empty() || value.find(')') != std::string::npos) {
+            error = "Invalid value for attribute: " + key;
+            return false;
+        }
+
+        if (code == static_cast<int>(ColumnType::Overflow)) {
+            error = "Invalid type for attribute: " + key; // Only the engine writes pointers
+            return false;
+        }
+
+        int ordinal = findOrdinal(key, hint);
+        if (ordinal != NO_COLUMN) {
+            const ColumnDescriptor& column = columns[ordinal];
+            hint = ordinal + 1;
+            if (code == static_cast<int>(ColumnType::Int) && column.type == ColumnType::Double) {
+                code = static_cast<int>(ColumnType::Double); // Widen int literals given for double columns
+            }
+            bool ok = code == static_cast<int>(column.type);
+            if (ok && column.type == ColumnType::Int) {
+                ok = isIntText(value);
+            } else if (ok && column.type == ColumnType::Double) {
+                ok = isDoubleText(value);
+            }
+            if (!ok) {
+                error = "Type mismatch for attribute: " + key;
+                return false;
+            }
+            uint64_t bit = uint64_t(1) << (ordinal % 64);
+            if (!(seen[ordinal / 64] & bit)) {
+                seen[ordinal / 64] |= bit;
+                ++seenCount;
+            }
+            if (static_cast<uint32_t>(ordinal) == idOrdinal) {
+                id = std::strtoll(value.c_str(), nullptr, 10);
+            }
+        }
+
+        out += key;
+        out += '(';
+        if (code >= 0 && code <= 9) {
+            out += static_cast<char>('0' + code);
+        } else {
+            out += std::to_string(code);
+        }
+        out += '|';
+        if (ordinal != NO_COLUMN && columns[ordinal].type == ColumnType::Int) {
+            out += std::to_string(std::strtoll(value.c_str(), nullptr, 10)); // Ids are matched as text, keep ints canonical
+        } else {
+            out += value;
+        }
+        out += ')';
+    }
+
+    if (seenCount != columns.size()) {
+        for (const ColumnDescriptor& column : columns) {
+            if (!(seen[column.ordinal / 64] & (uint64_t(1) << (column.ordinal % 64)))) {
+                error = "Missing required attribute: " + column.name;
+                break;
+            }
+        }
+        return false;
+    }
+    return true;
+}
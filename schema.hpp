@@ -0,0 +1,62 @@
+#ifndef SCHEMA_HPP
+#define SCHEMA_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "tuple.hpp"
+
+// Column types, numbered as the type codes stored in serialized tuples
+enum class ColumnType : uint8_t {
+    Invalid = 0,
+    Int = 1,
+    String = 2,
+    Double = 3,
+    Overflow = 4,   // Stored form only: a string kept in overflow pages, "firstPage:length"
+};
+
+struct ColumnDescriptor {
+    std::string name;
+    ColumnType type;
+    uint32_t ordinal;   // Position in the compiled schema (columns sorted by name)
+};
+
+// A table schema compiled once per table into a flat descriptor array.
+// Validation walks the tuple's attribute list against the descriptors by ordinal, without
+// building maps or copying attributes; encode() also coerces values and writes the stored form.
+class CompiledSchema {
+public:
+    static const int NO_COLUMN = -1;
+
+    CompiledSchema() = default;
+    explicit CompiledSchema(const std::map<std::string, std::string>& schema);
+
+    static ColumnType typeFromName(const std::string& typeName);
+    static const char* typeName(ColumnType type);
+
+    bool isValid() const;                 // Every column has a known type and there is an int "id"
+    size_t size() const;
+    const std::vector<ColumnDescriptor>& getColumns() const;
+    const ColumnDescriptor& getColumn(uint32_t ordinal) const;
+    int ordinalOf(const std::string& name) const;
+    int ordinalOf(const char* name, size_t length) const;
+    uint32_t getIdOrdinal() const;
+
+    // Checks a tuple against the schema and writes its serialized form to out (reusing out's
+    // buffer). Int values given for double columns are coerced; attributes outside the schema
+    // are kept as they are. On failure error names the offending column.
+    bool encode(const Tuple& tuple, std::string& out, int64_t& id, std::string& error) const;
+
+private:
+    std::vector<ColumnDescriptor> columns;
+    uint32_t idOrdinal = 0;
+    bool valid = false;
+
+    int findOrdinal(const std::string& name, uint32_t hint) const;
+    static bool isIntText(const std::string& text);
+    static bool isDoubleText(const std::string& text);
+};
+
+#endif // SCHEMA_HPP
@@ -0,0 +1,574 @@
+#include "server.hpp"
+#include <algorithm>
+#include <iterator>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+const uint64_t LISTEN_KEY = 0;
+const uint64_t WAKE_KEY = 1;
+const size_t READ_CHUNK = 64 * 1024;
+const int MAX_READ_CHUNKS = 16;   // Per wake-up, so one busy client cannot starve the others
+const int MAX_EVENTS = 64;
+
+void signal(int eventFd) {
+    uint64_t one = 1;
+    ssize_t written = ::write(eventFd, &one, sizeof(one));
+    (void)written; // The counter only saturates if the loop is far behind, and then it is awake anyway
+}
+
+std::string message(const std::string& text) {
+    std::string body;
+    WireWriter(body).str(text);
+    return body;
+}
+
+} // namespace
+
+StorageServer::StorageServer(const ServerOptions& opts) : options(opts) {
+    if (options.workers == 0) {
+        options.workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    options.maxInsertBatch = std::max<size_t>(options.maxInsertBatch, 1);
+}
+
+StorageServer::~StorageServer() {
+    stop();
+}
+
+bool StorageServer::start() {
+    sockaddr_un address{};
+    if (options.socketPath.empty() || options.socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error StorageServer: Socket path is empty or too long: " << options.socketPath << std::endl;
+        return false;
+    }
+    std::error_code error;
+    if (fs::is_socket(options.socketPath, error)) {
+        fs::remove(options.socketPath, error); // Left behind by a server that did not shut down
+    }
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, options.socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        ::listen(listenFd, SOMAXCONN) < 0) {
+        std::cerr << "Error StorageServer: Unable to listen on " << options.socketPath << ": " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event listenEvent{};
+    listenEvent.events = EPOLLIN;
+    listenEvent.data.u64 = LISTEN_KEY;
+    epoll_event wakeEvent{};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.u64 = WAKE_KEY;
+    if (epollFd < 0 || wakeFd < 0 || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) < 0 ||
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) < 0) {
+        std::cerr << "Error StorageServer: Unable to set up the event loop: " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = false;
+    }
+    for (unsigned i = 0; i < options.workers; ++i) {
+        workers.emplace_back(&StorageServer::runWorker, this);
+    }
+    loop = std::thread(&StorageServer::runLoop, this);
+    return true;
+}
+
+void StorageServer::stop() {
+    {
+        // Set under the queue lock so a worker between its check and its wait cannot miss the notify
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    if (loop.joinable()) {
+        signal(wakeFd);
+        loop.join();
+    }
+    queueReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    for (auto& [id, connection] : connections) {
+        ::close(connection->fd);
+    }
+    connections.clear();
+    runnable.clear();
+    readyToWrite.clear();
+    pendingInserts.clear();
+    for (int* fd : {&listenFd, &epollFd, &wakeFd}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    std::error_code error;
+    if (fs::is_socket(options.socketPath, error)) {
+        fs::remove(options.socketPath, error);
+    }
+}
+
+ServerStats StorageServer::getStats() const {
+    ServerStats stats;
+    stats.connections = connectionCount.load();
+    stats.requests = requestCount.load();
+    stats.insertBatches = insertBatches.load();
+    stats.batchedInserts = batchedInserts.load();
+    stats.protocolErrors = protocolErrors.load();
+    return stats;
+}
+
+void StorageServer::runLoop() {
+    epoll_event events[MAX_EVENTS];
+    while (!stopping) {
+        int count = ::epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error StorageServer: epoll_wait failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            uint64_t key = events[i].data.u64;
+            if (key == LISTEN_KEY) {
+                acceptClients();
+                continue;
+            }
+            if (key == WAKE_KEY) {
+                uint64_t counter;
+                while (::read(wakeFd, &counter, sizeof(counter)) > 0) {}
+                std::vector<std::shared_ptr<Connection>> ready;
+                {
+                    std::lock_guard<std::mutex> lock(readyMutex);
+                    ready.swap(readyToWrite);
+                }
+                for (const auto& connection : ready) {
+                    if (connections.count(connection->id) && !writeClient(connection)) {
+                        closeClient(connection);
+                    }
+                }
+                continue;
+            }
+
+            auto found = connections.find(key);
+            if (found == connections.end()) {
+                continue; // Closed earlier in this round
+            }
+            std::shared_ptr<Connection> connection = found->second;
+            uint32_t happened = events[i].events;
+            bool ok = true;
+            if (happened & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                ok = readClient(connection);
+            }
+            if (ok && (happened & EPOLLOUT)) {
+                ok = writeClient(connection);
+            }
+            if (!ok) {
+                closeClient(connection);
+            }
+        }
+    }
+}
+
+void StorageServer::acceptClients() {
+    for (;;) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Error StorageServer: accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        auto connection = std::make_shared<Connection>();
+        connection->id = nextConnectionId++;
+        connection->fd = fd;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = connection->id;
+        if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ::close(fd);
+            continue;
+        }
+        connections[connection->id] = connection;
+        connectionCount++;
+    }
+}
+
+// Reads whatever the client sent and queues every complete frame; false to drop the client
+bool StorageServer::readClient(const std::shared_ptr<Connection>& connection) {
+    bool open = true;
+    char chunk[READ_CHUNK];
+    for (int chunks = 0; chunks < MAX_READ_CHUNKS; ++chunks) { // Level-triggered: the rest waits its turn
+        ssize_t got = ::read(connection->fd, chunk, sizeof(chunk));
+        if (got > 0) {
+            connection->in.append(chunk, got);
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            open = false; // Requests already received still run, their replies are dropped
+        }
+        break;
+    }
+
+    std::vector<Request> requests;
+    size_t pos = 0;
+    std::string& in = connection->in;
+    while (in.size() - pos >= sizeof(uint32_t)) {
+        uint32_t length;
+        std::memcpy(&length, in.data() + pos, sizeof(length));
+        if (length < FRAME_HEADER_SIZE - sizeof(uint32_t) || length > MAX_FRAME_BYTES) {
+            std::cerr << "Error StorageServer: Malformed frame from connection " << connection->id << std::endl;
+            protocolErrors++;
+            return false;
+        }
+        if (in.size() - pos - sizeof(uint32_t) < length) {
+            break;
+        }
+        Request request;
+        std::memcpy(&request.id, in.data() + pos + 4, sizeof(request.id));
+        request.op = static_cast<RequestOp>(in[pos + 8]);
+        request.body.assign(in, pos + FRAME_HEADER_SIZE, length - (FRAME_HEADER_SIZE - sizeof(uint32_t)));
+        requests.push_back(std::move(request));
+        pos += sizeof(uint32_t) + length;
+    }
+    in.erase(0, pos);
+
+    if (!requests.empty()) {
+        requestCount += requests.size();
+        bool schedule;
+        {
+            std::lock_guard<std::mutex> lock(connection->workMutex);
+            for (Request& request : requests) {
+                connection->work.push_back(std::move(request));
+            }
+            schedule = !connection->scheduled;
+            connection->scheduled = true;
+        }
+        if (schedule) {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                runnable.push_back(connection);
+            }
+            queueReady.notify_one();
+        }
+    }
+    return open;
+}
+
+// Writes queued replies until the socket is full; false to drop the client
+bool StorageServer::writeClient(const std::shared_ptr<Connection>& connection) {
+    std::lock_guard<std::mutex> lock(connection->outMutex);
+    size_t sent = 0;
+    while (sent < connection->out.size()) {
+        ssize_t wrote = ::send(connection->fd, connection->out.data() + sent, connection->out.size() - sent, MSG_NOSIGNAL);
+        if (wrote < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        sent += wrote;
+    }
+    connection->out.erase(0, sent);
+    bool wantWrite = !connection->out.empty();
+    if (wantWrite != connection->writeArmed) {
+        watch(connection, wantWrite);
+    }
+    return true;
+}
+
+void StorageServer::watch(const std::shared_ptr<Connection>& connection, bool wantWrite) {
+    epoll_event event{};
+    event.events = EPOLLIN | (wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.u64 = connection->id;
+    ::epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->writeArmed = wantWrite;
+}
+
+void StorageServer::closeClient(const std::shared_ptr<Connection>& connection) {
+    {
+        std::lock_guard<std::mutex> lock(connection->outMutex);
+        connection->closed = true;
+        connection->out.clear();
+    }
+    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    ::close(connection->fd);
+    connections.erase(connection->id);
+}
+
+void StorageServer::runWorker() {
+    std::vector<Request> requests;
+    for (;;) {
+        std::shared_ptr<Connection> connection;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueReady.wait(lock, [this]() { return stopping || !runnable.empty(); });
+            if (stopping) {
+                return;
+            }
+            connection = std::move(runnable.front());
+            runnable.pop_front();
+        }
+        // Run everything the client has sent, including what arrives meanwhile
+        for (;;) {
+            requests.clear();
+            {
+                std::lock_guard<std::mutex> lock(connection->workMutex);
+                if (connection->work.empty()) {
+                    connection->scheduled = false;
+                    break;
+                }
+                for (Request& request : connection->work) {
+                    requests.push_back(std::move(request));
+                }
+                connection->work.clear();
+            }
+            run(connection, requests);
+            if (stopping) {
+                return;
+            }
+        }
+    }
+}
+
+// Runs one client's requests in order. A run of consecutive inserts is parked on the tables'
+// pending lists first, so one insertBatch covers them and whatever other clients parked.
+void StorageServer::run(const std::shared_ptr<Connection>& connection, std::vector<Request>& requests) {
+    for (size_t i = 0; i < requests.size();) {
+        if (requests[i].op != RequestOp::Insert) {
+            handle(connection, requests[i++]);
+            continue;
+        }
+
+        std::vector<std::pair<std::string, std::string>> tables;
+        for (; i < requests.size() && requests[i].op == RequestOp::Insert; ++i) {
+            WireReader reader(requests[i].body);
+            std::pair<std::string, std::string> table;
+            table.first = reader.str();
+            table.second = reader.str();
+            PendingInsert insert{connection, requests[i].id, Tuple()};
+            if (!reader.tuple(insert.tuple) || !reader.atEnd()) {
+                reply(connection, requests[i].id, ResponseStatus::Error, message("malformed insert"));
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(batchMutex);
+                pendingInserts[table].push_back(std::move(insert));
+            }
+            if (std::find(tables.begin(), tables.end(), table) == tables.end()) {
+                tables.push_back(std::move(table));
+            }
+        }
+        for (const auto& table : tables) {
+            std::lock_guard<std::mutex> engine(engineMutex);
+            applyInserts(table); // Finds an empty list if another worker applied ours already
+        }
+    }
+}
+
+// Applies everything parked for the table; called with the engine held
+void StorageServer::applyInserts(const std::pair<std::string, std::string>& table) {
+    std::vector<PendingInsert> batch;
+    std::vector<Tuple> tuples;
+    std::vector<uint8_t> inserted;
+    for (;;) {
+        batch.clear();
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            auto pending = pendingInserts.find(table);
+            if (pending == pendingInserts.end()) {
+                return;
+            }
+            std::vector<PendingInsert>& waiting = pending->second;
+            size_t take = std::min(waiting.size(), options.maxInsertBatch);
+            std::move(waiting.begin(), waiting.begin() + take, std::back_inserter(batch));
+            waiting.erase(waiting.begin(), waiting.begin() + take);
+            if (waiting.empty()) {
+                pendingInserts.erase(pending);
+            }
+        }
+
+        tuples.clear();
+        for (PendingInsert& insert : batch) {
+            tuples.push_back(std::move(insert.tuple));
+        }
+        if (storage.tableExists(table.first, table.second)) {
+            storage.insertBatch(table.first, table.second, tuples, &inserted);
+        } else {
+            inserted.assign(tuples.size(), 0);
+        }
+        insertBatches++;
+        batchedInserts += batch.size();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (inserted[i]) {
+                reply(batch[i].connection, batch[i].id, ResponseStatus::Ok);
+            } else {
+                reply(batch[i].connection, batch[i].id, ResponseStatus::Error,
+                      message("insert into " + table.second + " failed: no such table, schema mismatch or duplicate id"));
+            }
+        }
+    }
+}
+
+void StorageServer::handle(const std::shared_ptr<Connection>& connection, const Request& request) {
+    WireReader reader(request.body);
+    std::string body;
+    WireWriter writer(body);
+    ResponseStatus status = ResponseStatus::Ok;
+
+    // Decode fully before taking the engine
+    std::string db, table;
+    if (request.op != RequestOp::Ping) {
+        db = reader.str();
+        if (request.op != RequestOp::CreateDatabase) {
+            table = reader.str();
+        }
+    }
+    int64_t id = 0, lo = 0, hi = 0;
+    uint32_t limit = SCAN_NO_LIMIT;
+    std::map<std::string, std::string> schema;
+    std::vector<std::string> columns;
+    Tuple tuple;
+    switch (request.op) {
+        case RequestOp::CreateTable:
+            for (uint32_t n = reader.u32(), i = 0; reader.ok() && i < n; ++i) {
+                std::string column(reader.str());
+                schema[column] = reader.str();
+            }
+            break;
+        case RequestOp::Get:
+        case RequestOp::Delete:
+            id = reader.i64();
+            break;
+        case RequestOp::Update:
+            id = reader.i64();
+            reader.tuple(tuple);
+            break;
+        case RequestOp::Scan:
+            lo = reader.i64();
+            hi = reader.i64();
+            limit = reader.u32();
+            for (uint32_t n = reader.u32(), i = 0; reader.ok() && i < n; ++i) {
+                columns.emplace_back(reader.str());
+            }
+            break;
+        case RequestOp::Ping:
+        case RequestOp::CreateDatabase:
+        case RequestOp::TableExists:
+            break;
+        default:
+            reply(connection, request.id, ResponseStatus::Error, message("unknown operation"));
+            return;
+    }
+    if (!reader.ok() || !reader.atEnd()) {
+        reply(connection, request.id, ResponseStatus::Error, message("malformed request"));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> engine(engineMutex);
+        try {
+            switch (request.op) {
+                case RequestOp::Ping:
+                    break;
+                case RequestOp::CreateDatabase:
+                    status = storage.createDatabase(db) ? ResponseStatus::Ok : ResponseStatus::Error;
+                    break;
+                case RequestOp::CreateTable:
+                    status = storage.createTable(db, table, schema) ? ResponseStatus::Ok : ResponseStatus::Error;
+                    break;
+                case RequestOp::TableExists:
+                    status = storage.tableExists(db, table) ? ResponseStatus::Ok : ResponseStatus::NotFound;
+                    break;
+                case RequestOp::Get: {
+                    if (!storage.tableExists(db, table)) {
+                        status = ResponseStatus::NotFound;
+                        break;
+                    }
+                    std::map<std::string, std::string> row = storage.get(db, table, std::to_string(id));
+                    writer.u32(static_cast<uint32_t>(row.size()));
+                    for (const auto& [column, value] : row) {
+                        writer.str(column);
+                        writer.str(value);
+                    }
+                    break;
+                }
+                case RequestOp::Delete:
+                    status = storage.tableExists(db, table) && storage.deleteTupleFromTable(db, table, std::to_string(id))
+                                 ? ResponseStatus::Ok : ResponseStatus::NotFound;
+                    break;
+                case RequestOp::Update:
+                    status = storage.tableExists(db, table) && storage.updateTupleInTable(db, table, std::to_string(id), tuple)
+                                 ? ResponseStatus::Ok : ResponseStatus::Error;
+                    break;
+                case RequestOp::Scan: {
+                    if (!storage.tableExists(db, table)) {
+                        status = ResponseStatus::NotFound;
+                        break;
+                    }
+                    size_t countAt = body.size();
+                    writer.u32(0);
+                    uint32_t rows = 0;
+                    storage.scan(db, table, lo, hi, columns, [&](const ProjectedRow& row) {
+                        writer.i64(row.id);
+                        for (size_t c = 0; c < row.size(); ++c) {
+                            writer.str(row.value(c));
+                        }
+                        ++rows;
+                        return (limit == SCAN_NO_LIMIT || rows < limit) && body.size() < MAX_FRAME_BYTES / 2;
+                    });
+                    std::memcpy(&body[countAt], &rows, sizeof(rows));
+                    break;
+                }
+                default:
+                    break;
+            }
+        } catch (const std::out_of_range&) {
+            status = ResponseStatus::NotFound;
+            body.clear();
+        } catch (const std::exception& e) {
+            status = ResponseStatus::Error;
+            body = message(e.what());
+        }
+    }
+    reply(connection, request.id, status, body);
+}
+
+void StorageServer::reply(const std::shared_ptr<Connection>& connection, uint32_t id, ResponseStatus status, const std::string& body) {
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(connection->outMutex);
+        if (connection->closed) {
+            return;
+        }
+        wasEmpty = connection->out.empty();
+        WireWriter writer(connection->out);
+        size_t frame = writer.begin(id, static_cast<uint8_t>(status));
+        connection->out.append(body);
+        writer.end(frame);
+    }
+    // The loop writes a connection out completely or arms EPOLLOUT, so one wake-up per
+    // empty-to-pending transition is enough
+    if (wasEmpty) {
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            readyToWrite.push_back(connection);
+        }
+        signal(wakeFd);
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include "storage.hpp"
+#include "protocol.hpp"
+
+struct ServerOptions {
+    std::string socketPath;       // Unix domain socket to listen on
+    unsigned workers = 0;         // Worker threads, 0 = one per core
+    size_t maxInsertBatch = 4096; // Inserts applied together at most
+};
+
+struct ServerStats {
+    uint64_t connections = 0;     // Accepted so far
+    uint64_t requests = 0;
+    uint64_t insertBatches = 0;   // insertBatch calls made for Insert requests
+    uint64_t batchedInserts = 0;  // Insert requests they carried
+    uint64_t protocolErrors = 0;  // Connections dropped for a malformed frame
+};
+
+// Serves one Storage to local clients over a Unix domain socket (wire format in protocol.hpp).
+//
+// An epoll loop owns the sockets: it accepts clients, reads every complete frame a client
+// has pipelined, and hands the connection to a pool of workers; replies are queued back on
+// the connection and the loop writes them out. The engine is not thread-safe, so workers take
+// turns on it. Inserts do not wait for their turn one by one: each is parked on its table's
+// pending list, and whichever worker gets the engine next takes the whole list as one
+// Storage::insertBatch, which writes each page and the header once for the batch. The more
+// clients insert at once, the larger the batches get.
+class StorageServer {
+public:
+    explicit StorageServer(const ServerOptions& options);
+    ~StorageServer();
+    StorageServer(const StorageServer&) = delete;
+    StorageServer& operator=(const StorageServer&) = delete;
+
+    bool start();
+    void stop(); // Drops requests not yet run and closes every connection
+
+    ServerStats getStats() const;
+
+private:
+    struct Request {
+        uint32_t id;
+        RequestOp op;
+        std::string body;
+    };
+
+    // A client's requests run one at a time in arrival order, so a pipeline behaves like the
+    // same calls made one after another
+    struct Connection {
+        uint64_t id;
+        int fd;
+        std::string in;             // Bytes read but not yet parsed; loop only
+        bool writeArmed = false;    // EPOLLOUT registered; loop only
+        std::mutex workMutex;
+        std::deque<Request> work;   // Parsed, not yet run
+        bool scheduled = false;     // On the run queue or with a worker
+        std::mutex outMutex;
+        std::string out;            // Replies waiting to be written
+        bool closed = false;        // Under outMutex
+    };
+
+    struct PendingInsert {
+        std::shared_ptr<Connection> connection;
+        uint32_t id;
+        Tuple tuple;
+    };
+
+    ServerOptions options;
+    Storage storage;
+    std::mutex engineMutex;         // One worker at a time in storage
+
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;                // eventfd: replies ready or stop requested
+    std::thread loop;
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+
+    std::map<uint64_t, std::shared_ptr<Connection>> connections; // Loop only
+    uint64_t nextConnectionId = 2;  // 0 and 1 tag the listening socket and the eventfd
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<std::shared_ptr<Connection>> runnable;
+
+    std::mutex readyMutex;
+    std::vector<std::shared_ptr<Connection>> readyToWrite;
+
+    std::mutex batchMutex;
+    std::map<std::pair<std::string, std::string>, std::vector<PendingInsert>> pendingInserts; // (db, table) -> inserts
+
+    std::atomic<uint64_t> connectionCount{0};
+    std::atomic<uint64_t> requestCount{0};
+    std::atomic<uint64_t> insertBatches{0};
+    std::atomic<uint64_t> batchedInserts{0};
+    std::atomic<uint64_t> protocolErrors{0};
+
+    void runLoop();
+    void acceptClients();
+    bool readClient(const std::shared_ptr<Connection>& connection);
+    bool writeClient(const std::shared_ptr<Connection>& connection);
+    void closeClient(const std::shared_ptr<Connection>& connection);
+    void watch(const std::shared_ptr<Connection>& connection, bool wantWrite);
+
+    void runWorker();
+    void run(const std::shared_ptr<Connection>& connection, std::vector<Request>& requests);
+    void handle(const std::shared_ptr<Connection>& connection, const Request& request);
+    void applyInserts(const std::pair<std::string, std::string>& table);
+    void reply(const std::shared_ptr<Connection>& connection, uint32_t id, ResponseStatus status, const std::string& body = "");
+};
+
+#endif // SERVER_HPP
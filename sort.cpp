@@ -0,0 +1,367 @@
+#include "sort.hpp"
+#include "tablefile.hpp"
+#include "projection.hpp"
+#include "FileMetaData.hpp"
+#include "page.hpp"
+#include "overflow.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace {
+
+const uint64_t SIGN_BIT = uint64_t(1) << 63;
+
+void appendBigEndian(std::string& out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+struct RunReader {
+    std::ifstream in;
+    std::string key;
+    std::string row;
+    bool done = false;
+
+    bool advance() {
+        uint32_t keyLength, rowLength;
+        if (!in.read(reinterpret_cast<char*>(&keyLength), sizeof(keyLength))) return !(done = true);
+        key.resize(keyLength);
+        in.read(&key[0], keyLength);
+        in.read(reinterpret_cast<char*>(&rowLength), sizeof(rowLength));
+        row.resize(rowLength);
+        if (!in.read(&row[0], rowLength)) return !(done = true);
+        return true;
+    }
+};
+
+void writeRecord(std::ofstream& out, const std::string& key, const std::string& row) {
+    uint32_t keyLength = key.size();
+    uint32_t rowLength = row.size();
+    out.write(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+    out.write(key.data(), keyLength);
+    out.write(reinterpret_cast<const char*>(&rowLength), sizeof(rowLength));
+    out.write(row.data(), rowLength);
+}
+
+} // namespace
+
+LoserTree::LoserTree(size_t sourceCount, std::function<bool(size_t, size_t)> lessThan, std::function<bool(size_t)> isExhausted)
+    : sources(sourceCount), tree(std::max<size_t>(sourceCount, 1), sourceCount),
+      less(std::move(lessThan)), exhausted(std::move(isExhausted)) {
+    if (sources > 0) {
+        tree[0] = play(1);
+    }
+}
+
+bool LoserTree::beats(size_t a, size_t b) const {
+    if (exhausted(a)) return false;
+    if (exhausted(b)) return true;
+    if (less(a, b)) return true;
+    if (less(b, a)) return false;
+    return a < b; // Equal heads: the earlier source wins, so merges are stable
+}
+
+// Leaves sit at sources..2*sources-1 and node n's children at 2n and 2n+1
+size_t LoserTree::play(size_t node) {
+    if (node >= sources) {
+        return node - sources;
+    }
+    size_t left = play(2 * node);
+    size_t right = play(2 * node + 1);
+    if (beats(left, right)) {
+        tree[node] = right;
+        return left;
+    }
+    tree[node] = left;
+    return right;
+}
+
+size_t LoserTree::winner() const {
+    return tree[0];
+}
+
+bool LoserTree::empty() const {
+    return sources == 0 || exhausted(tree[0]);
+}
+
+void LoserTree::replay() {
+    size_t current = tree[0];
+    for (size_t node = (current + sources) / 2; node > 0; node /= 2) {
+        if (beats(tree[node], current)) {
+            std::swap(tree[node], current);
+        }
+    }
+    tree[0] = current;
+}
+
+ExternalSort::ExternalSort(const std::string& dbName, const std::string& tableName, const std::string& sortColumn,
+                           const SortOptions& opts)
+    : tablePath(dbName + "/" + tableName + ".HAD"), column(sortColumn), options(opts) {
+    std::string tempDir = options.tempDir.empty() ? dbName : options.tempDir;
+    tempPrefix = tempDir + "/" + tableName + ".sort";
+    options.mergeFanIn = std::max<size_t>(options.mergeFanIn, 2);
+}
+
+ExternalSort::~ExternalSort() {
+    removeRuns();
+}
+
+const SortStats& ExternalSort::getStats() const {
+    return stats;
+}
+
+bool ExternalSort::begin() {
+    TableFile file(tablePath, false);
+    if (!file.isOpen()) {
+        std::cerr << "Error orderBy: Table does not exist: " << tablePath << std::endl;
+        return false;
+    }
+    FileMetadata metadata;
+    try {
+        metadata.deserialize(file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error orderBy: " << e.what() << std::endl;
+        return false;
+    }
+    CompiledSchema schema(metadata.getSchema());
+    int ordinal = schema.ordinalOf(column);
+    if (ordinal == CompiledSchema::NO_COLUMN) {
+        std::cerr << "Error orderBy: Column " << column << " is not in " << tablePath << std::endl;
+        return false;
+    }
+    keyType = schema.getColumn(ordinal).type;
+
+    removeRuns();
+    buffer.clear();
+    bufferedBytes = 0;
+    sequence = 0;
+    stats = SortStats();
+    stats.topN = options.limit > 0;
+    return true;
+}
+
+// Keys are encoded so that comparing the bytes orders them like their values
+bool ExternalSort::encodeKey(std::string_view value, std::string& key) const {
+    key.clear();
+    const char* end = value.data() + value.size();
+    switch (keyType) {
+        case ColumnType::Int: {
+            int64_t parsed = 0;
+            if (std::from_chars(value.data(), end, parsed).ptr != end) return false;
+            appendBigEndian(key, static_cast<uint64_t>(parsed) ^ SIGN_BIT);
+            return true;
+        }
+        case ColumnType::Double: {
+            double parsed = 0;
+            if (std::from_chars(value.data(), end, parsed).ptr != end) return false;
+            if (parsed == 0) parsed = 0; // -0 sorts with 0
+            uint64_t bits;
+            std::memcpy(&bits, &parsed, sizeof(bits));
+            appendBigEndian(key, (bits & SIGN_BIT) ? ~bits : bits | SIGN_BIT);
+            return true;
+        }
+        default:
+            key.assign(value);
+            return true;
+    }
+}
+
+bool ExternalSort::keyLess(const std::string& a, const std::string& b) const {
+    return options.descending ? b < a : a < b;
+}
+
+bool ExternalSort::entryLess(const Entry& a, const Entry& b) const {
+    if (a.key != b.key) {
+        return keyLess(a.key, b.key);
+    }
+    return a.sequence < b.sequence;
+}
+
+bool ExternalSort::add(const std::string& row) {
+    std::string_view value;
+    Entry entry;
+    if (!Projection::readValue(row, column, value) || !encodeKey(value, entry.key)) {
+        stats.rowsSkipped++;
+        return true;
+    }
+    entry.row = row;
+    entry.sequence = sequence++;
+    stats.rowsSorted++;
+    if (stats.topN) {
+        return addTopN(std::move(entry));
+    }
+    bufferedBytes += entry.key.size() + entry.row.size() + sizeof(Entry);
+    buffer.push_back(std::move(entry));
+    return bufferedBytes <= options.memoryBudget || spillRun();
+}
+
+// Keeps the best limit rows as a heap whose top is the worst of them
+bool ExternalSort::addTopN(Entry entry) {
+    auto heapLess = [this](const Entry& a, const Entry& b) { return entryLess(a, b); };
+    if (buffer.size() == options.limit) {
+        if (!entryLess(entry, buffer.front())) {
+            return true;
+        }
+        std::pop_heap(buffer.begin(), buffer.end(), heapLess);
+        bufferedBytes -= buffer.back().key.size() + buffer.back().row.size() + sizeof(Entry);
+        buffer.pop_back();
+    }
+    bufferedBytes += entry.key.size() + entry.row.size() + sizeof(Entry);
+    buffer.push_back(std::move(entry));
+    std::push_heap(buffer.begin(), buffer.end(), heapLess);
+    if (bufferedBytes > options.memoryBudget) {
+        // The limit itself does not fit: fall back to sorted runs, each cut to the limit
+        stats.topN = false;
+        return spillRun();
+    }
+    return true;
+}
+
+bool ExternalSort::spillRun() {
+    std::sort(buffer.begin(), buffer.end(), [this](const Entry& a, const Entry& b) { return entryLess(a, b); });
+    if (options.limit > 0 && buffer.size() > options.limit) {
+        buffer.resize(options.limit);
+    }
+    std::string runPath = tempPrefix + std::to_string(runsCreated++) + ".tmp";
+    std::ofstream run(runPath, std::ios::binary | std::ios::trunc);
+    if (!run) {
+        std::cerr << "Error orderBy: Unable to create sort run: " << runPath << std::endl;
+        return false;
+    }
+    runPaths.push_back(runPath);
+    for (const Entry& entry : buffer) {
+        writeRecord(run, entry.key, entry.row);
+    }
+    if (!run.flush()) {
+        std::cerr << "Error orderBy: Failed writing sort run: " << runPath << std::endl;
+        return false;
+    }
+    stats.runsSpilled++;
+    buffer.clear();
+    bufferedBytes = 0;
+    return true;
+}
+
+bool ExternalSort::mergeRuns(const std::vector<std::string>& inputs,
+                             const std::function<bool(const std::string&, const std::string&)>& emit) {
+    std::vector<RunReader> readers(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        readers[i].in.open(inputs[i], std::ios::binary);
+        if (!readers[i].in) {
+            std::cerr << "Error orderBy: Unable to reopen sort run: " << inputs[i] << std::endl;
+            return false;
+        }
+        readers[i].advance();
+    }
+
+    LoserTree tree(readers.size(),
+                   [&](size_t a, size_t b) { return keyLess(readers[a].key, readers[b].key); },
+                   [&](size_t source) { return readers[source].done; });
+    while (!tree.empty()) {
+        RunReader& head = readers[tree.winner()];
+        if (!emit(head.key, head.row)) {
+            return true;
+        }
+        head.advance();
+        tree.replay();
+    }
+    return true;
+}
+
+bool ExternalSort::finish(const Emit& emit) {
+    uint64_t limit = options.limit > 0 ? options.limit : UINT64_MAX;
+    uint64_t emitted = 0;
+    bool ok = true;
+
+    if (runPaths.empty()) {
+        auto less = [this](const Entry& a, const Entry& b) { return entryLess(a, b); };
+        if (stats.topN) {
+            std::sort_heap(buffer.begin(), buffer.end(), less);
+        } else {
+            std::sort(buffer.begin(), buffer.end(), less);
+        }
+        for (const Entry& entry : buffer) {
+            if (emitted++ == limit || !emit(entry.row)) break;
+        }
+    } else {
+        ok = buffer.empty() || spillRun();
+        // Merge the oldest runs first and put the result in their place, so equal keys keep their order
+        while (ok && runPaths.size() > options.mergeFanIn) {
+            std::vector<std::string> inputs(runPaths.begin(), runPaths.begin() + options.mergeFanIn);
+            std::string mergedPath = tempPrefix + std::to_string(runsCreated++) + ".tmp";
+            std::ofstream merged(mergedPath, std::ios::binary | std::ios::trunc);
+            uint64_t written = 0;
+            ok = merged && mergeRuns(inputs, [&](const std::string& key, const std::string& row) {
+                writeRecord(merged, key, row);
+                return ++written < limit;
+            });
+            ok = ok && merged.flush();
+            if (!ok) {
+                std::cerr << "Error orderBy: Failed writing merged run: " << mergedPath << std::endl;
+                runPaths.push_back(mergedPath);
+                break;
+            }
+            for (const std::string& input : inputs) {
+                std::filesystem::remove(input);
+            }
+            runPaths.erase(runPaths.begin(), runPaths.begin() + options.mergeFanIn);
+            runPaths.insert(runPaths.begin(), mergedPath);
+            stats.mergePasses++;
+        }
+        if (ok) {
+            ok = mergeRuns(runPaths, [&](const std::string&, const std::string& row) {
+                return emitted++ < limit && emit(row);
+            });
+            stats.mergePasses++;
+        }
+    }
+
+    buffer.clear();
+    bufferedBytes = 0;
+    removeRuns();
+    return ok;
+}
+
+bool ExternalSort::run(const Emit& emit) {
+    if (!begin()) {
+        return false;
+    }
+    try {
+        TableFile file(tablePath, false);
+        FileMetadata metadata;
+        metadata.deserialize(file);
+        Page page(0);
+        std::string row;
+        for (uint64_t pageID = 0; pageID < metadata.getPageCount(); ++pageID) {
+            file.readPage(metadata, pageID, page); // Overflow and header pages come back without rows
+            for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+                if (page.getSlot(i).length == 0) continue; // Deleted slot
+                row = page.getTupleData(i);
+                // Rows are emitted whole, so long values are read back from their overflow pages
+                if (OverflowStore::hasPointers(row) && !OverflowStore::resolveRow(file, metadata, row)) {
+                    throw std::runtime_error("unable to read the overflow pages of a row in " + tablePath);
+                }
+                if (!add(row)) {
+                    removeRuns();
+                    return false;
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error orderBy: " << e.what() << std::endl;
+        removeRuns();
+        return false;
+    }
+    return finish(emit);
+}
+
+void ExternalSort::removeRuns() {
+    for (const std::string& runPath : runPaths) {
+        std::filesystem::remove(runPath);
+    }
+    runPaths.clear();
+}
@@ -0,0 +1,101 @@
+#ifndef SORT_HPP
+#define SORT_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "schema.hpp"
+
+struct SortOptions {
+    size_t memoryBudget = 64 * 1024 * 1024;  // Bytes of rows buffered before a sorted run is spilled
+    size_t mergeFanIn = 64;                  // Most runs merged at once; more take extra merge passes
+    bool descending = false;
+    uint64_t limit = 0;                      // ORDER BY ... LIMIT n; 0 means every row
+    std::string tempDir;                     // Where sorted runs go, defaults to the database folder
+};
+
+struct SortStats {
+    uint64_t rowsSorted = 0;
+    uint64_t rowsSkipped = 0;   // Rows without the sort column
+    uint32_t runsSpilled = 0;
+    uint32_t mergePasses = 0;
+    bool topN = false;          // Whether the LIMIT fast path kept every candidate in memory
+};
+
+// Picks the next row of a k-way merge in log2(k) comparisons against the losers stored on
+// the path from the winning leaf to the root, instead of the two per level a heap needs.
+// less(a, b) orders the current heads of sources a and b; exhausted(a) retires a source.
+class LoserTree {
+public:
+    LoserTree(size_t sources, std::function<bool(size_t, size_t)> less, std::function<bool(size_t)> exhausted);
+
+    size_t winner() const;
+    bool empty() const;
+    // Call after the winner's source has advanced to its next head
+    void replay();
+
+private:
+    size_t sources;
+    std::vector<size_t> tree; // tree[0] is the winner, tree[1..sources-1] the losers of each match
+    std::function<bool(size_t, size_t)> less;
+    std::function<bool(size_t)> exhausted;
+
+    bool beats(size_t a, size_t b) const;
+    size_t play(size_t node);
+};
+
+// ORDER BY one column of a table with a bounded memory budget.
+// Rows are buffered with a memcmp-ordered encoding of their key, sorted and spilled as runs
+// when the buffer outgrows the budget, then k-way merged through a loser tree. With a limit
+// only the best n rows are kept in a bounded heap and nothing touches disk unless those n
+// rows alone exceed the budget. Ties keep the order rows were added in.
+class ExternalSort {
+public:
+    using Emit = std::function<bool(const std::string& row)>;
+
+    ExternalSort(const std::string& dbName, const std::string& tableName, const std::string& column,
+                 const SortOptions& options = SortOptions());
+    ~ExternalSort();
+
+    // Sorts the whole table; emit may return false to stop early
+    bool run(const Emit& emit);
+
+    // Feed rows from any other scan, then finish() to emit them in order
+    bool begin();
+    bool add(const std::string& row);
+    bool finish(const Emit& emit);
+
+    const SortStats& getStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::string row;
+        uint64_t sequence;
+    };
+
+    std::string tablePath;
+    std::string column;
+    std::string tempPrefix;
+    SortOptions options;
+    SortStats stats;
+    ColumnType keyType = ColumnType::Invalid;
+    std::vector<Entry> buffer;
+    size_t bufferedBytes = 0;
+    uint64_t sequence = 0;
+    std::vector<std::string> runPaths;
+    size_t runsCreated = 0;
+
+    bool encodeKey(std::string_view value, std::string& key) const;
+    bool entryLess(const Entry& a, const Entry& b) const;
+    bool keyLess(const std::string& a, const std::string& b) const;
+    bool addTopN(Entry entry);
+    bool spillRun();
+    bool mergeRuns(const std::vector<std::string>& inputs, const std::function<bool(const std::string&, const std::string&)>& emit);
+    void removeRuns();
+};
+
+#endif // SORT_HPP
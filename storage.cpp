@@ -1,6 +1,22 @@
 #include "storage.hpp"
+#include "projection.hpp"
+#include <algorithm>
+#include <thread>
+#include <exception>
+#include <charconv>
 
 std::string Storage::tablePath = "";
+
+// Parses a row id for the row cache. Rows are matched on the id text, so only the canonical
+// spelling is cached: "007" must keep missing even when "7" is cached.
+bool Storage::parseRowId(const std::string& id, int64_t& value) {
+    if (id.size() > 1 && (id[0] == '0' || (id[0] == '-' && id[1] == '0'))) {
+        return false;
+    }
+    const char* end = id.data() + id.size();
+    auto result = std::from_chars(id.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
 // Function to create a new database
 bool Storage::createDatabase(const std::string& dbName) {
     if (!fs::exists(dbName)) {
@@ -17,34 +33,94 @@ bool Storage::createDatabase(const std::string& dbName) {
 // Function to check if a table exists
 bool Storage::tableExists(const std::string& dbName, const std::string& tableName) {
     tablePath = dbName + "/" + tableName + ".HAD";
-    return fs::exists(tablePath);
+    return catalog.hasTable(dbName, tableName);
+}
+
+// Scans a database directory into the catalog up front instead of on its first use
+size_t Storage::loadCatalog(const std::string& dbName) {
+    return catalog.loadDatabase(dbName);
+}
+
+std::map<std::string, std::string> Storage::getTableSchema(const std::string& dbName, const std::string& tableName) {
+    const std::map<std::string, std::string>* schema = catalog.getSchema(dbName, tableName);
+    return schema ? *schema : std::map<std::string, std::string>();
+}
+
+std::vector<std::string> Storage::listTables(const std::string& dbName) {
+    return catalog.listTables(dbName);
+}
+
+void Storage::setOpenFileBudget(size_t files) {
+    catalog.setFileBudget(files);
+}
+
+CatalogStats Storage::getCatalogStats() const {
+    return catalog.getStats();
+}
+
+// Cached handle on the table from the catalog; sets tablePath like the other operations
+TableFile* Storage::openTable(const std::string& dbName, const std::string& tableName) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    TableFile* file = catalog.open(dbName, tableName);
+    if (!file) {
+        std::cerr << "Table does not exist: " << tablePath << std::endl;
+    }
+    return file;
 }
 
 // Function to create a new table with the provided schema
-bool Storage::createTable(const std::string& dbName, const std::string& tableName, const std::map<std::string, std::string>& schema1) {
+bool Storage::createTable(const std::string& dbName, const std::string& tableName, const std::map<std::string, std::string>& schema1, const TableOptions& options) {
+    TraceSpan span(trace, TraceOp::CreateTable, dbName, tableName);
+    span.setExtra(TraceRecorder::schemaText(schema1));
     tablePath = dbName + "/" + tableName + ".HAD";
     std::cout << "Debug createTable: Creating table at path: " << tablePath << std::endl;
 
-    if (fs::exists(tablePath)) {
+    if (catalog.hasTable(dbName, tableName)) {
         std::cout << "Table already exists: " << tablePath << std::endl;
         return true; // Table exists, so continue
     }
+    schemaCatalog.erase(tablePath);
+    plans.invalidateTable(tablePath);
+
+    if (!isSupportedPageSize(options.pageSize)) {
+        std::cerr << "Error createTable: Unsupported page size " << options.pageSize << "; use 4096, 8192, 16384, 32768 or 65536." << std::endl;
+        return false;
+    }
+    if (options.segmentSize != 0 && options.segmentSize < options.pageSize) {
+        std::cerr << "Error createTable: Segment size must be at least one page (" << options.pageSize << " bytes)." << std::endl;
+        return false;
+    }
+    if (options.extentSize != 0 && options.extentSize < options.pageSize) {
+        std::cerr << "Error createTable: Extent size must be at least one page (" << options.pageSize << " bytes)." << std::endl;
+        return false;
+    }
+
+    { std::ofstream create(tablePath, std::ios::binary | std::ios::trunc); }
+    TableFile newTable(tablePath);
+    if (newTable.isOpen()) {
+        FileMetadata metadata;
+        metadata.setPageCount(0); // Start with 0 pages
+        metadata.setClustered(options.clustered);
+        metadata.setPageSize(options.pageSize);
+        metadata.setSegmentPages(options.segmentSize / options.pageSize);
+        metadata.setExtentPages(options.extentSize / options.pageSize);
+        metadata.setSchema(schema1); // Use the provided schema
 
-    std::fstream newTable(tablePath, std::ios::binary | std::ios::out | std::ios::in | std::ios::trunc);
-    if (newTable) {
-        FileMetadata* metadata = FileMetadata::getInstance();
-        metadata->setPageCount(0); // Start with 0 pages
-        FileMetadata::schema=schema1;// Use the provided schema
-        
         std::cout << "Debug createTable: Initialized metadata with 0 pages and provided schema." << std::endl;
 
-        metadata->serialize(newTable);  // Serialize metadata
-        if (newTable) {
+        fs::remove(IdIndex::pathForTable(tablePath)); // Drop a stale index left by a removed table
+        if (!metadata.openIndex(tablePath)) {
+            std::cerr << "Error createTable: Failed to create id index for table: " << tablePath << std::endl;
+            return false;
+        }
+        metadata.serialize(newTable);  // Serialize metadata
+        if (newTable.headerStream()) {
             std::cout << "Debug createTable: Serialized metadata to table file successfully." << std::endl;
         } else {
             std::cerr << "Error createTable: Failed to write metadata to table file." << std::endl;
         }
         newTable.close();
+        catalog.addTable(dbName, tableName);
         std::cout << "Created new table with metadata: " << tablePath << std::endl;
         return true;
     }
@@ -55,11 +131,26 @@ bool Storage::createTable(const std::string& dbName, const std::string& tableNam
 
 // Function to delete a table
 bool Storage::deleteTable(const std::string& tablePath) {
+    fs::path tableFile(tablePath);
+    TraceSpan span(trace, TraceOp::DeleteTable, tableFile.parent_path().string(), tableFile.stem().string());
     std::cout << "Debug deleteTable: Attempting to delete table at path: " << tablePath << std::endl;
 
     if (fs::exists(tablePath)) {
         try {
+            schemaCatalog.erase(tablePath);
+            plans.invalidateTable(tablePath);
+            rowCache.invalidateTable(tablePath);
+            catalog.forget(tablePath); // Close the cached handles before the files go
+            if (executor) executor->forgetTable(tablePath);
+            logs.erase(tablePath);
+            WriteAheadLog::removeFiles(tablePath); // Nothing left to recover
+            ChangeTracker::discard(tablePath); // Or to back up incrementally
             fs::remove(tablePath); // Remove the table file
+            fs::remove(IdIndex::pathForTable(tablePath)); // And its id index
+            IdFilter::discard(IdIndex::pathForTable(tablePath)); // And the index's filter
+            for (uint64_t segment = 1; fs::exists(TableFile::segmentPath(tablePath, segment)); ++segment) {
+                fs::remove(TableFile::segmentPath(tablePath, segment)); // And any segment files
+            }
             std::cout << "Debug deleteTable: Table deleted successfully: " << tablePath << std::endl;
             return true;
         } catch (const fs::filesystem_error& e) {
@@ -72,30 +163,25 @@ bool Storage::deleteTable(const std::string& tablePath) {
 }
 
 // Helper function to load a page by ID
-Page Storage::loadPageByID(const std::string& tablePath, uint32_t pageID) {
-    std::fstream dbFile(tablePath, std::ios::in | std::ios::binary);
-    if (!dbFile.is_open()) {
-        dbFile.open(tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }
+Page Storage::loadPageByID(const std::string& tablePath, uint64_t pageID) {
+    TableFile dbFile(tablePath, false);
+    if (!dbFile.isOpen()) {
+        throw std::runtime_error("Error loadPageByID: Unable to open table file: " + tablePath);
     }
 
     FileMetadata* fileMetadata = FileMetadata::getInstance();
     fileMetadata->deserialize(dbFile);
-    uint32_t pagePosition = fileMetadata->getPagePosition(pageID);
-    dbFile.seekg(pagePosition, std::ios::beg);
 
-    Page page(pageID);
-    page.deserialize(dbFile);
-    dbFile.close();
+    Page page(pageID, fileMetadata->getPageSize());
+    dbFile.readPage(*fileMetadata, pageID, page);
     return page;
 }
 
 // Retrieve tuples from a page
 std::vector<Tuple> Storage::getTuplesFromPage(const Page& page) {
     std::vector<Tuple> tuples;
-    for (size_t i = 0; i < page.getTupleCount(); ++i) {
+    for (size_t i = 0; i < page.getSlots().size(); ++i) {
+        if (page.getSlot(i).length == 0) continue; // Deleted slot
         try {
             std::string tupleData = page.getTupleData(i);
             Tuple tuple;
@@ -110,13 +196,9 @@ std::vector<Tuple> Storage::getTuplesFromPage(const Page& page) {
 }
 
 // Load a tuple by ID
-std::string Storage::loadTuple(const std::string& tablePath, uint16_t tupleID) {
-    std::fstream dbFile(tablePath, std::ios::in | std::ios::binary);
-    if (!dbFile.is_open()) {
-  dbFile.open(Storage::tablePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!dbFile.is_open()) {
-            throw std::runtime_error("Error File Metadata serialize: Unable to reopen the file stream.");
-        }        
+std::string Storage::loadTuple(const std::string& tablePath, int64_t tupleID) {
+    TableFile dbFile(tablePath, false);
+    if (!dbFile.isOpen()) {
         return "";
     }
 
@@ -124,40 +206,39 @@ std::string Storage::loadTuple(const std::string& tablePath, uint16_t tupleID) {
     try {
         fileMetadata->deserialize(dbFile);
     } catch (const std::exception& e) {
-        dbFile.close();
         return "";
     }
 
-    auto it = fileMetadata->getTupleToPageMap().find(tupleID);
-    if (it == fileMetadata->getTupleToPageMap().end() || it->second == -2) {
-        dbFile.close();
+    int64_t pageID = fileMetadata->getPageIDForTuple(tupleID);
+    if (pageID < 0) {
         return "";
     }
 
-    uint16_t pageID = it->second;
-    uint32_t pagePosition = fileMetadata->getPagePosition(pageID);
-    dbFile.seekg(pagePosition, std::ios::beg);
-
-    Page page(pageID);
-    page.deserialize(dbFile);
+    Page page(pageID, fileMetadata->getPageSize());
+    dbFile.readPage(*fileMetadata, pageID, page);
 
     int slotIndex = page.getTupleIndexByID(std::to_string(tupleID));
     if (slotIndex == -1) {
-        dbFile.close();
         return "";
     }
 
-    std::string tupleData = page.getTupleData(slotIndex);
-    dbFile.close();
-    return tupleData;
+    return page.getTupleData(slotIndex);
 }
 
 std::map<std::string, std::string> Storage::get(const std::string& dbName, const std::string& tableName, const std::string& id) {
-    // Construct the table path
-     tablePath = dbName + "/" + tableName + ".HAD";
+    TraceSpan span(trace, TraceOp::Get, dbName, tableName);
+    span.setId(id);
+    // A cached row needs neither the table file nor decoding
+    std::string path = dbName + "/" + tableName + ".HAD";
+    int64_t rowId = 0;
+    bool cacheable = rowCache.enabled() && parseRowId(id, rowId);
+    RowCache::Row row;
+    if (cacheable && rowCache.lookup(path, rowId, row)) {
+        return row;
+    }
 
     // Open the table file
-    std::fstream file(tablePath, std::ios::binary | std::ios::in);
+    TableFile* file = openTable(dbName, tableName);
     if (!file) {
         throw std::runtime_error("Failed to open the table file.");
     }
@@ -165,56 +246,58 @@ std::map<std::string, std::string> Storage::get(const std::string& dbName, const
     // Read file metadata to get the tuple-to-page map
     FileMetadata* fileMetadata = FileMetadata::getInstance();
     try {
-        fileMetadata->deserialize(file);
+        fileMetadata->deserialize(*file);
     } catch (const std::exception& e) {
-        file.close();
         throw std::runtime_error("Error deserializing file metadata: " + std::string(e.what()));
     }
-    
-    uint32_t tupleId;
+    row = readRow(*file, *fileMetadata, id);
+    if (cacheable) {
+        rowCache.store(path, rowId, row);
+    }
+    return row;
+}
+
+// Finds a row through the id index of an open table; touches no state of its own, so readers
+// with their own handle and metadata can call it concurrently
+std::map<std::string, std::string> Storage::readRow(TableFile& file, const FileMetadata& metadata, const std::string& id) {
+    int64_t tupleId;
     try {
-        tupleId = std::stoi(id);  // Convert string id to integer
+        tupleId = std::stoll(id);  // Convert string id to integer
     } catch (const std::invalid_argument& e) {
-        file.close();
         throw std::invalid_argument("Invalid ID format: " + id);
     }
 
-    // Check if the tuple exists in the map
-    auto it = fileMetadata->getTupleToPageMap().find(stoi(id));
-    if (it == fileMetadata->getTupleToPageMap().end() || it->second == -1) {
+    // Look the tuple up in the id index
+    int64_t pageID = metadata.getPageIDForTuple(tupleId);
+    if (pageID < 0) {
         // Tuple ID not found or is marked as deleted
-        file.close();
         throw std::out_of_range("Tuple ID not found");
     }
 
-    // Get the page ID from the map
-    uint32_t pageID = it->second;
-
-    // Calculate the position of the page in the file
-    file.seekg(fileMetadata->getPagePosition(pageID), std::ios::beg);
-
-     if (!file.good()) {
-        file.close();
-        throw std::runtime_error("Failed to seek to page position in file.");
-    }
-
     // Load the page
-    Page page(pageID);
+    Page page(pageID, metadata.getPageSize());
     try {
-        page.deserialize(file);
+        file.readPage(metadata, pageID, page);
     } catch (const std::exception& e) {
-        file.close();
         throw std::runtime_error("Error deserializing page with ID " + std::to_string(pageID) + ": " + std::string(e.what()));
     }
 
-    // Search for the tuple in the page
-    for (uint16_t i = 0; i < page.getTupleCount(); ++i) {
+    // Search for the tuple in the page; only the id is read from the other rows, which
+    // matters on large pages
+    for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+        if (page.getSlot(i).length == 0) continue; // Deleted slot
         std::string tupleData = page.getTupleData(i);
+        int64_t rowId;
+        if (!Projection::readId(tupleData, rowId) || rowId != tupleId) continue;
         Tuple tuple;
 
         // Deserialize the tuple and check if the ID matches
         if (tuple.deserialize(tupleData) && tuple.getAttributeValue("id") == id) {
-            file.close();
+            // Long values come back from their overflow pages
+            if (OverflowStore::hasPointers(tupleData) &&
+                !(OverflowStore::resolveRow(file, metadata, tupleData) && tuple.deserialize(tupleData))) {
+                throw std::runtime_error("Error reading the overflow pages of tuple " + id);
+            }
 
             // Create a map to store the tuple's key-value pairs
             std::map<std::string, std::string> result;
@@ -227,114 +310,417 @@ std::map<std::string, std::string> Storage::get(const std::string& dbName, const
     }
 
     // If the tuple was not found
-    file.close();
     throw std::out_of_range("Tuple with ID " + id + " not found on page " + std::to_string(pageID));
 
 }
 
-bool Storage::addTupleToTable(const std::string& dbName, const std::string& tableName, const std::string& tupleSerialized, int id) {
-     tablePath = dbName + "/" + tableName + ".HAD";
-    std::cout << "Debug addTupleToTable: Adding tuple to table file: " << tablePath << std::endl;
+ProjectedRow Storage::get(const std::string& dbName, const std::string& tableName, const std::string& id, const std::vector<std::string>& columns) {
+    TraceSpan span(trace, TraceOp::GetColumns, dbName, tableName);
+    span.setId(id);
+    span.setExtra(TraceRecorder::joinColumns(columns));
+    TableFile* file = openTable(dbName, tableName);
+    if (!file) {
+        throw std::runtime_error("Failed to open the table file.");
+    }
 
-    // Check if the table exists
-    if (!fs::exists(tablePath)) {
-        std::cerr << "Table does not exist: " << tablePath << std::endl;
-        return false;
+    FileMetadata* fileMetadata = FileMetadata::getInstance();
+    try {
+        fileMetadata->deserialize(*file);
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Error deserializing file metadata: " + std::string(e.what()));
+    }
+    Projection projection(compiledSchema(tablePath, *fileMetadata), columns);
+    projection.setFetch([&](std::string_view pointer, std::string& value) {
+        return OverflowStore::fetch(*file, *fileMetadata, pointer, value);
+    });
+
+    int64_t tupleId;
+    try {
+        tupleId = std::stoll(id);
+    } catch (const std::exception& e) {
+        throw std::invalid_argument("Invalid ID format: " + id);
+    }
+    int64_t pageID = fileMetadata->getPageIDForTuple(tupleId);
+    if (pageID < 0) {
+        throw std::out_of_range("Tuple ID not found");
+    }
+
+    Page page(pageID, fileMetadata->getPageSize());
+    file->readPage(*fileMetadata, pageID, page);
+
+    // Only the id is read from the other rows on the page
+    ProjectedRow row;
+    for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+        if (page.getSlot(i).length == 0) continue; // Deleted slot
+        std::string tupleData = page.getTupleData(i);
+        int64_t rowId;
+        if (Projection::readId(tupleData, rowId) && rowId == tupleId && projection.decode(tupleData, row)) {
+            return row;
+        }
     }
+    throw std::out_of_range("Tuple with ID " + id + " not found on page " + std::to_string(pageID));
+}
 
+uint64_t Storage::scan(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi,
+                       const std::vector<std::string>& columns, const std::function<bool(const ProjectedRow&)>& visit) {
+    TraceSpan span(trace, TraceOp::Scan, dbName, tableName);
+    span.setKeys(lo, hi);
+    span.setExtra(TraceRecorder::joinColumns(columns));
+    TableFile* file = openTable(dbName, tableName);
+    if (!file) {
+        throw std::runtime_error("Table does not exist: " + tablePath);
+    }
+    FileMetadata metadata;
+    metadata.deserialize(*file);
+    Projection projection(compiledSchema(tablePath, metadata), columns);
+    projection.setFetch([&](std::string_view pointer, std::string& value) {
+        return OverflowStore::fetch(*file, metadata, pointer, value);
+    });
+
+    // Like TupleIterator: take ids from the index in batches, read each page of a batch once
+    const size_t batchSize = 1024;
+    std::vector<std::pair<int64_t, int64_t>> wanted; // (page, id)
+    std::vector<ProjectedRow> rows(batchSize);       // Reused, so values keep their buffers
+    std::vector<size_t> order;
+    IdIndex::Iterator cursor = metadata.getIdIndex().lowerBound(lo);
+    int64_t cachedPageID = -1;
+    Page page(0, metadata.getPageSize());
+    uint64_t visited = 0;
+
+    while (cursor.valid() && cursor.key() <= hi) {
+        wanted.clear();
+        while (cursor.valid() && cursor.key() <= hi && wanted.size() < batchSize) {
+            wanted.push_back({cursor.value(), cursor.key()});
+            cursor.next();
+        }
+        std::sort(wanted.begin(), wanted.end());
+
+        size_t filled = 0;
+        for (size_t start = 0; start < wanted.size();) {
+            int64_t pageID = wanted[start].first;
+            size_t end = start;
+            while (end < wanted.size() && wanted[end].first == pageID) {
+                ++end;
+            }
+            if (pageID != cachedPageID) {
+                file->readPage(metadata, pageID, page); // Replaces the whole page, reusing its buffer
+                cachedPageID = pageID;
+            }
+            for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+                if (page.getSlot(i).length == 0) continue; // Deleted slot
+                std::string tupleData = page.getTupleData(i);
+                int64_t rowId;
+                if (!Projection::readId(tupleData, rowId) ||
+                    !std::binary_search(wanted.begin() + start, wanted.begin() + end, std::make_pair(pageID, rowId))) {
+                    continue;
+                }
+                if (filled < rows.size() && projection.decode(tupleData, rows[filled])) {
+                    ++filled;
+                }
+            }
+            start = end;
+        }
+
+        order.resize(filled);
+        for (size_t i = 0; i < filled; ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&rows](size_t a, size_t b) { return rows[a].id < rows[b].id; });
+        for (size_t i : order) {
+            ++visited;
+            if (!visit(rows[i])) {
+                return visited;
+            }
+        }
+    }
+    return visited;
+}
+
+std::vector<AggregateRow> Storage::aggregate(const std::string& dbName, const std::string& tableName, const std::vector<AggregateSpec>& specs,
+                                             const std::string& groupBy, unsigned threads) {
+    TraceSpan span(trace, TraceOp::Aggregate, dbName, tableName);
+    TableFile* file = openTable(dbName, tableName);
+    if (!file) {
+        throw std::runtime_error("Table does not exist: " + tablePath);
+    }
+    FileMetadata metadata;
+    metadata.deserialize(*file);
+    const CompiledSchema& schema = compiledSchema(tablePath, metadata);
+
+    // Split the pages into one contiguous range per worker; each worker reads its range in
+    // file order through its own handle and aggregates into its own Aggregator
+    uint64_t pageCount = metadata.getPageCount();
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<uint64_t>(1, std::min<uint64_t>(threads, pageCount));
+
+    std::vector<Aggregator> partials(threads, Aggregator(schema, specs, groupBy));
+    std::vector<std::exception_ptr> failures(threads);
+    auto work = [&](unsigned worker) {
+        try {
+            TableFile workerFile(tablePath, false);
+            uint64_t begin = pageCount * worker / threads;
+            uint64_t end = pageCount * (worker + 1) / threads;
+            Page page(0, metadata.getPageSize());
+            auto fetch = [&](std::string_view pointer, std::string& value) {
+                return OverflowStore::fetch(workerFile, metadata, pointer, value);
+            };
+            for (uint64_t pageID = begin; pageID < end; ++pageID) {
+                workerFile.readPage(metadata, pageID, page);
+                partials[worker].consume(page, fetch);
+            }
+        } catch (...) {
+            failures[worker] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned worker = 1; worker < threads; ++worker) {
+        workers.emplace_back(work, worker);
+    }
+    work(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const std::exception_ptr& failure : failures) {
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    for (unsigned worker = 1; worker < threads; ++worker) {
+        partials[0].merge(partials[worker]);
+    }
+    return partials[0].results();
+}
+
+uint64_t Storage::join(const std::string& dbName, const std::string& leftTable, const std::string& leftColumn,
+                       const std::string& rightTable, const std::string& rightColumn, const HashJoin::Emit& emit,
+                       const JoinOptions& options, JoinStats* stats) {
+    TraceSpan span(trace, TraceOp::Join, dbName, leftTable);
+    HashJoin join(dbName, leftTable, leftColumn, rightTable, rightColumn, options);
+    if (!join.run(emit)) {
+        std::cerr << "Failed to join " << leftTable << "." << leftColumn << " with " << rightTable << "." << rightColumn << std::endl;
+        return 0;
+    }
+    if (stats) {
+        *stats = join.getStats();
+    }
+    return join.getStats().outputRows;
+}
+
+uint64_t Storage::orderBy(const std::string& dbName, const std::string& tableName, const std::string& column,
+                          const ExternalSort::Emit& emit, const SortOptions& options, SortStats* stats) {
+    TraceSpan span(trace, TraceOp::OrderBy, dbName, tableName);
+    ExternalSort sort(dbName, tableName, column, options);
+    uint64_t emitted = 0;
+    bool ok = sort.run([&](const std::string& row) {
+        ++emitted;
+        return emit(row);
+    });
+    if (!ok) {
+        std::cerr << "Failed to sort " << tableName << " by " << column << std::endl;
+        return 0;
+    }
+    if (stats) {
+        *stats = sort.getStats();
+    }
+    return emitted;
+}
+
+TupleIterator Storage::getRange(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi) {
+    TraceSpan span(trace, TraceOp::Scan, dbName, tableName);
+    span.setKeys(lo, hi);
+    span.setExtra("*"); // Whole rows, read later through the iterator
+    tablePath = dbName + "/" + tableName + ".HAD";
+    if (!catalog.hasTable(dbName, tableName)) {
+        throw std::runtime_error("Table does not exist: " + tablePath);
+    }
+    return TupleIterator(tablePath, lo, hi);
+}
+
+bool Storage::addTupleToTable(const std::string& dbName, const std::string& tableName, const std::string& tupleSerialized, int64_t id) {
+    TraceSpan span(trace, TraceOp::Insert, dbName, tableName);
+    span.setKeys(id, 0);
     // Open the table file for reading and writing
-    std::fstream file(tablePath, std::ios::binary | std::ios::in | std::ios::out);
+    TableFile* file = openTable(dbName, tableName);
     if (!file) {
-        std::cerr << "Failed to open table file for reading and writing.\n";
         return false;
     }
-    std::cout << "Debug addTupleToTable: Successfully opened table file for reading and writing.\n";
+    std::cout << "Debug addTupleToTable: Adding tuple to table file: " << tablePath << std::endl;
 
     FileMetadata* fileMetadata=FileMetadata::getInstance();
     try {
-        fileMetadata->deserialize(file);
+        fileMetadata->deserialize(*file);
         std::cout << "Debug addTupleToTable: Deserialized file metadata.\n";
     } catch (const std::exception& e) {
         std::cerr << "Error deserializing file metadata: " << e.what() << std::endl;
-        file.close();
-        return false;
-    }
-
-    // Check if there is space in the existing pages
-    int pageId = fileMetadata->getPageCount(); // Assuming this is the next available page ID
-    size_t pagePosition = fileMetadata->getPagePosition(pageId);  // Calculate the position of the page
-
-    // Read the page to check for space
-    file.seekg(pagePosition);
-    Page page(pageId);
-    page.deserialize(file);
-
-    std::cout << "Debug addTupleToTable: Page deserialized.\n";
-    // Try to add the tuple to this page
-    if (page.addTuple(tupleSerialized, fileMetadata,id)) {
-        std::cout << "Debug addTupleToTable: Writing updated page at position " << pagePosition << "\n";
-        
-        file.seekp(pagePosition);
-        page.serialize(file);
-         std::cout << "Debug addTupleToTable: Updated page serialized and written to file.\n";
-        
-        // Update metadata after adding a tuple to an existing page
-        file.seekp(0);  // Go to the beginning of the file to write metadata
-        fileMetadata->serialize(file);  // Update the metadata
-        // Flush and close the file
-        file.flush();
-        file.close();
-
-        std::cout << "Debug addTupleToTable: Tuple successfully added to existing page.\n";
-        return true;  // Tuple successfully added
-    } else {
-        std::cerr << "Error addTupleToTable: Failed to add tuple to page.\n";
+        return false;
+    }
+    if (fileMetadata->hasTupleWithID(id)) {
+        std::cerr << "Duplicate ID: " << id << " for table: " << tableName << std::endl;
+        return false;
+    }
+    rowCache.invalidate(tablePath, id);
+    bool added = appendTuple(*file, fileMetadata, tupleSerialized, id);
+    file->flush(); // The handle stays open; readers on other handles must see the write
+    return added;
+}
+
+// Places a tuple in an open table: an existing page if it has room, otherwise a new one
+bool Storage::appendTuple(TableFile& file, FileMetadata* fileMetadata, const std::string& row, int64_t id) {
+    // Long values go to overflow pages first, leaving pointers in the row
+    if (row.size() <= OverflowStore::inlineLimit(fileMetadata->getPageSize())) {
+        return placeTuple(file, fileMetadata, row, id);
+    }
+    std::string spilled = row;
+    if (!OverflowStore::spill(file, *fileMetadata, spilled)) {
+        return false;
+    }
+    if (placeTuple(file, fileMetadata, spilled, id)) {
+        return true;
+    }
+    // The row did not go in, so its chains go to the free list
+    OverflowStore::release(file, *fileMetadata, spilled);
+    fileMetadata->serialize(file);
+    return false;
+}
+
+bool Storage::placeTuple(TableFile& file, FileMetadata* fileMetadata, const std::string& tupleSerialized, int64_t id) {
+    // Try the insert page first; earlier pages are treated as full.
+    // Clustered tables instead target the page that holds the neighbouring ids.
+    uint64_t pageCount = fileMetadata->getPageCount();
+    if (pageCount > 0) {
+        uint64_t pageId = fileMetadata->isClustered() ? clusteredTargetPage(fileMetadata, id) : fileMetadata->getInsertPage();
+
+        // Read the page to check for space
+        Page page(pageId, fileMetadata->getPageSize());
+        file.readPage(*fileMetadata, pageId, page);
+
+        std::cout << "Debug addTupleToTable: Page deserialized.\n";
+        // Try to add the tuple to this page; it may hold header or value overflow instead of rows
+        if (page.getPageType() == PAGE_TYPE_DATA && page.addTuple(tupleSerialized, fileMetadata, id)) {
+            std::cout << "Debug addTupleToTable: Writing updated page " << pageId << "\n";
+
+            file.writePage(*fileMetadata, page);
+            std::cout << "Debug addTupleToTable: Updated page serialized and written to file.\n";
+
+            // Update metadata after adding a tuple to an existing page
+            fileMetadata->serialize(file);  // Update the metadata
+            file.flush();
+
+            std::cout << "Debug addTupleToTable: Tuple successfully added to existing page.\n";
+            return true;  // Tuple successfully added
+        }
+
+        if (fileMetadata->isClustered() && page.getPageType() == PAGE_TYPE_DATA) {
+            return splitPageForTuple(file, fileMetadata, page, tupleSerialized, id);
+        }
     }
 
     // If no existing page had space, create a new page and append it
-    
-    Page newPage(fileMetadata->getNextPageID()); // Assuming this method gives the next available page ID
+    Page newPage(fileMetadata->allocatePage(), fileMetadata->getPageSize());
     std::cout << "Debug addTupleToTable: No space on existing pages. Creating a new page with ID: " << newPage.getPageID() << "\n";
-    
+    file.reserveExtent(*fileMetadata);
+
     if (!newPage.addTuple(tupleSerialized, fileMetadata, id)) {
         std::cerr << "Failed to add tuple to a new page.\n";
-        file.close();
         return false;
     }
 
-    // Append the new page to the end of the file
-    file.clear();
-    file.seekp(0, std::ios::end);
-    newPage.serialize(file);
+    // Append the new page right after the last one
+    file.writePage(*fileMetadata, newPage);
+    if (!fileMetadata->isClustered()) {
+        fileMetadata->setInsertPage(newPage.getPageID());
+    }
     std::cout << "Debug addTupleToTable: New page serialized and appended to file.\n";
 
-    // Increment the page ID after creating a new page
-    fileMetadata->incrementPageID();
-    file.seekp(0);  // Seek to the beginning of the file to write metadata
     fileMetadata->serialize(file);  // Write updated metadata
-    file.close();
-    
+
     std::cout << "Debug addTupleToTable: Tuple successfully added to a new page.\n";;
     return true;
 }
 
-bool Storage::checkTupleExists(const std::string& dbName, const std::string& tableName, const std::string& id) {
-    // Check if the database exists
-    if (!fs::exists(dbName)) {
-        std::cerr << "Database '" << dbName << "' not found.\n";
-        return false;
+// Page holding the closest smaller id, or the closest larger one for a new minimum
+int64_t Storage::clusteredTargetPage(FileMetadata* fileMetadata, int64_t id) {
+    IdIndex& index = fileMetadata->getIdIndex();
+    int64_t pageId = index.findFloor(id);
+    if (pageId < 0) {
+        IdIndex::Iterator successor = index.lowerBound(id);
+        pageId = successor.valid() ? successor.value() : fileMetadata->getInsertPage();
+    }
+    return pageId;
+}
+
+// Splits a full page of a clustered table: rows stay sorted by id, the lower half keeps the
+// page and the upper half moves to a new page appended at the end of the file.
+bool Storage::splitPageForTuple(TableFile& file, FileMetadata* fileMetadata, const Page& page, const std::string& tupleSerialized, int64_t id) {
+    std::vector<std::pair<int64_t, std::string>> rows;
+    for (size_t i = 0; i < page.getSlots().size(); ++i) {
+        if (page.getSlot(i).length == 0) continue; // Deleted slot
+        std::string tupleData = page.getTupleData(i);
+        Tuple tuple;
+        if (tuple.deserialize(tupleData)) {
+            rows.push_back({std::stoll(tuple.getAttributeValue("id")), tupleData});
+        }
+    }
+    rows.push_back({id, tupleSerialized});
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    size_t totalBytes = 0;
+    for (const auto& row : rows) {
+        totalBytes += row.second.size();
+    }
+    size_t cut = 0, leftBytes = 0;
+    while (cut + 1 < rows.size() && leftBytes + rows[cut].second.size() <= totalBytes / 2) {
+        leftBytes += rows[cut++].second.size();
+    }
+    if (cut == 0) {
+        cut = 1;
+    }
+
+    uint64_t newPageId = fileMetadata->allocatePage();
+    file.reserveExtent(*fileMetadata);
+    Page left(page.getPageID(), page.getPageSize());
+    Page right(newPageId, page.getPageSize());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        Page& target = i < cut ? left : right;
+        if (!target.appendTuple(rows[i].second)) {
+            std::cerr << "Error splitPageForTuple: Tuple " << rows[i].first << " does not fit after splitting page "
+                      << page.getPageID() << ".\n";
+            return false;
+        }
+    }
+
+    // Moved rows get their index entries repointed, the new row is mapped wherever it landed
+    for (size_t i = 0; i < rows.size(); ++i) {
+        int64_t target = i < cut ? left.getPageID() : newPageId;
+        if (rows[i].first == id) {
+            fileMetadata->addTupleToPageMap(id, target);
+        } else if (i >= cut) {
+            fileMetadata->getIdIndex().insert(rows[i].first, target);
+        }
     }
 
+    file.writePage(*fileMetadata, left);
+    file.writePage(*fileMetadata, right);
+    fileMetadata->serialize(file);
+    return true;
+}
+
+bool Storage::checkTupleExists(const std::string& dbName, const std::string& tableName, const std::string& id) {
+    TraceSpan span(trace, TraceOp::Exists, dbName, tableName);
+    span.setId(id);
     // Check if the table exists
-     tablePath = dbName + "/" + tableName + ".HAD";
-    if (!fs::exists(tablePath)) {
+    if (!catalog.hasTable(dbName, tableName)) {
         std::cerr << "Table '" << tableName << "' not found in database '" << dbName << "'.\n";
         return false;
     }
 
-    int tupleID;
+    int64_t tupleID;
     try {
-        tupleID = std::stoi(id);  // Convert string id to integer
+        tupleID = std::stoll(id);  // Convert string id to integer
     } catch (const std::invalid_argument& e) {
         std::cerr << "Invalid ID format: '" << id << "'. ID must be a valid integer.\n";
         return false;
@@ -342,193 +728,375 @@ bool Storage::checkTupleExists(const std::string& dbName, const std::string& tab
         std::cerr << "ID '" << id << "' is out of range.\n";
         return false;
     }
+
+    // Most probes are for ids the table does not have; a loaded id filter rules those out
+    // without opening the table
+    std::shared_ptr<IdFilter> filter = IdFilter::find(IdIndex::pathForTable(dbName + "/" + tableName + ".HAD"));
+    if (filter && !filter->mayContain(tupleID)) {
+        std::cerr << "Tuple with ID '" << id << "' not found in table: " << tableName << " (via id filter).\n";
+        return false;
+    }
+
     // Open the table file for reading
-    std::fstream file(tablePath, std::ios::binary | std::ios::in);
+    TableFile* file = openTable(dbName, tableName);
     if (!file) {
-        std::cerr << "Failed to open table g: " << tablePath << "\n";
         return false;
     }
 
     // Read the file metadata
     FileMetadata* fileMetadata=FileMetadata::getInstance();
     try {
-        fileMetadata->deserialize(file);
+        fileMetadata->deserialize(*file);
     } catch (const std::exception& e) {
         std::cerr << "Error deserializing file metadata: " << e.what() << "\n";
-        file.close();
         return false;
     }
 
     // Check if the tuple ID exists in the tuple-to-page map in file metadata
-    if (fileMetadata->hasTupleInPageMap(std::stoi(id))) {
+    if (fileMetadata->hasTupleInPageMap(tupleID)) {
         std::cout << "Tuple with ID '" << id << "' found in table: " << tableName << " (via metadata lookup).\n";
-        file.close();
         return true; // Tuple found via metadata map
     }
 
     std::cerr << "Tuple with ID '" << id << "' not found in table: " << tableName << " (via metadata map).\n";
-    file.close();
     return false; // Tuple does not exist
 }
 bool Storage::insert(const std::string& dbName, const std::string& tableName, const Tuple& tuple) {
-
-        std::map<int, std::string> typeMap = {
-        {1, "int"},
-        {2, "string"},
-        {3, "double"},
-        // Add more types as needed
-    };
-    // Validate database existence
-    if (!fs::exists(dbName)) {
-        std::cerr << "Database does not exist: " << dbName << std::endl;
+    TraceSpan span(trace, TraceOp::Insert, dbName, tableName);
+    span.addTuple(tuple);
+    // Open the table file for reading and writing; the catalog knows whether it exists
+    TableFile* file = openTable(dbName, tableName);
+    if (!file) {
         return false;
     }
 
-    // Validate table existence
-    tablePath = dbName + "/" + tableName + ".HAD";
-    if (!fs::exists(tablePath)) {
-        std::cerr << "Table does not exist: " << tableName << std::endl;
+    // Read file metadata; the schema is compiled the first time the table is seen
+    FileMetadata* fileMetadata=FileMetadata::getInstance();
+    try {
+        fileMetadata->deserialize(*file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error deserializing file metadata: " << e.what() << std::endl;
         return false;
     }
+    const CompiledSchema& schema = compiledSchema(tablePath, *fileMetadata);
 
-    // Open the table file for reading
-    std::fstream file(tablePath, std::ios::binary | std::ios::in | std::ios::out);
-    if (!file) {
-        std::cerr << "Failed to open table file: " << tablePath << "\n";
+    // Validate and serialize the tuple against the compiled schema in one pass
+    int64_t id = 0;
+    std::string error;
+    if (!schema.encode(tuple, insertBuffer, id, error)) {
+        std::cerr << error << std::endl;
         return false;
     }
 
-    // Read file metadata, including schema
-    FileMetadata* fileMetadata=FileMetadata::getInstance();
-    std::map<std::string, std::string>  schema2=fileMetadata->deserialize(file);
-
-    // Extract and validate tuple attributes against schema in file metadata
-    std::map<std::string, std::pair<int, std::string>> attributes = tuple.getAttributes();
-    for (const auto& attr : attributes) {
-        std::cout<< attr.first<<" ";
-    }
-    std::cout<<std::endl;
-    for (const auto& [key, type] : schema2) {
-        std::cout<<key<<" "<<" type";
-        std::cout<<std::endl;
-        // Check if attribute exists in tuple
-        // if (attributes.find(key) == attributes.end()) {
-        //     std::cerr << "Missing required attribute: " << key << std::endl;
-        //     return false;
-        // }
-
-        // Check data type and length
-        const auto& [attrType, attrValue] = attributes[key];
-        if (typeMap[attrType] != type) {
-            std::cerr << "Type mismatch for attribute: " << key << std::endl;
-            return false;
-        }
-    }
-
-    // Check if 'id' is unique using tuple-to-page map in file metadata
-    std::string idValue = attributes["id"].second; // Assuming "id" is always present
-    int id = std::stoi(idValue);
+    // Check if 'id' is unique using the id index
     if (fileMetadata->hasTupleWithID(id)) {
         std::cerr << "Duplicate ID: " << id << " for table: " << tableName << std::endl;
         return false;
     }
 
-    // Serialize tuple and add to the table
-    std::string serializedTuple = tuple.serialize();
-
-
-    if (!addTupleToTable(dbName, tableName, serializedTuple,id)) {
+    rowCache.invalidate(tablePath, id);
+    bool added = appendTuple(*file, fileMetadata, insertBuffer, id);
+    file->flush();
+    if (!added) {
         std::cerr << "Failed to add tuple to table: " << tableName << std::endl;
         return false;
     }
 
     std::cout << "Debug insert: Tuple successfully added to table: " << tableName << std::endl;
-    file.flush();
     return true;
 }
 
-bool Storage::deleteTupleFromTable(const std::string& dbName, const std::string& tableName, const std::string& id) {
-     tablePath = dbName + "/" + tableName + ".HAD";
-    std::cout << "Debug deleteTupleFromTable: Deleting tuple from table file: " << tablePath << std::endl;
+size_t Storage::insertBatch(const std::string& dbName, const std::string& tableName, const std::vector<Tuple>& tuples,
+                            std::vector<uint8_t>* rowInserted) {
+    TraceSpan span(trace, TraceOp::InsertBatch, dbName, tableName);
+    if (span.recording()) {
+        std::string ids;
+        uint8_t flags = 0;
+        for (const Tuple& tuple : tuples) {
+            span.addTuple(tuple);
+            int64_t id = TraceRecorder::keyOf(tuple.getAttributeValue("id"), flags);
+            ids.append(reinterpret_cast<const char*>(&id), sizeof(id));
+        }
+        span.setKeys(0, static_cast<int64_t>(tuples.size()));
+        span.setExtra(std::move(ids));
+    }
+    if (rowInserted) {
+        rowInserted->assign(tuples.size(), 0);
+    }
+    TableFile* file = openTable(dbName, tableName);
+    if (!file) {
+        return 0;
+    }
+    FileMetadata* fileMetadata=FileMetadata::getInstance();
+    try {
+        fileMetadata->deserialize(*file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error deserializing file metadata: " << e.what() << std::endl;
+        return 0;
+    }
+    const CompiledSchema& schema = compiledSchema(tablePath, *fileMetadata);
+
+    // Each row is checked against the schema as it is encoded, then placed.
+    // Rows of an unclustered table fill the last page in memory, and each page is written
+    // once after it fills or the batch ends, with a single header write for the batch.
+    // Filled pages are held back and written in runs, which are adjacent unless rows spilled.
+    size_t inserted = 0;
+    Page page(0, fileMetadata->getPageSize());
+    bool pageLoaded = false;
+    bool pageDirty = false;
+    std::vector<Page> filled;
+    for (size_t i = 0; i < tuples.size(); ++i) {
+        int64_t id = 0;
+        std::string error;
+        if (!schema.encode(tuples[i], insertBuffer, id, error)) {
+            std::cerr << "Error insertBatch: Row " << i << " does not match the schema of " << tableName
+                      << (error.empty() ? "" : ": " + error) << std::endl;
+            continue;
+        }
+        if (fileMetadata->hasTupleWithID(id)) {
+            std::cerr << "Duplicate ID: " << id << " for table: " << tableName << std::endl;
+            continue;
+        }
+        rowCache.invalidate(tablePath, id);
+        if (fileMetadata->isClustered()) {
+            if (appendTuple(*file, fileMetadata, insertBuffer, id)) {
+                ++inserted;
+                if (rowInserted) (*rowInserted)[i] = 1;
+            }
+            continue;
+        }
+        if (insertBuffer.size() > OverflowStore::inlineLimit(fileMetadata->getPageSize()) &&
+            !OverflowStore::spill(*file, *fileMetadata, insertBuffer)) {
+            std::cerr << "Error insertBatch: Row " << i << " does not fit on a page.\n";
+            continue;
+        }
 
-    // Check if the table exists
-    if (!fs::exists(tablePath)) {
-        std::cerr << "Table does not exist: " << tablePath << std::endl;
-        return false;
+        if (!pageLoaded && fileMetadata->getPageCount() > 0) {
+            file->readPage(*fileMetadata, fileMetadata->getInsertPage(), page);
+            pageLoaded = true;
+        }
+        // The insert page may hold header overflow instead of rows
+        bool placed = pageLoaded && page.getPageType() == PAGE_TYPE_DATA && page.addTuple(insertBuffer, fileMetadata, id);
+        if (!placed) {
+            if (pageDirty) {
+                filled.push_back(std::move(page));
+                if (filled.size() == TableFile::WRITE_RUN_PAGES) {
+                    file->writePages(*fileMetadata, filled);
+                    filled.clear();
+                }
+            }
+            page = Page(fileMetadata->allocatePage(), fileMetadata->getPageSize());
+            file->reserveExtent(*fileMetadata);
+            fileMetadata->setInsertPage(page.getPageID());
+            pageLoaded = true;
+            pageDirty = true; // The new page is written even if the row does not fit it
+            placed = page.addTuple(insertBuffer, fileMetadata, id);
+            if (!placed) {
+                std::cerr << "Error insertBatch: Row " << i << " does not fit on an empty page.\n";
+                if (OverflowStore::hasPointers(insertBuffer)) {
+                    OverflowStore::release(*file, *fileMetadata, insertBuffer); // The header goes out with the batch
+                }
+            }
+        }
+        if (placed) {
+            pageDirty = true;
+            ++inserted;
+            if (rowInserted) (*rowInserted)[i] = 1;
+        }
+    }
+    if (pageDirty) {
+        filled.push_back(std::move(page));
+        file->writePages(*fileMetadata, filled);
+        fileMetadata->serialize(*file);
     }
+    file->flush();
+    return inserted;
+}
 
-    // Open the table file for reading and writing
-    std::fstream file(tablePath, std::ios::binary | std::ios::in | std::ios::out);
+// Schema of a table compiled into column descriptors, kept for as long as this Storage lives
+const CompiledSchema& Storage::compiledSchema(const std::string& tablePath, const FileMetadata& fileMetadata) {
+    auto it = schemaCatalog.find(tablePath);
+    if (it == schemaCatalog.end()) {
+        it = schemaCatalog.emplace(tablePath, CompiledSchema(fileMetadata.getSchema())).first;
+    }
+    return it->second;
+}
+
+// Tombstones the live rows named by targets ((page, id) pairs) that match accepts. Targets are
+// sorted by page so each page is read and written once; the deleted ids then leave the index
+// in one pass and the header is written once. Returns the deleted ids, sorted.
+std::vector<int64_t> Storage::deleteRows(TableFile& file, FileMetadata& metadata, std::vector<std::pair<int64_t, int64_t>>& targets,
+                                         const std::function<bool(const std::string&)>& match) {
+    std::sort(targets.begin(), targets.end());
+    std::vector<int64_t> deleted;
+    std::vector<std::string> spilledRows; // Deleted rows whose chains are released once the pages are written
+    std::vector<Page> dirty; // Written in runs of adjacent pages
+    Page page(0, metadata.getPageSize());
+    for (size_t start = 0; start < targets.size();) {
+        int64_t pageID = targets[start].first;
+        size_t end = start;
+        while (end < targets.size() && targets[end].first == pageID) {
+            ++end;
+        }
+        file.readPage(metadata, pageID, page);
+        bool pageDirty = false;
+        for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+            if (page.getSlot(i).length == 0) continue; // Deleted slot
+            std::string tupleData = page.getTupleData(i);
+            int64_t rowId;
+            if (!Projection::readId(tupleData, rowId) ||
+                !std::binary_search(targets.begin() + start, targets.begin() + end, std::make_pair(pageID, rowId)) ||
+                (match && !match(tupleData))) {
+                continue;
+            }
+            if (page.markDeleted(i)) {
+                rowCache.invalidate(tablePath, rowId);
+                deleted.push_back(rowId);
+                pageDirty = true;
+                if (OverflowStore::hasPointers(tupleData)) {
+                    spilledRows.push_back(std::move(tupleData));
+                }
+            }
+        }
+        if (pageDirty) {
+            if (!dirty.empty() && (dirty.size() == TableFile::WRITE_RUN_PAGES || dirty.back().getPageID() + 1 != page.getPageID())) {
+                file.writePages(metadata, dirty);
+                dirty.clear();
+            }
+            dirty.push_back(std::move(page));
+            page = Page(0, metadata.getPageSize());
+        }
+        start = end;
+    }
+    file.writePages(metadata, dirty);
+    for (const std::string& row : spilledRows) {
+        OverflowStore::release(file, metadata, row);
+    }
+    if (!deleted.empty()) {
+        std::sort(deleted.begin(), deleted.end());
+        metadata.getIdIndex().eraseBatch(deleted);
+        metadata.serialize(file);
+    }
+    file.flush();
+    return deleted;
+}
+
+bool Storage::deleteTupleFromTable(const std::string& dbName, const std::string& tableName, const std::string& id) {
+    TraceSpan span(trace, TraceOp::Delete, dbName, tableName);
+    span.setId(id);
+    TableFile* file = openTable(dbName, tableName);
     if (!file) {
-        std::cerr << "Failed to open table file for reading and writing.\n";
         return false;
     }
-    std::cout << "Debug deleteTupleFromTable: Table file opened for reading and writing.\n";
-
+    std::cout << "Debug deleteTupleFromTable: Deleting tuple from table file: " << tablePath << std::endl;
 
-    // Read file metadata (including tuple-to-page map)
     FileMetadata fileMetadata;
-    fileMetadata.deserialize(file);
-    std::cout << "Debug deleteTupleFromTable: File metadata deserialized.\n";
+    try {
+        fileMetadata.deserialize(*file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error deserializing file metadata: " << e.what() << std::endl;
+        return false;
+    }
 
-    // Check if the tuple exists using the tuple-to-page map
-    int tupleID = std::stoi(id);
-    if (!fileMetadata.hasTupleWithID(tupleID)) {
+    // Check if the tuple exists using the id index
+    int64_t tupleID;
+    if (!parseRowId(id, tupleID) || !fileMetadata.hasTupleWithID(tupleID)) {
         std::cerr << "Tuple with ID " << id << " does not exist.\n";
-        file.close();
         return false;
     }
+    std::vector<std::pair<int64_t, int64_t>> targets{{fileMetadata.getPageIDForTuple(tupleID), tupleID}};
+    if (deleteRows(*file, fileMetadata, targets, nullptr).empty()) {
+        std::cerr << "Failed to delete tuple with ID: " << id << ". It may not exist.\n";
+        return false;
+    }
+    std::cout << "Successfully deleted tuple with ID: " << id << std::endl;
+    return true;
+}
 
-    std::cout << "Debug deleteTupleFromTable: Tuple with ID " << id << " found in the file metadata.\n";
-
-    // Retrieve the page ID from the map
-    int pageID = fileMetadata.getPageIDForTuple(tupleID);
-    std::cout << "Debug deleteTupleFromTable: Found page ID " << pageID << " for tuple ID " << id << ".\n";
-
-
-    // Locate the corresponding page and find the tuple
-    Page page(pageID);
-    std::streampos pagePos = file.tellg();
-    file.seekg(fileMetadata.getPagePosition(pageID), std::ios::beg); // Move to the correct page position
-    page.deserialize(file);
+size_t Storage::deleteBatch(const std::string& dbName, const std::string& tableName, const std::vector<int64_t>& ids,
+                            std::vector<uint8_t>* rowDeleted) {
+    TraceSpan span(trace, TraceOp::DeleteBatch, dbName, tableName);
+    if (span.recording()) {
+        span.setKeys(0, static_cast<int64_t>(ids.size()));
+        span.setExtra(std::string(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(int64_t)));
+    }
+    if (rowDeleted) {
+        rowDeleted->assign(ids.size(), 0);
+    }
+    TableFile* file = openTable(dbName, tableName);
+    if (!file) {
+        return 0;
+    }
+    FileMetadata metadata;
+    try {
+        metadata.deserialize(*file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error deserializing file metadata: " << e.what() << std::endl;
+        return 0;
+    }
 
-    bool tupleFound = false;
-    for (uint16_t i = 0; i < page.getTupleCount(); ++i) {
-        std::string tupleData = page.getTupleData(i);
-        Tuple tuple;
-        if (tuple.deserialize(tupleData) && tuple.getAttributeValue("id") == id) {
-            tupleFound = true; // Tuple found, proceed to delete
-             std::cout << "Debug deleteTupleFromTable: Tuple with ID " << id << " found in the page.\n";
-            if (page.deleteTuple(i, tupleID, tablePath)) { // Call deleteTuple from Page class
-                // Update the tuple-to-page map and mark the tuple as deleted
-                fileMetadata.setTupleAsDeleted(tupleID);
-                std::cout << "Debug deleteTupleFromTable: Tuple marked as deleted in file metadata.\n";
-
-                // Write the modified page back to the file
-                file.seekp(pagePos); // Move the write pointer to the start of the page
-                page.serialize(file);
-                fileMetadata.serialize(file); // Re-serialize the metadata
-                std::cout << "Debug deleteTupleFromTable: Page and file metadata serialized back to file.\n";
-
-                file.close();
-                std::cout << "Successfully deleted tuple with ID: " << id << std::endl;
-                return true; // Tuple successfully deleted
-            }
+    std::vector<std::pair<int64_t, int64_t>> targets; // (page, id)
+    targets.reserve(ids.size());
+    for (int64_t id : ids) {
+        int64_t pageID = metadata.getIdIndex().find(id);
+        if (pageID >= 0) {
+            targets.push_back({pageID, id});
         }
     }
+    std::vector<int64_t> deleted = deleteRows(*file, metadata, targets, nullptr);
+    if (rowDeleted) {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            (*rowDeleted)[i] = std::binary_search(deleted.begin(), deleted.end(), ids[i]);
+        }
+    }
+    return deleted.size();
+}
 
-    file.close();
-    if (!tupleFound) {
-        std::cerr << "Failed to delete tuple with ID: " << id << ". It may not exist.\n";
+size_t Storage::deleteWhere(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi,
+                            const std::vector<std::string>& columns, const std::function<bool(const ProjectedRow&)>& predicate) {
+    // Recorded as the deleteBatch of the ids it deleted, so a replay needs no predicate
+    TraceSpan span(trace, TraceOp::DeleteBatch, dbName, tableName);
+    TableFile* file = openTable(dbName, tableName);
+    if (!file) {
+        return 0;
+    }
+    FileMetadata metadata;
+    try {
+        metadata.deserialize(*file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error deserializing file metadata: " << e.what() << std::endl;
+        return 0;
+    }
+    Projection projection(compiledSchema(tablePath, metadata), columns);
+    projection.setFetch([&](std::string_view pointer, std::string& value) {
+        return OverflowStore::fetch(*file, metadata, pointer, value);
+    });
+
+    // Collect the whole range before changing anything, so no leaf is written under the cursor
+    std::vector<std::pair<int64_t, int64_t>> targets; // (page, id)
+    for (IdIndex::Iterator cursor = metadata.getIdIndex().lowerBound(lo); cursor.valid() && cursor.key() <= hi; cursor.next()) {
+        targets.push_back({cursor.value(), cursor.key()});
     }
-    return false; // Tuple with the given ID was not found
+    ProjectedRow row;
+    std::vector<int64_t> deleted = deleteRows(*file, metadata, targets, [&](const std::string& tupleData) {
+        return projection.decode(tupleData, row) && predicate(row);
+    });
+    if (span.recording()) {
+        span.setKeys(0, static_cast<int64_t>(deleted.size()));
+        span.setExtra(std::string(reinterpret_cast<const char*>(deleted.data()), deleted.size() * sizeof(int64_t)));
+    }
+    return deleted.size();
 }
+
 bool Storage::updateTupleInTable(const std::string& dbName, const std::string& tableName, const std::string& id, const Tuple& updatedTuple) {
+    TraceSpan span(trace, TraceOp::Update, dbName, tableName);
+    span.addTuple(updatedTuple);
+    span.setId(id);
     tablePath = dbName + "/" + tableName + ".HAD";
     std::cout << "Debug: Attempting to update tuple in table file: " << tablePath << std::endl;
 
     // Check if the table exists
-    if (!fs::exists(tablePath)) {
+    if (!catalog.hasTable(dbName, tableName)) {
         std::cerr << "Table does not exist: " << tablePath << std::endl;
         return false;
     }
@@ -554,3 +1122,249 @@ bool Storage::updateTupleInTable(const std::string& dbName, const std::string& t
     return true; // Tuple successfully updated
 }
 
+void Storage::setExecutorThreads(unsigned threads) {
+    executorThreads = threads;
+}
+
+StorageExecutor& Storage::getExecutor() {
+    if (!executor) {
+        executor = std::make_unique<StorageExecutor>(*this, executorThreads);
+    }
+    return *executor;
+}
+
+std::future<std::map<std::string, std::string>> Storage::submitGet(const std::string& dbName, const std::string& tableName, const std::string& id) {
+    return getExecutor().get(dbName, tableName, id);
+}
+
+std::future<bool> Storage::submitInsert(const std::string& dbName, const std::string& tableName, const Tuple& tuple) {
+    return getExecutor().insert(dbName, tableName, tuple);
+}
+
+std::future<bool> Storage::submitDelete(const std::string& dbName, const std::string& tableName, const std::string& id) {
+    return getExecutor().remove(dbName, tableName, id);
+}
+
+std::future<bool> Storage::submitUpdate(const std::string& dbName, const std::string& tableName, const std::string& id, const Tuple& updatedTuple) {
+    return getExecutor().update(dbName, tableName, id, updatedTuple);
+}
+
+bool Storage::startTrace(const std::string& path) {
+    return trace.open(path);
+}
+
+void Storage::stopTrace() {
+    trace.close();
+}
+
+TraceStats Storage::getTraceStats() const {
+    return trace.getStats();
+}
+
+void Storage::setRowCacheBytes(size_t bytes) {
+    rowCache.setCapacity(bytes);
+}
+
+RowCacheStats Storage::getRowCacheStats() const {
+    return rowCache.getStats();
+}
+
+IdFilterStats Storage::getFilterStats() const {
+    return IdFilter::getStats();
+}
+
+void Storage::setMemoryBudget(size_t bytes) {
+    MemoryGovernor::getInstance().setBudget(bytes);
+}
+
+MemoryStats Storage::getMemoryStats() const {
+    return MemoryGovernor::getInstance().getStats();
+}
+
+std::shared_ptr<const QueryPlan> Storage::prepare(const std::string& dbName, const std::string& text) {
+    if (std::shared_ptr<const QueryPlan> cached = plans.find(dbName, text)) {
+        return cached;
+    }
+    std::string error;
+    std::shared_ptr<QueryPlan> plan = QueryPlan::parse(dbName, text, error);
+    if (plan) {
+        const std::map<std::string, std::string>* schema = catalog.getSchema(dbName, plan->getTable());
+        if (!plan->bind(schema ? *schema : std::map<std::string, std::string>(), error)) {
+            plan = nullptr;
+        }
+    }
+    if (!plan) {
+        std::cerr << "Error prepare: " << error << std::endl;
+        return nullptr;
+    }
+    plans.store(dbName, text, plan);
+    return plan;
+}
+
+QueryResult Storage::execute(const QueryPlan& plan, const std::vector<std::string>& params) {
+    return plan.execute(*this, params);
+}
+
+QueryResult Storage::query(const std::string& dbName, const std::string& text, const std::vector<std::string>& params) {
+    std::shared_ptr<const QueryPlan> plan = prepare(dbName, text);
+    if (!plan) {
+        QueryResult result;
+        result.error = "the statement does not parse or bind";
+        return result;
+    }
+    return execute(*plan, params);
+}
+
+PlanCacheStats Storage::getPlanCacheStats() const {
+    return plans.getStats();
+}
+
+OverflowStats Storage::getOverflowStats() const {
+    return OverflowStore::getStats();
+}
+
+ExecutorStats Storage::getExecutorStats() const {
+    return executor ? executor->getStats() : ExecutorStats();
+}
+
+bool Storage::enableLogging(const std::string& dbName, const std::string& tableName, const WalOptions& options) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    if (logs.count(tablePath)) {
+        return true;
+    }
+    // The segment and page sizes never change after creation, and the fixed header fields are
+    // all the log needs before it has repaired the rest of the table
+    uint64_t segmentPages;
+    uint32_t pageSize;
+    if (!FileMetadata::readLayout(tablePath, segmentPages, pageSize)) {
+        std::cerr << "Table does not exist or is not in the current format: " << tablePath << std::endl;
+        return false;
+    }
+    auto log = std::make_unique<WriteAheadLog>(tablePath, segmentPages, pageSize, options);
+    if (!log->isOpen()) {
+        return false;
+    }
+    logs[tablePath] = std::move(log);
+    return true;
+}
+
+bool Storage::disableLogging(const std::string& dbName, const std::string& tableName) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    return logs.erase(tablePath) > 0;
+}
+
+bool Storage::checkpoint(const std::string& dbName, const std::string& tableName) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    auto it = logs.find(tablePath);
+    if (it == logs.end()) {
+        std::cerr << "Error checkpoint: Table is not logged: " << tablePath << std::endl;
+        return false;
+    }
+    return it->second->checkpoint();
+}
+
+bool Storage::migrateTable(const std::string& dbName, const std::string& tableName) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    if (!catalog.hasTable(dbName, tableName)) {
+        std::cerr << "Table does not exist: " << tablePath << std::endl;
+        return false;
+    }
+    catalog.close(tablePath); // The migration replaces the files under any open handle
+    rowCache.invalidateTable(tablePath);
+    if (executor) executor->forgetTable(tablePath);
+    TableMigration migration(tablePath);
+    if (!migration.run()) {
+        std::cerr << "Failed to migrate table: " << tableName << std::endl;
+        return false;
+    }
+    ChangeTracker::discard(tablePath); // Every page moved, so the next backup is a full one
+    const MigrationStats& stats = migration.getStats();
+    std::cout << "Migrated " << stats.rowsMigrated << " rows from " << stats.pagesRead << " pages into "
+              << stats.pagesWritten << " pages of table: " << tableName << std::endl;
+    return true;
+}
+
+bool Storage::compactTable(const std::string& dbName, const std::string& tableName, CompactionStats* stats) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    if (!catalog.hasTable(dbName, tableName)) {
+        std::cerr << "Table does not exist: " << tablePath << std::endl;
+        return false;
+    }
+    if (logs.count(tablePath)) {
+        std::cerr << "Error compactTable: Disable logging on " << tablePath << " before compacting it.\n";
+        return false;
+    }
+    catalog.close(tablePath); // The compaction replaces the files under any open handle
+    rowCache.invalidateTable(tablePath);
+    if (executor) executor->forgetTable(tablePath);
+    TableCompaction compaction(tablePath);
+    if (!compaction.run()) {
+        std::cerr << "Failed to compact table: " << tableName << std::endl;
+        return false;
+    }
+    ChangeTracker::discard(tablePath); // Every page moved, so the next backup is a full one
+    if (stats) *stats = compaction.getStats();
+    return true;
+}
+
+bool Storage::bulkLoad(const std::string& dbName, const std::string& tableName, const std::string& csvPath, const BulkLoadOptions& options) {
+    TraceSpan span(trace, TraceOp::BulkLoad, dbName, tableName);
+    catalog.close(dbName + "/" + tableName + ".HAD"); // The loader writes through its own handle
+    rowCache.invalidateTable(dbName + "/" + tableName + ".HAD");
+    BulkLoader loader(dbName, tableName, options);
+    if (!loader.loadCSV(csvPath)) {
+        std::cerr << "Failed to bulk load " << csvPath << " into table: " << tableName << std::endl;
+        return false;
+    }
+    const BulkLoadStats& stats = loader.getStats();
+    std::cout << "Bulk loaded " << stats.rowsLoaded << " rows into " << stats.pagesWritten
+              << " pages of table: " << tableName << " (" << stats.runsSpilled << " sorted runs spilled)" << std::endl;
+    return true;
+}
+
+std::future<BackupStats> Storage::backupTable(const std::string& dbName, const std::string& tableName, const std::string& backupPath,
+                                              const BackupOptions& options) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    auto backup = std::make_shared<TableBackup>(tablePath, backupPath, options);
+    bool started = false;
+    if (TableFile* file = openTable(dbName, tableName)) {
+        FileMetadata* fileMetadata = FileMetadata::getInstance();
+        try {
+            fileMetadata->deserialize(*file);
+            started = backup->begin(*file, *fileMetadata);
+        } catch (const std::exception& e) {
+            std::cerr << "Error deserializing file metadata: " << e.what() << std::endl;
+        }
+    } else {
+        std::cerr << "Table does not exist: " << tablePath << std::endl;
+    }
+    if (!started) {
+        std::promise<BackupStats> failed;
+        failed.set_value(backup->getStats());
+        return failed.get_future();
+    }
+    return std::async(std::launch::async, [backup]() {
+        backup->copyPages();
+        return backup->getStats();
+    });
+}
+
+bool Storage::restoreTable(const std::string& dbName, const std::string& tableName, const std::vector<std::string>& backupPaths) {
+    tablePath = dbName + "/" + tableName + ".HAD";
+    if (logs.count(tablePath)) {
+        std::cerr << "Error restoreTable: Disable logging on " << tablePath << " before restoring it.\n";
+        return false;
+    }
+    schemaCatalog.erase(tablePath);
+    plans.invalidateTable(tablePath);
+    rowCache.invalidateTable(tablePath);
+    catalog.forget(tablePath); // The restore replaces the files under any open handle
+    if (executor) executor->forgetTable(tablePath);
+    if (!TableBackup::restore(tablePath, backupPaths)) {
+        std::cerr << "Failed to restore table: " << tableName << std::endl;
+        return false;
+    }
+    catalog.addTable(dbName, tableName);
+    std::cout << "Restored table " << tableName << " from " << backupPaths.size() << " backups" << std::endl;
+    return true;
+}
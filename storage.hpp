@@ -7,35 +7,167 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <future>
 #include "page.hpp"
 #include "FileMetaData.hpp"
 #include "tuple.hpp"
+#include "bulkload.hpp"
+#include "tupleiterator.hpp"
+#include "tablefile.hpp"
+#include "schema.hpp"
+#include "projection.hpp"
+#include "aggregate.hpp"
+#include "join.hpp"
+#include "sort.hpp"
+#include "wal.hpp"
+#include "catalog.hpp"
+#include "executor.hpp"
+#include "rowcache.hpp"
+#include "trace.hpp"
+#include "overflow.hpp"
+#include "memory.hpp"
+#include "backup.hpp"
+#include "query.hpp"
+#include "migrate.hpp"
 
 namespace fs = std::filesystem;
 
+// Creation-time options stored in the table header
+struct TableOptions {
+    bool clustered = false;     // Place rows in id order (see addTupleToTable)
+    uint64_t segmentSize = 0;   // Bytes per segment file, 0 keeps the table in one file
+    uint64_t extentSize = 0;    // Bytes the files grow by at a time, preallocated; 0 grows them page by page
+    uint32_t pageSize = PAGE_SIZE; // Bytes per page: larger pages suit scans, 4 KB suits point lookups
+};
+
 class Storage {
 
 private:
     std::vector<Page> pages;
     uint32_t nextPageID = 1; // Unique page ID counter
 
-    std::map<std::string, std::map<std::string, std::map<std::string, Tuple>>> databases;
+    std::map<std::string, CompiledSchema> schemaCatalog; // Table path -> compiled schema
+    std::string insertBuffer;                            // Reused serialization buffer for inserts
+    std::map<std::string, std::unique_ptr<WriteAheadLog>> logs; // Table path -> redo log of a logged table
+    Catalog catalog;                                     // Tables seen so far and their open handles; closed before the logs
+    RowCache rowCache;                                   // Decoded rows for get; off until given a capacity
+    TraceRecorder trace;                                 // Public calls, while a trace is being recorded
+    PlanCache plans;                                     // Prepared statements by text
+    unsigned executorThreads = 0;
+    std::unique_ptr<StorageExecutor> executor;           // Started by the first submit; last, so it finishes first
+
+    friend class StorageExecutor;
+    template <typename... Columns> friend class TypedTable; // Shares the catalog's handles and the row cache
+    TableFile* openTable(const std::string& dbName, const std::string& tableName);
+    static bool parseRowId(const std::string& id, int64_t& value);
+    static std::map<std::string, std::string> readRow(TableFile& file, const FileMetadata& metadata, const std::string& id);
+    StorageExecutor& getExecutor();
+    int64_t clusteredTargetPage(FileMetadata* fileMetadata, int64_t id);
+    bool appendTuple(TableFile& file, FileMetadata* fileMetadata, const std::string& tupleSerialized, int64_t id);
+    // appendTuple once long values are spilled; false leaves the row out
+    bool placeTuple(TableFile& file, FileMetadata* fileMetadata, const std::string& tupleSerialized, int64_t id);
+    const CompiledSchema& compiledSchema(const std::string& tablePath, const FileMetadata& fileMetadata);
+    bool splitPageForTuple(TableFile& file, FileMetadata* fileMetadata, const Page& page, const std::string& tupleSerialized, int64_t id);
+    std::vector<int64_t> deleteRows(TableFile& file, FileMetadata& metadata, std::vector<std::pair<int64_t, int64_t>>& targets,
+                                    const std::function<bool(const std::string&)>& match);
 
 public:
     static std::string tablePath;
     bool createDatabase(const std::string& dbName);
     bool tableExists(const std::string& dbName, const std::string& tableName);
-    bool createTable(const std::string& dbName, const std::string& tableName, const std::map<std::string, std::string>& schema);
+    size_t loadCatalog(const std::string& dbName);
+    std::vector<std::string> listTables(const std::string& dbName);
+    // Column name -> type, empty if the table does not exist
+    std::map<std::string, std::string> getTableSchema(const std::string& dbName, const std::string& tableName);
+    void setOpenFileBudget(size_t files);
+    CatalogStats getCatalogStats() const;
+    bool createTable(const std::string& dbName, const std::string& tableName, const std::map<std::string, std::string>& schema, const TableOptions& options = TableOptions());
     bool deleteTable(const std::string& tablePath);
-    Page loadPageByID(const std::string& tablePath, uint32_t pageID);
+    Page loadPageByID(const std::string& tablePath, uint64_t pageID);
     std::vector<Tuple> getTuplesFromPage(const Page& page);
-    std::string loadTuple(const std::string& tablePath, uint16_t tupleID);
+    std::string loadTuple(const std::string& tablePath, int64_t tupleID);
     std::map<std::string, std::string> get(const std::string& dbName, const std::string& tableName, const std::string& id);
-    bool addTupleToTable(const std::string& dbName, const std::string& tableName, const std::string& tupleSerialized, int id);
+    ProjectedRow get(const std::string& dbName, const std::string& tableName, const std::string& id, const std::vector<std::string>& columns);
+    uint64_t scan(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi,
+                  const std::vector<std::string>& columns, const std::function<bool(const ProjectedRow&)>& visit);
+    std::vector<AggregateRow> aggregate(const std::string& dbName, const std::string& tableName, const std::vector<AggregateSpec>& specs,
+                                        const std::string& groupBy = "", unsigned threads = 0);
+    // Rows emitted; stats, if given, gets the build, probe and spill counts of the join
+    uint64_t join(const std::string& dbName, const std::string& leftTable, const std::string& leftColumn,
+                  const std::string& rightTable, const std::string& rightColumn, const HashJoin::Emit& emit,
+                  const JoinOptions& options = JoinOptions(), JoinStats* stats = nullptr);
+    // Rows emitted; stats, if given, gets the row, run and merge pass counts of the sort
+    uint64_t orderBy(const std::string& dbName, const std::string& tableName, const std::string& column,
+                     const ExternalSort::Emit& emit, const SortOptions& options = SortOptions(), SortStats* stats = nullptr);
+    TupleIterator getRange(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi);
+    // Places a row already serialized for the table; false if its id is taken
+    bool addTupleToTable(const std::string& dbName, const std::string& tableName, const std::string& tupleSerialized, int64_t id);
     bool checkTupleExists(const std::string& dbName, const std::string& tableName, const std::string& id);
     bool insert(const std::string& dbName, const std::string& tableName, const Tuple& tuple);
+    // Inserts the rows that fit the schema; rowInserted, if given, gets 1 for each row that went in
+    size_t insertBatch(const std::string& dbName, const std::string& tableName, const std::vector<Tuple>& tuples,
+                       std::vector<uint8_t>* rowInserted = nullptr);
     bool deleteTupleFromTable(const std::string& dbName, const std::string& tableName, const std::string& id);
+    // Deletes the rows with these ids, writing each page they are on and the header once; rowDeleted,
+    // if given, gets 1 for each id that was deleted. Slots are tombstoned and their space is only
+    // reclaimed when the table is rewritten (compactTable); overflow chains are reused right away.
+    size_t deleteBatch(const std::string& dbName, const std::string& tableName, const std::vector<int64_t>& ids,
+                       std::vector<uint8_t>* rowDeleted = nullptr);
+    // Deletes the rows with ids in [lo, hi] for which predicate, given the listed columns, returns true
+    size_t deleteWhere(const std::string& dbName, const std::string& tableName, int64_t lo, int64_t hi,
+                       const std::vector<std::string>& columns, const std::function<bool(const ProjectedRow&)>& predicate);
     bool updateTupleInTable(const std::string& dbName, const std::string& tableName, const std::string& id, const Tuple& updatedTuple);
+
+    // Asynchronous variants, run on a work-stealing thread pool owned by this Storage (see
+    // StorageExecutor for what runs in parallel and what is ordered)
+    void setExecutorThreads(unsigned threads); // Before the first submit; 0 = one per core
+    std::future<std::map<std::string, std::string>> submitGet(const std::string& dbName, const std::string& tableName, const std::string& id);
+    std::future<bool> submitInsert(const std::string& dbName, const std::string& tableName, const Tuple& tuple);
+    std::future<bool> submitDelete(const std::string& dbName, const std::string& tableName, const std::string& id);
+    std::future<bool> submitUpdate(const std::string& dbName, const std::string& tableName, const std::string& id, const Tuple& updatedTuple);
+    ExecutorStats getExecutorStats() const;
+    // Caches up to bytes of decoded rows for get and submitGet; 0 (the default) turns it off.
+    // Only writes made through this Storage invalidate it.
+    void setRowCacheBytes(size_t bytes);
+    RowCacheStats getRowCacheStats() const;
+    // Records every public call to a binary trace until stopTrace; see the replay tool
+    bool startTrace(const std::string& path);
+    void stopTrace();
+    TraceStats getTraceStats() const;
+    // Id filters of all tables in the process, with their observed false positive rate
+    IdFilterStats getFilterStats() const;
+    // Long values kept in overflow pages, across all tables in the process
+    OverflowStats getOverflowStats() const;
+    // Process-wide memory budget; past it the row caches of every Storage are shrunk. 0 = none
+    void setMemoryBudget(size_t bytes);
+    // Engine memory in the process by component, as reported through the memory governor
+    MemoryStats getMemoryStats() const;
+
+    // Parses a statement of the query language (see QueryPlan) and binds it to its table in
+    // dbName, or returns the plan cached for the same text; null if it does not parse or bind.
+    // Executing a plan only converts its parameters and calls the methods above.
+    std::shared_ptr<const QueryPlan> prepare(const std::string& dbName, const std::string& text);
+    QueryResult execute(const QueryPlan& plan, const std::vector<std::string>& params = {});
+    QueryResult query(const std::string& dbName, const std::string& text, const std::vector<std::string>& params = {});
+    PlanCacheStats getPlanCacheStats() const;
+
+    bool enableLogging(const std::string& dbName, const std::string& tableName, const WalOptions& options = WalOptions());
+    bool disableLogging(const std::string& dbName, const std::string& tableName);
+    bool checkpoint(const std::string& dbName, const std::string& tableName);
+    bool migrateTable(const std::string& dbName, const std::string& tableName);
+    // Rewrites the table without the space of its deleted rows (see TableCompaction); not for logged tables
+    bool compactTable(const std::string& dbName, const std::string& tableName, CompactionStats* stats = nullptr);
+    bool bulkLoad(const std::string& dbName, const std::string& tableName, const std::string& csvPath, const BulkLoadOptions& options = BulkLoadOptions());
+    // Backs the table up to backupPath without taking it offline. The cut is taken before this
+    // returns; the pages are copied on a background thread while this Storage keeps writing.
+    // An incremental backup copies only the pages written since the table's previous backup.
+    std::future<BackupStats> backupTable(const std::string& dbName, const std::string& tableName, const std::string& backupPath,
+                                         const BackupOptions& options = BackupOptions());
+    // Replaces the table with the state of the last of backupPaths: a full backup followed by
+    // the incremental ones taken after it, in order
+    bool restoreTable(const std::string& dbName, const std::string& tableName, const std::vector<std::string>& backupPaths);
 };
 
 #endif // STORAGE_HPP
@@ -0,0 +1,52 @@
+#include "server.hpp"
+#include <csignal>
+
+// Storage daemon: serves the databases under the working directory to local clients.
+// Usage: storaged <socket> [--workers N] [--max-batch N] [--quiet]
+static void printUsage() {
+    std::cerr << "Usage: storaged <socket> [--workers N] [--max-batch N] [--quiet]\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    ServerOptions options;
+    options.socketPath = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--workers" && hasValue) {
+            options.workers = std::stoul(argv[++i]);
+        } else if (arg == "--max-batch" && hasValue) {
+            options.maxInsertBatch = std::stoull(argv[++i]);
+        } else if (arg == "--quiet") {
+            std::cout.setstate(std::ios::failbit); // The engine's debug output
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    // Block the shutdown signals before any thread starts, then wait for them here
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    StorageServer server(options);
+    if (!server.start()) {
+        return 1;
+    }
+    std::cerr << "storaged: listening on " << options.socketPath << " with " << options.workers << " workers\n";
+    int received = 0;
+    sigwait(&signals, &received);
+
+    server.stop();
+    ServerStats stats = server.getStats();
+    std::cerr << "storaged: served " << stats.requests << " requests on " << stats.connections << " connections, "
+              << stats.batchedInserts << " inserts in " << stats.insertBatches << " batches\n";
+    return 0;
+}
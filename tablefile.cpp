@@ -0,0 +1,287 @@
+#include "tablefile.hpp"
+#include "wal.hpp"
+#include "backup.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <sys/uio.h>
+
+// Positional vectored I/O of a whole request: retries on a short transfer or an interrupt
+static bool transferFully(int fd, struct iovec* pieces, int count, off_t offset, bool writing) {
+    while (count > 0) {
+        int batch = std::min(count, IOV_MAX);
+        ssize_t done = writing ? ::pwritev(fd, pieces, batch, offset) : ::preadv(fd, pieces, batch, offset);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return false;
+        offset += done;
+        while (count > 0 && static_cast<size_t>(done) >= pieces->iov_len) {
+            done -= pieces->iov_len;
+            ++pieces;
+            --count;
+        }
+        if (count > 0) {
+            pieces->iov_base = static_cast<char*>(pieces->iov_base) + done;
+            pieces->iov_len -= done;
+        }
+    }
+    return true;
+}
+
+TableFile::TableFile(const std::string& tablePath, bool writable) {
+    open(tablePath, writable);
+}
+
+TableFile::~TableFile() {
+    close();
+}
+
+std::string TableFile::segmentPath(const std::string& tablePath, uint64_t segment) {
+    return tablePath + "." + std::to_string(segment);
+}
+
+bool TableFile::open(const std::string& tablePath, bool canWrite) {
+    close();
+    path = tablePath;
+    writable = canWrite;
+    std::ios::openmode mode = std::ios::binary | std::ios::in;
+    if (writable) {
+        mode |= std::ios::out;
+    }
+    main.open(path, mode);
+    if (main.is_open()) {
+        mainFd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (mainFd < 0) {
+            main.close();
+        }
+    }
+    return main.is_open();
+}
+
+bool TableFile::isOpen() const {
+    return main.is_open();
+}
+
+size_t TableFile::openFiles() const {
+    return (main.is_open() ? 1 : 0) + segments.size() + (index && index->isOpen() ? 1 : 0);
+}
+
+const std::string& TableFile::getPath() const {
+    return path;
+}
+
+// Page writes reach the file as they are made; only the header block is buffered
+void TableFile::flush() {
+    main.flush();
+}
+
+void TableFile::close() {
+    if (main.is_open()) {
+        main.close();
+    }
+    if (mainFd >= 0) {
+        ::close(mainFd);
+        mainFd = -1;
+    }
+    for (auto& [segment, fd] : segments) {
+        ::close(fd);
+    }
+    segments.clear();
+    index.reset(); // A FileMetadata still holding it keeps it open until it deserializes another table
+}
+
+std::fstream& TableFile::headerStream() {
+    main.clear();
+    return main;
+}
+
+std::shared_ptr<IdIndex> TableFile::getIdIndex() {
+    if (index && index->isOpen() && index->refresh()) {
+        return index;
+    }
+    index = std::make_shared<IdIndex>();
+    if (!index->open(IdIndex::pathForTable(path))) {
+        index.reset();
+    }
+    return index;
+}
+
+int TableFile::fdForPage(const FileMetadata& metadata, uint64_t pageID, off_t& offset) {
+    uint64_t segmentPages = metadata.getSegmentPages();
+    uint64_t segment = segmentPages == 0 ? 0 : pageID / segmentPages;
+    uint64_t localPage = segmentPages == 0 ? pageID : pageID % segmentPages;
+
+    if (segment == 0) {
+        offset = FileMetadata::METADATA_SIZE + static_cast<off_t>(localPage) * metadata.getPageSize();
+        return mainFd;
+    }
+
+    offset = static_cast<off_t>(localPage) * metadata.getPageSize();
+    auto it = segments.find(segment);
+    if (it == segments.end()) {
+        std::string segmentFile = segmentPath(path, segment);
+        int fd = ::open(segmentFile.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Error TableFile: Unable to open segment file: " + segmentFile);
+        }
+        it = segments.emplace(segment, fd).first;
+    }
+    return it->second;
+}
+
+void TableFile::reserveExtent(FileMetadata& metadata) {
+    uint64_t extentPages = metadata.getExtentPages();
+    uint64_t allocated = metadata.getAllocatedPages();
+    uint64_t needed = metadata.getPageCount();
+    if (extentPages == 0 || needed <= allocated) {
+        return;
+    }
+
+    // One fallocate per segment the new extents touch; the file size moves once per extent
+    // instead of once per page, and the blocks are reserved together
+    uint64_t end = (needed + extentPages - 1) / extentPages * extentPages;
+    uint64_t segmentPages = metadata.getSegmentPages();
+    const off_t pageSize = metadata.getPageSize();
+    flush();
+    for (uint64_t pageID = allocated; pageID < end;) {
+        uint64_t segment = segmentPages == 0 ? 0 : pageID / segmentPages;
+        uint64_t localPage = segmentPages == 0 ? pageID : pageID % segmentPages;
+        uint64_t pieceEnd = segmentPages == 0 ? end : std::min(end, (segment + 1) * segmentPages);
+        std::string file = segment == 0 ? path : segmentPath(path, segment);
+        off_t offset = (segment == 0 ? FileMetadata::METADATA_SIZE : 0) + static_cast<off_t>(localPage) * pageSize;
+        off_t length = static_cast<off_t>(pieceEnd - pageID) * pageSize;
+
+        int fd = ::open(file.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Error TableFile: Unable to open " + file + " to preallocate");
+        }
+        int error = ::posix_fallocate(fd, offset, length);
+        ::close(fd);
+        if (error != 0) {
+            throw std::runtime_error("Error TableFile: Unable to preallocate " + std::to_string(length) + " bytes in " +
+                                     file + ": " + std::strerror(error));
+        }
+        pageID = pieceEnd;
+    }
+    metadata.setAllocatedPages(end);
+}
+
+void TableFile::readPage(const FileMetadata& metadata, uint64_t pageID, Page& page) {
+    if (pageID >= metadata.getPageCount()) {
+        throw std::out_of_range("Invalid pageID: " + std::to_string(pageID) + " (pageCount: " +
+                                std::to_string(metadata.getPageCount()) + ")");
+    }
+    if (page.getPageSize() != metadata.getPageSize()) {
+        page = Page(pageID, metadata.getPageSize()); // Sized once per page object, when the table's size differs
+    }
+    // Straight into the page's own buffer
+    off_t offset;
+    int fd = fdForPage(metadata, pageID, offset);
+    struct iovec piece = {page.data.data(), page.data.size()};
+    if (!transferFully(fd, &piece, 1, offset, false)) {
+        throw std::runtime_error("Error TableFile: Failed to read page " + std::to_string(pageID));
+    }
+    page.parseImage();
+}
+
+void TableFile::writePage(const FileMetadata& metadata, const Page& page) {
+    writePageRun(metadata, &page, 1);
+}
+
+void TableFile::writePages(const FileMetadata& metadata, const std::vector<Page>& pages) {
+    uint64_t segmentPages = metadata.getSegmentPages();
+    for (size_t start = 0; start < pages.size();) {
+        // A run ends at a gap in the page IDs, at the end of a segment, or at WRITE_RUN_PAGES
+        size_t end = start + 1;
+        while (end < pages.size() && end - start < WRITE_RUN_PAGES &&
+               pages[end].getPageID() == pages[end - 1].getPageID() + 1 &&
+               (segmentPages == 0 || pages[end].getPageID() % segmentPages != 0)) {
+            ++end;
+        }
+        writePageRun(metadata, pages.data() + start, end - start);
+        start = end;
+    }
+}
+
+// Adjacent pages within one segment
+void TableFile::writePageRun(const FileMetadata& metadata, const Page* pages, size_t count) {
+    const size_t pageSize = metadata.getPageSize();
+    for (size_t i = 0; i < count; ++i) {
+        if (pages[i].getPageSize() != pageSize) {
+            throw std::runtime_error("Error TableFile: Page " + std::to_string(pages[i].getPageID()) + " has " +
+                                     std::to_string(pages[i].getPageSize()) + " bytes but the table's pages have " +
+                                     std::to_string(pageSize));
+        }
+    }
+    uint64_t firstPageID = pages[0].getPageID();
+    if (WriteAheadLog::find(path)) {
+        // The log takes whole images
+        std::vector<char> images(count * pageSize);
+        for (size_t i = 0; i < count; ++i) {
+            pages[i].toImage(images.data() + i * pageSize);
+        }
+        writePageImages(metadata, firstPageID, images.data(), count);
+        return;
+    }
+    if (std::shared_ptr<ChangeTracker> tracker = ChangeTracker::find(path)) {
+        tracker->beforeWrite(*this, metadata, firstPageID, count);
+    }
+    std::vector<struct iovec> pieces(count * Page::IMAGE_PIECES);
+    std::vector<uint32_t> directorySizes(count);
+    for (size_t i = 0; i < count; ++i) {
+        pages[i].imagePieces(pieces.data() + i * Page::IMAGE_PIECES, directorySizes[i]);
+    }
+    off_t offset;
+    int fd = fdForPage(metadata, firstPageID, offset);
+    if (!transferFully(fd, pieces.data(), static_cast<int>(pieces.size()), offset, true)) {
+        throw std::runtime_error("Error TableFile: Failed to write pages starting at " + std::to_string(firstPageID) +
+                                 ": " + std::strerror(errno));
+    }
+}
+
+void TableFile::readPageImage(const FileMetadata& metadata, uint64_t pageID, char* image) {
+    off_t offset;
+    int fd = fdForPage(metadata, pageID, offset);
+    struct iovec piece = {image, metadata.getPageSize()};
+    if (!transferFully(fd, &piece, 1, offset, false)) {
+        throw std::runtime_error("Error TableFile: Failed to read page " + std::to_string(pageID));
+    }
+}
+
+void TableFile::writePageImages(const FileMetadata& metadata, uint64_t firstPageID, const char* images, size_t count) {
+    uint64_t segmentPages = metadata.getSegmentPages();
+    const size_t pageSize = metadata.getPageSize();
+    WriteAheadLog* log = WriteAheadLog::find(path);
+    if (std::shared_ptr<ChangeTracker> tracker = ChangeTracker::find(path)) {
+        tracker->beforeWrite(*this, metadata, firstPageID, count);
+    }
+    size_t written = 0;
+    while (written < count) {
+        uint64_t pageID = firstPageID + written;
+        // Never let one write run past the end of a segment
+        size_t run = count - written;
+        if (segmentPages != 0) {
+            run = std::min<uint64_t>(run, segmentPages - pageID % segmentPages);
+        }
+        if (log) {
+            run = std::min(run, LOGGED_RUN_BYTES / pageSize);
+        }
+        off_t offset;
+        int fd = fdForPage(metadata, pageID, offset);
+        auto writeRun = [&]() {
+            struct iovec piece = {const_cast<char*>(images + written * pageSize), run * pageSize};
+            if (!transferFully(fd, &piece, 1, offset, true)) {
+                throw std::runtime_error("Error TableFile: Failed to write pages starting at " + std::to_string(pageID));
+            }
+        };
+        if (log) {
+            log->write(WriteAheadLog::PAGE_IMAGES, pageID, images + written * pageSize, run * pageSize, writeRun);
+        } else {
+            writeRun();
+        }
+        written += run;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef TABLEFILE_HPP
+#define TABLEFILE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <sys/types.h>
+#include "page.hpp"
+#include "FileMetaData.hpp"
+
+// Open handle on a table's files.
+// The main <table>.HAD file holds the header followed by segment 0. When the header sets
+// a segment size, page N lives in segment N / segmentPages: segment 0 stays in the main
+// file, later segments are <table>.HAD.1, <table>.HAD.2, ... holding only pages.
+// The header block goes through a stream; pages are read and written with positional
+// calls on file descriptors held for as long as the handle is open, one call per page or
+// per run of adjacent pages.
+class TableFile {
+public:
+    static const size_t WRITE_RUN_PAGES = 64; // Most pages writePages sends in one call
+
+    TableFile() = default;
+    explicit TableFile(const std::string& tablePath, bool writable = true);
+    ~TableFile();
+    TableFile(const TableFile&) = delete;
+    TableFile& operator=(const TableFile&) = delete;
+
+    static std::string segmentPath(const std::string& tablePath, uint64_t segment);
+
+    bool open(const std::string& tablePath, bool writable = true);
+    bool isOpen() const;
+    size_t openFiles() const; // Main file plus the segment files opened so far
+    const std::string& getPath() const;
+    void flush();
+    void close();
+
+    std::fstream& headerStream(); // Main file, for the first header block
+
+    // The table's id index, opened on first use and kept for as long as the handle. Later
+    // calls only re-read its header, which writes through another handle may have moved on.
+    // Null if it cannot be opened.
+    std::shared_ptr<IdIndex> getIdIndex();
+
+    // Makes sure the files have space for every page below the page count, growing them by
+    // whole preallocated extents when the table has an extent size
+    void reserveExtent(FileMetadata& metadata);
+
+    // Pages and images have the table's page size; readPage resizes a page that does not
+    void readPage(const FileMetadata& metadata, uint64_t pageID, Page& page);
+    void writePage(const FileMetadata& metadata, const Page& page);
+    // Writes pages in the order given; each run of adjacent page IDs goes out in one call
+    void writePages(const FileMetadata& metadata, const std::vector<Page>& pages);
+    void readPageImage(const FileMetadata& metadata, uint64_t pageID, char* image);
+    void writePageImages(const FileMetadata& metadata, uint64_t firstPageID, const char* images, size_t count);
+
+private:
+    static const size_t LOGGED_RUN_BYTES = 1024 * 1024; // Page images per log record when the table is logged
+
+    std::string path;
+    bool writable = true;
+    std::fstream main;                  // Header block
+    int mainFd = -1;                    // Pages of segment 0
+    std::map<uint64_t, int> segments;   // Segment -> descriptor, opened on first use
+    std::shared_ptr<IdIndex> index;     // Shared with the FileMetadata deserialized from this handle
+
+    int fdForPage(const FileMetadata& metadata, uint64_t pageID, off_t& offset);
+    void writePageRun(const FileMetadata& metadata, const Page* pages, size_t count);
+};
+
+#endif // TABLEFILE_HPP
@@ -0,0 +1,108 @@
+#include "threadpool.hpp"
+#include <algorithm>
+
+namespace {
+
+// Which pool, if any, the current thread works for
+thread_local const ThreadPool* workerPool = nullptr;
+thread_local int workerIndex = -1;
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+int ThreadPool::currentWorker() const {
+    return workerPool == this ? workerIndex : -1;
+}
+
+void ThreadPool::post(std::function<void()> task) {
+    int self = currentWorker();
+    unsigned target = self >= 0 ? static_cast<unsigned>(self) : nextQueue++ % queues.size();
+    {
+        // Counted first, so the count never drops below zero when a worker takes the task
+        // before the notify; taking the lock orders it against a worker about to sleep
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+// Own queue newest first, then the oldest task of the next queue that has one
+bool ThreadPool::take(unsigned self, std::function<void()>& task) {
+    {
+        WorkerQueue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        WorkerQueue& victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(unsigned self) {
+    workerPool = this;
+    workerIndex = static_cast<int>(self);
+    std::function<void()> task;
+    for (;;) {
+        if (take(self, task)) {
+            queued--;
+            task();
+            task = nullptr;
+            executed++;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+ThreadPoolStats ThreadPool::getStats() const {
+    ThreadPoolStats stats;
+    stats.executed = executed.load();
+    stats.stolen = stolen.load();
+    return stats;
+}
@@ -0,0 +1,72 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+struct ThreadPoolStats {
+    uint64_t executed = 0;
+    uint64_t stolen = 0;    // Tasks a worker took from another worker's queue
+};
+
+// Fixed set of worker threads with one task queue each.
+// A task submitted from a worker goes to that worker's own queue, others are spread over
+// the queues in turn. A worker runs its own newest task first, which keeps follow-up work
+// on a warm cache, and when its queue is empty steals the oldest task from another queue.
+// Idle workers sleep until something is submitted. Destroying the pool runs what is queued.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = 0); // 0 = one per core
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void post(std::function<void()> task);
+
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        std::future<Result> result = packaged->get_future();
+        post([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+    unsigned size() const;
+    // Index of the calling thread among this pool's workers, or -1 if it is not one of them
+    int currentWorker() const;
+
+    ThreadPoolStats getStats() const;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> nextQueue{0};
+    std::atomic<size_t> queued{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> stolen{0};
+
+    bool take(unsigned self, std::function<void()>& task);
+    void run(unsigned self);
+};
+
+#endif // THREADPOOL_HPP
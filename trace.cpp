@@ -0,0 +1,260 @@
+#include "trace.hpp"
+#include <charconv>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+const size_t FLUSH_BYTES = 64 * 1024;
+const uint32_t MAX_EXTRA_BYTES = 64 * 1024 * 1024; // Larger means the length itself is damaged
+
+// Spans open on this thread, so only the outermost call is recorded
+thread_local int openSpans = 0;
+
+} // namespace
+
+const char* traceOpName(TraceOp op) {
+    switch (op) {
+        case TraceOp::DefineTable: return "define";
+        case TraceOp::CreateTable: return "createTable";
+        case TraceOp::DeleteTable: return "deleteTable";
+        case TraceOp::Get: return "get";
+        case TraceOp::GetColumns: return "getColumns";
+        case TraceOp::Scan: return "scan";
+        case TraceOp::Exists: return "exists";
+        case TraceOp::Insert: return "insert";
+        case TraceOp::InsertBatch: return "insertBatch";
+        case TraceOp::Delete: return "delete";
+        case TraceOp::Update: return "update";
+        case TraceOp::Aggregate: return "aggregate";
+        case TraceOp::Join: return "join";
+        case TraceOp::OrderBy: return "orderBy";
+        case TraceOp::BulkLoad: return "bulkLoad";
+        case TraceOp::DeleteBatch: return "deleteBatch";
+    }
+    return "unknown";
+}
+
+TraceRecorder::~TraceRecorder() {
+    close();
+}
+
+bool TraceRecorder::open(const std::string& path) {
+    close();
+    std::lock_guard<std::mutex> lock(mutex);
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error TraceRecorder open: Unable to create trace file: " << path << std::endl;
+        return false;
+    }
+    start = std::chrono::steady_clock::now();
+    uint64_t wallClock = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, wallClock};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    tableRefs.clear();
+    buffer.clear();
+    stats = TraceStats();
+    stats.bytes = sizeof(header);
+    recording = true;
+    return true;
+}
+
+void TraceRecorder::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!recording) return;
+    recording = false;
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+    out.close();
+}
+
+uint64_t TraceRecorder::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TraceRecorder::append(const TraceRecord& record, const std::string& extra) {
+    buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    buffer.append(extra);
+    stats.bytes += sizeof(record) + extra.size();
+}
+
+void TraceRecorder::record(const TraceEvent& event) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!recording) return;
+
+    auto ref = tableRefs.find(event.table);
+    if (ref == tableRefs.end()) {
+        ref = tableRefs.emplace(event.table, static_cast<uint16_t>(tableRefs.size())).first;
+        TraceRecord define{};
+        define.op = static_cast<uint8_t>(TraceOp::DefineTable);
+        define.table = ref->second;
+        define.extraBytes = static_cast<uint32_t>(event.table.size());
+        append(define, event.table);
+    }
+
+    TraceRecord record{};
+    record.op = static_cast<uint8_t>(event.op);
+    record.flags = event.flags;
+    record.table = ref->second;
+    record.payloadBytes = event.payloadBytes;
+    record.extraBytes = static_cast<uint32_t>(event.extra.size());
+    record.key = event.key;
+    record.key2 = event.key2;
+    record.startNanos = event.startNanos;
+    record.durationNanos = event.durationNanos;
+    append(record, event.extra);
+    stats.records++;
+
+    if (buffer.size() >= FLUSH_BYTES) {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+TraceStats TraceRecorder::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+int64_t TraceRecorder::keyOf(const std::string& id, uint8_t& flags) {
+    int64_t key = 0;
+    const char* end = id.data() + id.size();
+    auto result = std::from_chars(id.data(), end, key);
+    if (result.ec != std::errc() || result.ptr != end) {
+        flags |= FLAG_BAD_KEY;
+        return 0;
+    }
+    return key;
+}
+
+uint32_t TraceRecorder::tupleBytes(const Tuple& tuple) {
+    size_t bytes = 0;
+    for (const auto& [name, typed] : tuple.getAttributeList()) {
+        bytes += name.size() + typed.second.size();
+    }
+    return static_cast<uint32_t>(bytes);
+}
+
+std::string TraceRecorder::joinColumns(const std::vector<std::string>& columns) {
+    std::string joined;
+    for (const std::string& column : columns) {
+        if (!joined.empty()) joined += ',';
+        joined += column;
+    }
+    return joined;
+}
+
+std::string TraceRecorder::schemaText(const std::map<std::string, std::string>& schema) {
+    std::string text;
+    for (const auto& [column, type] : schema) {
+        if (!text.empty()) text += ',';
+        text += column + ":" + type;
+    }
+    return text;
+}
+
+TraceSpan::TraceSpan(TraceRecorder& owner, TraceOp op, const std::string& dbName, const std::string& tableName)
+    : recorder(owner) {
+    if (!recorder.active()) {
+        return;
+    }
+    counted = true;
+    if (openSpans++ > 0) {
+        return;
+    }
+    outermost = true;
+    exceptions = std::uncaught_exceptions();
+    event.op = op;
+    event.table = dbName + "/" + tableName;
+    event.startNanos = recorder.now();
+}
+
+TraceSpan::~TraceSpan() {
+    if (counted) {
+        openSpans--;
+    }
+    if (!outermost) {
+        return;
+    }
+    event.durationNanos = recorder.now() - event.startNanos;
+    if (std::uncaught_exceptions() > exceptions) {
+        event.flags |= TraceRecorder::FLAG_THREW;
+    }
+    recorder.record(event);
+}
+
+void TraceSpan::setId(const std::string& id) {
+    if (outermost) {
+        event.key = TraceRecorder::keyOf(id, event.flags);
+    }
+}
+
+void TraceSpan::setKeys(int64_t key, int64_t key2) {
+    event.key = key;
+    event.key2 = key2;
+}
+
+void TraceSpan::addTuple(const Tuple& tuple) {
+    if (outermost) {
+        event.payloadBytes += TraceRecorder::tupleBytes(tuple);
+        event.key = TraceRecorder::keyOf(tuple.getAttributeValue("id"), event.flags);
+    }
+}
+
+void TraceSpan::setExtra(std::string extra) {
+    if (outermost) {
+        event.extra = std::move(extra);
+    }
+}
+
+bool TraceReader::open(const std::string& path) {
+    in.open(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error TraceReader open: Unable to open trace file: " << path << std::endl;
+        return false;
+    }
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || header.magic != TraceRecorder::TRACE_MAGIC || header.version != TraceRecorder::TRACE_VERSION) {
+        std::cerr << "Error TraceReader open: Not a trace file, or of another version: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::next(TraceEvent& event) {
+    for (;;) {
+        TraceRecorder::TraceRecord record;
+        if (!in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+            return false;
+        }
+        if (record.extraBytes > MAX_EXTRA_BYTES) {
+            std::cerr << "Error TraceReader next: Damaged record in the trace.\n";
+            return false;
+        }
+        std::string extra(record.extraBytes, '\0');
+        if (record.extraBytes > 0 && !in.read(&extra[0], record.extraBytes)) {
+            std::cerr << "Error TraceReader next: Truncated record at the end of the trace.\n";
+            return false;
+        }
+        if (record.op == static_cast<uint8_t>(TraceOp::DefineTable)) {
+            tables[record.table] = extra;
+            continue;
+        }
+        auto table = tables.find(record.table);
+        if (table == tables.end() || record.op > static_cast<uint8_t>(TraceOp::DeleteBatch)) {
+            std::cerr << "Error TraceReader next: Damaged record in the trace.\n";
+            return false;
+        }
+        event.op = static_cast<TraceOp>(record.op);
+        event.flags = record.flags;
+        event.table = table->second;
+        event.key = record.key;
+        event.key2 = record.key2;
+        event.payloadBytes = record.payloadBytes;
+        event.startNanos = record.startNanos;
+        event.durationNanos = record.durationNanos;
+        event.extra = std::move(extra);
+        return true;
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "tuple.hpp"
+
+// Public Storage calls a trace records
+enum class TraceOp : uint8_t {
+    DefineTable = 0,    // Not a call: names a table reference, the name follows the record
+    CreateTable = 1,    // Schema "col:type,..." follows
+    DeleteTable = 2,
+    Get = 3,
+    GetColumns = 4,     // Projected columns "col,..." follow
+    Scan = 5,           // key..key2, projected columns follow
+    Exists = 6,
+    Insert = 7,
+    InsertBatch = 8,    // key2 rows, their ids follow as int64s
+    Delete = 9,
+    Update = 10,
+    Aggregate = 11,
+    Join = 12,
+    OrderBy = 13,
+    BulkLoad = 14,
+    DeleteBatch = 15    // key2 rows, their ids follow as int64s
+};
+
+const char* traceOpName(TraceOp op);
+
+struct TraceEvent {
+    TraceOp op = TraceOp::Get;
+    uint8_t flags = 0;
+    std::string table;          // "db/table"
+    int64_t key = 0;
+    int64_t key2 = 0;
+    uint32_t payloadBytes = 0;  // Bytes of tuple data written
+    uint64_t startNanos = 0;    // Since the trace started
+    uint64_t durationNanos = 0;
+    std::string extra;
+};
+
+struct TraceStats {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+};
+
+// Binary trace of the public calls made on a Storage, for replaying real traffic against
+// later builds (see TraceReplayer). The file is a 16-byte header, then fixed 48-byte
+// records, each optionally followed by extraBytes of operation data. Tables are written
+// as 16-bit references defined by a DefineTable record on first use. Only sizes of the
+// written tuples are kept, never their values. Calls made by other calls (update's delete
+// and insert, say) are not recorded separately.
+class TraceRecorder {
+public:
+    static const uint32_t TRACE_MAGIC = 0x43525448; // "HTRC"
+    static const uint32_t TRACE_VERSION = 1;
+    static const uint8_t FLAG_THREW = 0x01;         // The call ended with an exception
+    static const uint8_t FLAG_BAD_KEY = 0x02;       // The key was not a valid integer
+
+    struct TraceHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t startUnixNanos;
+    };
+
+    struct TraceRecord {
+        uint8_t op;
+        uint8_t flags;
+        uint16_t table;
+        uint32_t payloadBytes;
+        uint32_t extraBytes;
+        uint32_t unused;
+        int64_t key;
+        int64_t key2;
+        uint64_t startNanos;
+        uint64_t durationNanos;
+    };
+
+    TraceRecorder() = default;
+    ~TraceRecorder();
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool active() const { return recording.load(std::memory_order_relaxed); }
+
+    uint64_t now() const; // Nanoseconds since the trace started
+    void record(const TraceEvent& event);
+    TraceStats getStats() const;
+
+    static int64_t keyOf(const std::string& id, uint8_t& flags);
+    static uint32_t tupleBytes(const Tuple& tuple);
+    static std::string joinColumns(const std::vector<std::string>& columns);
+    static std::string schemaText(const std::map<std::string, std::string>& schema);
+
+private:
+    mutable std::mutex mutex;
+    std::ofstream out;
+    std::string buffer;                         // Written out in large pieces
+    std::map<std::string, uint16_t> tableRefs;
+    std::chrono::steady_clock::time_point start;
+    std::atomic<bool> recording{false};
+    TraceStats stats;
+
+    void append(const TraceRecord& record, const std::string& extra);
+};
+
+// Records one call when it goes out of scope. Does nothing while the recorder is idle,
+// and for calls made while another span is open on the same thread; the setters cost
+// nothing then, so calls describe themselves unconditionally.
+class TraceSpan {
+public:
+    TraceSpan(TraceRecorder& recorder, TraceOp op, const std::string& dbName, const std::string& tableName);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    bool recording() const { return outermost; }
+    void setId(const std::string& id);
+    void setKeys(int64_t key, int64_t key2);
+    void addTuple(const Tuple& tuple);      // Adds its size to the payload and takes its id
+    void setExtra(std::string extra);
+
+private:
+    TraceRecorder& recorder;
+    bool counted = false;       // Opened while recording, so it counts as open
+    bool outermost = false;
+    int exceptions = 0;
+    TraceEvent event;
+};
+
+// Reads a trace back, resolving table references
+class TraceReader {
+public:
+    bool open(const std::string& path);
+    bool next(TraceEvent& event);     // False at the end or on a damaged record
+    uint64_t getStartUnixNanos() const { return header.startUnixNanos; }
+
+private:
+    std::ifstream in;
+    TraceRecorder::TraceHeader header{};
+    std::map<uint16_t, std::string> tables;
+};
+
+#endif // TRACE_HPP
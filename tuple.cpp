@@ -65,13 +65,18 @@ bool Tuple::deserialize(const std::string& data) {
 
 // Retrieve all attributes as a map
 std::map<std::string, std::pair<int, std::string>> Tuple::getAttributes() const {
-      static std::map<std::string, std::pair<int, std::string>> attributesMap;
+    std::map<std::string, std::pair<int, std::string>> attributesMap;
     for (const auto& attr : attributes) {
         attributesMap[attr.first] = attr.second;
     }
     return attributesMap;
 }
 
+// Attributes in the order they were added, without copying
+const Tuple::AttributeList& Tuple::getAttributeList() const {
+    return attributes;
+}
+
 // Get the value of a specific attribute by key
 std::string Tuple::getAttributeValue(const std::string& key) const {
     for (const auto& attr : attributes) {
@@ -7,18 +7,24 @@
 #include <map>
 #include <sstream>
 #include <cstdint>
+#include "memory.hpp"
 
 
 
 class Tuple {
+public:
+    using Attribute = std::pair<std::string, std::pair<int, std::string>>;
+    using AttributeList = std::vector<Attribute, AccountingAllocator<Attribute, MemoryComponent::Tuples>>;
+
 private:
-    std::vector<std::pair<std::string, std::pair<int, std::string>>> attributes;
+    AttributeList attributes;
 
 public:
     void addAttribute(const std::string& key, int type, const std::string& value);
     std::string serialize() const;
     bool deserialize(const std::string& data);
     std::map<std::string, std::pair<int, std::string>> getAttributes() const;
+    const AttributeList& getAttributeList() const;
     std::string getAttributeValue(const std::string& key) const;
 };
 
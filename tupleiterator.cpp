@@ -0,0 +1,104 @@
+#include "tupleiterator.hpp"
+#include "storage.hpp"
+#include <algorithm>
+
+TupleIterator::TupleIterator(const std::string& tablePath, int64_t lo, int64_t high)
+    : hi(high), metadata(new FileMetadata()) {
+    if (!file.open(tablePath, false)) {
+        throw std::runtime_error("Failed to open the table file: " + tablePath);
+    }
+    metadata->deserialize(file);
+    if (lo <= hi) {
+        cursor = metadata->getIdIndex().lowerBound(lo);
+    }
+    fillBatch();
+}
+
+bool TupleIterator::valid() const {
+    return position < batch.size();
+}
+
+int64_t TupleIterator::id() const {
+    return batch[position].first;
+}
+
+const Tuple& TupleIterator::tuple() const {
+    return batch[position].second;
+}
+
+void TupleIterator::next() {
+    if (++position >= batch.size()) {
+        fillBatch();
+    }
+}
+
+uint32_t TupleIterator::pagesRead() const {
+    return pageReads;
+}
+
+const Page& TupleIterator::readPage(int64_t pageID) {
+    if (pageID != cachedPageID) {
+        file.readPage(*metadata, pageID, cachedPage); // Replaces the whole page, reusing its buffer
+        cachedPageID = pageID;
+        pageReads++;
+    }
+    return cachedPage;
+}
+
+void TupleIterator::fillBatch() {
+    batch.clear();
+    position = 0;
+
+    // Collect the next ids in range and group them by page
+    std::vector<std::pair<int64_t, int64_t>> wanted; // (page, id)
+    while (cursor.valid() && cursor.key() <= hi && wanted.size() < BATCH_SIZE) {
+        wanted.push_back({cursor.value(), cursor.key()});
+        cursor.next();
+    }
+    if (wanted.empty()) {
+        return;
+    }
+    size_t expected = wanted.size();
+
+    // Visit pages in file order, starting with the one still cached from the previous batch
+    std::sort(wanted.begin(), wanted.end(), [this](const auto& a, const auto& b) {
+        bool aCached = a.first == cachedPageID, bCached = b.first == cachedPageID;
+        if (aCached != bCached) return aCached;
+        return a < b;
+    });
+
+    for (size_t start = 0; start < wanted.size();) {
+        int64_t pageID = wanted[start].first;
+        size_t end = start;
+        while (end < wanted.size() && wanted[end].first == pageID) {
+            ++end;
+        }
+
+        const Page& page = readPage(pageID);
+        for (size_t i = 0; i < page.getSlots().size(); ++i) {
+            if (page.getSlot(i).length == 0) continue; // Deleted slot
+            Tuple tuple;
+            std::string tupleData = page.getTupleData(i);
+            if (!tuple.deserialize(tupleData)) continue;
+            int64_t tupleID = std::stoll(tuple.getAttributeValue("id"));
+            auto match = std::lower_bound(wanted.begin() + start, wanted.begin() + end, std::make_pair(pageID, tupleID));
+            if (match == wanted.begin() + end || match->second != tupleID) continue;
+            // Whole tuples are returned, so their long values are read back from overflow pages
+            if (OverflowStore::hasPointers(tupleData) &&
+                !(OverflowStore::resolveRow(file, *metadata, tupleData) && tuple.deserialize(tupleData))) {
+                continue; // Counted as missing below
+            }
+            batch.push_back({tupleID, std::move(tuple)});
+        }
+        start = end;
+    }
+
+    if (batch.size() != expected) {
+        std::cerr << "Error TupleIterator: " << expected - batch.size() << " indexed tuples were not found on their pages.\n";
+        if (batch.empty()) {
+            fillBatch();
+            return;
+        }
+    }
+    std::sort(batch.begin(), batch.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+}
@@ -0,0 +1,44 @@
+#ifndef TUPLEITERATOR_HPP
+#define TUPLEITERATOR_HPP
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "page.hpp"
+#include "FileMetaData.hpp"
+#include "tuple.hpp"
+#include "tablefile.hpp"
+
+// Walks tuples with lo <= id <= hi in id order.
+// Ids are pulled from the id index in batches; each batch reads every page it touches once,
+// in file order, and the last page read is kept for the next batch.
+class TupleIterator {
+public:
+    TupleIterator(const std::string& tablePath, int64_t lo, int64_t hi);
+
+    bool valid() const;
+    int64_t id() const;
+    const Tuple& tuple() const;
+    void next();
+    uint32_t pagesRead() const;
+
+private:
+    static const size_t BATCH_SIZE = 1024;
+
+    int64_t hi;
+    TableFile file;
+    std::unique_ptr<FileMetadata> metadata;
+    IdIndex::Iterator cursor;
+    std::vector<std::pair<int64_t, Tuple>> batch;
+    size_t position = 0;
+    int64_t cachedPageID = -1;
+    Page cachedPage{0};
+    uint32_t pageReads = 0;
+
+    void fillBatch();
+    const Page& readPage(int64_t pageID);
+};
+
+#endif // TUPLEITERATOR_HPP
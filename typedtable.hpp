@@ -0,0 +1,361 @@
+#ifndef TYPEDTABLE_HPP
+#define TYPEDTABLE_HPP
+
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <map>
+#include <unordered_map>
+#include <type_traits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "storage.hpp"
+
+// Declares a column for TypedTable: TYPED_COLUMN(Age, "age", int64_t) makes a type Age naming
+// the "age" attribute. Supported value types are int64_t ("int"), double and std::string.
+#define TYPED_COLUMN(Type, columnName, ValueType)              \
+    struct Type {                                             \
+        static constexpr const char* name = columnName;       \
+        using type = ValueType;                               \
+    }
+
+// Type code and schema type name for each supported value type, as used by Tuple and Storage
+template <typename T> struct ColumnTraits;
+
+template <> struct ColumnTraits<int64_t> {
+    static constexpr int code = 1;
+    static constexpr const char* typeName = "int";
+    static void encode(std::string& out, int64_t value) { out += std::to_string(value); }
+    static bool decode(const char* text, size_t length, int64_t& value) {
+        if (length == 0 || length > 20) return false;
+        char buffer[24];
+        std::memcpy(buffer, text, length);
+        buffer[length] = '\0';
+        char* end = nullptr;
+        value = std::strtoll(buffer, &end, 10);
+        return end == buffer + length;
+    }
+};
+
+template <> struct ColumnTraits<double> {
+    static constexpr int code = 3;
+    static constexpr const char* typeName = "double";
+    static void encode(std::string& out, double value) {
+        char buffer[32];
+        int length = std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+        out.append(buffer, length);
+    }
+    static bool decode(const char* text, size_t length, double& value) {
+        std::string buffer(text, length);
+        char* end = nullptr;
+        value = std::strtod(buffer.c_str(), &end);
+        return length > 0 && end == buffer.c_str() + length;
+    }
+};
+
+template <> struct ColumnTraits<std::string> {
+    static constexpr int code = 2;
+    static constexpr const char* typeName = "string";
+    static void encode(std::string& out, const std::string& value) { out += value; }
+    static bool decode(const char* text, size_t length, std::string& value) {
+        value.assign(text, length);
+        return true;
+    }
+};
+
+namespace typedtable_detail {
+
+constexpr bool sameName(const char* a, const char* b) {
+    return *a == *b && (*a == '\0' || sameName(a + 1, b + 1));
+}
+
+constexpr size_t nameLength(const char* name) {
+    return *name == '\0' ? 0 : 1 + nameLength(name + 1);
+}
+
+// Position of column C in Columns..., or sizeof...(Columns) when absent
+template <typename C, typename... Columns> struct IndexOf;
+template <typename C> struct IndexOf<C> {
+    static constexpr size_t value = 0;
+};
+template <typename C, typename First, typename... Rest> struct IndexOf<C, First, Rest...> {
+    static constexpr size_t value = std::is_same<C, First>::value ? 0 : 1 + IndexOf<C, Rest...>::value;
+};
+
+} // namespace typedtable_detail
+
+// Table whose schema is fixed at compile time.
+// Rows are plain structs of values: get<Column>() resolves to a member at a fixed offset, and
+// encoding/decoding is generated per column, so no attribute lookup by name happens at runtime.
+// Rows are stored exactly as Tuple::serialize() writes them, so a TypedTable and the dynamic
+// Storage API can read and write the same table. One column must be an int64_t named "id".
+// Files are reached through the Storage's catalog, so a TypedTable shares its open handles.
+template <typename... Columns>
+class TypedTable {
+public:
+    static constexpr size_t COLUMN_COUNT = sizeof...(Columns);
+    static constexpr const char* names[COLUMN_COUNT] = {Columns::name...};
+    static constexpr int codes[COLUMN_COUNT] = {ColumnTraits<typename Columns::type>::code...};
+
+    static constexpr size_t idColumn() {
+        for (size_t i = 0; i < COLUMN_COUNT; ++i) {
+            if (typedtable_detail::sameName(names[i], "id")) return i;
+        }
+        return COLUMN_COUNT;
+    }
+
+    class Row {
+    public:
+        Row() = default;
+        explicit Row(const typename Columns::type&... values) : values(values...) {}
+
+        template <typename C>
+        const typename C::type& get() const {
+            return std::get<indexOf<C>()>(values);
+        }
+        template <typename C>
+        void set(typename C::type value) {
+            std::get<indexOf<C>()>(values) = std::move(value);
+        }
+        int64_t id() const {
+            return std::get<idColumn()>(values);
+        }
+
+    private:
+        friend class TypedTable;
+        std::tuple<typename Columns::type...> values;
+    };
+
+    TypedTable(Storage& store, const std::string& db, const std::string& table)
+        : storage(store), dbName(db), tableName(table), tablePath(db + "/" + table + ".HAD") {
+        static_assert(idColumn() < COLUMN_COUNT, "TypedTable needs a column named \"id\"");
+        static_assert(codes[idColumn()] == ColumnTraits<int64_t>::code, "The \"id\" column must be int64_t");
+    }
+
+    template <typename C>
+    static constexpr size_t indexOf() {
+        constexpr size_t index = typedtable_detail::IndexOf<C, Columns...>::value;
+        static_assert(index < COLUMN_COUNT, "Column is not part of this table");
+        return index;
+    }
+
+    // Schema in the form Storage::createTable takes
+    static std::map<std::string, std::string> schema() {
+        return {{Columns::name, ColumnTraits<typename Columns::type>::typeName}...};
+    }
+
+    // Creates the table, or checks that an existing one has this schema
+    bool create(const TableOptions& options = TableOptions()) {
+        if (storage.tableExists(dbName, tableName)) {
+            return open();
+        }
+        return storage.createTable(dbName, tableName, schema(), options);
+    }
+
+    // Checks that the table on disk has exactly the declared columns and types
+    bool open() {
+        TableFile* file = storage.openTable(dbName, tableName);
+        if (!file) {
+            return false;
+        }
+        FileMetadata metadata;
+        std::map<std::string, std::string> onDisk;
+        try {
+            onDisk = metadata.deserialize(*file);
+        } catch (const std::exception& e) {
+            std::cerr << "Error TypedTable open: " << e.what() << std::endl;
+            return false;
+        }
+        if (onDisk != schema()) {
+            std::cerr << "Error TypedTable open: Schema of " << tablePath << " does not match the declared columns.\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Serializes a row in the key(type|value) format, columns in declaration order
+    static std::string encode(const Row& row) {
+        std::string out;
+        encodeColumns(out, row, std::index_sequence_for<Columns...>());
+        return out;
+    }
+
+    // Parses a stored row. Attributes written in declaration order are matched positionally,
+    // others by name; every declared column must be present with the declared type.
+    static bool decode(const std::string& data, Row& row) {
+        bool seen[COLUMN_COUNT] = {false};
+        size_t expected = 0;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t open = data.find('(', pos);
+            size_t bar = open == std::string::npos ? open : data.find('|', open);
+            size_t close = bar == std::string::npos ? bar : data.find(')', bar);
+            if (close == std::string::npos) return false;
+
+            const char* key = data.data() + pos;
+            size_t keyLength = open - pos;
+            size_t column = COLUMN_COUNT;
+            if (expected < COLUMN_COUNT && keyMatches(expected, key, keyLength)) {
+                column = expected;
+            } else {
+                for (size_t i = 0; i < COLUMN_COUNT; ++i) {
+                    if (keyMatches(i, key, keyLength)) {
+                        column = i;
+                        break;
+                    }
+                }
+            }
+            if (column < COLUMN_COUNT) {
+                int code = std::atoi(data.c_str() + open + 1);
+                if (code != codes[column] ||
+                    !decodeColumn(column, data.data() + bar + 1, close - bar - 1, row, std::index_sequence_for<Columns...>())) {
+                    return false;
+                }
+                seen[column] = true;
+                expected = column + 1;
+            }
+            pos = close + 1;
+        }
+        for (size_t i = 0; i < COLUMN_COUNT; ++i) {
+            if (!seen[i]) return false;
+        }
+        return true;
+    }
+
+    bool insert(const Row& row) {
+        if (!validStrings(row, std::index_sequence_for<Columns...>())) {
+            std::cerr << "Error TypedTable insert: String values may not contain ')'.\n";
+            return false;
+        }
+        return storage.addTupleToTable(dbName, tableName, encode(row), row.id()); // Rejects duplicate ids
+    }
+
+    // Looks a row up by id; false if it does not exist. A row the Storage's row cache holds
+    // is decoded from there without reading the table.
+    bool get(int64_t id, Row& row) {
+        RowCache::Row cached;
+        if (storage.rowCache.enabled() && storage.rowCache.lookup(tablePath, id, cached) &&
+            decodeValues(cached, row, std::index_sequence_for<Columns...>())) {
+            return true;
+        }
+        TableFile* file = storage.openTable(dbName, tableName);
+        if (!file) {
+            throw std::runtime_error("Failed to open the table file: " + tablePath);
+        }
+        FileMetadata metadata;
+        metadata.deserialize(*file);
+        int64_t pageID = metadata.getPageIDForTuple(id);
+        if (pageID < 0) {
+            return false;
+        }
+        Page page(pageID, metadata.getPageSize());
+        file->readPage(metadata, pageID, page);
+        for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+            if (page.getSlot(i).length == 0) continue; // Deleted slot
+            if (decodeStored(*file, metadata, page.getTupleData(i), id, id, row) && row.id() == id) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Calls visit(row) for every row with lo <= id <= hi, in id order. Each page is decoded once
+    // per visit; visit may return false to stop early.
+    template <typename Visitor>
+    uint64_t scan(int64_t lo, int64_t hi, Visitor visit) {
+        TableFile* file = storage.openTable(dbName, tableName);
+        if (!file) {
+            throw std::runtime_error("Failed to open the table file: " + tablePath);
+        }
+        FileMetadata metadata;
+        metadata.deserialize(*file);
+
+        uint64_t visited = 0;
+        int64_t cachedPageID = -1;
+        std::unordered_map<int64_t, Row> pageRows;
+        for (IdIndex::Iterator it = metadata.getIdIndex().lowerBound(lo); it.valid() && it.key() <= hi; it.next()) {
+            if (it.value() != cachedPageID) {
+                cachedPageID = it.value();
+                pageRows.clear();
+                Page page(cachedPageID, metadata.getPageSize());
+                file->readPage(metadata, cachedPageID, page);
+                for (uint32_t i = 0; i < page.getSlots().size(); ++i) {
+                    if (page.getSlot(i).length == 0) continue; // Deleted slot
+                    Row row;
+                    if (decodeStored(*file, metadata, page.getTupleData(i), lo, hi, row)) {
+                        pageRows.emplace(row.id(), std::move(row));
+                    }
+                }
+            }
+            auto found = pageRows.find(it.key());
+            if (found == pageRows.end()) {
+                std::cerr << "Error TypedTable scan: Indexed tuple " << it.key() << " not found on page " << cachedPageID << ".\n";
+                continue;
+            }
+            ++visited;
+            if (!visit(static_cast<const Row&>(found->second))) {
+                break;
+            }
+        }
+        return visited;
+    }
+
+private:
+    Storage& storage;
+    std::string dbName;
+    std::string tableName;
+    std::string tablePath;
+
+    // Decodes a stored row, reading long values back from their overflow pages first. Only
+    // rows with lo <= id <= hi have their chains read; others fail without any I/O.
+    bool decodeStored(TableFile& file, const FileMetadata& metadata, std::string data, int64_t lo, int64_t hi, Row& row) {
+        if (OverflowStore::hasPointers(data)) {
+            int64_t id;
+            if (!Projection::readId(data, id) || id < lo || id > hi ||
+                !OverflowStore::resolveRow(file, metadata, data)) {
+                return false;
+            }
+        }
+        return decode(data, row);
+    }
+
+    static bool keyMatches(size_t column, const char* key, size_t keyLength) {
+        static constexpr size_t lengths[COLUMN_COUNT] = {typedtable_detail::nameLength(Columns::name)...};
+        return lengths[column] == keyLength && std::memcmp(names[column], key, keyLength) == 0;
+    }
+
+    template <size_t... I>
+    static void encodeColumns(std::string& out, const Row& row, std::index_sequence<I...>) {
+        ((out += names[I], out += '(', out += std::to_string(codes[I]), out += '|',
+          ColumnTraits<typename Columns::type>::encode(out, std::get<I>(row.values)), out += ')'), ...);
+    }
+
+    template <size_t... I>
+    static bool decodeColumn(size_t column, const char* text, size_t length, Row& row, std::index_sequence<I...>) {
+        bool ok = false;
+        ((column == I ? (ok = ColumnTraits<typename Columns::type>::decode(text, length, std::get<I>(row.values)), true) : false) || ...);
+        return ok;
+    }
+
+    // Every declared column from a row as Storage::get returns it
+    template <size_t... I>
+    static bool decodeValues(const RowCache::Row& values, Row& row, std::index_sequence<I...>) {
+        auto decodeOne = [&](const char* name, auto& value) {
+            auto found = values.find(name);
+            return found != values.end() &&
+                   ColumnTraits<std::decay_t<decltype(value)>>::decode(found->second.data(), found->second.size(), value);
+        };
+        return (decodeOne(names[I], std::get<I>(row.values)) && ...);
+    }
+
+    template <size_t... I>
+    static bool validStrings(const Row& row, std::index_sequence<I...>) {
+        return (validValue(std::get<I>(row.values)) && ...);
+    }
+    template <typename T>
+    static bool validValue(const T&) { return true; }
+    static bool validValue(const std::string& value) { return value.find(')') == std::string::npos && !value.empty(); }
+};
+
+#endif // TYPEDTABLE_HPP
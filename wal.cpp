@@ -0,0 +1,388 @@
+#include "wal.hpp"
+#include "tablefile.hpp"
+#include "idfilter.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+std::mutex WriteAheadLog::registryMutex;
+std::map<std::string, WriteAheadLog*> WriteAheadLog::registry;
+std::atomic<int> WriteAheadLog::registered{0};
+
+namespace {
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, uint64_t pagesPerSegment, uint32_t bytesPerPage, const WalOptions& opts)
+    : tablePath(path), indexPath(IdIndex::pathForTable(path)), segmentPages(pagesPerSegment), pageSize(bytesPerPage), options(opts) {
+    if (!recover()) {
+        std::cerr << "Error WriteAheadLog: Recovery of " << tablePath << " failed, logging is off." << std::endl;
+        return;
+    }
+    lastCheckpoint = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry[tablePath] = this;
+        registry[indexPath] = this;
+        registered++;
+    }
+    checkpointer = std::thread(&WriteAheadLog::runCheckpointer, this);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (checkpointer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(checkpointerMutex);
+            checkpointerStop = true;
+        }
+        checkpointerWake.notify_all();
+        checkpointer.join();
+    }
+    if (fd < 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.erase(tablePath);
+        registry.erase(indexPath);
+        registered--;
+    }
+    // A clean shutdown leaves every change in the table files and no log to replay
+    if (checkpoint()) {
+        ::close(fd);
+        std::filesystem::remove(segmentPath(tablePath, segment));
+    } else {
+        ::close(fd);
+    }
+}
+
+bool WriteAheadLog::isOpen() const {
+    return fd >= 0;
+}
+
+WriteAheadLog* WriteAheadLog::find(const std::string& path) {
+    if (registered.load() == 0) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(path);
+    return it == registry.end() ? nullptr : it->second;
+}
+
+std::string WriteAheadLog::segmentPath(const std::string& tablePath, uint64_t segment) {
+    return tablePath + ".wal." + std::to_string(segment);
+}
+
+std::vector<uint64_t> WriteAheadLog::listSegments(const std::string& tablePath) {
+    std::vector<uint64_t> segments;
+    std::filesystem::path table(tablePath);
+    std::string prefix = table.filename().string() + ".wal.";
+    std::filesystem::path folder = table.has_parent_path() ? table.parent_path() : std::filesystem::path(".");
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string number = name.substr(prefix.size());
+        if (number.empty() || number.find_first_not_of("0123456789") != std::string::npos) continue;
+        segments.push_back(std::stoull(number));
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+void WriteAheadLog::removeFiles(const std::string& tablePath) {
+    for (uint64_t segment : listSegments(tablePath)) {
+        std::filesystem::remove(segmentPath(tablePath, segment));
+    }
+}
+
+// FNV-1a over the record header (checksum field zero) and payload; a torn tail fails it
+uint32_t WriteAheadLog::checksum(const RecordHeader& header, const char* data) {
+    RecordHeader copy = header;
+    copy.checksum = 0;
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const char* bytes, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 16777619u;
+        }
+    };
+    mix(reinterpret_cast<const char*>(&copy), sizeof(copy));
+    mix(data, header.length);
+    return hash;
+}
+
+bool WriteAheadLog::recover() {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint64_t> segments = listSegments(tablePath);
+    uint64_t bytes = 0;
+
+    if (!segments.empty()) {
+        TableFile table(tablePath);
+        if (!std::filesystem::exists(indexPath)) {
+            std::ofstream create(indexPath, std::ios::binary);
+        }
+        std::fstream index(indexPath, std::ios::binary | std::ios::in | std::ios::out);
+        if (!table.isOpen() || !index.is_open()) {
+            std::cerr << "Error WriteAheadLog: Unable to open " << tablePath << " for recovery." << std::endl;
+            return false;
+        }
+        try {
+            for (uint64_t number : segments) {
+                if (!replaySegment(segmentPath(tablePath, number), bytes, table, index)) {
+                    break; // Nothing after a torn record was ever applied
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error WriteAheadLog: " << e.what() << std::endl;
+            return false;
+        }
+        table.close();
+        index.close();
+        if (!syncTableFiles()) {
+            return false;
+        }
+        if (recoveredRecords > 0) {
+            IdFilter::discard(indexPath); // Replayed index nodes may hold ids the filter never saw
+        }
+    }
+    recoverySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (options.replayBytesPerSecond > 0) {
+        replayRate = options.replayBytesPerSecond;
+    } else if (bytes >= 4 * 1024 * 1024 && recoverySeconds > 0) {
+        replayRate = static_cast<uint64_t>(bytes / recoverySeconds);
+    }
+
+    if (!openSegment(segments.empty() ? 0 : segments.back() + 1)) {
+        return false;
+    }
+    for (uint64_t number : segments) {
+        std::filesystem::remove(segmentPath(tablePath, number));
+    }
+    checkpointLsn = nextLsn;
+    return true;
+}
+
+bool WriteAheadLog::replaySegment(const std::string& path, uint64_t& bytes, TableFile& table, std::fstream& index) {
+    std::ifstream in(path, std::ios::binary);
+    SegmentHeader segmentHeader;
+    if (!in.read(reinterpret_cast<char*>(&segmentHeader), sizeof(segmentHeader)) ||
+        segmentHeader.magic != LOG_MAGIC || segmentHeader.version != LOG_VERSION) {
+        return false;
+    }
+    nextLsn = std::max(nextLsn, segmentHeader.firstLsn);
+
+    RecordHeader header;
+    std::vector<char> data;
+    while (in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        data.resize(header.length);
+        if (!in.read(data.data(), header.length) || checksum(header, data.data()) != header.checksum) {
+            return false;
+        }
+        apply(header, data.data(), table, index);
+        nextLsn = std::max(nextLsn, header.lsn + 1);
+        bytes += sizeof(header) + header.length;
+        recoveredRecords++;
+    }
+    return true;
+}
+
+void WriteAheadLog::apply(const RecordHeader& header, const char* data, TableFile& table, std::fstream& index) {
+    switch (header.kind) {
+        case PAGE_IMAGES: {
+            FileMetadata layout;
+            layout.setSegmentPages(segmentPages);
+            layout.setPageSize(pageSize);
+            table.writePageImages(layout, header.target, data, header.length / pageSize);
+            break;
+        }
+        case HEADER_BLOCK: {
+            std::fstream& stream = table.headerStream();
+            stream.seekp(0, std::ios::beg);
+            stream.write(data, header.length);
+            break;
+        }
+        case INDEX_NODE:
+            index.clear();
+            index.seekp(static_cast<std::streamoff>(header.target), std::ios::beg);
+            index.write(data, header.length);
+            break;
+        default:
+            throw std::runtime_error("unknown log record kind " + std::to_string(header.kind));
+    }
+}
+
+bool WriteAheadLog::openSegment(uint64_t number) {
+    std::string path = segmentPath(tablePath, number);
+    int segmentFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (segmentFd < 0) {
+        std::cerr << "Error WriteAheadLog: Unable to create log segment " << path << std::endl;
+        return false;
+    }
+    SegmentHeader header = {LOG_MAGIC, LOG_VERSION, nextLsn, segmentPages};
+    if (!writeAll(segmentFd, reinterpret_cast<const char*>(&header), sizeof(header))) {
+        std::cerr << "Error WriteAheadLog: Unable to write log segment " << path << std::endl;
+        ::close(segmentFd);
+        return false;
+    }
+    // A synced record is only found after power loss if the segment's directory entry is durable too
+    if (options.syncWrites && (::fdatasync(segmentFd) != 0 || !syncDirectory())) {
+        std::cerr << "Error WriteAheadLog: Unable to sync log segment " << path << std::endl;
+        ::close(segmentFd);
+        return false;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = segmentFd;
+    segment = number;
+    return true;
+}
+
+void WriteAheadLog::write(RecordKind kind, uint64_t target, const char* data, size_t size, const std::function<void()>& applyWrite) {
+    RecordHeader header = {0, target, kind, static_cast<uint32_t>(size), 0, 0};
+    std::lock_guard<std::mutex> lock(logMutex);
+    header.lsn = nextLsn;
+    header.checksum = checksum(header, data);
+    if (!writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) || !writeAll(fd, data, size) ||
+        (options.syncWrites && ::fdatasync(fd) != 0)) {
+        throw std::runtime_error("Error WriteAheadLog: Failed to append to the log of " + tablePath);
+    }
+    nextLsn++;
+    bytesSinceCheckpoint += sizeof(header) + size;
+    applyWrite();
+    if (bytesSinceCheckpoint >= logBudget() && !checkpointDue.exchange(true)) {
+        checkpointerWake.notify_one();
+    }
+}
+
+bool WriteAheadLog::sync() {
+    std::lock_guard<std::mutex> lock(logMutex);
+    return fd >= 0 && ::fdatasync(fd) == 0;
+}
+
+bool WriteAheadLog::syncDirectory() const {
+    std::filesystem::path table(tablePath);
+    std::string folder = table.has_parent_path() ? table.parent_path().string() : ".";
+    int folderFd = ::open(folder.c_str(), O_RDONLY | O_DIRECTORY);
+    if (folderFd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(folderFd) == 0;
+    ::close(folderFd);
+    return synced;
+}
+
+bool WriteAheadLog::syncTableFiles() const {
+    std::vector<std::string> paths = {tablePath, indexPath};
+    for (uint64_t number = 1; std::filesystem::exists(TableFile::segmentPath(tablePath, number)); ++number) {
+        paths.push_back(TableFile::segmentPath(tablePath, number));
+    }
+    for (const std::string& path : paths) {
+        int fileFd = ::open(path.c_str(), O_RDONLY);
+        if (fileFd < 0) {
+            if (path == indexPath) continue; // Tables without rows may not have an index yet
+            std::cerr << "Error WriteAheadLog: Unable to open " << path << " to sync it." << std::endl;
+            return false;
+        }
+        bool synced = ::fsync(fileFd) == 0;
+        ::close(fileFd);
+        if (!synced) {
+            std::cerr << "Error WriteAheadLog: fsync of " << path << " failed." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteAheadLog::checkpoint() {
+    std::lock_guard<std::mutex> checkpointLock(checkpointMutex);
+    uint64_t previousSegment, position;
+    {
+        // Writers wait only for the switch to a new segment. Everything logged before the
+        // switch has been applied to the files by then, since records are applied under the lock.
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (fd < 0) {
+            return false;
+        }
+        if (bytesSinceCheckpoint == 0) {
+            lastCheckpoint = std::chrono::steady_clock::now();
+            return true;
+        }
+        previousSegment = segment;
+        if (!openSegment(segment + 1)) {
+            return false;
+        }
+        position = nextLsn;
+        bytesSinceCheckpoint = 0;
+    }
+
+    // Fuzzy: writes keep landing in the files while they are synced; those are in the new segment
+    if (!syncTableFiles()) {
+        return false;
+    }
+    for (uint64_t number : listSegments(tablePath)) {
+        if (number <= previousSegment) {
+            std::filesystem::remove(segmentPath(tablePath, number));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(logMutex);
+    checkpointLsn = position;
+    lastCheckpoint = std::chrono::steady_clock::now();
+    checkpoints++;
+    return true;
+}
+
+uint64_t WriteAheadLog::logBudget() const {
+    return replayRate * static_cast<uint64_t>(options.recoveryTarget.count()) / 1000;
+}
+
+void WriteAheadLog::runCheckpointer() {
+    std::unique_lock<std::mutex> wakeLock(checkpointerMutex);
+    for (;;) {
+        checkpointerWake.wait_for(wakeLock, options.checkInterval, [this]() { return checkpointerStop || checkpointDue.load(); });
+        if (checkpointerStop) {
+            break;
+        }
+        checkpointDue = false;
+        bool due;
+        {
+            std::lock_guard<std::mutex> lock(logMutex);
+            due = bytesSinceCheckpoint >= logBudget() ||
+                  (bytesSinceCheckpoint > 0 && std::chrono::steady_clock::now() - lastCheckpoint >= options.maxCheckpointInterval);
+        }
+        if (due) {
+            wakeLock.unlock();
+            checkpoint();
+            wakeLock.lock();
+        }
+    }
+}
+
+WalStats WriteAheadLog::getStats() const {
+    std::lock_guard<std::mutex> lock(logMutex);
+    WalStats stats;
+    stats.nextLsn = nextLsn;
+    stats.checkpointLsn = checkpointLsn;
+    stats.bytesSinceCheckpoint = bytesSinceCheckpoint;
+    stats.logBudgetBytes = logBudget();
+    stats.checkpoints = checkpoints;
+    stats.recoveredRecords = recoveredRecords;
+    stats.recoverySeconds = recoverySeconds;
+    return stats;
+}
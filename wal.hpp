@@ -0,0 +1,142 @@
+#ifndef WAL_HPP
+#define WAL_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+class TableFile;
+
+struct WalOptions {
+    bool syncWrites = true;                               // fdatasync each record before it is applied; off survives only process crashes
+    std::chrono::milliseconds recoveryTarget{2000};       // Replay time a crash may cost at most
+    uint64_t replayBytesPerSecond = 0;                    // Replay speed to plan with, 0 = measure
+    std::chrono::milliseconds checkInterval{100};         // How often the checkpointer looks at the log
+    std::chrono::milliseconds maxCheckpointInterval{60000}; // Checkpoint at least this often while writes arrive
+};
+
+struct WalStats {
+    uint64_t nextLsn = 0;
+    uint64_t checkpointLsn = 0;        // Replay after a crash starts here
+    uint64_t bytesSinceCheckpoint = 0;
+    uint64_t logBudgetBytes = 0;       // Log allowed to build up before a checkpoint is due
+    uint32_t checkpoints = 0;
+    uint64_t recoveredRecords = 0;
+    double recoverySeconds = 0;
+};
+
+// Redo log for one table.
+// Every write to the table file, its header block or its id index goes through write(),
+// which appends the bytes being written to <table>.HAD.wal.<n> before applying them, so a
+// crash can be repaired by writing the logged images again. Records are full page / block
+// images, which makes replay idempotent. With syncWrites (the default) each record reaches
+// the disk before its image is applied, which covers power loss and torn page writes. Without
+// it the log sits in the page cache: a process crash is still repaired, but power loss can
+// lose the tail of the log together with the pages it was to repair.
+//
+// A background checkpointer bounds recovery time. When the log written since the last
+// checkpoint would take longer than recoveryTarget to replay, it starts a new log segment,
+// fsyncs the table's files without holding writers off, and deletes the older segments.
+// The first LSN of the oldest remaining segment is the checkpoint position; opening the
+// log replays only the segments from there on. Writes that arrive while the files are being
+// synced go to the new segment, so the log overshoots its budget by one checkpoint's worth.
+class WriteAheadLog {
+public:
+    enum RecordKind : uint32_t {
+        PAGE_IMAGES = 1,   // target = first page ID, payload = consecutive page images
+        HEADER_BLOCK = 2,  // target = 0, payload = the table header block
+        INDEX_NODE = 3     // target = byte offset in the id index, payload = one node
+    };
+
+    // Recovers the table from any log left behind, then logs and checkpoints it until destroyed
+    WriteAheadLog(const std::string& tablePath, uint64_t segmentPages, uint32_t pageSize, const WalOptions& options = WalOptions());
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    bool isOpen() const;
+
+    // Log for the table owning this table or id index file, or null when it is not logged
+    static WriteAheadLog* find(const std::string& path);
+    static void removeFiles(const std::string& tablePath);
+
+    // Logs the bytes and then runs apply, which writes them and flushes its stream
+    void write(RecordKind kind, uint64_t target, const char* data, size_t size, const std::function<void()>& apply);
+    bool sync();
+    bool checkpoint();
+
+    WalStats getStats() const;
+
+private:
+    struct RecordHeader {
+        uint64_t lsn;
+        uint64_t target;
+        uint32_t kind;
+        uint32_t length;
+        uint32_t checksum;
+        uint32_t unused;
+    };
+    struct SegmentHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t firstLsn;
+        uint64_t segmentPages;
+    };
+    static const uint32_t LOG_MAGIC = 0x4C415748; // "HWAL"
+    static const uint32_t LOG_VERSION = 1;
+    static const uint64_t DEFAULT_REPLAY_RATE = 64 * 1024 * 1024;
+
+    std::string tablePath;
+    std::string indexPath;
+    uint64_t segmentPages;
+    uint32_t pageSize;
+    WalOptions options;
+
+    mutable std::mutex logMutex;       // Orders records and their writes
+    int fd = -1;
+    uint64_t segment = 0;              // Number of the segment being appended to
+    uint64_t nextLsn = 1;
+    uint64_t checkpointLsn = 1;
+    uint64_t bytesSinceCheckpoint = 0;
+    std::chrono::steady_clock::time_point lastCheckpoint;
+
+    std::mutex checkpointMutex;        // One checkpoint at a time
+    uint32_t checkpoints = 0;
+    uint64_t replayRate = DEFAULT_REPLAY_RATE;
+    uint64_t recoveredRecords = 0;
+    double recoverySeconds = 0;
+
+    std::thread checkpointer;
+    std::mutex checkpointerMutex;
+    std::condition_variable checkpointerWake;
+    bool checkpointerStop = false;
+    std::atomic<bool> checkpointDue{false}; // Set by writers once the log passes its budget
+
+    static std::mutex registryMutex;
+    static std::map<std::string, WriteAheadLog*> registry;
+    static std::atomic<int> registered;
+
+    static std::string segmentPath(const std::string& tablePath, uint64_t segment);
+    static std::vector<uint64_t> listSegments(const std::string& tablePath);
+    static uint32_t checksum(const RecordHeader& header, const char* data);
+
+    bool recover();
+    bool replaySegment(const std::string& path, uint64_t& bytes, TableFile& table, std::fstream& index);
+    void apply(const RecordHeader& header, const char* data, TableFile& table, std::fstream& index);
+    bool openSegment(uint64_t number);
+    bool syncDirectory() const;
+    bool syncTableFiles() const;
+    uint64_t logBudget() const;
+    void runCheckpointer();
+};
+
+#endif // WAL_HPP